@@ -0,0 +1,785 @@
+#include "Model.h"
+#include "Camera.h"
+#include "Culling.h"
+#include "Occlusion.h"
+#include "Bvh.h"
+#include "RayQuery.h"
+#include "DrawQueue.h"
+#include "MeshCodec.h"
+#include "Meshlet.h"
+#include "MeshOptimizer.h"
+#include "ModelRegistry.h"
+#include "MeshResidency.h"
+#include "PointCloud.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Headless checks of the CPU side against simple reference implementations.
+// Every failed check is printed, the exit code is the number of failures so
+// that ctest picks it up.
+//
+//   learndx12_check
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    int g_failures = 0;
+
+    void Check(bool condition, const char* what)
+    {
+        if (condition) return;
+        std::printf("  FAILED: %s\n", what);
+        g_failures++;
+    }
+
+    template <typename F>
+    double Time(F&& f)
+    {
+        auto start = Clock::now();
+        f();
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // a bumpy grid, rows of triangles are already in a local order
+    void MakeGrid(uint32_t size, std::vector<Vertex>& vertices, std::vector<uint32_t>& indicies)
+    {
+        std::mt19937 random(7);
+        std::uniform_real_distribution<float> bump(-0.01f, 0.01f);
+        vertices.resize(size * size);
+        for (uint32_t y = 0; y < size; ++y)
+        {
+            for (uint32_t x = 0; x < size; ++x)
+            {
+                auto& v = vertices[y * size + x];
+                v.position = XMFLOAT3(static_cast<float>(x), static_cast<float>(y), bump(random));
+                v.normal = XMFLOAT3(bump(random), bump(random), 1.f);
+            }
+        }
+        indicies.clear();
+        for (uint32_t y = 0; y + 1 < size; ++y)
+        {
+            for (uint32_t x = 0; x + 1 < size; ++x)
+            {
+                uint32_t i = y * size + x;
+                indicies.insert(indicies.end(), { i, i + size, i + 1, i + 1, i + size, i + size + 1 });
+            }
+        }
+    }
+
+    // the decoder may rotate a triangle, the winding has to stay
+    bool SameTriangles(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b)
+    {
+        if (a.size() != b.size()) return false;
+        for (size_t i = 0; i < a.size(); i += 3)
+        {
+            bool same = false;
+            for (size_t r = 0; r < 3 && !same; ++r)
+            {
+                same = a[i] == b[i + r] && a[i + 1] == b[i + (r + 1) % 3] && a[i + 2] == b[i + (r + 2) % 3];
+            }
+            if (!same) return false;
+        }
+        return true;
+    }
+
+    void CheckMeshCodec()
+    {
+        std::printf("MeshCodec\n");
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indicies;
+        MakeGrid(512, vertices, indicies);
+
+        // the order the renderer caches meshes in, and a random one for the
+        // explicit codes
+        std::vector<uint32_t> optimized = indicies;
+        MeshOptimizer::OptimizeVertexCache(optimized, vertices.size());
+        std::vector<uint32_t> shuffled = indicies;
+        std::mt19937 random(3);
+        for (size_t i = shuffled.size() / 3; i > 1; --i)
+        {
+            size_t j = random() % i;
+            for (size_t k = 0; k < 3; ++k) std::swap(shuffled[(i - 1) * 3 + k], shuffled[j * 3 + k]);
+        }
+
+        for (auto* source: { &indicies, &optimized, &shuffled })
+        {
+            auto encoded = MeshCodec::EncodeIndexBuffer(source->data(), source->size());
+            std::vector<uint32_t> decoded(source->size());
+            Check(MeshCodec::DecodeIndexBuffer(decoded.data(), decoded.size(), encoded.data(), encoded.size()),
+                "index buffer decodes");
+            Check(SameTriangles(*source, decoded), "index buffer round trip");
+            Check(!MeshCodec::DecodeIndexBuffer(decoded.data(), decoded.size(), encoded.data(), encoded.size() - 1),
+                "truncated index buffer is rejected");
+        }
+
+        auto encoded = MeshCodec::EncodeVertexBuffer(vertices.data(), vertices.size(), sizeof(Vertex));
+        std::vector<Vertex> decoded(vertices.size());
+        Check(MeshCodec::DecodeVertexBuffer(decoded.data(), decoded.size(), sizeof(Vertex), encoded.data(), encoded.size()),
+            "vertex buffer decodes");
+        Check(std::memcmp(decoded.data(), vertices.data(), vertices.size() * sizeof(Vertex)) == 0,
+            "vertex buffer round trip");
+        Check(!MeshCodec::DecodeVertexBuffer(decoded.data(), decoded.size(), sizeof(Vertex), encoded.data(), encoded.size() - 1),
+            "truncated vertex buffer is rejected");
+        // a count that is not a multiple of the block or group size
+        size_t oddCount = MeshCodec::VERTEX_BLOCK_SIZE * 3 + 7;
+        auto odd = MeshCodec::EncodeVertexBuffer(vertices.data(), oddCount, sizeof(Vertex));
+        Check(MeshCodec::DecodeVertexBuffer(decoded.data(), oddCount, sizeof(Vertex), odd.data(), odd.size())
+            && std::memcmp(decoded.data(), vertices.data(), oddCount * sizeof(Vertex)) == 0,
+            "partial vertex block round trip");
+
+        // Decode throughput, printed rather than checked: it depends on the
+        // machine and the build type far more than on the code.
+        auto encodedIndicies = MeshCodec::EncodeIndexBuffer(optimized.data(), optimized.size());
+        std::vector<uint32_t> decodedIndicies(optimized.size());
+        const int runs = 10;
+        double indexTime = Time([&] {
+            for (int i = 0; i < runs; ++i)
+            {
+                MeshCodec::DecodeIndexBuffer(decodedIndicies.data(), decodedIndicies.size(),
+                    encodedIndicies.data(), encodedIndicies.size());
+            }
+        });
+        double vertexTime = Time([&] {
+            for (int i = 0; i < runs; ++i)
+            {
+                MeshCodec::DecodeVertexBuffer(decoded.data(), decoded.size(), sizeof(Vertex), encoded.data(), encoded.size());
+            }
+        });
+        std::printf("  indicies %.2f bits per triangle, decode %.2f GB/s\n",
+            encodedIndicies.size() * 8. / (optimized.size() / 3),
+            optimized.size() * sizeof(uint32_t) * runs / indexTime * 1e-9);
+        std::printf("  vertices %.0f%% of raw, decode %.2f GB/s\n",
+            100. * encoded.size() / (vertices.size() * sizeof(Vertex)),
+            vertices.size() * sizeof(Vertex) * runs / vertexTime * 1e-9);
+    }
+
+    // a grid bent to either side, one of them is concave to the front faces
+    void MakeCurvedGrid(uint32_t size, float curvature, std::vector<XMFLOAT3>& positions,
+        std::vector<uint32_t>& indicies)
+    {
+        std::vector<Vertex> vertices;
+        MakeGrid(size, vertices, indicies);
+        positions.resize(vertices.size());
+        float half = (size - 1) * 0.5f;
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            XMFLOAT3 p = vertices[i].position;
+            float x = (p.x - half) / half, y = (p.y - half) / half;
+            positions[i] = XMFLOAT3(x, y, curvature * (x * x + y * y) + p.z);
+        }
+    }
+
+    void CheckMeshlets()
+    {
+        std::printf("Meshlet\n");
+        std::mt19937 random(13);
+        std::uniform_real_distribution<float> unit(-3.f, 3.f);
+        std::vector<XMFLOAT3> eyes(2000);
+        for (auto& eye: eyes) eye = XMFLOAT3(unit(random), unit(random), unit(random));
+
+        for (float curvature: { 0.5f, -0.5f, 0.05f })
+        {
+            std::vector<XMFLOAT3> positions;
+            std::vector<uint32_t> indicies;
+            MakeCurvedGrid(48, curvature, positions, indicies);
+            MeshletData data = MeshletBuilder::Build(indicies, positions.data(), positions.size(), sizeof(XMFLOAT3));
+
+            // a rejected meshlet must not have a single triangle facing the eye
+            size_t wrong = 0, rejected = 0;
+            for (auto& eye: eyes)
+            {
+                for (size_t m = 0; m < data.meshlets.size(); ++m)
+                {
+                    if (!MeshletBuilder::IsBackFacing(data.bounds[m], eye)) continue;
+                    rejected++;
+                    const Meshlet& meshlet = data.meshlets[m];
+                    bool facing = false;
+                    for (uint32_t t = 0; t < meshlet.triangleCount && !facing; ++t)
+                    {
+                        const uint8_t* triangle = &data.triangles[(meshlet.triangleOffset + t) * 3];
+                        const XMFLOAT3& a = positions[data.vertices[meshlet.vertexOffset + triangle[0]]];
+                        const XMFLOAT3& b = positions[data.vertices[meshlet.vertexOffset + triangle[1]]];
+                        const XMFLOAT3& c = positions[data.vertices[meshlet.vertexOffset + triangle[2]]];
+                        XMVECTOR p0 = XMLoadFloat3(&a);
+                        XMVECTOR normal = XMVector3Normalize(XMVector3Cross(XMVectorSubtract(XMLoadFloat3(&b), p0),
+                            XMVectorSubtract(XMLoadFloat3(&c), p0)));
+                        facing = XMVectorGetX(XMVector3Dot(XMVectorSubtract(XMLoadFloat3(&eye), p0), normal)) > 1e-4f;
+                    }
+                    wrong += facing ? 1 : 0;
+                }
+            }
+            Check(wrong == 0, "back-facing meshlets have no triangle facing the eye");
+            auto statistics = MeshletBuilder::Analyze(data, eyes);
+            std::printf("  curvature %5.2f: %u meshlets, %zu of %zu rejections wrong, %.1f%% rejected\n", curvature,
+                statistics.meshletCount, wrong, rejected, statistics.coneRejection * 100.f);
+        }
+    }
+
+    void CheckPointOctree()
+    {
+        std::printf("PointOctree\n");
+        // a scanned looking cloud: a wavy ground with some clutter above it
+        std::mt19937 random(17);
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        const size_t pointCount = 300000;
+        std::vector<XMFLOAT3> points(pointCount);
+        for (size_t i = 0; i < pointCount; ++i)
+        {
+            float x = unit(random) * 100.f, y = unit(random) * 100.f;
+            float z = i % 8 == 0 ? unit(random) * 20.f : std::sin(x * 0.1f) * std::cos(y * 0.1f) * 3.f;
+            points[i] = XMFLOAT3(x, y, z);
+        }
+        PointOctree octree = PointOctree::Build(points.data(), points.size(), sizeof(XMFLOAT3));
+        auto& nodes = octree.GetNodes();
+
+        std::vector<uint32_t> parent(nodes.size(), ~0u);
+        uint32_t total = 0, largest = 0;
+        for (uint32_t n = 0; n < nodes.size(); ++n)
+        {
+            for (uint32_t c = 0; c < nodes[n].childCount; ++c) parent[nodes[n].firstChild + c] = n;
+            total += nodes[n].pointCount;
+            largest = std::max(largest, nodes[n].pointCount);
+        }
+        std::vector<uint32_t> order = octree.GetPointOrder();
+        std::sort(order.begin(), order.end());
+        bool permutation = order.size() == pointCount;
+        for (size_t i = 0; i < order.size() && permutation; ++i) permutation = order[i] == i;
+        Check(total == pointCount && permutation, "every point is in exactly one node");
+        std::printf("  %zu nodes, root %u points, largest %u\n", nodes.size(), nodes[0].pointCount, largest);
+
+        // from above the ground, and from within the cloud
+        PointCloudView views[2];
+        views[0].eye = XMFLOAT3(50.f, 50.f, 150.f);
+        views[1].eye = XMFLOAT3(10.f, 20.f, 2.f);
+        for (auto& view: views)
+        {
+            view.pixelsPerUnit = 1000.f;
+            view.nearPlane = 0.1f;
+        }
+        for (auto& view: views)
+        {
+            for (uint32_t budget: { 100u, 10000u, 100000u, 1000000u })
+            {
+                auto selection = octree.Select(view, budget);
+                std::vector<bool> taken(nodes.size(), false);
+                bool parentsFirst = !selection.nodes.empty() && selection.nodes[0] == 0;
+                uint32_t selected = 0;
+                for (auto index: selection.nodes)
+                {
+                    parentsFirst = parentsFirst && !taken[index] && (index == 0 || taken[parent[index]]);
+                    taken[index] = true;
+                    selected += nodes[index].pointCount;
+                }
+                Check(!selection.nodes.empty(), "the selection is never empty");
+                Check(parentsFirst, "the selection has parents before children");
+                Check(selected == selection.pointCount, "the selection counts its points");
+                Check(selection.pointCount <= std::max(budget, nodes[0].pointCount), "the selection keeps the budget");
+                std::printf("  budget %7u: %4zu nodes, %6u points\n", budget, selection.nodes.size(), selection.pointCount);
+            }
+        }
+        auto everything = octree.Select(views[1], ~0u, 0.f);
+        Check(everything.nodes.size() == nodes.size() && everything.pointCount == pointCount,
+            "an unlimited selection takes every node");
+    }
+
+    // every point twice, once nudged by a float step, the weld has to merge
+    // exactly the copies unless epsilon covers the step
+    bool CheckWeldCase(float epsilon, float scale, bool nudgeMerges)
+    {
+        std::mt19937 random(19);
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        const size_t count = 20000;
+        std::vector<XMFLOAT3> positions;
+        for (size_t i = 0; i < count; ++i)
+        {
+            positions.push_back(XMFLOAT3(unit(random) * scale, unit(random) * scale, unit(random) * scale));
+        }
+        for (size_t i = 0; i < count; ++i) positions.push_back(positions[i]);
+        for (size_t i = 0; i < count; ++i)
+        {
+            XMFLOAT3 p = positions[i];
+            p.x = std::nextafter(p.x, std::numeric_limits<float>::infinity());
+            positions.push_back(p);
+        }
+        positions.push_back(XMFLOAT3(0.f, 0.f, 0.f));
+        positions.push_back(XMFLOAT3(-0.f, 0.f, -0.f));
+
+        MeshOptimizer::WeldConfig config;
+        config.epsilon = epsilon;
+        std::vector<uint32_t> remap;
+        size_t kept = MeshOptimizer::GenerateWeldRemap(positions.data(), nullptr, positions.size(), sizeof(XMFLOAT3),
+            config, remap);
+        bool same = remap[count * 3] == remap[count * 3 + 1];
+        for (size_t i = 0; i < count; ++i)
+        {
+            same = same && remap[count + i] == remap[i] && (remap[count * 2 + i] == remap[i]) == nudgeMerges;
+        }
+        return same && kept == (nudgeMerges ? count : count * 2) + 1;
+    }
+
+    void CheckWeld()
+    {
+        std::printf("Weld\n");
+        Check(CheckWeldCase(0.f, 1.f, false), "epsilon 0 merges equal positions only");
+        Check(CheckWeldCase(1e-30f, 1e6f, false), "a tiny epsilon with large coordinates");
+        Check(CheckWeldCase(1e-6f, 1e30f, false), "the default epsilon with huge coordinates");
+        Check(CheckWeldCase(1e-3f, 1.f, true), "epsilon above the float step merges the nudged copies");
+    }
+
+    // a mesh without a device, the callbacks only track what would be resident
+    struct FakeMesh
+    {
+        bool cpu = true;
+        bool gpu = true;
+        int cpuRestores = 0;
+        int gpuRestores = 0;
+
+        MeshResidencyCallbacks Callbacks()
+        {
+            MeshResidencyCallbacks callbacks;
+            callbacks.releaseCPU = [this]() { cpu = false; return true; };
+            callbacks.restoreCPU = [this]() { cpu = true; cpuRestores++; return true; };
+            callbacks.releaseGPU = [this]() { gpu = false; };
+            callbacks.restoreGPU = [this]() { gpu = true; gpuRestores++; return cpu; };
+            return callbacks;
+        }
+    };
+
+    void CheckMeshResidency()
+    {
+        std::printf("MeshResidency\n");
+        const uint32_t framesInFlight = 2;
+        MeshResidencyManager residency(MeshResidencyBudget(), framesInFlight);
+        FakeMesh meshes[4];
+        MeshResidencyManager::MeshId ids[4];
+        for (int i = 0; i < 4; ++i) ids[i] = residency.Register(100, 1000, true, true, meshes[i].Callbacks());
+        Check(residency.GetStatistics().cpuBytes == 400 && residency.GetStatistics().gpuBytes == 4000,
+            "registered bytes are counted");
+
+        // meshes used in the order 0..3, 3 is the most recent one
+        for (int i = 0; i < 4; ++i)
+        {
+            residency.Request(ids[i], true, true);
+            residency.EndFrame();
+        }
+        // 3 was drawn within framesInFlight and 2 just before, only 0 and 1
+        // may go, and the budget needs two of them gone
+        residency.SetBudget({ ~0ull, 2000 });
+        residency.EndFrame();
+        Check(!meshes[0].gpu && !meshes[1].gpu && meshes[2].gpu && meshes[3].gpu, "least recently used go first");
+        Check(meshes[0].cpu && meshes[1].cpu, "a GPU eviction keeps the CPU copy");
+        Check(residency.GetStatistics().gpuBytes == 2000 && residency.GetStatistics().gpuEvictions == 2,
+            "evictions are counted");
+
+        // an impossible budget does not touch meshes the GPU may still read
+        residency.Request(ids[2]);
+        residency.EndFrame();
+        residency.SetBudget({ ~0ull, 0 });
+        residency.EndFrame();
+        Check(meshes[2].gpu, "no eviction within framesInFlight");
+        Check(!meshes[3].gpu, "older meshes still go");
+
+        // CPU copies of drawable meshes go before the CPU copies of meshes
+        // that are not resident at all, even if those are older
+        residency.SetBudget({ 300, ~0ull });
+        residency.EndFrame();
+        Check(!meshes[2].cpu && meshes[0].cpu && meshes[1].cpu && meshes[3].cpu, "drawable meshes lose their CPU copy first");
+        Check(residency.GetStatistics().cpuBytes == 300 && residency.GetStatistics().cpuEvictions == 1,
+            "CPU bytes follow the eviction");
+        residency.SetBudget({ 100, ~0ull });
+        residency.EndFrame();
+        Check(!meshes[0].cpu && !meshes[1].cpu && meshes[3].cpu, "then the least recently used of the rest");
+
+        // drawing a mesh without any copy restores both
+        Check(residency.Request(ids[0]), "a fully evicted mesh is restored");
+        Check(meshes[0].cpu && meshes[0].gpu && meshes[0].cpuRestores == 1 && meshes[0].gpuRestores == 1,
+            "the CPU copy comes back before the GPU one");
+        Check(residency.GetStatistics().cpuBytes == 200 && residency.GetStatistics().gpuBytes == 2000,
+            "restored bytes are counted");
+        auto& statistics = residency.GetStatistics();
+        std::printf("  %llu CPU and %llu GPU evictions, %llu and %llu restores\n",
+            static_cast<unsigned long long>(statistics.cpuEvictions), static_cast<unsigned long long>(statistics.gpuEvictions),
+            static_cast<unsigned long long>(statistics.cpuRestores), static_cast<unsigned long long>(statistics.gpuRestores));
+        residency.Unregister(ids[0]);
+        Check(residency.GetStatistics().cpuBytes == 100 && residency.GetStatistics().gpuBytes == 1000,
+            "unregistered bytes are dropped");
+
+        // a real model goes through the mesh cache and comes back the same
+        auto model = std::make_shared<Model>(L"bun_zipper.ply", ModelType::PLY, true);
+        auto hash = model->GetGeometryHash();
+        MeshResidencyCallbacks callbacks;
+        callbacks.releaseCPU = [&model]() { return model->ReleaseCPUData(); };
+        callbacks.restoreCPU = [&model]() { return model->RestoreCPUData(); };
+        MeshResidencyManager cache({ 0, ~0ull }, framesInFlight);
+        auto id = cache.Register(model->GetCPUBytes(), 0, true, true, callbacks);
+        // registering counts as a use in that frame
+        cache.EndFrame();
+        cache.EndFrame();
+        Check(!model->IsCPUResident() && cache.GetStatistics().cpuBytes == 0, "the model's CPU copy is released");
+        Check(cache.Request(id, false, true) && model->IsCPUResident() && model->GetGeometryHash() == hash,
+            "the model reloads from the mesh cache");
+    }
+
+    void CheckFrustumCuller()
+    {
+        std::printf("FrustumCuller\n");
+        // enough objects for several ParallelFor chunks, and a count that
+        // leaves a partial batch; many of them cross a plane
+        Camera camera(1280.f, 720.f, 45.f, 0.1f, 50.f, XMFLOAT4(3.f, 2.f, -30.f, 1.f), XMFLOAT4(0.f, 0.f, 0.f, 1.f));
+        const Frustum& frustum = camera.GetFrustum();
+        std::mt19937 random(29);
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        CullingSpheres spheres;
+        CullingBoxes boxes;
+        std::vector<uint32_t> expectedSpheres, expectedBoxes;
+        const uint32_t count = FrustumCuller::GRAIN * 3 + 3;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            XMFLOAT3 center(unit(random) * 40.f, unit(random) * 40.f, unit(random) * 60.f);
+            float size = i % 16 == 0 ? 10.f : (unit(random) + 1.f) * 1.5f;
+            XMFLOAT3 extents(size, size * 0.5f, size * 2.f);
+            spheres.Add(center, size);
+            boxes.Add(center, extents);
+            if (FrustumCuller::IsVisible(frustum, center, size)) expectedSpheres.push_back(i);
+            if (FrustumCuller::IsVisible(frustum, center, extents)) expectedBoxes.push_back(i);
+        }
+        std::vector<uint32_t> visible;
+        FrustumCuller::Cull(frustum, spheres, visible);
+        Check(visible == expectedSpheres, "Cull matches IsVisible for spheres");
+        size_t visibleSpheres = visible.size();
+        FrustumCuller::Cull(frustum, boxes, visible);
+        Check(visible == expectedBoxes, "Cull matches IsVisible for boxes");
+        std::printf("  %u objects, %zu spheres and %zu boxes visible\n", count, visibleSpheres, visible.size());
+    }
+
+    void CheckOcclusion()
+    {
+        std::printf("Occlusion\n");
+        // the camera looks down +z at a 4 x 4 quad through the origin
+        Camera camera(256.f, 128.f, 45.f, 0.1f, 100.f, XMFLOAT4(0.f, 0.f, -10.f, 1.f));
+        XMMATRIX viewProjection = camera.GetViewProjectionMatrix();
+        const XMFLOAT3 quad[] = { XMFLOAT3(-2.f, -2.f, 0.f), XMFLOAT3(2.f, -2.f, 0.f),
+            XMFLOAT3(2.f, 2.f, 0.f), XMFLOAT3(-2.f, 2.f, 0.f) };
+        const uint32_t quadIndicies[] = { 0, 2, 1, 0, 3, 2 };
+        OcclusionBuffer occlusion;
+        occlusion.AddOccluder(quad, sizeof(XMFLOAT3), 4, quadIndicies, 6, viewProjection);
+        occlusion.Rasterize();
+        Check(occlusion.GetTriangleCount() == 2, "the quad is rasterized");
+
+        const XMFLOAT3 small(0.5f, 0.5f, 0.5f);
+        Check(!occlusion.IsVisible(XMFLOAT3(0.f, 0.f, 5.f), small, viewProjection), "a box behind the quad is hidden");
+        Check(occlusion.IsVisible(XMFLOAT3(0.f, 0.f, -5.f), small, viewProjection), "a box in front of the quad is visible");
+        Check(occlusion.IsVisible(XMFLOAT3(0.f, 0.f, -0.2f), small, viewProjection), "a box through the quad is visible");
+        Check(occlusion.IsVisible(XMFLOAT3(6.f, 0.f, 5.f), small, viewProjection), "a box beside the quad is visible");
+        Check(occlusion.IsVisible(XMFLOAT3(0.f, 0.f, -10.f), small, viewProjection), "a box around the near plane is visible");
+
+        // Test agrees with IsVisible box by box
+        CullingBoxes boxes;
+        std::vector<uint32_t> candidates;
+        std::vector<bool> expected;
+        std::mt19937 random(23);
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        for (uint32_t i = 0; i < 5000; ++i)
+        {
+            XMFLOAT3 center(unit(random) * 8.f, unit(random) * 5.f, unit(random) * 12.f);
+            float size = (unit(random) + 1.f) * 0.5f;
+            candidates.push_back(boxes.Add(center, XMFLOAT3(size, size, size)));
+            expected.push_back(occlusion.IsVisible(center, XMFLOAT3(size, size, size), viewProjection));
+        }
+        std::vector<uint32_t> visible;
+        occlusion.Test(boxes, viewProjection, candidates, visible);
+        std::vector<uint32_t> reference;
+        for (uint32_t i = 0; i < expected.size(); ++i)
+        {
+            if (expected[i]) reference.push_back(i);
+        }
+        Check(visible == reference, "Test matches IsVisible");
+        std::printf("  %zu of %zu boxes pass\n", visible.size(), candidates.size());
+
+        // every tile keeps the farthest of its pixels
+        const uint32_t tile = OcclusionBuffer::TILE_SIZE;
+        uint32_t tilesX = occlusion.GetWidth() / tile;
+        bool tilesMatch = true;
+        size_t covered = 0;
+        for (uint32_t ty = 0; ty < occlusion.GetHeight() / tile; ++ty)
+        {
+            for (uint32_t tx = 0; tx < tilesX; ++tx)
+            {
+                float farthest = 0.f;
+                for (uint32_t y = ty * tile; y < (ty + 1) * tile; ++y)
+                {
+                    for (uint32_t x = tx * tile; x < (tx + 1) * tile; ++x)
+                    {
+                        farthest = std::max(farthest, occlusion.GetDepth()[y * occlusion.GetWidth() + x]);
+                    }
+                }
+                tilesMatch = tilesMatch && occlusion.GetTileDepth()[ty * tilesX + tx] == farthest;
+                covered += farthest < 1.f ? 1 : 0;
+            }
+        }
+        Check(tilesMatch, "tile depth is the farthest of its pixels");
+        Check(covered > 0, "some tiles are covered by the quad");
+
+        // an occluder crossing the near plane is dropped and hides nothing
+        const XMFLOAT3 floor[] = { XMFLOAT3(-50.f, -1.f, -20.f), XMFLOAT3(50.f, -1.f, -20.f),
+            XMFLOAT3(50.f, -1.f, 50.f), XMFLOAT3(-50.f, -1.f, 50.f) };
+        OcclusionBuffer crossing;
+        crossing.AddOccluder(floor, sizeof(XMFLOAT3), 4, quadIndicies, 6, viewProjection);
+        crossing.Rasterize();
+        Check(crossing.GetTriangleCount() == 0, "occluders crossing the near plane are dropped");
+        Check(crossing.IsVisible(XMFLOAT3(0.f, -3.f, 5.f), small, viewProjection), "and hide nothing");
+    }
+
+    // Moller-Trumbore over every triangle, the reference for the Bvh
+    BvhHit IntersectBruteForce(const BvhRay& ray, const std::vector<XMFLOAT3>& positions,
+        const std::vector<uint32_t>& indicies)
+    {
+        BvhHit best;
+        for (size_t i = 0; i < indicies.size(); i += 3)
+        {
+            const XMFLOAT3& a = positions[indicies[i]];
+            const XMFLOAT3& b = positions[indicies[i + 1]];
+            const XMFLOAT3& c = positions[indicies[i + 2]];
+            XMFLOAT3 e1(b.x - a.x, b.y - a.y, b.z - a.z);
+            XMFLOAT3 e2(c.x - a.x, c.y - a.y, c.z - a.z);
+            const XMFLOAT3& d = ray.direction;
+            XMFLOAT3 p(d.y * e2.z - d.z * e2.y, d.z * e2.x - d.x * e2.z, d.x * e2.y - d.y * e2.x);
+            float determinant = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+            if (std::abs(determinant) < 1e-20f) continue;
+            float inverse = 1.f / determinant;
+            XMFLOAT3 s(ray.origin.x - a.x, ray.origin.y - a.y, ray.origin.z - a.z);
+            float u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverse;
+            if (u < 0.f || u > 1.f) continue;
+            XMFLOAT3 q(s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x);
+            float v = (d.x * q.x + d.y * q.y + d.z * q.z) * inverse;
+            if (v < 0.f || u + v > 1.f) continue;
+            float t = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inverse;
+            if (t < ray.tMin || t >= std::min(ray.tMax, best.t)) continue;
+            best.t = t;
+            best.triangle = static_cast<uint32_t>(i / 3);
+            best.u = u;
+            best.v = v;
+        }
+        return best;
+    }
+
+    // Hits agree when both miss or both hit at the same distance, the
+    // triangle may differ where two of them meet at that distance.
+    bool SameHit(const BvhHit& a, const BvhHit& b)
+    {
+        if (a.IsHit() != b.IsHit()) return false;
+        return !a.IsHit() || std::abs(a.t - b.t) <= 1e-5f * std::max(1.f, std::abs(a.t));
+    }
+
+    void CheckRayQuery()
+    {
+        std::printf("RayQuery\n");
+        // a soup of overlapping triangles, rays pass through many of them
+        std::mt19937 random(11);
+        std::uniform_real_distribution<float> unit(-1.f, 1.f);
+        std::vector<XMFLOAT3> positions;
+        std::vector<uint32_t> indicies;
+        for (uint32_t i = 0; i < 3000; ++i)
+        {
+            XMFLOAT3 center(unit(random), unit(random), unit(random));
+            for (int k = 0; k < 3; ++k)
+            {
+                indicies.push_back(static_cast<uint32_t>(positions.size()));
+                positions.push_back(XMFLOAT3(center.x + unit(random) * 0.1f, center.y + unit(random) * 0.1f,
+                    center.z + unit(random) * 0.1f));
+            }
+        }
+        Bvh bvh = Bvh::Build(indicies, positions.data(), positions.size(), sizeof(XMFLOAT3));
+
+        // incoherent rays, some of them short, and a camera's coherent ones
+        std::vector<BvhRay> rays;
+        for (uint32_t i = 0; i < 4000; ++i)
+        {
+            BvhRay ray;
+            ray.origin = XMFLOAT3(unit(random) * 2.f, unit(random) * 2.f, unit(random) * 2.f);
+            XMVECTOR direction = XMVector3Normalize(XMVectorSet(unit(random), unit(random), unit(random), 0.f));
+            XMStoreFloat3(&ray.direction, direction);
+            if (i % 4 == 0) ray.tMax = 0.5f;
+            if (i % 8 == 0) ray.tMin = 0.2f;
+            rays.push_back(ray);
+        }
+        Camera camera(64.f, 64.f);
+        for (uint32_t y = 0; y < 64; ++y)
+        {
+            for (uint32_t x = 0; x < 64; ++x)
+            {
+                rays.push_back(RayQuery::ScreenRay(camera, XMMatrixIdentity(), static_cast<float>(x),
+                    static_cast<float>(y), 64.f, 64.f));
+            }
+        }
+
+        std::vector<BvhHit> expected(rays.size());
+        size_t hitCount = 0;
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            expected[i] = IntersectBruteForce(rays[i], positions, indicies);
+            hitCount += expected[i].IsHit() ? 1 : 0;
+        }
+
+        RayQuery query(bvh);
+        std::vector<BvhHit> hits(rays.size());
+        query.IntersectClosest(rays.data(), hits.data(), rays.size());
+        std::vector<uint8_t> occluded(rays.size());
+        query.IntersectAny(rays.data(), occluded.data(), rays.size());
+        size_t closestErrors = 0, anyErrors = 0, scalarErrors = 0;
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            closestErrors += SameHit(hits[i], expected[i]) ? 0 : 1;
+            anyErrors += (occluded[i] != 0) == expected[i].IsHit() ? 0 : 1;
+            BvhHit hit;
+            bvh.Intersect(rays[i], hit);
+            scalarErrors += SameHit(hit, expected[i]) ? 0 : 1;
+        }
+        Check(closestErrors == 0, "IntersectClosest matches brute force");
+        Check(anyErrors == 0, "IntersectAny matches brute force");
+        Check(scalarErrors == 0, "Bvh::Intersect matches brute force");
+        std::printf("  %zu rays, %zu hits, %zu / %zu / %zu mismatches\n", rays.size(), hitCount,
+            closestErrors, anyErrors, scalarErrors);
+
+        // a triangle with an index past the vertices is left out
+        auto broken = indicies;
+        broken[4] = static_cast<uint32_t>(positions.size());
+        Bvh partial = Bvh::Build(broken, positions.data(), positions.size(), sizeof(XMFLOAT3));
+        Check(partial.GetTriangles().size() == indicies.size() / 3 - 1, "out of range triangles are left out");
+    }
+
+    // one frame of items, against std::stable_sort and a plain batch loop
+    bool CheckDrawQueueFrame(DrawQueue& queue, uint32_t itemCount, uint32_t pipelines, uint32_t meshes,
+        uint32_t materials, std::mt19937& random, double* radixTime, double* referenceTime)
+    {
+        std::uniform_real_distribution<float> depth(-0.1f, 1.1f);
+        queue.Clear();
+        for (uint32_t i = 0; i < itemCount; ++i)
+        {
+            XMFLOAT4X4 transform = {};
+            transform.m[3][0] = static_cast<float>(i);
+            queue.Submit(random() % pipelines, random() % meshes, random() % materials, depth(random), transform);
+        }
+        double time = Time([&] { queue.Build(); });
+        if (radixTime) *radixTime += time;
+
+        const auto& keys = queue.GetKeys();
+        std::vector<uint32_t> order(itemCount);
+        time = Time([&] {
+            std::iota(order.begin(), order.end(), 0u);
+            std::stable_sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+        });
+        if (referenceTime) *referenceTime += time;
+        if (order != queue.GetOrder()) return false;
+
+        const uint32_t batchShift = DrawQueue::MATERIAL_BITS + DrawQueue::DEPTH_BITS;
+        std::vector<DrawBatch> batches;
+        for (uint32_t i = 0; i < itemCount; ++i)
+        {
+            uint64_t key = keys[order[i]];
+            if (i == 0 || (keys[order[i - 1]] >> batchShift) != (key >> batchShift))
+            {
+                batches.push_back({ DrawQueue::GetPipeline(key), DrawQueue::GetMesh(key), i, 0 });
+            }
+            batches.back().instanceCount++;
+            if (queue.GetInstanceMaterials()[i] != DrawQueue::GetMaterial(key)) return false;
+            if (queue.GetInstanceTransforms()[i].m[3][0] != static_cast<float>(order[i])) return false;
+        }
+        auto& result = queue.GetBatches();
+        if (batches.size() != result.size()) return false;
+        for (size_t i = 0; i < batches.size(); ++i)
+        {
+            if (batches[i].pipeline != result[i].pipeline || batches[i].mesh != result[i].mesh
+                || batches[i].firstInstance != result[i].firstInstance
+                || batches[i].instanceCount != result[i].instanceCount)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void CheckDrawQueue()
+    {
+        std::printf("DrawQueue\n");
+        std::mt19937 random(5);
+        DrawQueue queue;
+        // few assets skip most radix passes, many use all of them, ids past
+        // their bits are truncated
+        Check(CheckDrawQueueFrame(queue, 0, 1, 1, 1, random, nullptr, nullptr), "empty queue");
+        Check(CheckDrawQueueFrame(queue, 1, 1, 1, 1, random, nullptr, nullptr), "single item");
+        Check(CheckDrawQueueFrame(queue, 5000, 4, 64, 256, random, nullptr, nullptr), "few assets match stable_sort");
+        Check(CheckDrawQueueFrame(queue, 5000, 1u << 10, 1u << 22, 1u << 18, random, nullptr, nullptr),
+            "many assets match stable_sort");
+        Check(CheckDrawQueueFrame(queue, 3000, 2, 2, 2, random, nullptr, nullptr), "reused queue matches stable_sort");
+
+        double radixTime = 0., referenceTime = 0.;
+        bool same = true;
+        for (int frame = 0; frame < 5; ++frame)
+        {
+            same = CheckDrawQueueFrame(queue, 100000, 4, 64, 256, random, &radixTime, &referenceTime) && same;
+        }
+        Check(same, "100k items match stable_sort");
+        std::printf("  100k items: Build %.2f ms, stable_sort alone %.2f ms\n", radixTime / 5 * 1e3,
+            referenceTime / 5 * 1e3);
+    }
+
+    void CheckModelRegistry()
+    {
+        std::printf("ModelRegistry\n");
+        auto registry = ModelRegistry::GetInstance();
+        registry->Clear();
+        auto before = registry->GetStatistics();
+
+        // concurrent requests for one name, the file is parsed once
+        const int requests = 4;
+        std::shared_ptr<Model> models[requests];
+        std::vector<std::thread> threads;
+        int postProcessed = 0;
+        for (int i = 0; i < requests; ++i)
+        {
+            threads.emplace_back([&, i] {
+                models[i] = registry->Acquire(L"bun_zipper.ply", ModelType::PLY, true,
+                    [&](Model&) { postProcessed++; });
+            });
+        }
+        for (auto& thread: threads) thread.join();
+
+        auto statistics = registry->GetStatistics();
+        bool same = true;
+        for (auto& model: models) same = same && model && model == models[0];
+        Check(same, "concurrent requests share one model");
+        Check(statistics.loads - before.loads == 1, "concurrent requests load once");
+        Check(postProcessed == 1, "concurrent requests post process once");
+        std::printf("  %llu name hits, %llu pending hits\n",
+            static_cast<unsigned long long>(statistics.nameHits - before.nameHits),
+            static_cast<unsigned long long>(statistics.pendingHits - before.pendingHits));
+        registry->Clear();
+    }
+}
+
+int main()
+{
+    CheckMeshCodec();
+    CheckModelRegistry();
+    CheckMeshResidency();
+    CheckWeld();
+    CheckMeshlets();
+    CheckPointOctree();
+    CheckRayQuery();
+    CheckFrustumCuller();
+    CheckOcclusion();
+    CheckDrawQueue();
+    if (g_failures == 0) std::printf("all checks passed\n");
+    else std::printf("%d checks failed\n", g_failures);
+    return g_failures;
+}
\ No newline at end of file
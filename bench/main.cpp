@@ -0,0 +1,342 @@
+#include "Model.h"
+#include "Camera.h"
+#include "TaskPool.h"
+#include "Bvh.h"
+#include "RayQuery.h"
+#include "Culling.h"
+#include "Occlusion.h"
+#include "SceneGraph.h"
+#include "DrawQueue.h"
+#include "LooseOctree.h"
+#include "MeshCodec.h"
+#include "Meshlet.h"
+#include "ModelRegistry.h"
+#include "common/ModelLoader.h"
+#include <cctype>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+// Headless benchmark of the CPU side: loads a model from the model directory,
+// runs the passes the renderer runs on it, then the per frame structures on
+// a scene of moving objects, and prints how long each took.
+//
+//   learndx12_bench [model file] [object count]
+
+namespace
+{
+    using Clock = std::chrono::steady_clock;
+
+    template <typename F>
+    double Time(F&& f)
+    {
+        auto start = Clock::now();
+        f();
+        return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    }
+
+    void Report(const char* name, double milliseconds, const char* format = "", ...)
+    {
+        char detail[256];
+        va_list args;
+        va_start(args, format);
+        std::vsnprintf(detail, sizeof(detail), format, args);
+        va_end(args);
+        std::printf("  %-26s %10.3f ms  %s\n", name, milliseconds, detail);
+    }
+
+    ModelType GetModelType(const std::wstring& name)
+    {
+        auto extension = std::filesystem::path(name).extension().string();
+        for (auto& c: extension) c = static_cast<char>(std::tolower(c));
+        if (extension == ".ply") return ModelType::PLY;
+        if (extension == ".obj") return ModelType::OBJ;
+        if (extension == ".glb" || extension == ".gltf") return ModelType::GLTF;
+        if (extension == ".stl") return ModelType::STL;
+        throw std::runtime_error("unknown model type " + extension);
+    }
+
+    void BenchModel(const std::wstring& name)
+    {
+        std::printf("model %ls\n", name.c_str());
+        auto type = GetModelType(name);
+        auto path = Model::GetModelFullPath(name);
+
+        auto loader = ModelLoader::CreateModelLoader(type);
+        double parse = Time([&] { loader->LoadFromFile(path); });
+        double megabytes = std::filesystem::file_size(path) / (1024. * 1024.);
+        Report("parse", parse, "%zu vertices, %zu triangles, %.1f MB/s", loader->GetVertexCount(),
+            loader->GetIndicies().size() / 3, megabytes / (parse * 1e-3));
+        loader.reset();
+
+        std::shared_ptr<Model> model;
+        double load = Time([&] { model = std::make_shared<Model>(name, type, true); });
+        Report("Model (cache may hit)", load, "%u vertices, %u triangles", model->GetVerticesNum(),
+            model->GetIndiciesNum() / 3);
+
+        // the second request is served by the first one's entry
+        auto registry = ModelRegistry::GetInstance();
+        std::shared_ptr<Model> shared;
+        double time = Time([&] { shared = registry->Acquire(name, type, true); });
+        Report("ModelRegistry Acquire", time, "%llu loads",
+            static_cast<unsigned long long>(registry->GetStatistics().loads));
+        time = Time([&] { shared = registry->Acquire(name, type, true); });
+        Report("ModelRegistry Acquire again", time, "%llu name hits",
+            static_cast<unsigned long long>(registry->GetStatistics().nameHits));
+        shared.reset();
+        registry->Clear();
+
+        Camera camera(1280.f, 720.f);
+        XMMATRIX modelMatrix = XMMatrixIdentity();
+        if (model->IsPointCloud())
+        {
+            double octree = Time([&] { model->BuildPointOctree(); });
+            Report("BuildPointOctree", octree, "%zu nodes", model->GetPointOctree()->GetNodes().size());
+            return;
+        }
+
+        MeshOptimizer::CleanReport clean;
+        time = Time([&] { clean = model->Clean(); });
+        Report("Clean", time, "%u degenerate, %u duplicate triangles, %u unreferenced vertices",
+            clean.degenerateTriangles, clean.duplicateTriangles, clean.unreferencedVertices);
+        uint32_t welded = 0;
+        time = Time([&] { welded = model->Weld(MeshOptimizer::WeldConfig()); });
+        Report("Weld", time, "%u vertices merged", welded);
+
+        float acmr = 0.f;
+        time = Time([&] { acmr = model->GetACMR(); });
+        Report("GetACMR", time, "%.3f", acmr);
+        time = Time([&] { model->OptimizeVertexCache(); });
+        Report("OptimizeVertexCache", time, "ACMR %.3f", model->GetACMR());
+        MeshOptimizer::OverdrawReport overdraw;
+        time = Time([&] { overdraw = model->OptimizeOverdraw(); });
+        Report("OptimizeOverdraw", time, "%u clusters, ACMR %.3f -> %.3f", overdraw.clusterCount,
+            overdraw.acmrBefore, overdraw.acmrAfter);
+        time = Time([&] { model->OptimizeVertexFetch(); });
+        Report("OptimizeVertexFetch", time);
+
+        auto vertices = model->GetVertices();
+        auto indicies = model->GetIndicies();
+        std::vector<uint8_t> encodedIndicies, encodedVertices;
+        time = Time([&] {
+            encodedIndicies = MeshCodec::EncodeIndexBuffer(indicies.data(), indicies.size());
+            encodedVertices = MeshCodec::EncodeVertexBuffer(vertices.data(), vertices.size(), sizeof(Vertex));
+        });
+        Report("MeshCodec encode", time, "%.2f bits per triangle, vertices %.0f%% of raw",
+            encodedIndicies.size() * 8. / (indicies.size() / 3),
+            100. * encodedVertices.size() / (vertices.size() * sizeof(Vertex)));
+        std::vector<uint32_t> decodedIndicies(indicies.size());
+        time = Time([&] {
+            MeshCodec::DecodeIndexBuffer(decodedIndicies.data(), decodedIndicies.size(),
+                encodedIndicies.data(), encodedIndicies.size());
+        });
+        Report("MeshCodec decode indicies", time, "%.2f GB/s", indicies.size() * sizeof(uint32_t) / (time * 1e6));
+        std::vector<Vertex> decodedVertices(vertices.size());
+        time = Time([&] {
+            MeshCodec::DecodeVertexBuffer(decodedVertices.data(), decodedVertices.size(), sizeof(Vertex),
+                encodedVertices.data(), encodedVertices.size());
+        });
+        Report("MeshCodec decode vertices", time, "%.2f GB/s", vertices.size() * sizeof(Vertex) / (time * 1e6));
+
+        MeshletData meshlets;
+        time = Time([&] { meshlets = model->BuildMeshlets(); });
+        Report("BuildMeshlets", time, "%zu meshlets", meshlets.meshlets.size());
+        // eyes spread over a sphere a bit larger than the model's bounds
+        const ModelBounds& bounds = model->GetBounds();
+        std::vector<XMFLOAT3> viewpoints;
+        std::mt19937 random(1);
+        std::normal_distribution<float> normal;
+        for (int i = 0; i < 256; ++i)
+        {
+            XMFLOAT3 direction;
+            XMStoreFloat3(&direction, XMVector3Normalize(XMVectorSet(normal(random), normal(random), normal(random), 0.f)));
+            float distance = bounds.radius * 1.5f;
+            viewpoints.push_back(XMFLOAT3(bounds.center.x + direction.x * distance,
+                bounds.center.y + direction.y * distance, bounds.center.z + direction.z * distance));
+        }
+        MeshletStatistics meshletStatistics;
+        time = Time([&] { meshletStatistics = MeshletBuilder::Analyze(meshlets, viewpoints); });
+        Report("Meshlet Analyze", time, "fill %.0f%% vertices, %.0f%% triangles, cone rejects %.1f%% (%.1f%% triangles)",
+            meshletStatistics.vertexFill * 100.f, meshletStatistics.triangleFill * 100.f,
+            meshletStatistics.coneRejection * 100.f, meshletStatistics.triangleRejection * 100.f);
+
+        time = Time([&] {
+            model->GenerateLODs();
+            while (!model->IsLODReady() && model->HasPendingLODs()) std::this_thread::yield();
+        });
+        Report("GenerateLODs", time, "%u levels, coarsest %zu triangles", model->GetLODCount(),
+            model->GetLODCount() > 1 ? model->GetLODIndicies(model->GetLODCount() - 1).size() / 3 : 0);
+        uint32_t level = 0;
+        time = Time([&] {
+            for (int i = 0; i < 100000; ++i) level = model->SelectLOD(camera, modelMatrix, 720.f);
+        });
+        Report("SelectLOD x 100k", time, "level %u", level);
+
+        Bvh bvh;
+        time = Time([&] { bvh = model->BuildBvh(); });
+        Report("BuildBvh", time, "%u nodes, %.2f Mtris/s", bvh.GetStatistics().nodeCount,
+            model->GetIndiciesNum() / 3 / (time * 1e3));
+
+        const uint32_t width = 512, height = 512;
+        std::vector<BvhRay> rays(width * height);
+        std::vector<BvhHit> hits(rays.size());
+        for (uint32_t y = 0; y < height; ++y)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                rays[y * width + x] = RayQuery::ScreenRay(camera, modelMatrix, static_cast<float>(x),
+                    static_cast<float>(y), static_cast<float>(width), static_cast<float>(height));
+            }
+        }
+        RayQuery query(bvh);
+        time = Time([&] { query.IntersectClosest(rays.data(), hits.data(), rays.size()); });
+        size_t hitCount = 0;
+        for (auto& hit: hits) hitCount += hit.IsHit() ? 1 : 0;
+        Report("IntersectClosest", time, "%zu rays, %zu hits, %.2f Mrays/s", rays.size(), hitCount,
+            rays.size() / (time * 1e3));
+
+        OcclusionBuffer occlusion;
+        XMMATRIX mvp = modelMatrix * camera.GetViewProjectionMatrix();
+        time = Time([&] {
+            occlusion.Clear();
+            occlusion.AddOccluder(&vertices[0].position, sizeof(Vertex), vertices.size(), indicies.data(),
+                indicies.size(), mvp);
+            occlusion.Rasterize();
+        });
+        Report("Occlusion rasterize", time, "%u triangles", occlusion.GetTriangleCount());
+    }
+
+    void BenchScene(uint32_t objectCount)
+    {
+        std::printf("scene of %u objects\n", objectCount);
+        const float worldSize = 100.f;
+        std::mt19937 random(1);
+        std::uniform_real_distribution<float> position(-worldSize * 0.5f, worldSize * 0.5f);
+        std::uniform_real_distribution<float> size(0.05f, 1.f);
+        std::uniform_real_distribution<float> velocity(-0.1f, 0.1f);
+        std::vector<XMFLOAT3> centers(objectCount), extents(objectCount), velocities(objectCount);
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            centers[i] = XMFLOAT3(position(random), position(random), position(random));
+            float s = size(random);
+            extents[i] = XMFLOAT3(s, s, s);
+            velocities[i] = XMFLOAT3(velocity(random), velocity(random), velocity(random));
+        }
+        Camera camera(1280.f, 720.f, 45.f, 0.1f, worldSize * 2.f, XMFLOAT4(0.f, 0.f, -worldSize, 1.f));
+        const Frustum& frustum = camera.GetFrustum();
+
+        CullingSpheres spheres;
+        CullingBoxes boxes;
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            spheres.Add(centers[i], extents[i].x * 1.7320508f);
+            boxes.Add(centers[i], extents[i]);
+        }
+        std::vector<uint32_t> visible;
+        double time = Time([&] { FrustumCuller::Cull(frustum, spheres, visible); });
+        Report("Cull spheres", time, "%zu visible", visible.size());
+        time = Time([&] { FrustumCuller::Cull(frustum, boxes, visible); });
+        Report("Cull boxes", time, "%zu visible", visible.size());
+
+        // a box in front of the camera hides part of the scene
+        OcclusionBuffer occlusion;
+        const XMFLOAT3 wall[] = { XMFLOAT3(-20.f, -20.f, -50.f), XMFLOAT3(20.f, -20.f, -50.f),
+            XMFLOAT3(20.f, 20.f, -50.f), XMFLOAT3(-20.f, 20.f, -50.f) };
+        const uint32_t wallIndicies[] = { 0, 2, 1, 0, 3, 2 };
+        XMMATRIX viewProjection = camera.GetViewProjectionMatrix();
+        occlusion.AddOccluder(wall, sizeof(XMFLOAT3), 4, wallIndicies, 6, viewProjection);
+        occlusion.Rasterize();
+        std::vector<uint32_t> unoccluded;
+        time = Time([&] { occlusion.Test(boxes, viewProjection, visible, unoccluded); });
+        Report("Occlusion test", time, "%zu of %zu pass", unoccluded.size(), visible.size());
+
+        // a forest of shallow hierarchies, a few roots move every frame
+        SceneGraph scene;
+        const XMFLOAT4 identity(0.f, 0.f, 0.f, 1.f);
+        const XMFLOAT3 one(1.f, 1.f, 1.f);
+        std::vector<uint32_t> roots;
+        for (uint32_t i = 0; i < objectCount; ++i)
+        {
+            uint32_t parent = i % 16 == 0 ? SceneGraph::INVALID_NODE : i - 1;
+            uint32_t node = scene.AddNode(parent, centers[i], identity, one);
+            if (parent == SceneGraph::INVALID_NODE) roots.push_back(node);
+        }
+        uint32_t updated = 0;
+        time = Time([&] { updated = scene.UpdateAll(); });
+        Report("SceneGraph UpdateAll", time, "%u nodes", updated);
+        time = Time([&] {
+            for (size_t i = 0; i < roots.size(); i += 64) scene.SetTranslation(roots[i], XMFLOAT3(0.f, 1.f, 0.f));
+            updated = scene.Update();
+        });
+        Report("SceneGraph Update", time, "%u nodes", updated);
+
+        DrawQueue queue;
+        time = Time([&] {
+            queue.Clear();
+            for (auto object: visible)
+            {
+                float depth = (centers[object].z + worldSize) / (worldSize * 2.f);
+                queue.Submit(object % 4, object % 64, object % 256, depth, scene.GetWorldMatrix(object));
+            }
+            queue.Build();
+        });
+        Report("DrawQueue", time, "%u items, %zu draws", queue.GetItemCount(), queue.GetBatches().size());
+
+        LooseOctree octree(XMFLOAT3(0.f, 0.f, 0.f), worldSize * 0.5f);
+        std::vector<uint32_t> ids(objectCount);
+        time = Time([&] {
+            for (uint32_t i = 0; i < objectCount; ++i) ids[i] = octree.Insert(centers[i], extents[i]);
+        });
+        Report("LooseOctree insert", time, "%zu nodes", octree.GetNodes().size());
+        const int frames = 10;
+        time = Time([&] {
+            for (int frame = 0; frame < frames; ++frame)
+            {
+                for (uint32_t i = 0; i < objectCount; ++i)
+                {
+                    centers[i].x += velocities[i].x;
+                    centers[i].y += velocities[i].y;
+                    centers[i].z += velocities[i].z;
+                    octree.Move(ids[i], centers[i], extents[i]);
+                }
+            }
+        });
+        Report("LooseOctree move", time / frames, "per frame, %.2f M moves/s", objectCount / (time / frames * 1e3));
+        std::vector<uint32_t> found;
+        time = Time([&] { octree.QueryFrustum(frustum, found); });
+        Report("LooseOctree frustum", time, "%zu objects", found.size());
+        time = Time([&] {
+            for (uint32_t i = 0; i < 1000; ++i)
+            {
+                found.clear();
+                octree.QuerySphere(centers[i % objectCount], 2.f, found);
+            }
+        });
+        Report("LooseOctree sphere x 1000", time);
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string modelName = argc > 1 ? argv[1] : "bun_zipper.ply";
+    uint32_t objectCount = argc > 2 ? static_cast<uint32_t>(std::strtoul(argv[2], nullptr, 10)) : 100000;
+
+    std::printf("%u worker threads\n", TaskPool::GetInstance()->GetThreadCount());
+    try
+    {
+        BenchModel(std::wstring(modelName.begin(), modelName.end()));
+        if (objectCount > 0) BenchScene(objectCount);
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "%s\n", e.what());
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
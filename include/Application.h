@@ -2,6 +2,7 @@
 #define __APPLICATION_H__
 
 #include "DXWindow.h"
+#include "ProgressiveMesh.h"
 
 class Application
 {
@@ -19,6 +20,9 @@ private:
     bool m_windowCreated = false;
 
     std::shared_ptr<Model> m_model;
+    ModelLoadHandle m_modelLoad;
+    ProgressiveMeshStream m_modelStream;
+    std::string m_modelError;
 
 public:
     static void CreateInstance(HINSTANCE hInst);
@@ -31,7 +35,19 @@ public:
 
     void SetWARP(bool isUse);
     void SetModel(std::shared_ptr<Model>& m_model);
+    // The model becomes current once PollModel sees the load finished.
+    void SetModel(ModelLoadHandle modelLoad);
+    // true when a pending load just finished and GetModel changed
+    bool PollModel();
+    // The window draws the levels as they arrive and hands the complete
+    // model back through EndModelStream.
+    void SetModel(ProgressiveMeshStream modelStream);
+    ProgressiveMeshStream& GetModelStream();
+    // model is null if the stream broke off
+    void EndModelStream(std::shared_ptr<Model> model);
     std::shared_ptr<Model> GetModel() const;
+    const ModelLoadHandle& GetModelLoad() const;
+    const std::string& GetModelError() const;
 
     ComPtr<ID3D12Device2> GetDevice();
 
@@ -0,0 +1,109 @@
+#ifndef __BVH_H__
+#define __BVH_H__
+
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+#include <limits>
+
+using namespace DirectX;
+
+struct BvhNode
+{
+    XMFLOAT3 min;
+    // leaves: first triangle in Bvh order, interior nodes: the second child,
+    // the first one follows the node
+    uint32_t offset;
+    XMFLOAT3 max;
+    // triangles of a leaf, 0 for interior nodes
+    uint32_t count;
+
+    bool IsLeaf() const { return count > 0; }
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode is meant to take half a cache line");
+
+struct BvhConfig
+{
+    // SAH split candidates per axis
+    uint32_t binCount = 16;
+    // larger nodes are always split
+    uint32_t maxLeafTriangles = 8;
+    // SAH costs of visiting a node and of intersecting a triangle
+    float traversalCost = 1.f;
+    float intersectionCost = 1.f;
+};
+
+struct BvhStatistics
+{
+    uint32_t nodeCount = 0;
+    uint32_t leafCount = 0;
+    uint32_t maxDepth = 0;
+    float averageLeafTriangles = 0.f;
+    // expected cost of a ray through the root under the SAH, lower is better
+    float sahCost = 0.f;
+    double buildMilliseconds = 0.;
+};
+
+struct BvhRay
+{
+    XMFLOAT3 origin;
+    XMFLOAT3 direction;
+    float tMin = 0.f;
+    float tMax = std::numeric_limits<float>::max();
+};
+
+struct BvhHit
+{
+    float t = std::numeric_limits<float>::max();
+    // of the index buffer the Bvh was built from
+    uint32_t triangle = ~0u;
+    // barycentrics of the second and third vertex
+    float u = 0.f;
+    float v = 0.f;
+
+    bool IsHit() const { return triangle != ~0u; }
+};
+
+// Accumulated over calls, for comparing trees.
+struct BvhTraversalStatistics
+{
+    uint64_t rays = 0;
+    uint64_t nodesVisited = 0;
+    uint64_t trianglesTested = 0;
+};
+
+// Bounding volume hierarchy over the triangles of an index buffer. Built top
+// down with binned SAH on the task pool, then flattened depth first so that
+// the first child of a node is the next node and the triangles of every
+// leaf are consecutive.
+class Bvh
+{
+private:
+    std::vector<BvhNode> m_nodes;
+    // Bvh order -> triangle of the index buffer
+    std::vector<uint32_t> m_triangles;
+    // three per triangle in Bvh order, intersection reads no index buffer
+    std::vector<XMFLOAT3> m_vertices;
+    BvhStatistics m_statistics;
+
+public:
+    // below this many triangles a node's subtrees are built on one thread
+    static constexpr uint32_t PARALLEL_THRESHOLD = 1 << 12;
+    static constexpr uint32_t MAX_DEPTH = 64;
+
+    Bvh() = default;
+
+    // Triangles with an index past vertexCount are left out.
+    static Bvh Build(const std::vector<uint32_t>& indicies, const XMFLOAT3* positions, size_t vertexCount,
+        size_t vertexStride, const BvhConfig& config = BvhConfig());
+
+    const std::vector<BvhNode>& GetNodes() const;
+    const std::vector<uint32_t>& GetTriangles() const;
+    const std::vector<XMFLOAT3>& GetTriangleVertices() const;
+    const BvhStatistics& GetStatistics() const;
+
+    // Closest hit between ray.tMin and ray.tMax, both faces count.
+    bool Intersect(const BvhRay& ray, BvhHit& hit, BvhTraversalStatistics* statistics = nullptr) const;
+};
+
+#endif
\ No newline at end of file
@@ -2,9 +2,27 @@
 #define __CAMERA_H__
 
 #include <DirectXMath.h>
+#include <cstdint>
 
 using namespace DirectX;
 
+// ax + by + cz + d >= 0 inside, normalized so that the left side is the
+// signed distance
+struct Frustum
+{
+    enum Plane
+    {
+        Left,
+        Right,
+        Bottom,
+        Top,
+        Near,
+        Far,
+        PLANE_COUNT
+    };
+    XMFLOAT4 planes[PLANE_COUNT];
+};
+
 class Camera
 {
 private:
@@ -17,12 +35,31 @@ private:
     float m_far;
     float m_aspectRatio;
 
+    // Derived data is rebuilt on the first Get after a change. m_version
+    // grows with every change, consumers keep the version their own derived
+    // data was built for and skip the work while it is the same.
+    enum DirtyFlags : uint32_t
+    {
+        VIEW_DIRTY = 1,
+        PROJECTION_DIRTY = 2
+    };
+    uint32_t m_dirty = VIEW_DIRTY | PROJECTION_DIRTY;
+    uint64_t m_version = 1;
+
     XMMATRIX m_viewMatrix;
     XMMATRIX m_projectionMatrix;
+    XMMATRIX m_viewProjectionMatrix;
+    XMMATRIX m_inverseViewMatrix;
+    XMMATRIX m_inverseProjectionMatrix;
+    XMMATRIX m_inverseViewProjectionMatrix;
+    // in world space
+    Frustum m_frustum;
 
     void SetAspectRatio(float windowWidth, float windowHeight);
     void SetViewMatrix();
     void SetProjectionMatrix();
+    void MarkDirty(uint32_t flags);
+    void UpdateDerivedData();
 public:
     Camera(
         float windowWidth,
@@ -45,6 +82,21 @@ public:
 
     XMMATRIX GetViewMatrix();
     XMMATRIX GetProjectionMatrix();
+    XMMATRIX GetViewProjectionMatrix();
+    XMMATRIX GetInverseViewMatrix();
+    XMMATRIX GetInverseProjectionMatrix();
+    XMMATRIX GetInverseViewProjectionMatrix();
+    // in world space
+    const Frustum& GetFrustum();
+    // In the space modelMatrix maps from.
+    Frustum GetFrustum(const XMMATRIX& modelMatrix);
+    // changes whenever any of the above would
+    uint64_t GetVersion() const;
+
+    XMFLOAT4 GetPosition() const;
+    float GetFoV() const;
+    float GetNear() const;
+    float GetFar() const;
 };
 
 
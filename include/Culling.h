@@ -0,0 +1,74 @@
+#ifndef __CULLING_H__
+#define __CULLING_H__
+
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+#include "Camera.h"
+
+using namespace DirectX;
+
+// Bounding spheres of many objects, one array per component so that the
+// culler loads four objects with one instruction. The arrays are padded to
+// a multiple of FrustumCuller::BATCH with spheres that are never visible.
+class CullingSpheres
+{
+private:
+    std::vector<float> m_x;
+    std::vector<float> m_y;
+    std::vector<float> m_z;
+    std::vector<float> m_radius;
+    uint32_t m_count = 0;
+
+public:
+    // returns the object's index
+    uint32_t Add(const XMFLOAT3& center, float radius);
+    void Set(uint32_t index, const XMFLOAT3& center, float radius);
+    void Clear();
+    uint32_t GetCount() const;
+
+    const float* GetX() const;
+    const float* GetY() const;
+    const float* GetZ() const;
+    const float* GetRadius() const;
+};
+
+// Axis aligned boxes as center and extents, laid out like CullingSpheres.
+class CullingBoxes
+{
+private:
+    std::vector<float> m_center[3];
+    std::vector<float> m_extents[3];
+    uint32_t m_count = 0;
+
+public:
+    uint32_t Add(const XMFLOAT3& center, const XMFLOAT3& extents);
+    void Set(uint32_t index, const XMFLOAT3& center, const XMFLOAT3& extents);
+    void Clear();
+    uint32_t GetCount() const;
+
+    const float* GetCenter(int axis) const;
+    const float* GetExtents(int axis) const;
+};
+
+// Frustum culling of many objects, BATCH of them per SSE test. Large sets
+// are split into chunks on the task pool. Bounds and frustum have to be in
+// the same space.
+class FrustumCuller
+{
+public:
+    static constexpr uint32_t BATCH = 4;
+    // objects per ParallelFor chunk, smaller sets are culled on the caller
+    static constexpr uint32_t GRAIN = 1 << 13;
+
+    // visible receives the indices of the objects that intersect the frustum,
+    // in increasing order
+    static void Cull(const Frustum& frustum, const CullingSpheres& spheres, std::vector<uint32_t>& visible);
+    static void Cull(const Frustum& frustum, const CullingBoxes& boxes, std::vector<uint32_t>& visible);
+
+    // single objects, for callers that only have a few
+    static bool IsVisible(const Frustum& frustum, const XMFLOAT3& center, float radius);
+    static bool IsVisible(const Frustum& frustum, const XMFLOAT3& center, const XMFLOAT3& extents);
+};
+
+#endif
\ No newline at end of file
@@ -7,6 +7,11 @@
 #include "DescriptorHeap.h"
 #include "Model.h"
 #include "Camera.h"
+#include "MeshResidency.h"
+#include "ProgressiveMesh.h"
+#include "RayQuery.h"
+#include "Culling.h"
+#include "SceneGraph.h"
 
 using namespace DirectX;
 
@@ -42,10 +47,33 @@ class DXWindow
 
     ComPtr<ID3D12RootSignature> m_RootSignature;
     ComPtr<ID3D12PipelineState> m_PipelineState;
+    // same shaders, for point clouds
+    ComPtr<ID3D12PipelineState> m_PointPipelineState;
+    // points drawn per frame at most
+    uint32_t m_pointBudget = 2000000;
     ComPtr<ID3D12Resource> m_VertexBuffer;
     D3D12_VERTEX_BUFFER_VIEW m_VertexBufferView;
     ComPtr<ID3D12Resource> m_IndexBuffer;
     D3D12_INDEX_BUFFER_VIEW m_IndexBufferView;
+    // LOD 1..n of the model back to back, they share m_VertexBuffer
+    ComPtr<ID3D12Resource> m_LODIndexBuffer;
+    D3D12_INDEX_BUFFER_VIEW m_LODIndexBufferView;
+    std::vector<uint32_t> m_LODIndexOffsets;
+
+    // levels of a model that is still streaming, m_IndexBuffer holds the
+    // finest one so far
+    ProgressiveMeshData m_streamData;
+    uint32_t m_streamIndexCount = 0;
+    bool m_progressiveStored = false;
+
+    // for picking, built on the first click on a model
+    std::shared_ptr<const Bvh> m_pickBvh;
+    // a model loaded at the address of a freed one still gets a new Bvh
+    std::weak_ptr<const Model> m_pickModel;
+    uint32_t m_pickedTriangle = ~0u;
+
+    MeshResidencyManager m_residency { MeshResidencyBudget(), SwapChain::NUM_OF_FRAMES };
+    MeshResidencyManager::MeshId m_modelResidency = MeshResidencyManager::INVALID_MESH;
 
     // Depth buffer.
     ComPtr<ID3D12Resource> m_DepthBuffer;
@@ -59,7 +87,15 @@ class DXWindow
 
     // float m_FoV;
 
-    DirectX::XMMATRIX m_ModelMatrix; // TODO
+    // the model is m_modelNode, m_ModelMatrix its world matrix of this frame
+    SceneGraph m_scene;
+    uint32_t m_modelNode = SceneGraph::INVALID_NODE;
+    DirectX::XMMATRIX m_ModelMatrix;
+    // the MVP constants and the model space frustum are rebuilt only when
+    // the model matrix or the camera changed
+    bool m_modelMatrixChanged = true;
+    uint64_t m_cameraVersion = 0;
+    Frustum m_modelFrustum;
     // DirectX::XMMATRIX m_ViewMatrix;
     // DirectX::XMMATRIX m_ProjectionMatrix;
 
@@ -72,9 +108,26 @@ class DXWindow
         ID3D12Resource** pIntermediateResource,
         size_t numElements, size_t elementSize, const void* bufferData,
         D3D12_RESOURCE_FLAGS flags = D3D12_RESOURCE_FLAG_NONE);
+    // Copy into [offset, offset + size) of an existing buffer, the rest of it
+    // is left alone.
+    void UpdateBufferRange(
+        ComPtr<ID3D12GraphicsCommandList> commandList,
+        ID3D12Resource* pDestinationResource,
+        ID3D12Resource** pIntermediateResource,
+        size_t offset, size_t size, const void* bufferData);
     void LoadAssets();
+    void UploadModel();
+    void RegisterModel();
+    void StreamModel(ProgressiveMeshStream& stream);
+    void UploadStreamLevel(const ProgressiveLevel& level, const ProgressiveMesh::Header& header);
+    void UploadMeshBuffers();
+    void ReleaseMeshBuffers();
+    uint64_t GetMeshGPUBytes() const;
+    void UploadLODs();
 
     void UpdateWindowRect(uint32_t width, uint32_t height);
+    // closest triangle of the model under the pixel, ~0u if none
+    uint32_t Pick(int x, int y);
 public:
     DXWindow(const wchar_t* name, uint32_t w = 1280, uint32_t h = 720) noexcept;
     ~DXWindow() = default;
@@ -96,6 +149,8 @@ public:
     uint32_t GetWidth() const;
     uint32_t GetHeight() const;
     const wchar_t* GetName() const;
+    // budgets for the meshes this window draws
+    MeshResidencyManager& GetResidency();
 
     bool IsInitialized() const;
     bool IsFullscreen() const;
@@ -0,0 +1,76 @@
+#ifndef __DRAWQUEUE_H__
+#define __DRAWQUEUE_H__
+
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// One instanced draw: instanceCount instances of mesh with pipeline, their
+// transforms and materials are [firstInstance, firstInstance + instanceCount)
+// of the queue's instance arrays.
+struct DrawBatch
+{
+    uint32_t pipeline;
+    uint32_t mesh;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+// Draw submission without any graphics API. Every visible item becomes a
+// 64 bit sort key, the keys are radix sorted and runs of items that share a
+// pipeline and a mesh become one instanced draw, so the number of draws
+// grows with the number of distinct assets rather than with instances.
+//
+// Key from the most significant bits: pipeline, mesh, material, depth. State
+// changes are sorted out first, then instances are front to back.
+class DrawQueue
+{
+private:
+    std::vector<uint64_t> m_keys;
+    std::vector<XMFLOAT4X4> m_transforms;
+    // item indices in key order
+    std::vector<uint32_t> m_order;
+
+    std::vector<DrawBatch> m_batches;
+    std::vector<XMFLOAT4X4> m_instanceTransforms;
+    std::vector<uint32_t> m_instanceMaterials;
+
+    // radix sort ping-pong buffers
+    std::vector<uint64_t> m_sortKeys;
+    std::vector<uint32_t> m_sortOrder;
+
+    void Sort();
+
+public:
+    static constexpr uint32_t PIPELINE_BITS = 8;
+    static constexpr uint32_t MESH_BITS = 20;
+    static constexpr uint32_t MATERIAL_BITS = 16;
+    static constexpr uint32_t DEPTH_BITS = 20;
+    static_assert(PIPELINE_BITS + MESH_BITS + MATERIAL_BITS + DEPTH_BITS == 64, "the key has 64 bits");
+
+    // depth is clamped to [0, 1], e.g. view distance over the far plane
+    static uint64_t MakeKey(uint32_t pipeline, uint32_t mesh, uint32_t material, float depth);
+    static uint32_t GetPipeline(uint64_t key);
+    static uint32_t GetMesh(uint64_t key);
+    static uint32_t GetMaterial(uint64_t key);
+
+    // Start a new frame, the arrays keep their capacity.
+    void Clear();
+    // Ids beyond their bits are truncated. Returns the item index.
+    uint32_t Submit(uint32_t pipeline, uint32_t mesh, uint32_t material, float depth, const XMFLOAT4X4& transform);
+    // Sort the items and merge them into batches.
+    void Build();
+
+    uint32_t GetItemCount() const;
+    const std::vector<uint64_t>& GetKeys() const;
+    // item indices in draw order, valid after Build
+    const std::vector<uint32_t>& GetOrder() const;
+    const std::vector<DrawBatch>& GetBatches() const;
+    // per instance, in draw order, to upload as the instance buffer
+    const std::vector<XMFLOAT4X4>& GetInstanceTransforms() const;
+    const std::vector<uint32_t>& GetInstanceMaterials() const;
+};
+
+#endif
\ No newline at end of file
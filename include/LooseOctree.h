@@ -0,0 +1,83 @@
+#ifndef __LOOSEOCTREE_H__
+#define __LOOSEOCTREE_H__
+
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+#include "Camera.h"
+
+using namespace DirectX;
+
+struct LooseOctreeNode
+{
+    XMFLOAT3 center;
+    // of the cell, the loose bounds are twice as large
+    float halfSize;
+    uint32_t parent;
+    // the eight children are consecutive, INVALID_INDEX for leaves
+    uint32_t firstChild;
+    // list of the objects stored in this node
+    uint32_t firstObject;
+    uint32_t objectCount;
+    // objects in the node and below, empty subtrees are skipped and freed
+    uint32_t subtreeCount;
+};
+
+// Octree over moving objects' boxes. Every node's bounds are loosened to twice
+// its cell, so an object's node only depends on its center and its size: no
+// split or merge, insert, move and remove cost a walk of at most maxDepth
+// levels. Nodes live in one array and are allocated eight siblings at a time
+// from a free list, objects are a free list of indices as well.
+//
+// Objects whose center is outside of the root cell are kept in the root.
+class LooseOctree
+{
+private:
+    std::vector<LooseOctreeNode> m_nodes;
+    // first nodes of free blocks of eight
+    std::vector<uint32_t> m_freeBlocks;
+    uint32_t m_maxDepth;
+
+    // per object
+    std::vector<XMFLOAT3> m_centers;
+    std::vector<XMFLOAT3> m_extents;
+    std::vector<uint32_t> m_objectNodes;
+    std::vector<uint32_t> m_next;
+    std::vector<uint32_t> m_previous;
+    std::vector<uint32_t> m_freeObjects;
+    uint32_t m_objectCount = 0;
+
+    uint32_t FindNode(const XMFLOAT3& center, const XMFLOAT3& extents, bool create);
+    uint32_t AllocateChildren(uint32_t parent);
+    void FreeChildren(uint32_t node);
+    void Link(uint32_t object, uint32_t node);
+    void Unlink(uint32_t object);
+
+public:
+    static constexpr uint32_t INVALID_INDEX = ~0u;
+    static constexpr uint32_t MAX_DEPTH = 16;
+
+    // the root cell, objects are best kept inside it
+    LooseOctree(const XMFLOAT3& center, float halfSize, uint32_t maxDepth = 8);
+
+    // returns the object's id, ids of removed objects are reused
+    uint32_t Insert(const XMFLOAT3& center, const XMFLOAT3& extents);
+    void Move(uint32_t object, const XMFLOAT3& center, const XMFLOAT3& extents);
+    void Remove(uint32_t object);
+
+    // Objects whose box intersects, appended to result in no particular
+    // order. The queries only read, any number may run at once.
+    void QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& result) const;
+    void QuerySphere(const XMFLOAT3& center, float radius, std::vector<uint32_t>& result) const;
+    // boxes the ray enters between 0 and tMax
+    void QueryRay(const XMFLOAT3& origin, const XMFLOAT3& direction, float tMax, std::vector<uint32_t>& result) const;
+
+    uint32_t GetObjectCount() const;
+    const XMFLOAT3& GetCenter(uint32_t object) const;
+    const XMFLOAT3& GetExtents(uint32_t object) const;
+    // the node object is stored in
+    uint32_t GetNode(uint32_t object) const;
+    const std::vector<LooseOctreeNode>& GetNodes() const;
+};
+
+#endif
\ No newline at end of file
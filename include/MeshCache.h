@@ -0,0 +1,99 @@
+#ifndef __MESHCACHE_H__
+#define __MESHCACHE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Model.h"
+
+// Range of the index buffer drawn as one piece, all of a model for now.
+struct MeshSubmesh
+{
+    uint32_t indexOffset;
+    uint32_t indexCount;
+    ModelBounds bounds;
+};
+
+struct MeshCacheData
+{
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indicies;
+    std::vector<MeshSubmesh> submeshes;
+    ModelBounds bounds;
+};
+
+// Binary copy of a loaded model, written after the first load of a source
+// file and memory mapped on later loads. The vertex and index blobs have the
+// layout DXWindow uploads, so a warm load is a validation and a copy.
+//
+// Entries are keyed by source path and load flags (file name) and by the
+// size, modification time and content hash of the source (header). A source
+// with a new time but the same content keeps its entry.
+namespace MeshCache
+{
+    constexpr uint32_t MAGIC = 0x434d5844; // "DXMC"
+    constexpr uint32_t VERSION = 3;
+    constexpr uint32_t BLOB_ALIGNMENT = 64;
+
+    // load flags that change the cached result
+    constexpr uint32_t FLAG_RECONSTRUCT = 1u << 0;
+    // current state of a model, written when its CPU copy is released
+    constexpr uint32_t FLAG_SNAPSHOT = 1u << 1;
+
+    // Blobs compressed with MeshCodec, a blob that does not get smaller is
+    // stored as is. Compressed index buffers may come back with rotated
+    // triangles.
+    constexpr uint32_t ENCODED_VERTICES = 1u << 0;
+    constexpr uint32_t ENCODED_INDICIES = 1u << 1;
+
+    struct Blob
+    {
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t flags;
+        uint32_t vertexStride;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint64_t sourceHash;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t submeshCount;
+        uint32_t encoding;
+        ModelBounds bounds;
+        uint32_t reserved2;
+        // utf-8 source path, guards against file name collisions
+        Blob path;
+        Blob vertices;
+        Blob indicies;
+        Blob submeshes;
+    };
+
+    struct SourceState
+    {
+        uint64_t size;
+        int64_t time;
+    };
+    bool GetSourceState(const std::wstring& sourcePath, SourceState& state);
+    // reads the whole source
+    bool HashSource(const std::wstring& sourcePath, uint64_t& hash);
+    // same size and time, or same size and content
+    bool IsSourceUnchanged(const std::wstring& sourcePath, uint64_t size, int64_t time, uint64_t hash);
+
+    std::wstring GetCachePath(const std::wstring& sourcePath, uint32_t flags);
+
+    // false if there is no valid entry for the current state of the source
+    bool Load(const std::wstring& sourcePath, uint32_t flags, MeshCacheData& data);
+    // Failures are not fatal, the next load just parses the source again.
+    bool Store(const std::wstring& sourcePath, uint32_t flags,
+        const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indicies,
+        const std::vector<MeshSubmesh>& submeshes, const ModelBounds& bounds,
+        uint32_t encoding = ENCODED_VERTICES | ENCODED_INDICIES);
+}
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef __MESHCODEC_H__
+#define __MESHCODEC_H__
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Lossless compression for index and vertex buffers, tuned for meshes that
+// went through MeshOptimizer (triangles in locality order, vertices in first
+// use order). No dependencies and cheap enough to decode in the load path.
+//
+// Decoders return false on malformed input instead of throwing, the caller
+// decides whether that is an error.
+//
+// learndx12_check prints the decode throughput.
+namespace MeshCodec
+{
+    constexpr uint8_t INDEX_CODEC_VERSION = 1;
+    constexpr uint8_t VERTEX_CODEC_VERSION = 1;
+    // vertices are coded in blocks of this many, one byte plane at a time
+    constexpr size_t VERTEX_BLOCK_SIZE = 256;
+
+    // One code byte per triangle: an edge shared with one of the last 15
+    // triangles plus the third vertex, which is either the next unused vertex,
+    // one of the last 14 vertices or a varint delta. The decoded triangles may
+    // be rotated (a, b, c -> b, c, a), winding and order are kept.
+    std::vector<uint8_t> EncodeIndexBuffer(const uint32_t* indicies, size_t indexCount);
+    bool DecodeIndexBuffer(uint32_t* indicies, size_t indexCount, const uint8_t* data, size_t size);
+
+    // Every 4-byte channel is delta coded against the previous vertex and
+    // zigzagged, each byte plane of a block is then packed in groups of 16 at
+    // 0, 2, 4 or 8 bits. vertexStride has to be a multiple of 4.
+    std::vector<uint8_t> EncodeVertexBuffer(const void* vertices, size_t vertexCount, size_t vertexStride);
+    bool DecodeVertexBuffer(void* vertices, size_t vertexCount, size_t vertexStride, const uint8_t* data, size_t size);
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef __MESHOPTIMIZER_H__
+#define __MESHOPTIMIZER_H__
+
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Index/vertex buffer passes that work on raw streams, so that they do not
+// depend on the layout of Vertex. Positions are read as XMFLOAT3 at the start
+// of every vertexStride-byte element.
+namespace MeshOptimizer
+{
+    // Size of the FIFO post-transform cache used when simulating ACMR.
+    constexpr uint32_t DEFAULT_CACHE_SIZE = 16;
+    // Resolution of the grid the overdraw estimator rasterizes into.
+    constexpr uint32_t DEFAULT_OVERDRAW_RESOLUTION = 256;
+    // Memory the vertex fetch analysis simulates: a direct mapped cache of
+    // FETCH_CACHE_LINES lines of FETCH_CACHE_LINE_SIZE bytes.
+    constexpr uint32_t FETCH_CACHE_LINE_SIZE = 64;
+    constexpr uint32_t FETCH_CACHE_LINES = 256;
+
+    struct OverdrawStatistics
+    {
+        uint64_t pixelsCovered = 0;
+        uint64_t pixelsShaded = 0;
+        // pixelsShaded / pixelsCovered, 1 means no overdraw at all
+        float overdraw = 0.f;
+    };
+
+    struct OverdrawGain
+    {
+        XMFLOAT3 viewDirection;
+        OverdrawStatistics before;
+        OverdrawStatistics after;
+        // relative reduction of shaded pixels, 0.1 means 10% less shading
+        float gain = 0.f;
+    };
+
+    struct OverdrawReport
+    {
+        float acmrBefore = 0.f;
+        float acmrAfter = 0.f;
+        uint32_t clusterCount = 0;
+        std::vector<OverdrawGain> views;
+    };
+
+    struct VertexFetchStatistics
+    {
+        // mean distance in bytes between two consecutively fetched vertices
+        float averageFetchStride = 0.f;
+        uint64_t bytesFetched = 0;
+        // bytesFetched / bytes of all referenced vertices, 1 is optimal
+        float overfetch = 0.f;
+    };
+
+    struct VertexFetchReport
+    {
+        VertexFetchStatistics before;
+        VertexFetchStatistics after;
+    };
+
+    // remap entry of a vertex CompactVertexBuffer drops
+    constexpr uint32_t REMOVED_VERTEX = ~0u;
+
+    struct WeldConfig
+    {
+        // vertices at most this far apart are merged, finite and not
+        // negative. 0 merges equal positions only.
+        float epsilon = 1e-6f;
+        // and only if the dot product of their normals is at least this,
+        // -1 merges regardless of normals
+        float minNormalDot = -1.f;
+    };
+
+    struct CleanReport
+    {
+        // repeat a vertex or have no area
+        uint32_t degenerateTriangles = 0;
+        // same vertices as an earlier triangle
+        uint32_t duplicateTriangles = 0;
+        uint32_t unreferencedVertices = 0;
+    };
+
+    // Average cache miss ratio: transformed vertices per triangle.
+    float CalculateACMR(const std::vector<uint32_t>& indicies, size_t vertexCount,
+        uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+    // Reorder triangles for the post-transform cache (Tipsify, Sander et al.
+    // 2007): fan around the most recently used vertex that is still live,
+    // fall back to recently used vertices at dead ends. Linear time.
+    // Run it before OptimizeOverdraw, which keeps the order inside clusters.
+    void OptimizeVertexCache(std::vector<uint32_t>& indicies, size_t vertexCount,
+        uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+    // Split the index buffer into clusters whose ACMR stays within threshold
+    // times the ACMR of the input order, then sort the clusters so that the
+    // ones facing away from the mesh centre (likely occluders) are drawn first.
+    // Returns the number of clusters, 0 if the reordered buffer would still
+    // exceed threshold times the input ACMR and indicies were left alone.
+    uint32_t OptimizeOverdraw(std::vector<uint32_t>& indicies,
+        const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride,
+        float threshold = 1.05f, uint32_t cacheSize = DEFAULT_CACHE_SIZE);
+
+    // Orthographic software rasterization of the mesh along viewDirection with
+    // depth test and back-face culling matching the default rasterizer state.
+    OverdrawStatistics AnalyzeOverdraw(const std::vector<uint32_t>& indicies,
+        const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride,
+        const XMFLOAT3& viewDirection, uint32_t resolution = DEFAULT_OVERDRAW_RESOLUTION);
+
+    std::vector<OverdrawGain> EstimateOverdrawGain(
+        const std::vector<uint32_t>& before, const std::vector<uint32_t>& after,
+        const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride,
+        const std::vector<XMFLOAT3>& viewDirections, uint32_t resolution = DEFAULT_OVERDRAW_RESOLUTION);
+
+    // old index -> new index so that vertices are numbered in the order the
+    // index buffer first uses them. Unreferenced vertices keep their relative
+    // order after all referenced ones, so the vertex count does not change.
+    std::vector<uint32_t> GenerateVertexFetchRemap(const std::vector<uint32_t>& indicies, size_t vertexCount);
+    void RemapIndexBuffer(std::vector<uint32_t>& indicies, const std::vector<uint32_t>& remap);
+    // Works on any per-vertex stream, vertexSize is the element size in bytes.
+    void RemapVertexBuffer(void* destination, const void* vertices, size_t vertexCount, size_t vertexSize,
+        const std::vector<uint32_t>& remap);
+
+    template <typename T>
+    void RemapVertexBuffer(std::vector<T>& vertices, const std::vector<uint32_t>& remap)
+    {
+        std::vector<T> result(vertices.size());
+        RemapVertexBuffer(result.data(), vertices.data(), vertices.size(), sizeof(T), remap);
+        vertices.swap(result);
+    }
+
+    // Remove degenerate triangles, then triangles that repeat an earlier one.
+    // Triangles are compared with their smallest index rotated first, so a
+    // face and its back face are both kept. Runs on the task pool, fills the
+    // triangle counts of the report.
+    CleanReport CleanIndexBuffer(std::vector<uint32_t>& indicies,
+        const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride);
+
+    // old index -> new index over the vertices the index buffer uses, in their
+    // old order, REMOVED_VERTEX for the others. Returns the kept vertex count.
+    size_t GenerateCompactRemap(const std::vector<uint32_t>& indicies, size_t vertexCount,
+        std::vector<uint32_t>& remap);
+    // old index -> new index that merges vertices within config.epsilon of
+    // each other. Every group keeps its smallest old index, and no two kept
+    // vertices are within epsilon, so a vertex moves by at most epsilon.
+    // Positions are hashed into a grid of 4 * epsilon cells, a CSR hash table
+    // built on the task pool, and a vertex checks its cell and the neighbours
+    // behind faces closer than epsilon.
+    // normals may be null, it is read with vertexStride as well. Returns the
+    // kept vertex count.
+    size_t GenerateWeldRemap(const XMFLOAT3* positions, const XMFLOAT3* normals, size_t vertexCount, size_t vertexStride,
+        const WeldConfig& config, std::vector<uint32_t>& remap);
+    // Copies the first old vertex of every new index, so it works with the
+    // remaps of GenerateCompactRemap and GenerateWeldRemap, which number new
+    // indices in the order of their first old vertex. REMOVED_VERTEX entries
+    // are skipped.
+    void CompactVertexBuffer(void* destination, const void* vertices, size_t vertexCount, size_t vertexSize,
+        const std::vector<uint32_t>& remap);
+
+    template <typename T>
+    void CompactVertexBuffer(std::vector<T>& vertices, const std::vector<uint32_t>& remap, size_t keptCount)
+    {
+        std::vector<T> result(keptCount);
+        CompactVertexBuffer(result.data(), vertices.data(), vertices.size(), sizeof(T), remap);
+        vertices.swap(result);
+    }
+
+    VertexFetchStatistics AnalyzeVertexFetch(const std::vector<uint32_t>& indicies, size_t vertexCount, size_t vertexSize);
+}
+
+#endif
\ No newline at end of file
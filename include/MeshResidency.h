@@ -0,0 +1,99 @@
+#ifndef __MESHRESIDENCY_H__
+#define __MESHRESIDENCY_H__
+
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <unordered_map>
+
+struct MeshResidencyBudget
+{
+    uint64_t cpuBytes = std::numeric_limits<uint64_t>::max();
+    uint64_t gpuBytes = std::numeric_limits<uint64_t>::max();
+};
+
+struct MeshResidencyStatistics
+{
+    // currently resident
+    uint64_t cpuBytes = 0;
+    uint64_t gpuBytes = 0;
+    uint64_t cpuEvictions = 0;
+    uint64_t gpuEvictions = 0;
+    uint64_t cpuRestores = 0;
+    uint64_t gpuRestores = 0;
+    uint64_t failedRestores = 0;
+};
+
+// What the manager does to a mesh. The manager itself never touches a
+// device, so the policy runs with callbacks that only count as well.
+struct MeshResidencyCallbacks
+{
+    // false keeps the copy, e.g. while something still needs it
+    std::function<bool()> releaseCPU;
+    std::function<bool()> restoreCPU;
+    std::function<void()> releaseGPU;
+    // only called with the CPU copy resident
+    std::function<bool()> restoreGPU;
+};
+
+// Keeps the CPU and GPU bytes of registered meshes within budgets by
+// evicting the least recently used ones at the end of a frame. A mesh that
+// is still GPU resident loses its CPU copy first, since it can be drawn
+// without it. Request brings evicted meshes back.
+//
+// GPU copies used in the last framesInFlight frames are never evicted, the
+// GPU may still read them. Budgets are soft within a frame.
+class MeshResidencyManager
+{
+public:
+    using MeshId = uint32_t;
+    static const MeshId INVALID_MESH = 0;
+
+private:
+    struct Entry
+    {
+        uint64_t cpuBytes;
+        uint64_t gpuBytes;
+        bool cpuResident;
+        bool gpuResident;
+        uint64_t lastCPUUse;
+        uint64_t lastGPUUse;
+        MeshResidencyCallbacks callbacks;
+    };
+
+    std::unordered_map<MeshId, Entry> m_entries;
+    MeshId m_nextId = 1;
+    uint64_t m_frame = 0;
+    uint32_t m_framesInFlight;
+    MeshResidencyBudget m_budget;
+    MeshResidencyStatistics m_statistics;
+
+    bool RestoreCPU(Entry& entry);
+    void ReleaseCPU(Entry& entry);
+    void EvictGPU();
+    void EvictCPU();
+
+public:
+    explicit MeshResidencyManager(MeshResidencyBudget budget = MeshResidencyBudget(), uint32_t framesInFlight = 3);
+
+    MeshId Register(uint64_t cpuBytes, uint64_t gpuBytes, bool cpuResident, bool gpuResident,
+        MeshResidencyCallbacks callbacks);
+    // does not call any callback, the owner frees what is left
+    void Unregister(MeshId id);
+    // sizes of the resident copies changed, e.g. LODs were added
+    void UpdateSizes(MeshId id, uint64_t cpuBytes, uint64_t gpuBytes);
+
+    // Makes the requested copies resident and marks them used this frame.
+    // false if a restore failed.
+    bool Request(MeshId id, bool gpu = true, bool cpu = false);
+    // Evicts down to the budgets and starts the next frame.
+    void EndFrame();
+
+    void SetBudget(const MeshResidencyBudget& budget);
+    const MeshResidencyBudget& GetBudget() const;
+    bool IsCPUResident(MeshId id) const;
+    bool IsGPUResident(MeshId id) const;
+    const MeshResidencyStatistics& GetStatistics() const;
+};
+
+#endif
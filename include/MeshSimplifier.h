@@ -0,0 +1,25 @@
+#ifndef __MESHSIMPLIFIER_H__
+#define __MESHSIMPLIFIER_H__
+
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+namespace MeshSimplifier
+{
+    // Quadric error metric edge collapse (Garland & Heckbert). Vertices are
+    // only ever collapsed onto other existing vertices, so the result is an
+    // index buffer into the unchanged vertex buffer and every LOD of a model
+    // can share one vertex buffer. Vertices sharing a position are one point
+    // for the topology, those of attribute seams are locked so that every
+    // corner keeps a vertex with its own attributes.
+    // Stops at targetIndexCount or before the error would exceed targetError,
+    // both in model space units. resultError receives the reached error.
+    std::vector<uint32_t> Simplify(const std::vector<uint32_t>& indicies,
+        const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride,
+        size_t targetIndexCount, float targetError, float* resultError = nullptr);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef __MESHLET_H__
+#define __MESHLET_H__
+
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+struct Meshlet
+{
+    // into MeshletData::vertices
+    uint32_t vertexOffset;
+    // into MeshletData::triangles, in triangles
+    uint32_t triangleOffset;
+    uint32_t vertexCount;
+    uint32_t triangleCount;
+};
+
+struct MeshletBounds
+{
+    // bounding sphere, for frustum and occlusion culling
+    XMFLOAT3 center;
+    float radius;
+    // normal cone, the meshlet is back-facing for every eye position with
+    // dot(normalize(coneApex - eye), coneAxis) >= coneCutoff
+    XMFLOAT3 coneApex;
+    XMFLOAT3 coneAxis;
+    float coneCutoff;
+};
+
+struct MeshletData
+{
+    std::vector<Meshlet> meshlets;
+    std::vector<MeshletBounds> bounds;
+    // meshlet local vertex -> model vertex
+    std::vector<uint32_t> vertices;
+    // 3 local (8 bit) vertex indices per triangle
+    std::vector<uint8_t> triangles;
+};
+
+struct MeshletStatistics
+{
+    uint32_t meshletCount = 0;
+    // average vertexCount / maxVertices and triangleCount / maxTriangles
+    float vertexFill = 0.f;
+    float triangleFill = 0.f;
+    // fraction of (meshlet, viewpoint) pairs rejected by the normal cone
+    float coneRejection = 0.f;
+    // fraction of the triangles behind those rejections
+    float triangleRejection = 0.f;
+};
+
+namespace MeshletBuilder
+{
+    constexpr uint32_t MAX_VERTICES = 64;
+    constexpr uint32_t MAX_TRIANGLES = 124;
+
+    // Greedy partition: grow the current meshlet with the adjacent triangle
+    // that adds the fewest new vertices, start a new one when none fits.
+    // Local indices are 8 bit, so maxVertices must not exceed 256.
+    MeshletData Build(const std::vector<uint32_t>& indicies,
+        const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride,
+        uint32_t maxVertices = MAX_VERTICES, uint32_t maxTriangles = MAX_TRIANGLES);
+
+    MeshletBounds ComputeBounds(const MeshletData& data, const Meshlet& meshlet,
+        const XMFLOAT3* positions, size_t vertexStride);
+
+    bool IsBackFacing(const MeshletBounds& bounds, const XMFLOAT3& eye);
+
+    // viewpoints are eye positions in model space
+    MeshletStatistics Analyze(const MeshletData& data, const std::vector<XMFLOAT3>& viewpoints,
+        uint32_t maxVertices = MAX_VERTICES, uint32_t maxTriangles = MAX_TRIANGLES);
+}
+
+#endif
\ No newline at end of file
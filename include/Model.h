@@ -4,35 +4,216 @@
 #include <DirectXMath.h>
 #include <vector>
 #include <string>
+#include <future>
+#include <functional>
+#include <memory>
+#include <cstddef>
 #include "common/ModelLoader.h"
+#include "common/Hash.h"
+#include "MeshOptimizer.h"
+#include "Meshlet.h"
+#include "PointCloud.h"
+#include "Bvh.h"
+#include "VertexLayout.h"
 
 using namespace DirectX;
 
+// The vertex every Model, cache and buffer uses. With colors, add
+// VertexAttribute::Color here and the member to Vertex.
+using ModelVertexLayout = VertexLayout<VertexAttribute::Position, VertexAttribute::Normal>;
+
 struct Vertex
 {
     XMFLOAT3 position;
     XMFLOAT3 normal;
     // XMFLOAT4 color;
 };
+static_assert(sizeof(Vertex) == ModelVertexLayout::STRIDE
+    && offsetof(Vertex, normal) == ModelVertexLayout::OffsetOf(VertexAttribute::Normal),
+    "Vertex does not match ModelVertexLayout");
+
+struct ModelBounds
+{
+    // axis aligned box
+    XMFLOAT3 center;
+    XMFLOAT3 extents;
+    // bounding sphere around center
+    float radius;
+};
+
+struct LODConfig
+{
+    // target index count as a fraction of the full mesh
+    float ratio;
+    // error bound relative to the bounding sphere radius
+    float maxError;
+};
+
+struct ModelLOD
+{
+    std::vector<uint32_t> indicies;
+    // model space error
+    float error;
+};
+
+class Camera;
+class Model;
+struct ProgressiveMeshData;
+
+// Errors are returned as values, model is null unless loading succeeded.
+struct ModelLoadResult
+{
+    std::shared_ptr<Model> model;
+    std::string error;
+
+    bool IsOk() const { return model != nullptr; }
+};
+
+// Returned by Model::LoadAsync. Cheap to copy, all copies share the load.
+class ModelLoadHandle
+{
+    std::shared_ptr<LoadProgress> m_progress;
+    std::shared_future<ModelLoadResult> m_result;
+
+public:
+    ModelLoadHandle() = default;
+    ModelLoadHandle(std::shared_ptr<LoadProgress> progress, std::shared_future<ModelLoadResult> result);
+
+    bool IsValid() const;
+    bool IsReady() const;
+    LoadStage GetStage() const;
+    uint64_t GetBytesParsed() const;
+    uint64_t GetTotalBytes() const;
+    // fraction of the file parsed, in [0, 1]
+    float GetProgress() const;
+    // The load stops at its next check point and fails with "loading cancelled".
+    void Cancel();
+    // blocks until the load has finished
+    ModelLoadResult Get() const;
+};
 
 class Model
 {
 private:
     std::vector<Vertex> m_vertices;
     std::vector<uint32_t> m_indicies;
+    ModelBounds m_bounds;
+
+    // LOD 1..n, LOD 0 is the full mesh. All levels index m_vertices.
+    std::vector<ModelLOD> m_lods;
+    std::vector<std::future<ModelLOD>> m_pendingLODs;
+
+    // of the cleanup when the model was parsed, empty for cache hits
+    MeshOptimizer::CleanReport m_cleanReport;
+
+    // only for point clouds (no indices), m_vertices are in its order
+    std::shared_ptr<const PointOctree> m_pointOctree;
+
+    // where ReleaseCPUData/RestoreCPUData keep the buffers
+    std::wstring m_sourcePath;
+    uint32_t m_cacheFlags = 0;
+    bool m_cpuResident = true;
+    uint32_t m_releasedVertexCount = 0;
+    uint32_t m_releasedIndexCount = 0;
+    // of what a restore returns, the index codec may rotate triangles
+    Hash::Hash128 m_snapshotHash;
 
     void CalculateVertexNormal();
+    void CalculateBounds();
+    // Apply an old -> new vertex remap to every per-vertex stream.
+    void RemapVertices(const std::vector<uint32_t>& remap);
 
 public:
+    static const std::vector<LODConfig> DEFAULT_LOD_CONFIGS;
+
     static std::wstring GetModelFullPath(std::wstring model_name);
 
-    Model(std::wstring model_name, ModelType modelType, bool reconstruct = false) noexcept;
+    // Load on the task pool through the ModelRegistry, so loading a model
+    // that is already loaded returns the shared one. postProcess runs on the
+    // same worker before the handle becomes ready, so passes like
+    // OptimizeOverdraw stay off the calling thread too, and only once per
+    // registry entry.
+    static ModelLoadHandle LoadAsync(std::wstring model_name, ModelType modelType, bool reconstruct = false,
+        std::function<void(Model&)> postProcess = nullptr);
+
+    // Throws if the file cannot be loaded, see LoadAsync for a non-blocking,
+    // non-throwing alternative.
+    Model(std::wstring model_name, ModelType modelType, bool reconstruct = false, LoadProgress* progress = nullptr);
+    // From a fully read progressive mesh, its coarser levels become the LODs.
+    Model(ProgressiveMeshData&& data, std::wstring sourcePath, uint32_t cacheFlags);
     ~Model() = default;
 
     std::vector<Vertex> GetVertices() const;
     std::vector<uint32_t> GetIndicies() const;
     uint32_t GetVerticesNum() const;
     uint32_t GetIndiciesNum() const;
+    const ModelBounds& GetBounds() const;
+    // of the vertex and index buffers, changes with every reordering pass
+    Hash::Hash128 GetGeometryHash() const;
+
+    // Drop the vertex and index buffers, a snapshot of them goes to the mesh
+    // cache first. Counts, bounds and LODs stay, everything else needs the
+    // buffers back through RestoreCPUData. Fails while LODs are generated.
+    bool ReleaseCPUData();
+    // false if the snapshot is gone or no longer matches
+    bool RestoreCPUData();
+    bool IsCPUResident() const;
+    // bytes ReleaseCPUData frees
+    uint64_t GetCPUBytes() const;
+
+    // vertices without faces, drawn as points through the octree
+    bool IsPointCloud() const;
+    // Reorders the vertices, the constructor runs it for point clouds.
+    void BuildPointOctree(const PointOctreeConfig& config = PointOctreeConfig());
+    const PointOctree* GetPointOctree() const;
+
+    // Remove degenerate and duplicate triangles and the vertices no triangle
+    // uses. The constructor runs it on every parsed mesh.
+    MeshOptimizer::CleanReport Clean();
+    const MeshOptimizer::CleanReport& GetCleanReport() const;
+    // Merge vertices within config.epsilon of each other and Clean the
+    // triangles that collapsed, see MeshOptimizer::GenerateWeldRemap. Normals
+    // are compared as they are, then recalculated if recalculateNormals.
+    // Run it before the LODs are generated. Returns the merged vertex count.
+    uint32_t Weld(const MeshOptimizer::WeldConfig& config, bool recalculateNormals = true);
+
+    float GetACMR(uint32_t cacheSize = MeshOptimizer::DEFAULT_CACHE_SIZE) const;
+    // Triangle order for the post-transform cache, run it before OptimizeOverdraw.
+    void OptimizeVertexCache(uint32_t cacheSize = MeshOptimizer::DEFAULT_CACHE_SIZE);
+    // Reorder triangle clusters to reduce overdraw. viewDirections are only
+    // used to estimate the gain, the new order does not depend on them.
+    MeshOptimizer::OverdrawReport OptimizeOverdraw(float threshold = 1.05f,
+        const std::vector<XMFLOAT3>& viewDirections = {});
+    // Renumber vertices in first-use order of the index buffer. Run it after
+    // every pass that changes the triangle order.
+    MeshOptimizer::VertexFetchReport OptimizeVertexFetch();
+
+    // over the full mesh, triangles are those of GetIndicies
+    Bvh BuildBvh(const BvhConfig& config = BvhConfig()) const;
+
+    MeshletData BuildMeshlets(uint32_t maxVertices = MeshletBuilder::MAX_VERTICES,
+        uint32_t maxTriangles = MeshletBuilder::MAX_TRIANGLES) const;
+
+    // Start building the LOD chain on the task pool and return at once. Run it
+    // after the passes that reorder vertices, the levels index m_vertices.
+    // Vertices at a position that several used vertices share (attribute
+    // seams) are never moved, so every corner keeps its own attributes. Weld
+    // first so that plain duplicates do not lock the mesh too.
+    void GenerateLODs(const std::vector<LODConfig>& configs = DEFAULT_LOD_CONFIGS);
+    // True once all pending levels are generated and at least one of them is
+    // coarser than the full mesh. They are collected here, so call it from
+    // the thread that reads the LODs.
+    bool IsLODReady();
+    // levels still being generated, or generated but not collected yet
+    bool HasPendingLODs() const;
+    uint32_t GetLODCount() const;
+    const std::vector<uint32_t>& GetLODIndicies(uint32_t level) const;
+    float GetLODError(uint32_t level) const;
+    // Write the model and its LODs as a progressive mesh on the task pool, so
+    // the next start can stream it coarse to fine. Needs the LODs collected.
+    bool StoreProgressive() const;
+    // Coarsest level whose projected error stays within pixelBudget pixels.
+    uint32_t SelectLOD(Camera& camera, const XMMATRIX& modelMatrix, float viewportHeight, float pixelBudget = 1.f) const;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,75 @@
+#ifndef __MODELREGISTRY_H__
+#define __MODELREGISTRY_H__
+
+#include <future>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include "Model.h"
+
+struct ModelRegistryStatistics
+{
+    // models actually loaded
+    uint64_t loads = 0;
+    // requests served by an existing entry, by the stage that found it
+    uint64_t nameHits = 0;
+    uint64_t sourceHits = 0;
+    uint64_t geometryHits = 0;
+    // requests that waited for a load of the same name already running
+    uint64_t pendingHits = 0;
+};
+
+// Hands out shared models so that a file, or the same geometry under another
+// name, is loaded (and uploaded) once. Entries are looked up by name, then by
+// a hash of the source file, and after loading by a hash of the geometry.
+//
+// The registry only holds weak references. An entry lives as long as some
+// caller holds the model, and its reference count is the number of holders.
+class ModelRegistry
+{
+private:
+    using NameKey = std::tuple<std::wstring, uint32_t>;
+    // size, hash, load flags
+    using SourceKey = std::tuple<uint64_t, uint64_t, uint64_t, uint32_t>;
+    using GeometryKey = std::tuple<uint64_t, uint64_t>;
+
+    std::mutex m_mutex;
+    std::map<NameKey, std::weak_ptr<Model>> m_byName;
+    std::map<SourceKey, std::weak_ptr<Model>> m_bySource;
+    std::map<GeometryKey, std::weak_ptr<Model>> m_byGeometry;
+    // loads in flight, later requests for the name wait for them
+    std::map<NameKey, std::shared_future<std::shared_ptr<Model>>> m_pending;
+    ModelRegistryStatistics m_statistics;
+
+    void RemoveExpired();
+    // the lookups after the name, then the load itself
+    std::shared_ptr<Model> Load(const NameKey& nameKey, const std::wstring& modelName, ModelType modelType,
+        bool reconstruct, const std::function<void(Model&)>& postProcess, LoadProgress* progress);
+
+public:
+    ModelRegistry() = default;
+    ModelRegistry(ModelRegistry&) = delete;
+    ModelRegistry& operator=(ModelRegistry&) = delete;
+
+    static ModelRegistry* GetInstance();
+
+    // Returns the shared model for modelName, loading it when there is no
+    // entry yet. Throws like the Model constructor. A request for a name that
+    // is being loaded waits for that load instead of parsing the file again.
+    // postProcess runs once per entry, before it becomes visible to other
+    // callers, so a model handed out is never modified again by the registry.
+    // Callers that share an entry also share the first caller's post
+    // processing.
+    std::shared_ptr<Model> Acquire(const std::wstring& modelName, ModelType modelType, bool reconstruct = false,
+        const std::function<void(Model&)>& postProcess = nullptr, LoadProgress* progress = nullptr);
+
+    // live entries
+    size_t GetEntryCount();
+    // holders of the model, the one passed in included
+    long GetReferenceCount(const std::shared_ptr<Model>& model);
+    ModelRegistryStatistics GetStatistics();
+    // forget every entry, models already handed out stay valid
+    void Clear();
+};
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef __OCCLUSION_H__
+#define __OCCLUSION_H__
+
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+#include "Culling.h"
+
+using namespace DirectX;
+
+// Low resolution depth buffer of a few selected occluders, rasterized on the
+// CPU, for rejecting objects before their draws are recorded. Depth is that
+// of Camera's projection, 0 at the near plane and 1 at the far one. Every
+// TILE_SIZE x TILE_SIZE tile keeps the farthest depth of its pixels, so most
+// objects are decided by a handful of tiles and never touch the pixels.
+//
+// AddOccluder only transforms, Rasterize fills the buffer in horizontal
+// bands on the task pool, 4 pixels per SSE step. Objects are tested after
+// that, the tests are read only and can run on any thread.
+class OcclusionBuffer
+{
+private:
+    struct Triangle
+    {
+        // edge functions and depth as planes a * x + b * y + c over the
+        // screen, in pixels
+        float edges[3][3];
+        float depth[3];
+        int minX, maxX, minY, maxY;
+    };
+
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_tilesX;
+    uint32_t m_tilesY;
+    std::vector<float> m_depth;
+    std::vector<float> m_tileDepth;
+    std::vector<Triangle> m_triangles;
+
+    void RasterizeBand(uint32_t band);
+    bool IsRectVisible(int minX, int maxX, int minY, int maxY, float depth) const;
+
+public:
+    static constexpr uint32_t TILE_SIZE = 8;
+    // rows per ParallelFor task of Rasterize
+    static constexpr uint32_t BAND_HEIGHT = TILE_SIZE * 2;
+    // candidates per ParallelFor chunk of Test
+    static constexpr size_t TEST_GRAIN = 1 << 10;
+
+    // both are rounded up to a multiple of TILE_SIZE
+    explicit OcclusionBuffer(uint32_t width = 256, uint32_t height = 128);
+
+    // Forget the occluders, the buffer is at the far plane again.
+    void Clear();
+    // Triangles in the space mvp maps from. Triangles crossing the near plane
+    // are dropped, occluders only ever hide too little.
+    void AddOccluder(const XMFLOAT3* positions, size_t vertexStride, size_t vertexCount,
+        const uint32_t* indicies, size_t indexCount, const XMMATRIX& mvp);
+    void Rasterize();
+
+    // false only if the box is behind the occluders or off the screen
+    bool IsVisible(const XMFLOAT3& center, const XMFLOAT3& extents, const XMMATRIX& mvp) const;
+    // visible receives those of candidates (indices of boxes) that pass
+    // IsVisible, in the same order
+    void Test(const CullingBoxes& boxes, const XMMATRIX& mvp, const std::vector<uint32_t>& candidates,
+        std::vector<uint32_t>& visible) const;
+
+    uint32_t GetWidth() const;
+    uint32_t GetHeight() const;
+    // row major, m_width per row
+    const std::vector<float>& GetDepth() const;
+    // farthest depth of every tile, row major, m_width / TILE_SIZE per row
+    const std::vector<float>& GetTileDepth() const;
+    uint32_t GetTriangleCount() const;
+};
+
+#endif
\ No newline at end of file
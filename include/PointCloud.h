@@ -0,0 +1,86 @@
+#ifndef __POINTCLOUD_H__
+#define __POINTCLOUD_H__
+
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+class Camera;
+
+struct PointOctreeConfig
+{
+    // a node keeps at most one point per cell of a gridSize^3 grid over its
+    // box, a power of two. A scanned surface covers some gridSize^2 cells,
+    // which makes a few thousand points per node at 32.
+    uint32_t gridSize = 32;
+    // nodes with at most this many points left become leaves and keep all
+    uint32_t leafCapacity = 8192;
+    // 21 bits of position per axis, gridSize takes log2(gridSize) of them
+    uint32_t maxDepth = 14;
+};
+
+struct PointOctreeNode
+{
+    // cube
+    XMFLOAT3 center;
+    float halfSize;
+    // grid cell size the points were sampled with
+    float spacing;
+    // the points of a node add detail to those of its ancestors
+    uint32_t firstPoint;
+    uint32_t pointCount;
+    // children are consecutive, childCount is 0 for leaves
+    uint32_t firstChild;
+    uint32_t childCount;
+    uint32_t level;
+};
+
+// Where the point cloud is seen from, in model space.
+struct PointCloudView
+{
+    XMFLOAT3 eye;
+    // screen pixels covered by one model unit at distance 1
+    float pixelsPerUnit;
+    float nearPlane;
+
+    static PointCloudView FromCamera(Camera& camera, const XMMATRIX& modelMatrix, float viewportHeight);
+};
+
+struct PointCloudSelection
+{
+    // nodes to draw, parents before children
+    std::vector<uint32_t> nodes;
+    uint32_t pointCount = 0;
+};
+
+// Potree style LOD for point clouds. Every node holds a subsample of the
+// points in its box, one per grid cell, the rest is passed down. Drawing a
+// node and all its ancestors gives the density of the node's grid. The points
+// of each node are consecutive, so a selection is drawn as one range per node.
+class PointOctree
+{
+private:
+    std::vector<PointOctreeNode> m_nodes;
+    // octree order -> input point
+    std::vector<uint32_t> m_order;
+
+public:
+    PointOctree() = default;
+
+    // Runs on the task pool.
+    static PointOctree Build(const XMFLOAT3* positions, size_t pointCount, size_t stride,
+        const PointOctreeConfig& config = PointOctreeConfig());
+
+    const std::vector<PointOctreeNode>& GetNodes() const;
+    // apply to every per-point stream to get the node ranges right
+    const std::vector<uint32_t>& GetPointOrder() const;
+    // Greedy by projected node size. A node is only taken with its parent,
+    // refinement stops at nodes whose point spacing is below minSpacing
+    // pixels, and no node is taken that would exceed pointBudget. The root is
+    // always taken, so a budget below its point count is exceeded by it.
+    PointCloudSelection Select(const PointCloudView& view, uint32_t pointBudget, float minSpacing = 1.f) const;
+};
+
+#endif
@@ -0,0 +1,124 @@
+#ifndef __PROGRESSIVEMESH_H__
+#define __PROGRESSIVEMESH_H__
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <memory>
+#include <cstdint>
+#include "Model.h"
+
+// A model stored as its LOD chain, coarsest level first. Vertices are ordered
+// by the first level using them, so every level only appends a range to the
+// vertex buffer of the levels before it and brings the complete index buffer
+// it is drawn with. The coarsest level is a few percent of the file and can
+// be drawn as soon as it is read, later levels refine it without touching
+// what is already uploaded.
+struct ProgressiveMeshData
+{
+    std::vector<Vertex> vertices;
+    // coarse to fine, the last level is the full mesh with error 0
+    std::vector<ModelLOD> levels;
+    // vertices used by levels [0, i]
+    std::vector<uint32_t> vertexCounts;
+    ModelBounds bounds;
+};
+
+struct ProgressiveLevel
+{
+    uint32_t level;
+    // the new vertices go to [firstVertex, firstVertex + vertices.size())
+    uint32_t firstVertex;
+    std::vector<Vertex> vertices;
+    // whole index buffer of the level, into all vertices read so far
+    std::vector<uint32_t> indicies;
+    float error;
+};
+
+namespace ProgressiveMesh
+{
+    constexpr uint32_t MAGIC = 0x4d505844; // "DXPM"
+    constexpr uint32_t VERSION = 2;
+
+    struct Header
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t vertexStride;
+        uint32_t levelCount;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint64_t sourceHash;
+        uint32_t vertexCount;
+        // of the largest level, the full mesh
+        uint32_t indexCount;
+        ModelBounds bounds;
+        uint32_t reserved;
+    };
+
+    // Followed by the level data in the same order, new vertices then indices.
+    struct LevelEntry
+    {
+        uint32_t firstVertex;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        float error;
+        uint64_t offset;
+    };
+
+    // lods are fine to coarse as Model keeps them, all of them index vertices.
+    // Vertices no level uses are dropped.
+    ProgressiveMeshData Build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indicies,
+        const std::vector<ModelLOD>& lods, const ModelBounds& bounds);
+
+    // next to the MeshCache entry of the same source and flags
+    std::wstring GetPath(const std::wstring& sourcePath, uint32_t flags);
+    bool Write(const std::wstring& sourcePath, uint32_t flags, const ProgressiveMeshData& data);
+}
+
+// Sequential reader, every ReadNextLevel only reads the bytes of that level.
+class ProgressiveMeshReader
+{
+    std::ifstream m_file;
+    ProgressiveMesh::Header m_header = {};
+    std::vector<ProgressiveMesh::LevelEntry> m_levels;
+    uint32_t m_nextLevel = 0;
+
+public:
+    // false if there is no file for the current state of the source
+    bool Open(const std::wstring& sourcePath, uint32_t flags);
+    const ProgressiveMesh::Header& GetHeader() const;
+    bool IsComplete() const;
+    // false at the end or on a damaged file
+    bool ReadNextLevel(ProgressiveLevel& level);
+};
+
+// Reads a progressive mesh on the task pool. Levels queue up as they are read
+// and are picked up with Poll, the first one is there after a small fraction
+// of the file. Cheap to copy, all copies share the stream.
+class ProgressiveMeshStream
+{
+    struct State;
+    std::shared_ptr<State> m_state;
+
+public:
+    // Opens and validates the file on the calling thread, the result is
+    // invalid if there is no up to date file for the source.
+    static ProgressiveMeshStream Open(const std::wstring& sourcePath, uint32_t flags);
+
+    bool IsValid() const;
+    const std::wstring& GetSourcePath() const;
+    uint32_t GetCacheFlags() const;
+    const ProgressiveMesh::Header& GetHeader() const;
+    // levels handed out by Poll so far
+    uint32_t GetLevelsPolled() const;
+
+    // next level that has been read, never blocks
+    bool Poll(ProgressiveLevel& level);
+    // all levels polled, or reading stopped early
+    bool IsDone() const;
+    bool HasFailed() const;
+    void Cancel();
+};
+
+#endif
@@ -0,0 +1,44 @@
+#ifndef __RAYQUERY_H__
+#define __RAYQUERY_H__
+
+#include <DirectXMath.h>
+#include <cstdint>
+#include "Bvh.h"
+
+using namespace DirectX;
+
+class Camera;
+
+// Batches of rays against a Bvh, for picking, visibility tests and baking.
+// Rays go through the tree four at a time as SSE packets: a node is visited
+// once for every lane that reaches it, so coherent rays share most of their
+// traversal. Packets are spread over the task pool.
+class RayQuery
+{
+private:
+    const Bvh& m_bvh;
+
+public:
+    static constexpr uint32_t PACKET_SIZE = 4;
+    // packets per ParallelFor chunk
+    static constexpr size_t BATCH_GRAIN = 64;
+
+    // the Bvh has to outlive the query
+    explicit RayQuery(const Bvh& bvh);
+
+    // Closest hit of every ray, hits[i].IsHit() tells whether rays[i] hit
+    // anything. A packet counts once per node and triangle in statistics.
+    void IntersectClosest(const BvhRay* rays, BvhHit* hits, size_t count,
+        BvhTraversalStatistics* statistics = nullptr) const;
+    // occluded[i] is 1 if anything lies between rays[i].tMin and tMax. Lanes
+    // stop at their first hit, so this is cheaper than IntersectClosest.
+    void IntersectAny(const BvhRay* rays, uint8_t* occluded, size_t count,
+        BvhTraversalStatistics* statistics = nullptr) const;
+
+    // Ray through the center of pixel (x, y) in model space, from the near
+    // plane (t = 0) to the far plane (t = 1).
+    static BvhRay ScreenRay(Camera& camera, const XMMATRIX& modelMatrix, float x, float y,
+        float viewportWidth, float viewportHeight);
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,76 @@
+#ifndef __SCENEGRAPH_H__
+#define __SCENEGRAPH_H__
+
+#include <DirectXMath.h>
+#include <vector>
+#include <cstdint>
+
+using namespace DirectX;
+
+// Transform hierarchy in structure of arrays. A node is an index, parents
+// always come before their children, so the arrays are in topological order.
+// Setting a local transform only marks the node, Update recomputes the world
+// matrices of the marked nodes and their subtrees, one depth level at a time
+// from the shallowest marked node on, every level in parallel on the task
+// pool.
+class SceneGraph
+{
+private:
+    std::vector<uint32_t> m_parents;
+    std::vector<uint32_t> m_depths;
+    std::vector<XMFLOAT3> m_translations;
+    // quaternions
+    std::vector<XMFLOAT4> m_rotations;
+    std::vector<XMFLOAT3> m_scales;
+    std::vector<XMFLOAT4X4> m_worldMatrices;
+    // set by the setters, m_dirtyNodes lists them so that Update clears and
+    // starts from them without a pass over every node
+    std::vector<uint8_t> m_dirty;
+    std::vector<uint32_t> m_dirtyNodes;
+    bool m_allDirty = false;
+    // m_updateStamp of the last Update that recomputed the node, read by its
+    // children, stale stamps need no clearing
+    std::vector<uint32_t> m_updateStamps;
+    uint32_t m_updateStamp = 0;
+
+    // node indices grouped by depth, rebuilt after nodes were added
+    std::vector<std::vector<uint32_t>> m_levels;
+    bool m_levelsValid = true;
+
+    void MarkDirty(uint32_t node);
+    void BuildLevels();
+
+public:
+    static constexpr uint32_t INVALID_NODE = ~0u;
+    // nodes per ParallelFor chunk of a level
+    static constexpr size_t UPDATE_GRAIN = 1 << 11;
+
+    // parent is INVALID_NODE for roots, otherwise a node added before
+    uint32_t AddNode(uint32_t parent = INVALID_NODE,
+        const XMFLOAT3& translation = XMFLOAT3(0.f, 0.f, 0.f),
+        const XMFLOAT4& rotation = XMFLOAT4(0.f, 0.f, 0.f, 1.f),
+        const XMFLOAT3& scale = XMFLOAT3(1.f, 1.f, 1.f));
+    void Clear();
+
+    void SetTranslation(uint32_t node, const XMFLOAT3& translation);
+    void SetRotation(uint32_t node, const XMFLOAT4& rotation);
+    void SetScale(uint32_t node, const XMFLOAT3& scale);
+    void SetLocalTransform(uint32_t node, const XMFLOAT3& translation, const XMFLOAT4& rotation, const XMFLOAT3& scale);
+
+    // Recompute the subtrees of the nodes set since the last call, returns
+    // how many world matrices changed.
+    uint32_t Update();
+    // every world matrix, for comparing with Update
+    uint32_t UpdateAll();
+
+    uint32_t GetNodeCount() const;
+    uint32_t GetParent(uint32_t node) const;
+    const XMFLOAT3& GetTranslation(uint32_t node) const;
+    const XMFLOAT4& GetRotation(uint32_t node) const;
+    const XMFLOAT3& GetScale(uint32_t node) const;
+    // scale, then rotation, then translation, then the parent's world matrix,
+    // as of the last Update
+    const XMFLOAT4X4& GetWorldMatrix(uint32_t node) const;
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+#ifndef __TASKPOOL_H__
+#define __TASKPOOL_H__
+
+#include <vector>
+#include <queue>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <type_traits>
+
+// Fixed set of worker threads shared by the CPU side passes (LOD generation,
+// loaders, spatial structures...).
+class TaskPool
+{
+private:
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_tasks;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+
+    void Enqueue(std::function<void()> task);
+    void WorkerLoop();
+
+public:
+    // threadCount == 0 uses one thread less than the hardware provides (at
+    // least one), the thread calling ParallelFor works as well.
+    explicit TaskPool(uint32_t threadCount = 0);
+    ~TaskPool();
+    TaskPool(TaskPool&) = delete;
+    TaskPool& operator=(TaskPool&) = delete;
+
+    static TaskPool* GetInstance();
+
+    uint32_t GetThreadCount() const;
+
+    template <typename F>
+    auto Submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+    {
+        using R = std::invoke_result_t<std::decay_t<F>>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+        auto future = task->get_future();
+        Enqueue([task]() { (*task)(); });
+        return future;
+    }
+
+    // Calls fn(begin, end) for chunks of at most grain elements covering
+    // [0, count) and returns once all of them are done. The calling thread
+    // takes chunks too, so nested calls from inside a task do not deadlock.
+    // The first exception thrown by fn is rethrown here.
+    void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+};
+
+#endif
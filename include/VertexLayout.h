@@ -0,0 +1,175 @@
+#ifndef __VERTEXLAYOUT_H__
+#define __VERTEXLAYOUT_H__
+
+#include <DirectXMath.h>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include "TaskPool.h"
+#include "common/ModelLoader.h"
+#ifdef _WIN32
+#include <d3d12.h>
+#endif
+
+using namespace DirectX;
+
+enum class VertexAttribute : uint32_t
+{
+    Position,
+    Normal,
+    Color,
+    TexCoord
+};
+
+enum class VertexFormat : uint32_t
+{
+    Float2,
+    Float3,
+    Float4
+};
+
+template <VertexAttribute A>
+struct VertexAttributeTraits;
+
+template <>
+struct VertexAttributeTraits<VertexAttribute::Position>
+{
+    using Type = XMFLOAT3;
+    static constexpr const char* SEMANTIC = "POSITION";
+    static constexpr VertexFormat FORMAT = VertexFormat::Float3;
+
+    static void Pack(const VertexColumns& columns, size_t i, Type& out)
+    {
+        auto& p = columns.positions[i];
+        out = XMFLOAT3(static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2]));
+    }
+};
+
+template <>
+struct VertexAttributeTraits<VertexAttribute::Normal>
+{
+    using Type = XMFLOAT3;
+    static constexpr const char* SEMANTIC = "NORMAL";
+    static constexpr VertexFormat FORMAT = VertexFormat::Float3;
+
+    // normalized, zero without a column so that Model can accumulate them
+    static void Pack(const VertexColumns& columns, size_t i, Type& out)
+    {
+        if (!columns.normals)
+        {
+            out = XMFLOAT3(0.f, 0.f, 0.f);
+            return;
+        }
+        auto& n = columns.normals[i];
+        double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        double scale = length > 0. ? 1. / length : 0.;
+        out = XMFLOAT3(static_cast<float>(n[0] * scale), static_cast<float>(n[1] * scale), static_cast<float>(n[2] * scale));
+    }
+};
+
+template <>
+struct VertexAttributeTraits<VertexAttribute::Color>
+{
+    using Type = XMFLOAT4;
+    static constexpr const char* SEMANTIC = "COLOR";
+    static constexpr VertexFormat FORMAT = VertexFormat::Float4;
+
+    static void Pack(const VertexColumns& columns, size_t i, Type& out)
+    {
+        if (!columns.colors)
+        {
+            out = XMFLOAT4(1.f, 1.f, 1.f, 1.f);
+            return;
+        }
+        auto& c = columns.colors[i];
+        out = XMFLOAT4(c[0], c[1], c[2], c[3]);
+    }
+};
+
+template <>
+struct VertexAttributeTraits<VertexAttribute::TexCoord>
+{
+    using Type = XMFLOAT2;
+    static constexpr const char* SEMANTIC = "TEXCOORD";
+    static constexpr VertexFormat FORMAT = VertexFormat::Float2;
+
+    static void Pack(const VertexColumns& columns, size_t i, Type& out)
+    {
+        if (!columns.texcoords)
+        {
+            out = XMFLOAT2(0.f, 0.f);
+            return;
+        }
+        out = XMFLOAT2(columns.texcoords[i][0], columns.texcoords[i][1]);
+    }
+};
+
+#ifdef _WIN32
+inline DXGI_FORMAT ToDXGIFormat(VertexFormat format)
+{
+    switch (format)
+    {
+    case VertexFormat::Float2: return DXGI_FORMAT_R32G32_FLOAT;
+    case VertexFormat::Float3: return DXGI_FORMAT_R32G32B32_FLOAT;
+    case VertexFormat::Float4: return DXGI_FORMAT_R32G32B32A32_FLOAT;
+    }
+    return DXGI_FORMAT_UNKNOWN;
+}
+#endif
+
+// Interleaved vertex of the given attributes in order, tightly packed. The
+// offsets, the packer and the input layout all come from the attribute list,
+// so adding an attribute is a change of the list and of the shader.
+template <VertexAttribute... Attributes>
+struct VertexLayout
+{
+    static constexpr uint32_t COUNT = sizeof...(Attributes);
+    static constexpr std::array<VertexAttribute, COUNT> ATTRIBUTES = { Attributes... };
+    static constexpr std::array<uint32_t, COUNT> SIZES = {
+        static_cast<uint32_t>(sizeof(typename VertexAttributeTraits<Attributes>::Type))... };
+    static constexpr uint32_t STRIDE = (0 + ... + static_cast<uint32_t>(sizeof(typename VertexAttributeTraits<Attributes>::Type)));
+    // vertices per ParallelFor chunk of Pack
+    static constexpr size_t PACK_GRAIN = 1 << 15;
+
+    static constexpr bool Has(VertexAttribute attribute)
+    {
+        for (auto a: ATTRIBUTES)
+        {
+            if (a == attribute) return true;
+        }
+        return false;
+    }
+
+    static constexpr uint32_t OffsetOf(VertexAttribute attribute)
+    {
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < COUNT && ATTRIBUTES[i] != attribute; ++i) offset += SIZES[i];
+        return offset;
+    }
+
+    // One pass over the vertices on the task pool, every attribute is
+    // converted from its column straight into the interleaved vertex.
+    static void Pack(const VertexColumns& columns, size_t vertexCount, void* destination)
+    {
+        auto vertices = static_cast<uint8_t*>(destination);
+        TaskPool::GetInstance()->ParallelFor(vertexCount, PACK_GRAIN, [&columns, vertices](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+            {
+                uint8_t* vertex = vertices + i * STRIDE;
+                (VertexAttributeTraits<Attributes>::Pack(columns, i,
+                    *reinterpret_cast<typename VertexAttributeTraits<Attributes>::Type*>(vertex + OffsetOf(Attributes))), ...);
+            }
+        });
+    }
+
+#ifdef _WIN32
+    static std::array<D3D12_INPUT_ELEMENT_DESC, COUNT> GetInputElementDescs(UINT inputSlot = 0)
+    {
+        return { {
+            { VertexAttributeTraits<Attributes>::SEMANTIC, 0, ToDXGIFormat(VertexAttributeTraits<Attributes>::FORMAT),
+                inputSlot, OffsetOf(Attributes), D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }... } };
+    }
+#endif
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,750 @@
+#ifndef __GLTFHELPER_H__
+#define __GLTFHELPER_H__
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "MappedFile.h"
+#include "Utility.h"
+
+// glTF 2.0 reader for .glb files and .gltf files with external .bin buffers.
+// The files are memory mapped and accessors are handed out as views into the
+// mapping, nothing is copied until the caller converts or uploads it.
+namespace GltfHelper
+{
+    using std::string;
+    using std::vector;
+
+    // Just enough JSON for glTF documents.
+    class JsonValue
+    {
+    public:
+        enum class Type
+        {
+            Null,
+            Bool,
+            Number,
+            String,
+            Array,
+            Object
+        };
+
+        Type type = Type::Null;
+        bool boolean = false;
+        double number = 0.;
+        string text;
+        vector<JsonValue> items;
+        vector<std::pair<string, JsonValue>> members;
+
+        static const JsonValue& Null()
+        {
+            static const JsonValue null;
+            return null;
+        }
+
+        bool IsNull() const { return type == Type::Null; }
+        size_t Size() const { return type == Type::Array ? items.size() : members.size(); }
+
+        const JsonValue& operator[](size_t i) const
+        {
+            return type == Type::Array && i < items.size() ? items[i] : Null();
+        }
+        // a literal 0 would be ambiguous otherwise
+        const JsonValue& operator[](int i) const
+        {
+            return i < 0 ? Null() : (*this)[static_cast<size_t>(i)];
+        }
+        const JsonValue& operator[](const char* key) const
+        {
+            if (type != Type::Object) return Null();
+            for (auto& member: members)
+            {
+                if (member.first == key) return member.second;
+            }
+            return Null();
+        }
+
+        double AsNumber(double fallback = 0.) const
+        {
+            return type == Type::Number ? number : fallback;
+        }
+        // indices and counts, negative or fractional values are rejected
+        size_t AsIndex(size_t fallback = 0) const
+        {
+            if (type != Type::Number) return fallback;
+            if (number < 0. || number != std::floor(number) || number > 9007199254740992.)
+            {
+                throw std::runtime_error("gltf: invalid index");
+            }
+            return static_cast<size_t>(number);
+        }
+        const string& AsString() const
+        {
+            static const string empty;
+            return type == Type::String ? text : empty;
+        }
+    };
+
+    class JsonParser
+    {
+        static const int MAX_DEPTH = 64;
+
+        const char* m_cur;
+        const char* m_end;
+
+        [[noreturn]] void Fail(const char* what) const
+        {
+            throw std::runtime_error(string("gltf json: ") + what);
+        }
+
+        void SkipSpace()
+        {
+            while (m_cur < m_end && (*m_cur == ' ' || *m_cur == '\t' || *m_cur == '\n' || *m_cur == '\r')) m_cur++;
+        }
+
+        bool Consume(char c)
+        {
+            SkipSpace();
+            if (m_cur < m_end && *m_cur == c)
+            {
+                m_cur++;
+                return true;
+            }
+            return false;
+        }
+
+        void Expect(char c)
+        {
+            if (!Consume(c)) Fail("unexpected character");
+        }
+
+        bool ConsumeWord(const char* word)
+        {
+            size_t length = std::strlen(word);
+            if (static_cast<size_t>(m_end - m_cur) < length || std::memcmp(m_cur, word, length) != 0) return false;
+            m_cur += length;
+            return true;
+        }
+
+        static void AppendUtf8(string& out, uint32_t c)
+        {
+            if (c < 0x80) out += static_cast<char>(c);
+            else if (c < 0x800)
+            {
+                out += static_cast<char>(0xc0 | (c >> 6));
+                out += static_cast<char>(0x80 | (c & 0x3f));
+            }
+            else if (c < 0x10000)
+            {
+                out += static_cast<char>(0xe0 | (c >> 12));
+                out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (c & 0x3f));
+            }
+            else
+            {
+                out += static_cast<char>(0xf0 | (c >> 18));
+                out += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+                out += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+                out += static_cast<char>(0x80 | (c & 0x3f));
+            }
+        }
+
+        uint32_t ParseHex4()
+        {
+            if (m_end - m_cur < 4) Fail("truncated escape");
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i)
+            {
+                char c = *m_cur++;
+                value <<= 4;
+                if (c >= '0' && c <= '9') value |= c - '0';
+                else if (c >= 'a' && c <= 'f') value |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') value |= c - 'A' + 10;
+                else Fail("invalid escape");
+            }
+            return value;
+        }
+
+        string ParseString()
+        {
+            Expect('"');
+            string out;
+            while (true)
+            {
+                const char* start = m_cur;
+                while (m_cur < m_end && *m_cur != '"' && *m_cur != '\\') m_cur++;
+                out.append(start, m_cur);
+                if (m_cur >= m_end) Fail("unterminated string");
+                if (*m_cur++ == '"') return out;
+
+                if (m_cur >= m_end) Fail("unterminated string");
+                char c = *m_cur++;
+                switch (c)
+                {
+                case '"': out += '"'; break;
+                case '\\': out += '\\'; break;
+                case '/': out += '/'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u':
+                {
+                    uint32_t code = ParseHex4();
+                    if (code >= 0xd800 && code < 0xdc00 && m_end - m_cur >= 6 && m_cur[0] == '\\' && m_cur[1] == 'u')
+                    {
+                        m_cur += 2;
+                        uint32_t low = ParseHex4();
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    AppendUtf8(out, code);
+                    break;
+                }
+                default:
+                    Fail("invalid escape");
+                }
+            }
+        }
+
+        double ParseNumber()
+        {
+            const char* start = m_cur;
+            while (m_cur < m_end && *m_cur && (std::strchr("+-.eE", *m_cur) || (*m_cur >= '0' && *m_cur <= '9'))) m_cur++;
+            if (m_cur == start) Fail("unexpected character");
+            // the chunk is not null terminated
+            string token(start, m_cur);
+            char* parsed = nullptr;
+            double value = std::strtod(token.c_str(), &parsed);
+            if (parsed != token.c_str() + token.size()) Fail("invalid number");
+            return value;
+        }
+
+        void ParseValue(JsonValue& value, int depth)
+        {
+            if (depth > MAX_DEPTH) Fail("nested too deep");
+            SkipSpace();
+            if (m_cur >= m_end) Fail("unexpected end");
+
+            switch (*m_cur)
+            {
+            case '{':
+                m_cur++;
+                value.type = JsonValue::Type::Object;
+                if (Consume('}')) return;
+                do
+                {
+                    SkipSpace();
+                    value.members.emplace_back(ParseString(), JsonValue());
+                    Expect(':');
+                    ParseValue(value.members.back().second, depth + 1);
+                } while (Consume(','));
+                Expect('}');
+                return;
+            case '[':
+                m_cur++;
+                value.type = JsonValue::Type::Array;
+                if (Consume(']')) return;
+                do
+                {
+                    value.items.emplace_back();
+                    ParseValue(value.items.back(), depth + 1);
+                } while (Consume(','));
+                Expect(']');
+                return;
+            case '"':
+                value.type = JsonValue::Type::String;
+                value.text = ParseString();
+                return;
+            default:
+                if (ConsumeWord("true"))
+                {
+                    value.type = JsonValue::Type::Bool;
+                    value.boolean = true;
+                }
+                else if (ConsumeWord("false"))
+                {
+                    value.type = JsonValue::Type::Bool;
+                }
+                else if (ConsumeWord("null"))
+                {
+                    value.type = JsonValue::Type::Null;
+                }
+                else
+                {
+                    value.type = JsonValue::Type::Number;
+                    value.number = ParseNumber();
+                }
+            }
+        }
+
+    public:
+        JsonParser(const char* data, size_t size)
+            : m_cur(data)
+            , m_end(data + size)
+        {
+        }
+
+        JsonValue Parse()
+        {
+            JsonValue root;
+            ParseValue(root, 0);
+            SkipSpace();
+            // GLB pads the chunk with spaces, anything else is an error
+            while (m_cur < m_end && *m_cur == '\0') m_cur++;
+            if (m_cur != m_end) Fail("trailing characters");
+            return root;
+        }
+    };
+
+    enum ComponentType: uint32_t
+    {
+        BYTE = 5120,
+        UNSIGNED_BYTE = 5121,
+        SHORT = 5122,
+        UNSIGNED_SHORT = 5123,
+        UNSIGNED_INT = 5125,
+        FLOAT = 5126
+    };
+
+    enum PrimitiveMode: uint32_t
+    {
+        POINTS = 0,
+        LINES = 1,
+        LINE_LOOP = 2,
+        LINE_STRIP = 3,
+        TRIANGLES = 4,
+        TRIANGLE_STRIP = 5,
+        TRIANGLE_FAN = 6
+    };
+
+    inline size_t ComponentSize(uint32_t componentType)
+    {
+        switch (componentType)
+        {
+        case BYTE:
+        case UNSIGNED_BYTE: return 1;
+        case SHORT:
+        case UNSIGNED_SHORT: return 2;
+        case UNSIGNED_INT:
+        case FLOAT: return 4;
+        default: return 0;
+        }
+    }
+
+    inline uint32_t ComponentCount(const string& type)
+    {
+        if (type == "SCALAR") return 1;
+        if (type == "VEC2") return 2;
+        if (type == "VEC3") return 3;
+        if (type == "VEC4") return 4;
+        if (type == "MAT2") return 4;
+        if (type == "MAT3") return 9;
+        if (type == "MAT4") return 16;
+        return 0;
+    }
+
+    // Bytes of a buffer, stride is 0 unless the view is interleaved.
+    struct BufferSpan
+    {
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+        size_t stride = 0;
+    };
+
+    // An accessor as a strided range of the mapped file.
+    struct AccessorView
+    {
+        const uint8_t* data = nullptr;
+        size_t count = 0;
+        // distance between elements, at least the element size
+        size_t stride = 0;
+        uint32_t componentType = 0;
+        uint32_t components = 0;
+        bool normalized = false;
+
+        size_t ElementSize() const { return ComponentSize(componentType) * components; }
+        // Elements are back to back, data can go to an upload buffer as is.
+        bool IsPacked() const { return stride == ElementSize(); }
+
+        template <typename T>
+        const T& At(size_t i) const
+        {
+            return *reinterpret_cast<const T*>(data + stride * i);
+        }
+
+        // component c of element i converted to float, normalized integers
+        // map to [0, 1] or [-1, 1]
+        float ReadFloat(size_t i, uint32_t c) const
+        {
+            const uint8_t* p = data + stride * i + ComponentSize(componentType) * c;
+            switch (componentType)
+            {
+            case FLOAT: { float v; std::memcpy(&v, p, 4); return v; }
+            case UNSIGNED_INT: { uint32_t v; std::memcpy(&v, p, 4); return static_cast<float>(v); }
+            case UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); return normalized ? v / 65535.f : v; }
+            case SHORT: { int16_t v; std::memcpy(&v, p, 2); return normalized ? std::max(v / 32767.f, -1.f) : v; }
+            case UNSIGNED_BYTE: return normalized ? *p / 255.f : *p;
+            case BYTE: { int8_t v = static_cast<int8_t>(*p); return normalized ? std::max(v / 127.f, -1.f) : v; }
+            default: return 0.f;
+            }
+        }
+
+        uint32_t ReadIndex(size_t i) const
+        {
+            const uint8_t* p = data + stride * i;
+            switch (componentType)
+            {
+            case UNSIGNED_INT: { uint32_t v; std::memcpy(&v, p, 4); return v; }
+            case UNSIGNED_SHORT: { uint16_t v; std::memcpy(&v, p, 2); return v; }
+            case UNSIGNED_BYTE: return *p;
+            default: return 0;
+            }
+        }
+
+        // Copy count elements to dst, one block when neither side is strided.
+        void CopyTo(void* dst, size_t dstStride) const
+        {
+            size_t elementSize = ElementSize();
+            uint8_t* out = static_cast<uint8_t*>(dst);
+            if (IsPacked() && dstStride == elementSize)
+            {
+                std::memcpy(out, data, elementSize * count);
+                return;
+            }
+            for (size_t i = 0; i < count; ++i) std::memcpy(out + dstStride * i, data + stride * i, elementSize);
+        }
+    };
+
+    struct Primitive
+    {
+        // accessor indices, -1 if missing
+        int position = -1;
+        int normal = -1;
+        int indices = -1;
+        uint32_t mode = TRIANGLES;
+    };
+
+    struct Mesh
+    {
+        string name;
+        vector<Primitive> primitives;
+    };
+
+    // column major, as glTF stores it
+    using Matrix = std::array<double, 16>;
+
+    inline Matrix Identity()
+    {
+        return { 1., 0., 0., 0., 0., 1., 0., 0., 0., 0., 1., 0., 0., 0., 0., 1. };
+    }
+
+    inline Matrix Multiply(const Matrix& a, const Matrix& b)
+    {
+        Matrix r;
+        for (int col = 0; col < 4; ++col)
+        {
+            for (int row = 0; row < 4; ++row)
+            {
+                double sum = 0.;
+                for (int k = 0; k < 4; ++k) sum += a[k * 4 + row] * b[col * 4 + k];
+                r[col * 4 + row] = sum;
+            }
+        }
+        return r;
+    }
+
+    struct Node
+    {
+        string name;
+        int mesh = -1;
+        vector<uint32_t> children;
+        // local transform
+        Matrix matrix = Identity();
+    };
+
+    class GltfFile
+    {
+        MappedFile m_file;
+        // external .bin files of a .gltf, the GLB binary chunk is buffers[0]
+        vector<MappedFile> m_externalBuffers;
+        vector<BufferSpan> m_buffers;
+        vector<BufferSpan> m_bufferViews;
+        vector<AccessorView> m_accessors;
+        vector<Mesh> m_meshes;
+        vector<Node> m_nodes;
+        vector<uint32_t> m_sceneNodes;
+
+        static const uint32_t GLB_MAGIC = 0x46546c67;      // "glTF"
+        static const uint32_t CHUNK_JSON = 0x4e4f534a;     // "JSON"
+        static const uint32_t CHUNK_BIN = 0x004e4942;      // "BIN\0"
+
+        [[noreturn]] static void Fail(const string& what)
+        {
+            throw std::runtime_error("gltf: " + what);
+        }
+
+        static uint32_t ReadU32(const uint8_t* p)
+        {
+            uint32_t v;
+            std::memcpy(&v, p, 4);
+            return v;
+        }
+
+        static Matrix ComposeTRS(const JsonValue& node)
+        {
+            double t[3] = { 0., 0., 0. };
+            double q[4] = { 0., 0., 0., 1. };
+            double s[3] = { 1., 1., 1. };
+            for (int i = 0; i < 3; ++i) t[i] = node["translation"][i].AsNumber(t[i]);
+            for (int i = 0; i < 4; ++i) q[i] = node["rotation"][i].AsNumber(q[i]);
+            for (int i = 0; i < 3; ++i) s[i] = node["scale"][i].AsNumber(s[i]);
+
+            double x = q[0], y = q[1], z = q[2], w = q[3];
+            Matrix m = {
+                (1. - 2. * (y * y + z * z)) * s[0], (2. * (x * y + z * w)) * s[0], (2. * (x * z - y * w)) * s[0], 0.,
+                (2. * (x * y - z * w)) * s[1], (1. - 2. * (x * x + z * z)) * s[1], (2. * (y * z + x * w)) * s[1], 0.,
+                (2. * (x * z + y * w)) * s[2], (2. * (y * z - x * w)) * s[2], (1. - 2. * (x * x + y * y)) * s[2], 0.,
+                t[0], t[1], t[2], 1.
+            };
+            return m;
+        }
+
+        void ParseDocument(const JsonValue& root, const string& directory)
+        {
+            if (root["asset"]["version"].AsString().compare(0, 1, "2") != 0) Fail("only glTF 2.0 is supported");
+
+            auto& buffers = root["buffers"];
+            for (size_t i = 0; i < buffers.Size(); ++i)
+            {
+                auto& uri = buffers[i]["uri"].AsString();
+                size_t byteLength = buffers[i]["byteLength"].AsIndex();
+                if (uri.empty())
+                {
+                    // the GLB binary chunk
+                    if (i != 0 || m_buffers.empty()) Fail("buffer without data");
+                    if (m_buffers[0].size < byteLength) Fail("binary chunk shorter than its buffer");
+                    continue;
+                }
+                if (uri.compare(0, 5, "data:") == 0) Fail("data uris are not supported");
+
+                MappedFile external;
+                std::wstring path = Util::ToWideString(directory + uri);
+                if (!external.Open(path)) Fail("cannot open " + uri);
+                if (external.GetSize() < byteLength) Fail(uri + " is shorter than its buffer");
+                if (m_buffers.size() <= i) m_buffers.resize(i + 1);
+                m_buffers[i] = { external.GetData(), byteLength, 0 };
+                m_externalBuffers.emplace_back(std::move(external));
+            }
+            if (m_buffers.size() < buffers.Size()) m_buffers.resize(buffers.Size());
+
+            auto& views = root["bufferViews"];
+            for (size_t i = 0; i < views.Size(); ++i)
+            {
+                auto& view = views[i];
+                size_t buffer = view["buffer"].AsIndex(~size_t(0));
+                size_t offset = view["byteOffset"].AsIndex();
+                size_t length = view["byteLength"].AsIndex();
+                if (buffer >= m_buffers.size() || !m_buffers[buffer].data) Fail("buffer view without buffer");
+                if (offset > m_buffers[buffer].size || length > m_buffers[buffer].size - offset) Fail("buffer view out of range");
+                m_bufferViews.push_back({ m_buffers[buffer].data + offset, length, view["byteStride"].AsIndex() });
+            }
+
+            auto& accessors = root["accessors"];
+            for (size_t i = 0; i < accessors.Size(); ++i)
+            {
+                auto& accessor = accessors[i];
+                if (!accessor["sparse"].IsNull()) Fail("sparse accessors are not supported");
+                AccessorView a;
+                a.componentType = static_cast<uint32_t>(accessor["componentType"].AsIndex());
+                a.components = ComponentCount(accessor["type"].AsString());
+                a.count = accessor["count"].AsIndex();
+                a.normalized = accessor["normalized"].boolean;
+                size_t elementSize = a.ElementSize();
+                if (elementSize == 0) Fail("unknown accessor type");
+
+                size_t viewIndex = accessor["bufferView"].AsIndex(~size_t(0));
+                if (viewIndex >= m_bufferViews.size())
+                {
+                    // all zeros per spec, which no mesh we draw relies on
+                    m_accessors.push_back(AccessorView());
+                    continue;
+                }
+                auto& view = m_bufferViews[viewIndex];
+                size_t offset = accessor["byteOffset"].AsIndex();
+                a.stride = view.stride ? view.stride : elementSize;
+                if (a.stride < elementSize) Fail("byte stride smaller than the element");
+                if (offset > view.size) Fail("accessor out of range");
+                if (a.count > 0 && (view.size - offset < elementSize || (view.size - offset - elementSize) / a.stride < a.count - 1))
+                {
+                    Fail("accessor out of range");
+                }
+                a.data = view.data + offset;
+                m_accessors.push_back(a);
+            }
+
+            auto& meshes = root["meshes"];
+            for (size_t i = 0; i < meshes.Size(); ++i)
+            {
+                Mesh mesh;
+                mesh.name = meshes[i]["name"].AsString();
+                auto& primitives = meshes[i]["primitives"];
+                for (size_t p = 0; p < primitives.Size(); ++p)
+                {
+                    auto& primitive = primitives[p];
+                    Primitive prim;
+                    auto accessorIndex = [this](const JsonValue& v) {
+                        if (v.IsNull()) return -1;
+                        size_t index = v.AsIndex();
+                        if (index >= m_accessors.size()) Fail("missing accessor");
+                        return static_cast<int>(index);
+                    };
+                    prim.position = accessorIndex(primitive["attributes"]["POSITION"]);
+                    prim.normal = accessorIndex(primitive["attributes"]["NORMAL"]);
+                    prim.indices = accessorIndex(primitive["indices"]);
+                    prim.mode = static_cast<uint32_t>(primitive["mode"].AsIndex(TRIANGLES));
+                    mesh.primitives.push_back(prim);
+                }
+                m_meshes.push_back(std::move(mesh));
+            }
+
+            auto& nodes = root["nodes"];
+            for (size_t i = 0; i < nodes.Size(); ++i)
+            {
+                auto& node = nodes[i];
+                Node n;
+                n.name = node["name"].AsString();
+                size_t mesh = node["mesh"].AsIndex(~size_t(0));
+                if (!node["mesh"].IsNull())
+                {
+                    if (mesh >= m_meshes.size()) Fail("missing mesh");
+                    n.mesh = static_cast<int>(mesh);
+                }
+                for (size_t c = 0; c < node["children"].Size(); ++c)
+                {
+                    size_t child = node["children"][c].AsIndex();
+                    if (child >= nodes.Size()) Fail("missing node");
+                    n.children.push_back(static_cast<uint32_t>(child));
+                }
+                if (node["matrix"].Size() == 16)
+                {
+                    for (int k = 0; k < 16; ++k) n.matrix[k] = node["matrix"][k].AsNumber();
+                }
+                else n.matrix = ComposeTRS(node);
+                m_nodes.push_back(std::move(n));
+            }
+
+            auto& scenes = root["scenes"];
+            size_t scene = root["scene"].AsIndex(0);
+            if (scene < scenes.Size())
+            {
+                for (size_t i = 0; i < scenes[scene]["nodes"].Size(); ++i)
+                {
+                    size_t node = scenes[scene]["nodes"][i].AsIndex();
+                    if (node >= m_nodes.size()) Fail("missing node");
+                    m_sceneNodes.push_back(static_cast<uint32_t>(node));
+                }
+            }
+            else
+            {
+                // no scene, draw every node that is not a child
+                vector<bool> isChild(m_nodes.size(), false);
+                for (auto& node: m_nodes)
+                {
+                    for (auto child: node.children) isChild[child] = true;
+                }
+                for (uint32_t i = 0; i < m_nodes.size(); ++i)
+                {
+                    if (!isChild[i]) m_sceneNodes.push_back(i);
+                }
+            }
+        }
+
+    public:
+        GltfFile() = default;
+        GltfFile(const std::wstring& filePath)
+        {
+            Open(filePath);
+        }
+
+        void Open(const std::wstring& filePath)
+        {
+            if (!m_file.Open(filePath)) Fail("cannot open " + Util::ToByteString(filePath));
+            const uint8_t* data = m_file.GetData();
+            size_t size = m_file.GetSize();
+
+            const char* json = nullptr;
+            size_t jsonSize = 0;
+            if (size >= 12 && ReadU32(data) == GLB_MAGIC)
+            {
+                if (ReadU32(data + 4) != 2) Fail("only GLB version 2 is supported");
+                size_t length = std::min<size_t>(ReadU32(data + 8), size);
+                size_t offset = 12;
+                while (offset + 8 <= length)
+                {
+                    size_t chunkLength = ReadU32(data + offset);
+                    uint32_t chunkType = ReadU32(data + offset + 4);
+                    offset += 8;
+                    if (chunkLength > length - offset) Fail("truncated chunk");
+                    if (chunkType == CHUNK_JSON && !json)
+                    {
+                        json = reinterpret_cast<const char*>(data + offset);
+                        jsonSize = chunkLength;
+                    }
+                    else if (chunkType == CHUNK_BIN && m_buffers.empty())
+                    {
+                        m_buffers.push_back({ data + offset, chunkLength, 0 });
+                    }
+                    offset += (chunkLength + 3) & ~size_t(3);
+                }
+                if (!json) Fail("no JSON chunk");
+            }
+            else
+            {
+                json = reinterpret_cast<const char*>(data);
+                jsonSize = size;
+            }
+
+            string path = Util::ToByteString(filePath);
+            size_t slash = path.find_last_of("/\\");
+            string directory = slash == string::npos ? string() : path.substr(0, slash + 1);
+            ParseDocument(JsonParser(json, jsonSize).Parse(), directory);
+        }
+
+        size_t GetFileSize() const { return m_file.GetSize(); }
+        const vector<BufferSpan>& GetBufferViews() const { return m_bufferViews; }
+        const vector<AccessorView>& GetAccessors() const { return m_accessors; }
+        const vector<Mesh>& GetMeshes() const { return m_meshes; }
+        const vector<Node>& GetNodes() const { return m_nodes; }
+        const vector<uint32_t>& GetSceneNodes() const { return m_sceneNodes; }
+
+        // fn(node, world matrix) for every node of the scene, parents first
+        void VisitNodes(const std::function<void(const Node&, const Matrix&)>& fn) const
+        {
+            vector<std::pair<uint32_t, Matrix>> stack;
+            for (auto it = m_sceneNodes.rbegin(); it != m_sceneNodes.rend(); ++it) stack.emplace_back(*it, Identity());
+            size_t visited = 0;
+            while (!stack.empty())
+            {
+                auto top = stack.back();
+                stack.pop_back();
+                // every node has at most one parent, more visits mean a cycle
+                if (++visited > m_nodes.size()) Fail("node hierarchy is not a tree");
+
+                auto& node = m_nodes[top.first];
+                Matrix world = Multiply(top.second, node.matrix);
+                fn(node, world);
+                for (auto it = node.children.rbegin(); it != node.children.rend(); ++it) stack.emplace_back(*it, world);
+            }
+        }
+    };
+}
+#endif
@@ -0,0 +1,134 @@
+#ifndef __HASH_H__
+#define __HASH_H__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace Hash
+{
+    // XXH64, fast enough to hash model files on every load.
+    namespace Detail
+    {
+        const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+        const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+        const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+        const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+        const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+        inline uint64_t Rotl(uint64_t x, int r)
+        {
+            return (x << r) | (x >> (64 - r));
+        }
+        inline uint64_t Read64(const uint8_t* p)
+        {
+            uint64_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        inline uint32_t Read32(const uint8_t* p)
+        {
+            uint32_t v;
+            std::memcpy(&v, p, sizeof(v));
+            return v;
+        }
+        inline uint64_t Round(uint64_t acc, uint64_t input)
+        {
+            acc += input * PRIME2;
+            acc = Rotl(acc, 31);
+            return acc * PRIME1;
+        }
+        inline uint64_t Merge(uint64_t acc, uint64_t value)
+        {
+            acc ^= Round(0, value);
+            return acc * PRIME1 + PRIME4;
+        }
+    }
+
+    inline uint64_t Hash64(const void* data, size_t size, uint64_t seed = 0)
+    {
+        using namespace Detail;
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        const uint8_t* end = p + size;
+        uint64_t h;
+
+        if (size >= 32)
+        {
+            uint64_t v1 = seed + PRIME1 + PRIME2;
+            uint64_t v2 = seed + PRIME2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - PRIME1;
+            const uint8_t* limit = end - 32;
+            do
+            {
+                v1 = Round(v1, Read64(p));
+                v2 = Round(v2, Read64(p + 8));
+                v3 = Round(v3, Read64(p + 16));
+                v4 = Round(v4, Read64(p + 24));
+                p += 32;
+            } while (p <= limit);
+
+            h = Rotl(v1, 1) + Rotl(v2, 7) + Rotl(v3, 12) + Rotl(v4, 18);
+            h = Merge(h, v1);
+            h = Merge(h, v2);
+            h = Merge(h, v3);
+            h = Merge(h, v4);
+        }
+        else
+        {
+            h = seed + PRIME5;
+        }
+        h += static_cast<uint64_t>(size);
+
+        for (; p + 8 <= end; p += 8)
+        {
+            h ^= Round(0, Read64(p));
+            h = Rotl(h, 27) * PRIME1 + PRIME4;
+        }
+        if (p + 4 <= end)
+        {
+            h ^= static_cast<uint64_t>(Read32(p)) * PRIME1;
+            h = Rotl(h, 23) * PRIME2 + PRIME3;
+            p += 4;
+        }
+        for (; p < end; ++p)
+        {
+            h ^= (*p) * PRIME5;
+            h = Rotl(h, 11) * PRIME1;
+        }
+
+        h ^= h >> 33;
+        h *= PRIME2;
+        h ^= h >> 29;
+        h *= PRIME3;
+        h ^= h >> 32;
+        return h;
+    }
+
+    inline uint64_t Hash64(const std::wstring& s, uint64_t seed = 0)
+    {
+        return Hash64(s.data(), s.size() * sizeof(wchar_t), seed);
+    }
+
+    // Two independently seeded XXH64, for keys where a collision would
+    // silently alias different content.
+    struct Hash128
+    {
+        uint64_t low = 0;
+        uint64_t high = 0;
+
+        bool operator==(const Hash128& h) const { return low == h.low && high == h.high; }
+        bool operator!=(const Hash128& h) const { return !(*this == h); }
+    };
+
+    // Chain several buffers by passing the previous result as seed.
+    inline Hash128 Hash128Of(const void* data, size_t size, const Hash128& seed = Hash128())
+    {
+        Hash128 h;
+        h.low = Hash64(data, size, seed.low);
+        h.high = Hash64(data, size, seed.high ^ 0x9E3779B97F4A7C15ull);
+        return h;
+    }
+}
+
+#endif
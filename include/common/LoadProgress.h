@@ -0,0 +1,102 @@
+#ifndef __LOADPROGRESS_H__
+#define __LOADPROGRESS_H__
+
+#include <atomic>
+#include <fstream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+enum class LoadStage: uint32_t
+{
+    Queued,
+    Reading,    // parsing the file
+    Processing, // normals, bounds and post processing passes
+    Done,
+    Failed,
+    Cancelled
+};
+
+class LoadCancelled : public std::runtime_error
+{
+public:
+    LoadCancelled() : std::runtime_error("loading cancelled") {}
+};
+
+// Shared between a loader running on a worker thread and the thread waiting
+// for it. The loader only writes the counters, the waiter only requests
+// cancellation.
+struct LoadProgress
+{
+    std::atomic<LoadStage> stage{ LoadStage::Queued };
+    std::atomic<uint64_t> bytesParsed{ 0 };
+    std::atomic<uint64_t> totalBytes{ 0 };
+    std::atomic<bool> cancelRequested{ false };
+
+    void ThrowIfCancelled() const
+    {
+        if (cancelRequested.load(std::memory_order_relaxed)) throw LoadCancelled();
+    }
+};
+
+// File input that adds every consumed buffer to LoadProgress::bytesParsed and
+// aborts the parser with LoadCancelled once cancellation was requested.
+class ProgressStreamBuf : public std::streambuf
+{
+    static const size_t BUFFER_SIZE = 1 << 16;
+
+    std::filebuf m_file;
+    std::vector<char> m_buffer;
+    LoadProgress* m_progress;
+
+protected:
+    int_type underflow() override
+    {
+        if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+        if (m_progress) m_progress->ThrowIfCancelled();
+
+        std::streamsize size = m_file.sgetn(m_buffer.data(), m_buffer.size());
+        if (size <= 0) return traits_type::eof();
+        if (m_progress) m_progress->bytesParsed += static_cast<uint64_t>(size);
+
+        setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + size);
+        return traits_type::to_int_type(*gptr());
+    }
+
+public:
+    ProgressStreamBuf(const std::string& filePath, LoadProgress* progress)
+        : m_buffer(BUFFER_SIZE)
+        , m_progress(progress)
+    {
+        if (!m_file.open(filePath, std::ios::in | std::ios::binary))
+        {
+            throw std::runtime_error("cannot open " + filePath);
+        }
+        if (m_progress)
+        {
+            auto size = m_file.pubseekoff(0, std::ios::end, std::ios::in);
+            m_file.pubseekpos(0, std::ios::in);
+            m_progress->totalBytes = size > 0 ? static_cast<uint64_t>(size) : 0;
+            m_progress->bytesParsed = 0;
+        }
+        setg(m_buffer.data(), m_buffer.data(), m_buffer.data());
+    }
+};
+
+class ProgressStream : public std::istream
+{
+    ProgressStreamBuf m_buffer;
+
+public:
+    ProgressStream(const std::string& filePath, LoadProgress* progress)
+        : std::istream(nullptr)
+        , m_buffer(filePath, progress)
+    {
+        rdbuf(&m_buffer);
+        // let LoadCancelled thrown by the buffer reach the loader
+        exceptions(std::ios::badbit);
+    }
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+#include <string>
+#include <cstdint>
+
+// Read-only view of a whole file. Pages are only read when they are touched,
+// so opening is cheap and reading is limited by page-in speed.
+class MappedFile
+{
+private:
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_file = nullptr;
+    void* m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    // false if the file does not exist or cannot be mapped, empty files
+    // cannot be mapped either
+    bool Open(const std::wstring& filePath);
+    void Close();
+
+    bool IsOpen() const { return m_data != nullptr; }
+    const uint8_t* GetData() const { return m_data; }
+    size_t GetSize() const { return m_size; }
+};
+
+#endif
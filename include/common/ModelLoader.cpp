@@ -1,7 +1,14 @@
 #include "ModelLoader.h"
 #include "PlyHelper.h"
 #include "ObjHelper.h"
+#include "GltfHelper.h"
+#include "MappedFile.h"
+#include "TaskPool.h"
 #include <cassert>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
 
 std::unique_ptr<ModelLoader> ModelLoader::CreateModelLoader(ModelType type)
 {
@@ -13,12 +20,21 @@ std::unique_ptr<ModelLoader> ModelLoader::CreateModelLoader(ModelType type)
     //TODO
     case ModelType::OBJ:
         return std::make_unique<OBJModelLoader>();
+    case ModelType::GLTF:
+        return std::make_unique<GLTFModelLoader>();
+    case ModelType::STL:
+        return std::make_unique<STLModelLoader>();
     default:
-        throw std::exception("Unimplemented type");
+        throw std::runtime_error("Unimplemented type");
     }
     return nullptr;
 }
 
+void ModelLoader::SetProgress(LoadProgress* progress)
+{
+    m_progress = progress;
+}
+
 std::vector<std::array<double, 3>> ModelLoader::GetPositions()
 {
     return m_positions;
@@ -31,8 +47,22 @@ std::vector<uint32_t> ModelLoader::GetIndicies()
 {
     return m_indicies;
 }
+size_t ModelLoader::GetVertexCount() const
+{
+    return m_positions.size();
+}
+VertexColumns ModelLoader::GetColumns() const
+{
+    size_t count = m_positions.size();
+    VertexColumns columns;
+    columns.positions = m_positions.data();
+    if (m_normals.size() == count && count > 0) columns.normals = m_normals.data();
+    if (m_colors.size() == count && count > 0) columns.colors = m_colors.data();
+    if (m_texcoords.size() == count && count > 0) columns.texcoords = m_texcoords.data();
+    return columns;
+}
 
-void ModelLoader::SetPositions(std::vector<std::array<double, 3>>& positions)
+void ModelLoader::SetPositions(const std::vector<std::array<double, 3>>& positions)
 {
     m_positions = positions;
 }
@@ -41,7 +71,7 @@ void ModelLoader::SetPositions(std::vector<std::array<double, 3>>& positions)
 // Note that the face list generates triangles in the order of a TRIANGLE FAN, not a TRIANGLE STRIP. In the example above, the first face
 //   4 0 1 2 3
 // Is composed of the triangles 0,1,2 and 0,2,3 and not 0,1,2 and 1,2,3.
-static void CutPolygon(std::vector<uint32_t>& polygon, std::vector<std::array<uint32_t, 3>>& triangles)
+static void CutPolygon(const std::vector<uint32_t>& polygon, std::vector<std::array<uint32_t, 3>>& triangles)
 {
     uint32_t i0 = 0;
     // uint32_t i1 = 1;
@@ -54,7 +84,7 @@ static void CutPolygon(std::vector<uint32_t>& polygon, std::vector<std::array<ui
     return ;
 }
 
-void ModelLoader::SetIndicies(std::vector<std::vector<uint32_t>>& faces)
+void ModelLoader::SetIndicies(const std::vector<std::vector<uint32_t>>& faces)
 {
     std::vector<uint32_t> indicies;
     for(auto& face: faces)
@@ -82,7 +112,7 @@ void ModelLoader::Reconstruct()
     maxY = minY = m_positions[0][1];
     maxZ = minZ = m_positions[0][2];
 
-    for (int i = 1; i < m_positions.size(); ++i)
+    for (size_t i = 1; i < m_positions.size(); ++i)
     {
         if (m_positions[i][0] > maxX) maxX = m_positions[i][0];
         if (m_positions[i][0] < minX) minX = m_positions[i][0];
@@ -101,7 +131,7 @@ void ModelLoader::Reconstruct()
     float rangeZ = maxZ - minZ;
     float range = std::max(rangeX, std::max(rangeY, rangeZ)) / 2.;
 
-    for (int i = 0; i < m_positions.size(); ++i)
+    for (size_t i = 0; i < m_positions.size(); ++i)
     {
         m_positions[i][0] = (m_positions[i][0] - offsetX) / range;
         m_positions[i][1] = (m_positions[i][1] - offsetY) / range;
@@ -110,20 +140,50 @@ void ModelLoader::Reconstruct()
 }
 
 #pragma region PLY
-void PLYModelLoader::LoadFromFile(std::wstring& filePath)
+void PLYModelLoader::LoadFromFile(const std::wstring& filePath)
 {
-    happly::PLYData plyIn(Util::ToByteString(filePath));
+    ProgressStream in(Util::ToByteString(filePath), m_progress);
+    happly::PLYData plyIn(in);
     SetPositions(plyIn.getVertexPositions());
-    SetIndicies(plyIn.getFaceIndices<uint32_t>());
+    auto& vertexElement = plyIn.getElement("vertex");
+    if (vertexElement.hasPropertyType<unsigned char>("red") && vertexElement.hasPropertyType<unsigned char>("green")
+        && vertexElement.hasPropertyType<unsigned char>("blue"))
+    {
+        auto colors = plyIn.getVertexColors();
+        m_colors.resize(colors.size());
+        for (size_t i = 0; i < colors.size(); ++i)
+        {
+            m_colors[i] = { colors[i][0] / 255.f, colors[i][1] / 255.f, colors[i][2] / 255.f, 1.f };
+        }
+    }
+    if (plyIn.hasElement("face"))
+    {
+        SetIndicies(plyIn.getFaceIndices<uint32_t>());
+    }
+    else
+    {
+        // a scan with only a vertex element, it loads as a point cloud and
+        // keeps the scanner normals if there are any
+        m_indicies.clear();
+        if (vertexElement.hasProperty("nx") && vertexElement.hasProperty("ny") && vertexElement.hasProperty("nz"))
+        {
+            auto nx = vertexElement.getProperty<double>("nx");
+            auto ny = vertexElement.getProperty<double>("ny");
+            auto nz = vertexElement.getProperty<double>("nz");
+            m_normals.resize(nx.size());
+            for (size_t i = 0; i < nx.size(); ++i) m_normals[i] = { nx[i], ny[i], nz[i] };
+        }
+    }
 
     m_initialized = true;
 }
 #pragma endregion
 
 #pragma region OBJ
-void OBJModelLoader::LoadFromFile(std::wstring& filePath)
+void OBJModelLoader::LoadFromFile(const std::wstring& filePath)
 {
-    ObjHelper::ObjLoader objIn(Util::ToByteString(filePath));
+    ProgressStream in(Util::ToByteString(filePath), m_progress);
+    ObjHelper::ObjLoader objIn(in);
     SetPositions(objIn.GetverticesPosition());
 
     auto normals = objIn.GetVerticesNormal();
@@ -138,6 +198,29 @@ void OBJModelLoader::LoadFromFile(std::wstring& filePath)
         SetIndiciesAndNormals(facesVertexIndex, facesNormalIndex, normals);
     }
 
+    // texture coordinates are per corner, a position takes those of its first
+    // corner that has any
+    auto uvws = objIn.GetVerticesUVW();
+    if (uvws.size() > 0)
+    {
+        auto facesVertexIndex = objIn.GetFacesVertexIndex();
+        auto facesUVWIndex = objIn.GetFacesVertexUVWIndex();
+        std::vector<uint8_t> assigned(m_positions.size(), 0);
+        m_texcoords.assign(m_positions.size(), { 0.f, 0.f });
+        for (size_t i = 0; i < facesVertexIndex.size(); ++i)
+        {
+            for (size_t j = 0; j < facesVertexIndex[i].size() && j < facesUVWIndex[i].size(); ++j)
+            {
+                uint32_t vertex = facesVertexIndex[i][j];
+                uint32_t uvw = facesUVWIndex[i][j];
+                if (vertex >= m_positions.size() || uvw >= uvws.size() || assigned[vertex]) continue;
+                m_texcoords[vertex] = { static_cast<float>(uvws[uvw][0]), static_cast<float>(uvws[uvw][1]) };
+                assigned[vertex] = 1;
+            }
+        }
+    }
+
+    m_initialized = true;
 }
 
 namespace
@@ -164,10 +247,10 @@ void OBJModelLoader::SetIndiciesAndNormals(std::vector<std::vector<uint32_t>>& f
     m_normals.resize(m_positions.size());
     std::fill(m_normals.begin(), m_normals.end(), std::array<double, 3>{0., 0., 0.});
 
-    for (int i = 0; i < facesVertex.size(); i++)
+    for (size_t i = 0; i < facesVertex.size(); i++)
     {
         assert(facesVertex[i].size() >= 3 && "model format error.");
-        for (int j = 0; j < facesVertex[i].size(); j++)
+        for (size_t j = 0; j < facesVertex[i].size(); j++)
         {
             if (facesNormal[i].size() > j)
             {
@@ -187,3 +270,339 @@ void OBJModelLoader::SetIndiciesAndNormals(std::vector<std::vector<uint32_t>>& f
     }
 }
 #pragma endregion
+
+
+#pragma region GLTF
+void GLTFModelLoader::LoadFromFile(const std::wstring& filePath)
+{
+    if (m_progress) m_progress->ThrowIfCancelled();
+    GltfHelper::GltfFile file(filePath);
+    if (m_progress) m_progress->totalBytes = file.GetFileSize();
+
+    auto& accessors = file.GetAccessors();
+    auto& meshes = file.GetMeshes();
+    bool hasNormals = true;
+    std::vector<std::array<double, 3>> positions;
+    std::vector<std::array<double, 3>> normals;
+    std::vector<uint32_t> indicies;
+
+    file.VisitNodes([&](const GltfHelper::Node& node, const GltfHelper::Matrix& world) {
+        if (node.mesh < 0) return;
+        if (m_progress) m_progress->ThrowIfCancelled();
+
+        // normals go through the cofactor matrix, the inverse transpose up to
+        // a scale that normalizing removes
+        const auto& m = world;
+        double normalMatrix[9] = {
+            m[5] * m[10] - m[6] * m[9], m[6] * m[8] - m[4] * m[10], m[4] * m[9] - m[5] * m[8],
+            m[9] * m[2] - m[10] * m[1], m[10] * m[0] - m[8] * m[2], m[8] * m[1] - m[9] * m[0],
+            m[1] * m[6] - m[2] * m[5], m[2] * m[4] - m[0] * m[6], m[0] * m[5] - m[1] * m[4],
+        };
+        // mirroring transforms flip the winding
+        double determinant = m[0] * normalMatrix[0] + m[4] * normalMatrix[1] + m[8] * normalMatrix[2];
+
+        for (auto& primitive: meshes[node.mesh].primitives)
+        {
+            if (primitive.mode != GltfHelper::TRIANGLES || primitive.position < 0) continue;
+            auto& position = accessors[primitive.position];
+            if (position.componentType != GltfHelper::FLOAT || position.components != 3 || !position.data)
+            {
+                throw std::runtime_error("gltf: positions must be float3");
+            }
+
+            uint32_t base = static_cast<uint32_t>(positions.size());
+            positions.reserve(base + position.count);
+            for (size_t i = 0; i < position.count; ++i)
+            {
+                const float* p = &position.At<float>(i);
+                positions.push_back({
+                    m[0] * p[0] + m[4] * p[1] + m[8] * p[2] + m[12],
+                    m[1] * p[0] + m[5] * p[1] + m[9] * p[2] + m[13],
+                    m[2] * p[0] + m[6] * p[1] + m[10] * p[2] + m[14] });
+            }
+
+            if (primitive.normal >= 0 && accessors[primitive.normal].components == 3
+                && accessors[primitive.normal].count == position.count && accessors[primitive.normal].data)
+            {
+                auto& normal = accessors[primitive.normal];
+                normals.reserve(base + normal.count);
+                for (size_t i = 0; i < normal.count; ++i)
+                {
+                    double n[3] = { normal.ReadFloat(i, 0), normal.ReadFloat(i, 1), normal.ReadFloat(i, 2) };
+                    normals.push_back({
+                        normalMatrix[0] * n[0] + normalMatrix[3] * n[1] + normalMatrix[6] * n[2],
+                        normalMatrix[1] * n[0] + normalMatrix[4] * n[1] + normalMatrix[7] * n[2],
+                        normalMatrix[2] * n[0] + normalMatrix[5] * n[1] + normalMatrix[8] * n[2] });
+                }
+            }
+            else hasNormals = false;
+
+            size_t first = indicies.size();
+            if (primitive.indices >= 0)
+            {
+                auto& index = accessors[primitive.indices];
+                if (index.components != 1 || !index.data || index.componentType == GltfHelper::FLOAT
+                    || index.componentType == GltfHelper::BYTE || index.componentType == GltfHelper::SHORT)
+                {
+                    throw std::runtime_error("gltf: invalid index accessor");
+                }
+                indicies.reserve(first + index.count);
+                for (size_t i = 0; i + 2 < index.count; i += 3)
+                {
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        uint32_t v = index.ReadIndex(i + k);
+                        if (v >= position.count) throw std::runtime_error("gltf: index out of range");
+                        indicies.push_back(base + v);
+                    }
+                }
+            }
+            else
+            {
+                for (uint32_t i = 0; i < position.count / 3 * 3; ++i) indicies.push_back(base + i);
+            }
+            if (determinant < 0.)
+            {
+                for (size_t i = first; i + 2 < indicies.size(); i += 3) std::swap(indicies[i + 1], indicies[i + 2]);
+            }
+        }
+    });
+
+    m_positions.swap(positions);
+    // a normal per vertex or none, Model computes them then
+    if (hasNormals) m_normals.swap(normals);
+    m_indicies.swap(indicies);
+    if (m_progress) m_progress->bytesParsed = file.GetFileSize();
+
+    m_initialized = true;
+}
+#pragma endregion
+
+#pragma region STL
+namespace
+{
+    const size_t STL_HEADER_SIZE = 84;
+    const size_t STL_RECORD_SIZE = 50;
+    // triangles per ParallelFor chunk
+    const size_t STL_GRAIN = 1 << 15;
+    // corners are partitioned by the top bits of their key hash and every
+    // partition is welded on its own
+    const uint32_t STL_PARTITION_BITS = 8;
+    const size_t STL_PARTITIONS = size_t(1) << STL_PARTITION_BITS;
+    // grid cells per axis, three cell coordinates fit in one 64 bit key
+    const uint32_t STL_CELL_BITS = 21;
+
+    inline const float* StlCorner(const uint8_t* records, size_t corner)
+    {
+        // normal (12 bytes), 3 corners (36), attribute count (2)
+        return reinterpret_cast<const float*>(records + (corner / 3) * STL_RECORD_SIZE + 12 + (corner % 3) * 12);
+    }
+
+    inline uint64_t MixKey(uint64_t key)
+    {
+        key ^= key >> 33;
+        key *= 0xff51afd7ed558ccdull;
+        key ^= key >> 33;
+        key *= 0xc4ceb9fe1a85ec53ull;
+        return key ^ (key >> 33);
+    }
+}
+
+void STLModelLoader::LoadFromFile(const std::wstring& filePath)
+{
+    MappedFile file;
+    if (!file.Open(filePath)) throw std::runtime_error("cannot open " + Util::ToByteString(filePath));
+    if (m_progress)
+    {
+        m_progress->totalBytes = file.GetSize();
+        m_progress->ThrowIfCancelled();
+    }
+    if (file.GetSize() < STL_HEADER_SIZE) throw std::runtime_error("stl file is too short.");
+
+    uint32_t triangleCount;
+    std::memcpy(&triangleCount, file.GetData() + 80, 4);
+    if (file.GetSize() < STL_HEADER_SIZE + static_cast<uint64_t>(triangleCount) * STL_RECORD_SIZE)
+    {
+        if (std::memcmp(file.GetData(), "solid", 5) == 0) throw std::runtime_error("ascii stl is not supported.");
+        throw std::runtime_error("stl file is truncated.");
+    }
+    if (static_cast<uint64_t>(triangleCount) * 3 >= std::numeric_limits<uint32_t>::max())
+    {
+        throw std::runtime_error("stl file has too many triangles.");
+    }
+    const uint8_t* records = file.GetData() + STL_HEADER_SIZE;
+    size_t cornerCount = static_cast<size_t>(triangleCount) * 3;
+    auto pool = TaskPool::GetInstance();
+    size_t chunkCount = (triangleCount + STL_GRAIN - 1) / STL_GRAIN;
+
+    // 1. bounds of the quantization grid
+    // ParallelFor may hand out all chunks as one range, so unused entries
+    // have to stay neutral
+    const std::array<float, 6> EMPTY_BOUNDS = { std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
+        std::numeric_limits<float>::max(), std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest(),
+        std::numeric_limits<float>::lowest() };
+    std::vector<std::array<float, 6>> chunkBounds(chunkCount, EMPTY_BOUNDS);
+    pool->ParallelFor(triangleCount, STL_GRAIN, [&](size_t begin, size_t end) {
+        std::array<float, 6> b = EMPTY_BOUNDS;
+        for (size_t corner = begin * 3; corner < end * 3; ++corner)
+        {
+            const float* p = StlCorner(records, corner);
+            for (int k = 0; k < 3; ++k)
+            {
+                if (!std::isfinite(p[k])) throw std::runtime_error("stl has invalid positions.");
+                b[k] = std::min(b[k], p[k]);
+                b[k + 3] = std::max(b[k + 3], p[k]);
+            }
+        }
+        chunkBounds[begin / STL_GRAIN] = b;
+    });
+    if (m_progress) m_progress->ThrowIfCancelled();
+
+    double minP[3] = { 0., 0., 0. };
+    double scale[3] = { 0., 0., 0. };
+    if (chunkCount)
+    {
+        double maxP[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            minP[k] = chunkBounds[0][k];
+            maxP[k] = chunkBounds[0][k + 3];
+        }
+        for (auto& b: chunkBounds)
+        {
+            for (int k = 0; k < 3; ++k)
+            {
+                minP[k] = std::min<double>(minP[k], b[k]);
+                maxP[k] = std::max<double>(maxP[k], b[k + 3]);
+            }
+        }
+        double extent = std::max(maxP[0] - minP[0], std::max(maxP[1] - minP[1], maxP[2] - minP[2]));
+        double cells = static_cast<double>((1u << STL_CELL_BITS) - 1);
+        for (int k = 0; k < 3; ++k) scale[k] = extent > 0. ? cells / extent : 0.;
+    }
+
+    // 2. quantized keys, and how many corners of every chunk go to which partition
+    std::vector<uint64_t> keys(cornerCount);
+    std::vector<uint32_t> histograms(chunkCount * STL_PARTITIONS, 0);
+    pool->ParallelFor(triangleCount, STL_GRAIN, [&](size_t begin, size_t end) {
+        uint32_t* histogram = &histograms[begin / STL_GRAIN * STL_PARTITIONS];
+        for (size_t corner = begin * 3; corner < end * 3; ++corner)
+        {
+            const float* p = StlCorner(records, corner);
+            uint64_t key = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                uint64_t cell = static_cast<uint64_t>((p[k] - minP[k]) * scale[k] + 0.5);
+                key |= std::min<uint64_t>(cell, (1u << STL_CELL_BITS) - 1) << (STL_CELL_BITS * k);
+            }
+            keys[corner] = key;
+            histogram[MixKey(key) >> (64 - STL_PARTITION_BITS)]++;
+        }
+    });
+
+    // 3. stable scatter of the corners into their partitions
+    std::vector<uint32_t> partitionStart(STL_PARTITIONS + 1, 0);
+    {
+        uint32_t offset = 0;
+        for (size_t p = 0; p < STL_PARTITIONS; ++p)
+        {
+            partitionStart[p] = offset;
+            for (size_t c = 0; c < chunkCount; ++c)
+            {
+                uint32_t count = histograms[c * STL_PARTITIONS + p];
+                histograms[c * STL_PARTITIONS + p] = offset;
+                offset += count;
+            }
+        }
+        partitionStart[STL_PARTITIONS] = offset;
+    }
+    std::vector<uint32_t> sortedCorners(cornerCount);
+    pool->ParallelFor(triangleCount, STL_GRAIN, [&](size_t begin, size_t end) {
+        uint32_t* offsets = &histograms[begin / STL_GRAIN * STL_PARTITIONS];
+        for (size_t corner = begin * 3; corner < end * 3; ++corner)
+        {
+            sortedCorners[offsets[MixKey(keys[corner]) >> (64 - STL_PARTITION_BITS)]++] = static_cast<uint32_t>(corner);
+        }
+    });
+    if (m_progress) m_progress->ThrowIfCancelled();
+
+    // 4. weld every partition with its own table, corner -> partition local vertex
+    std::vector<uint32_t> cornerVertex(cornerCount);
+    std::vector<uint32_t> firstCorner(cornerCount);
+    std::vector<uint32_t> partitionVertices(STL_PARTITIONS, 0);
+    pool->ParallelFor(STL_PARTITIONS, 1, [&](size_t begin, size_t end) {
+        const uint32_t EMPTY = ~0u;
+        std::vector<uint32_t> table;
+        for (size_t p = begin; p < end; ++p)
+        {
+            uint32_t first = partitionStart[p];
+            uint32_t count = partitionStart[p + 1] - first;
+            size_t tableSize = 16;
+            while (tableSize < count * 2) tableSize *= 2;
+            table.assign(tableSize, EMPTY);
+
+            uint32_t vertexCount = 0;
+            for (uint32_t i = first; i < first + count; ++i)
+            {
+                uint32_t corner = sortedCorners[i];
+                uint64_t key = keys[corner];
+                size_t slot = MixKey(key) & (tableSize - 1);
+                while (table[slot] != EMPTY && keys[firstCorner[first + table[slot]]] != key)
+                {
+                    slot = (slot + 1) & (tableSize - 1);
+                }
+                if (table[slot] == EMPTY)
+                {
+                    table[slot] = vertexCount;
+                    firstCorner[first + vertexCount] = corner;
+                    vertexCount++;
+                }
+                cornerVertex[corner] = table[slot];
+            }
+            partitionVertices[p] = vertexCount;
+        }
+    });
+    if (m_progress) m_progress->ThrowIfCancelled();
+
+    // 5. global vertex ids, the first corner of a vertex gives its position
+    std::vector<uint32_t> partitionBase(STL_PARTITIONS + 1, 0);
+    for (size_t p = 0; p < STL_PARTITIONS; ++p) partitionBase[p + 1] = partitionBase[p] + partitionVertices[p];
+    std::vector<std::array<double, 3>> positions(partitionBase[STL_PARTITIONS]);
+    pool->ParallelFor(STL_PARTITIONS, 1, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p)
+        {
+            uint32_t first = partitionStart[p];
+            for (uint32_t v = 0; v < partitionVertices[p]; ++v)
+            {
+                const float* corner = StlCorner(records, firstCorner[first + v]);
+                positions[partitionBase[p] + v] = { corner[0], corner[1], corner[2] };
+            }
+            for (uint32_t i = first; i < partitionStart[p + 1]; ++i)
+            {
+                cornerVertex[sortedCorners[i]] += partitionBase[p];
+            }
+        }
+    });
+
+    // triangles that collapsed to a line or a point are dropped
+    std::vector<uint32_t> indicies;
+    indicies.reserve(cornerCount);
+    for (size_t t = 0; t < triangleCount; ++t)
+    {
+        uint32_t a = cornerVertex[t * 3];
+        uint32_t b = cornerVertex[t * 3 + 1];
+        uint32_t c = cornerVertex[t * 3 + 2];
+        if (a == b || b == c || a == c) continue;
+        indicies.push_back(a);
+        indicies.push_back(b);
+        indicies.push_back(c);
+    }
+
+    m_positions.swap(positions);
+    m_normals.clear();
+    m_indicies.swap(indicies);
+    if (m_progress) m_progress->bytesParsed = file.GetSize();
+
+    m_initialized = true;
+}
+#pragma endregion
\ No newline at end of file
@@ -5,11 +5,25 @@
 #include <string>
 #include <memory>
 #include <array>
+#include "LoadProgress.h"
 
 enum class ModelType: uint32_t
 {
     PLY,
-    OBJ // TODO
+    OBJ, // TODO
+    GLTF, // .glb, or .gltf with external buffers
+    STL // binary
+};
+
+// Per-vertex columns of a loaded file, null for those it does not have. They
+// point into the loader, see VertexLayout::Pack.
+struct VertexColumns
+{
+    const std::array<double, 3>* positions = nullptr;
+    const std::array<double, 3>* normals = nullptr;
+    // rgba in [0, 1]
+    const std::array<float, 4>* colors = nullptr;
+    const std::array<float, 2>* texcoords = nullptr;
 };
 
 class ModelLoader
@@ -17,26 +31,35 @@ class ModelLoader
 protected:
     std::vector<std::array<double, 3>> m_positions;
     std::vector<std::array<double, 3>> m_normals;
+    std::vector<std::array<float, 4>> m_colors;
+    std::vector<std::array<float, 2>> m_texcoords;
     std::vector<uint32_t> m_indicies;
     bool m_initialized = false;
+    LoadProgress* m_progress = nullptr;
 
     ModelLoader() = default;
 
-    virtual void SetPositions(std::vector<std::array<double, 3>>& positions);
-    virtual void SetIndicies(std::vector<std::vector<uint32_t>>& faces);
+    virtual void SetPositions(const std::vector<std::array<double, 3>>& positions);
+    virtual void SetIndicies(const std::vector<std::vector<uint32_t>>& faces);
 
 public:
     ~ModelLoader() = default;
     static std::unique_ptr<ModelLoader> CreateModelLoader(ModelType);
+
+    // optional, bytes read by LoadFromFile are reported here
+    void SetProgress(LoadProgress* progress);
     
     // 将模型移动放缩到 [-1,1]^3 的空间内
     void Reconstruct();
-    virtual void LoadFromFile(std::wstring& filePath) = 0;
+    virtual void LoadFromFile(const std::wstring& filePath) = 0;
 
     std::vector<std::array<double, 3>> GetPositions();
     // 未归一化的顶点法线
     std::vector<std::array<double, 3>> GetNormals();
     std::vector<uint32_t> GetIndicies();
+    size_t GetVertexCount() const;
+    // Columns with one entry per position, valid until the next load.
+    VertexColumns GetColumns() const;
 };
 
 class PLYModelLoader : public ModelLoader
@@ -44,7 +67,7 @@ class PLYModelLoader : public ModelLoader
 public:
     PLYModelLoader() = default;
     ~PLYModelLoader() = default;
-    void LoadFromFile(std::wstring& filePath) override;
+    void LoadFromFile(const std::wstring& filePath) override;
 };
 
 // TODO
@@ -56,6 +79,27 @@ class OBJModelLoader : public ModelLoader
 public:
     OBJModelLoader() = default;
     ~OBJModelLoader() = default;
-    void LoadFromFile(std::wstring& filePath) override;
+    void LoadFromFile(const std::wstring& filePath) override;
+};
+
+// Binary STL triangle soup. Corners at the same position (up to 2^-21 of the
+// bounding box) are welded into shared vertices on the task pool. The face
+// normals are dropped, Model computes smooth ones.
+class STLModelLoader : public ModelLoader
+{
+public:
+    STLModelLoader() = default;
+    ~STLModelLoader() = default;
+    void LoadFromFile(const std::wstring& filePath) override;
+};
+
+// Triangle primitives of every mesh node in the default scene, transformed to
+// world space and merged into one mesh.
+class GLTFModelLoader : public ModelLoader
+{
+public:
+    GLTFModelLoader() = default;
+    ~GLTFModelLoader() = default;
+    void LoadFromFile(const std::wstring& filePath) override;
 };
 #endif
\ No newline at end of file
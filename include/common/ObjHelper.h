@@ -2,6 +2,8 @@
 #define __OBJHELPER_H__
 
 #include <fstream>
+#include <istream>
+#include <stdexcept>
 #include <array>
 #include <vector>
 #include "Utility.h"
@@ -31,21 +33,30 @@ namespace ObjHelper
     public:
         ObjLoader() = delete;
         ~ObjLoader() = default;
-        ObjLoader(string& filePath)
+        ObjLoader(const string& filePath)
         {
             LoadFromFile(filePath);
         }
 
-        void LoadFromFile(string& filePath)
+        ObjLoader(std::istream& in)
+        {
+            LoadFromStream(in);
+        }
+
+        void LoadFromFile(const string& filePath)
         {
-            Clear();
             ifstream in;
             in.open(filePath, ifstream::in);
             if (in.fail())
             {
-                throw std::exception("obj file cannot be opened.");
+                throw std::runtime_error("obj file cannot be opened.");
             }
+            LoadFromStream(in);
+        }
 
+        void LoadFromStream(std::istream& in)
+        {
+            Clear();
             string line;
             bool fail = false;
             while (!in.eof())
@@ -142,7 +153,7 @@ namespace ObjHelper
 
             if (fail)
             {
-                throw std::exception("obj format error.");
+                throw std::runtime_error("obj format error.");
             }
         }
     
@@ -160,7 +171,7 @@ namespace ObjHelper
         }
         auto GetFacesVertexIndex() const
         {
-            return m_facesVertexNormal;
+            return m_facesVertexIndex;
         }
         auto GetFacesVertexNormalIndex() const
         {
@@ -15,8 +15,14 @@ namespace Util
         return converter.to_bytes(input);
     }
 
+    inline std::wstring ToWideString(const std::string& input)
+    {
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        return converter.from_bytes(input);
+    }
+
     // split a string by token
-    void Split(std::string& in, std::vector<std::string>& out, char token)
+    inline void Split(std::string& in, std::vector<std::string>& out, char token)
     {
         out.clear();
         int i = 0, last = 0;
@@ -31,7 +37,7 @@ namespace Util
         out.emplace_back(in.substr(last, in.size() - last));
     }
 
-    std::vector<std::string> Filter(std::vector<std::string>& in, std::string&& target)
+    inline std::vector<std::string> Filter(std::vector<std::string>& in, std::string&& target)
     {
         std::vector<std::string> out;
         for (auto& str: in)
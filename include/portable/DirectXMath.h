@@ -0,0 +1,264 @@
+#ifndef __PORTABLE_DIRECTXMATH_H__
+#define __PORTABLE_DIRECTXMATH_H__
+
+#include <cmath>
+#include <cstdint>
+#include <utility>
+
+// Scalar stand-in for the part of DirectXMath the core library uses, for
+// platforms without the real headers. Same names, same row vector
+// conventions, so the sources build unchanged. Only on the include path when
+// CMake does not find DirectXMath, the renderer always uses the real one.
+namespace DirectX
+{
+    constexpr float XM_PI = 3.141592654f;
+
+    struct XMFLOAT2
+    {
+        float x, y;
+        XMFLOAT2() = default;
+        constexpr XMFLOAT2(float _x, float _y) : x(_x), y(_y) {}
+    };
+
+    struct XMFLOAT3
+    {
+        float x, y, z;
+        XMFLOAT3() = default;
+        constexpr XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+    };
+
+    struct XMFLOAT4
+    {
+        float x, y, z, w;
+        XMFLOAT4() = default;
+        constexpr XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+    };
+
+    struct XMFLOAT4X4
+    {
+        float m[4][4];
+    };
+
+    struct XMVECTOR
+    {
+        float v[4];
+    };
+    using FXMVECTOR = XMVECTOR;
+    using GXMVECTOR = XMVECTOR;
+    using CXMVECTOR = XMVECTOR;
+
+    struct XMMATRIX
+    {
+        XMVECTOR r[4];
+    };
+    using FXMMATRIX = XMMATRIX;
+    using CXMMATRIX = XMMATRIX;
+
+    inline constexpr float XMConvertToRadians(float degrees)
+    {
+        return degrees * (XM_PI / 180.f);
+    }
+
+    inline XMVECTOR XMVectorSet(float x, float y, float z, float w)
+    {
+        return { { x, y, z, w } };
+    }
+    inline float XMVectorGetX(FXMVECTOR v)
+    {
+        return v.v[0];
+    }
+    inline float XMVectorGetY(FXMVECTOR v)
+    {
+        return v.v[1];
+    }
+    inline float XMVectorGetZ(FXMVECTOR v)
+    {
+        return v.v[2];
+    }
+    inline float XMVectorGetW(FXMVECTOR v)
+    {
+        return v.v[3];
+    }
+    inline XMVECTOR XMVectorSubtract(FXMVECTOR a, FXMVECTOR b)
+    {
+        return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } };
+    }
+
+    inline XMVECTOR XMLoadFloat3(const XMFLOAT3* source)
+    {
+        return { { source->x, source->y, source->z, 0.f } };
+    }
+    inline XMVECTOR XMLoadFloat4(const XMFLOAT4* source)
+    {
+        return { { source->x, source->y, source->z, source->w } };
+    }
+    inline void XMStoreFloat3(XMFLOAT3* destination, FXMVECTOR v)
+    {
+        *destination = XMFLOAT3(v.v[0], v.v[1], v.v[2]);
+    }
+    inline void XMStoreFloat4(XMFLOAT4* destination, FXMVECTOR v)
+    {
+        *destination = XMFLOAT4(v.v[0], v.v[1], v.v[2], v.v[3]);
+    }
+
+    inline XMVECTOR XMVector3Dot(FXMVECTOR a, FXMVECTOR b)
+    {
+        float dot = a.v[0] * b.v[0] + a.v[1] * b.v[1] + a.v[2] * b.v[2];
+        return { { dot, dot, dot, dot } };
+    }
+    inline XMVECTOR XMVector3Cross(FXMVECTOR a, FXMVECTOR b)
+    {
+        return { { a.v[1] * b.v[2] - a.v[2] * b.v[1], a.v[2] * b.v[0] - a.v[0] * b.v[2], a.v[0] * b.v[1] - a.v[1] * b.v[0], 0.f } };
+    }
+    inline XMVECTOR XMVector3Length(FXMVECTOR v)
+    {
+        float length = std::sqrt(XMVectorGetX(XMVector3Dot(v, v)));
+        return { { length, length, length, length } };
+    }
+    inline XMVECTOR XMVector3Normalize(FXMVECTOR v)
+    {
+        float length = XMVectorGetX(XMVector3Length(v));
+        float scale = length > 0.f ? 1.f / length : 0.f;
+        return { { v.v[0] * scale, v.v[1] * scale, v.v[2] * scale, v.v[3] * scale } };
+    }
+
+    inline XMMATRIX XMMatrixIdentity()
+    {
+        XMMATRIX m = {};
+        for (int i = 0; i < 4; ++i) m.r[i].v[i] = 1.f;
+        return m;
+    }
+    inline XMMATRIX XMMatrixMultiply(FXMMATRIX a, CXMMATRIX b)
+    {
+        XMMATRIX m;
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                m.r[i].v[j] = a.r[i].v[0] * b.r[0].v[j] + a.r[i].v[1] * b.r[1].v[j]
+                    + a.r[i].v[2] * b.r[2].v[j] + a.r[i].v[3] * b.r[3].v[j];
+            }
+        }
+        return m;
+    }
+    inline XMMATRIX operator*(FXMMATRIX a, CXMMATRIX b)
+    {
+        return XMMatrixMultiply(a, b);
+    }
+    inline XMMATRIX XMMatrixTranspose(FXMMATRIX a)
+    {
+        XMMATRIX m;
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j) m.r[i].v[j] = a.r[j].v[i];
+        }
+        return m;
+    }
+    // Gauss-Jordan in double, a singular matrix gives garbage as it does in
+    // DirectXMath. The determinant is not computed.
+    inline XMMATRIX XMMatrixInverse(XMVECTOR* determinant, FXMMATRIX matrix)
+    {
+        double a[4][8];
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j)
+            {
+                a[i][j] = matrix.r[i].v[j];
+                a[i][j + 4] = i == j ? 1. : 0.;
+            }
+        }
+        for (int c = 0; c < 4; ++c)
+        {
+            int pivot = c;
+            for (int r = c + 1; r < 4; ++r)
+            {
+                if (std::abs(a[r][c]) > std::abs(a[pivot][c])) pivot = r;
+            }
+            for (int k = 0; k < 8; ++k) std::swap(a[c][k], a[pivot][k]);
+            double scale = a[c][c] != 0. ? 1. / a[c][c] : 0.;
+            for (int k = 0; k < 8; ++k) a[c][k] *= scale;
+            for (int r = 0; r < 4; ++r)
+            {
+                if (r == c) continue;
+                double f = a[r][c];
+                for (int k = 0; k < 8; ++k) a[r][k] -= f * a[c][k];
+            }
+        }
+        XMMATRIX m;
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j) m.r[i].v[j] = static_cast<float>(a[i][j + 4]);
+        }
+        if (determinant) *determinant = XMVectorSet(0.f, 0.f, 0.f, 0.f);
+        return m;
+    }
+    inline XMMATRIX XMMatrixScaling(float x, float y, float z)
+    {
+        XMMATRIX m = XMMatrixIdentity();
+        m.r[0].v[0] = x;
+        m.r[1].v[1] = y;
+        m.r[2].v[2] = z;
+        return m;
+    }
+    inline XMMATRIX XMMatrixTranslation(float x, float y, float z)
+    {
+        XMMATRIX m = XMMatrixIdentity();
+        m.r[3] = XMVectorSet(x, y, z, 1.f);
+        return m;
+    }
+    inline XMMATRIX XMMatrixLookAtLH(FXMVECTOR eye, FXMVECTOR focus, FXMVECTOR up)
+    {
+        XMVECTOR z = XMVector3Normalize(XMVectorSubtract(focus, eye));
+        XMVECTOR x = XMVector3Normalize(XMVector3Cross(up, z));
+        XMVECTOR y = XMVector3Cross(z, x);
+        XMMATRIX m = XMMatrixIdentity();
+        for (int i = 0; i < 3; ++i)
+        {
+            m.r[i] = XMVectorSet(x.v[i], y.v[i], z.v[i], 0.f);
+        }
+        m.r[3] = XMVectorSet(-XMVectorGetX(XMVector3Dot(x, eye)), -XMVectorGetX(XMVector3Dot(y, eye)),
+            -XMVectorGetX(XMVector3Dot(z, eye)), 1.f);
+        return m;
+    }
+    inline XMMATRIX XMMatrixPerspectiveFovLH(float fov, float aspectRatio, float nearZ, float farZ)
+    {
+        float height = 1.f / std::tan(fov * 0.5f);
+        float range = farZ / (farZ - nearZ);
+        XMMATRIX m = {};
+        m.r[0].v[0] = height / aspectRatio;
+        m.r[1].v[1] = height;
+        m.r[2].v[2] = range;
+        m.r[2].v[3] = 1.f;
+        m.r[3].v[2] = -range * nearZ;
+        return m;
+    }
+
+    inline XMMATRIX XMLoadFloat4x4(const XMFLOAT4X4* source)
+    {
+        XMMATRIX m;
+        for (int i = 0; i < 4; ++i)
+        {
+            m.r[i] = XMVectorSet(source->m[i][0], source->m[i][1], source->m[i][2], source->m[i][3]);
+        }
+        return m;
+    }
+    inline void XMStoreFloat4x4(XMFLOAT4X4* destination, FXMMATRIX m)
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            for (int j = 0; j < 4; ++j) destination->m[i][j] = m.r[i].v[j];
+        }
+    }
+    // w is 1, the result is divided by its w
+    inline XMVECTOR XMVector3TransformCoord(FXMVECTOR v, FXMMATRIX m)
+    {
+        float o[4];
+        for (int j = 0; j < 4; ++j)
+        {
+            o[j] = v.v[0] * m.r[0].v[j] + v.v[1] * m.r[1].v[j] + v.v[2] * m.r[2].v[j] + m.r[3].v[j];
+        }
+        return XMVectorSet(o[0] / o[3], o[1] / o[3], o[2] / o[3], 1.f);
+    }
+}
+
+#endif
\ No newline at end of file
@@ -188,10 +188,52 @@ void Application::SetModel(std::shared_ptr<Model>& model)
 {
     m_model = model;
 }
+void Application::SetModel(ModelLoadHandle modelLoad)
+{
+    m_modelLoad = modelLoad;
+    m_modelError.clear();
+}
+bool Application::PollModel()
+{
+    if (!m_modelLoad.IsReady()) return false;
+
+    auto result = m_modelLoad.Get();
+    m_modelLoad = ModelLoadHandle();
+    if (!result.IsOk())
+    {
+        m_modelError = result.error;
+        return false;
+    }
+    m_model = result.model;
+    return true;
+}
+void Application::SetModel(ProgressiveMeshStream modelStream)
+{
+    m_modelStream = modelStream;
+    m_modelError.clear();
+}
+ProgressiveMeshStream& Application::GetModelStream()
+{
+    return m_modelStream;
+}
+void Application::EndModelStream(std::shared_ptr<Model> model)
+{
+    m_modelStream = ProgressiveMeshStream();
+    if (model) m_model = model;
+    else m_modelError = "model stream is damaged";
+}
 std::shared_ptr<Model> Application::GetModel() const
 {
     return m_model;
 }
+const ModelLoadHandle& Application::GetModelLoad() const
+{
+    return m_modelLoad;
+}
+const std::string& Application::GetModelError() const
+{
+    return m_modelError;
+}
 
 void Application::CreateInstance(HINSTANCE hInst)
 {
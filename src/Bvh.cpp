@@ -0,0 +1,553 @@
+#include "Bvh.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+namespace
+{
+    const size_t BIN_GRAIN = 1 << 14;
+    const uint32_t MAX_BINS = 64;
+    const uint32_t NO_CHILD = ~0u;
+    const uint32_t INVALID_TRIANGLE = ~0u;
+
+    inline const XMFLOAT3& GetPosition(const XMFLOAT3* positions, size_t stride, uint32_t index)
+    {
+        return *reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(positions) + stride * index);
+    }
+
+    inline float Get(const XMFLOAT3& v, int axis)
+    {
+        return (&v.x)[axis];
+    }
+
+    // trivial, so that bin arrays cost nothing until they are reset
+    struct Bounds
+    {
+        XMFLOAT3 min;
+        XMFLOAT3 max;
+
+        static Bounds Empty()
+        {
+            const float big = std::numeric_limits<float>::max();
+            return { XMFLOAT3(big, big, big), XMFLOAT3(-big, -big, -big) };
+        }
+
+        void Grow(const XMFLOAT3& p)
+        {
+            min = XMFLOAT3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+            max = XMFLOAT3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+        }
+        void Grow(const Bounds& b)
+        {
+            min = XMFLOAT3(std::min(min.x, b.min.x), std::min(min.y, b.min.y), std::min(min.z, b.min.z));
+            max = XMFLOAT3(std::max(max.x, b.max.x), std::max(max.y, b.max.y), std::max(max.z, b.max.z));
+        }
+        float Area() const
+        {
+            float dx = max.x - min.x, dy = max.y - min.y, dz = max.z - min.z;
+            if (dx < 0.f || dy < 0.f || dz < 0.f) return 0.f;
+            return 2.f * (dx * dy + dy * dz + dz * dx);
+        }
+    };
+
+    struct BuildNode
+    {
+        Bounds bounds;
+        Bounds centroidBounds;
+        uint32_t first;
+        uint32_t count;
+        uint32_t children[2];
+    };
+
+    // Partitioned along with the tree, so that binning a node reads its
+    // triangles in order.
+    struct Primitive
+    {
+        Bounds bounds;
+        XMFLOAT3 centroid;
+        uint32_t triangle;
+    };
+
+    struct Bin
+    {
+        Bounds bounds;
+        uint32_t count;
+    };
+    const Bin EMPTY_BIN = { Bounds::Empty(), 0 };
+
+    BuildNode MakeNode(uint32_t first, uint32_t count)
+    {
+        return { Bounds::Empty(), Bounds::Empty(), first, count, { NO_CHILD, NO_CHILD } };
+    }
+
+    struct Builder
+    {
+        const BvhConfig& config;
+        std::vector<Primitive> primitives;
+        std::vector<BuildNode> nodes;
+        std::atomic<uint32_t> nodeCount{ 0 };
+
+        explicit Builder(const BvhConfig& config) : config(config) {}
+
+        static float BinScale(const BuildNode& node, int axis, uint32_t binCount)
+        {
+            float extent = Get(node.centroidBounds.max, axis) - Get(node.centroidBounds.min, axis);
+            return extent > 0.f ? binCount / extent : 0.f;
+        }
+        static uint32_t BinIndex(const BuildNode& node, const Primitive& primitive, int axis, float scale, uint32_t binCount)
+        {
+            float offset = (Get(primitive.centroid, axis) - Get(node.centroidBounds.min, axis)) * scale;
+            return std::min(static_cast<uint32_t>(std::max(offset, 0.f)), binCount - 1);
+        }
+
+        uint32_t AllocateChildren(BuildNode& node)
+        {
+            uint32_t first = nodeCount.fetch_add(2);
+            node.children[0] = first;
+            node.children[1] = first + 1;
+            return first;
+        }
+
+        void MakeLeaf(BuildNode& node)
+        {
+            node.children[0] = node.children[1] = NO_CHILD;
+        }
+
+        // Object median along the widest centroid axis, for nodes SAH cannot
+        // split and for trees that got too deep.
+        void SplitMedian(BuildNode& node)
+        {
+            int axis = 0;
+            float extent = -1.f;
+            for (int k = 0; k < 3; ++k)
+            {
+                float e = Get(node.centroidBounds.max, k) - Get(node.centroidBounds.min, k);
+                if (e > extent)
+                {
+                    extent = e;
+                    axis = k;
+                }
+            }
+            auto begin = primitives.begin() + node.first;
+            auto middle = begin + node.count / 2;
+            std::nth_element(begin, middle, begin + node.count, [axis](const Primitive& a, const Primitive& b) {
+                return Get(a.centroid, axis) < Get(b.centroid, axis);
+            });
+
+            uint32_t first = AllocateChildren(node);
+            uint32_t counts[2] = { node.count / 2, node.count - node.count / 2 };
+            for (int c = 0; c < 2; ++c)
+            {
+                auto& child = nodes[first + c];
+                child = MakeNode(node.first + (c ? counts[0] : 0), counts[c]);
+                for (uint32_t i = child.first; i < child.first + child.count; ++i)
+                {
+                    child.bounds.Grow(primitives[i].bounds);
+                    child.centroidBounds.Grow(primitives[i].centroid);
+                }
+            }
+        }
+
+        // Bins of all three axes in one pass over the node's triangles, in
+        // parallel for large nodes.
+        void FillBins(const BuildNode& node, uint32_t binCount, Bin (*bins)[MAX_BINS])
+        {
+            float scale[3] = { BinScale(node, 0, binCount), BinScale(node, 1, binCount), BinScale(node, 2, binCount) };
+            auto fill = [&](uint32_t begin, uint32_t end, Bin (*target)[MAX_BINS]) {
+                for (uint32_t i = begin; i < end; ++i)
+                {
+                    const Primitive& primitive = primitives[i];
+                    for (int k = 0; k < 3; ++k)
+                    {
+                        uint32_t b = BinIndex(node, primitive, k, scale[k], binCount);
+                        target[k][b].count++;
+                        target[k][b].bounds.Grow(primitive.bounds);
+                    }
+                }
+            };
+
+            size_t chunkCount = (node.count + BIN_GRAIN - 1) / BIN_GRAIN;
+            if (chunkCount <= 1)
+            {
+                fill(node.first, node.first + node.count, bins);
+                return;
+            }
+            std::vector<Bin> chunkBins(chunkCount * 3 * MAX_BINS, EMPTY_BIN);
+            TaskPool::GetInstance()->ParallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+                for (size_t chunk = begin; chunk < end; ++chunk)
+                {
+                    uint32_t first = node.first + static_cast<uint32_t>(chunk * BIN_GRAIN);
+                    uint32_t last = std::min(first + static_cast<uint32_t>(BIN_GRAIN), node.first + node.count);
+                    fill(first, last, reinterpret_cast<Bin (*)[MAX_BINS]>(&chunkBins[chunk * 3 * MAX_BINS]));
+                }
+            });
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    for (uint32_t b = 0; b < binCount; ++b)
+                    {
+                        auto& source = chunkBins[(chunk * 3 + k) * MAX_BINS + b];
+                        bins[k][b].count += source.count;
+                        bins[k][b].bounds.Grow(source.bounds);
+                    }
+                }
+            }
+        }
+
+        void Split(uint32_t index, uint32_t depth)
+        {
+            BuildNode& node = nodes[index];
+            if (node.count <= 1)
+            {
+                MakeLeaf(node);
+                return;
+            }
+            if (depth >= Bvh::MAX_DEPTH / 2)
+            {
+                if (node.count <= config.maxLeafTriangles) MakeLeaf(node);
+                else SplitMedian(node);
+            }
+            else if (!SplitSAH(node))
+            {
+                return;
+            }
+            if (node.children[0] == NO_CHILD) return;
+
+            uint32_t first = node.children[0];
+            if (node.count > Bvh::PARALLEL_THRESHOLD)
+            {
+                TaskPool::GetInstance()->ParallelFor(2, 1, [this, first, depth](size_t begin, size_t end) {
+                    for (size_t c = begin; c < end; ++c) Split(first + static_cast<uint32_t>(c), depth + 1);
+                });
+            }
+            else
+            {
+                Split(first, depth + 1);
+                Split(first + 1, depth + 1);
+            }
+        }
+
+        // false if the node became a leaf
+        bool SplitSAH(BuildNode& node)
+        {
+            // more bins than triangles only adds empty split candidates
+            uint32_t binCount = std::max(2u, std::min(std::min(config.binCount, MAX_BINS), node.count));
+            Bin bins[3][MAX_BINS];
+            for (int k = 0; k < 3; ++k) std::fill(bins[k], bins[k] + binCount, EMPTY_BIN);
+            FillBins(node, binCount, bins);
+
+            // sweep from the right for the right side of every split plane
+            float bestCost = std::numeric_limits<float>::max();
+            int bestAxis = -1;
+            uint32_t bestSplit = 0;
+            for (int k = 0; k < 3; ++k)
+            {
+                if (Get(node.centroidBounds.max, k) <= Get(node.centroidBounds.min, k)) continue;
+                float rightArea[MAX_BINS];
+                uint32_t rightCount[MAX_BINS];
+                Bounds right = Bounds::Empty();
+                uint32_t count = 0;
+                for (uint32_t b = binCount - 1; b > 0; --b)
+                {
+                    right.Grow(bins[k][b].bounds);
+                    count += bins[k][b].count;
+                    rightArea[b] = right.Area();
+                    rightCount[b] = count;
+                }
+                Bounds left = Bounds::Empty();
+                count = 0;
+                for (uint32_t b = 1; b < binCount; ++b)
+                {
+                    left.Grow(bins[k][b - 1].bounds);
+                    count += bins[k][b - 1].count;
+                    if (count == 0 || rightCount[b] == 0) continue;
+                    float cost = left.Area() * count + rightArea[b] * rightCount[b];
+                    if (cost < bestCost)
+                    {
+                        bestCost = cost;
+                        bestAxis = k;
+                        bestSplit = b;
+                    }
+                }
+            }
+
+            float area = node.bounds.Area();
+            float leafCost = config.intersectionCost * node.count;
+            float splitCost = bestAxis < 0 ? std::numeric_limits<float>::max() :
+                config.traversalCost + config.intersectionCost * (area > 0.f ? bestCost / area : node.count);
+            if (node.count <= config.maxLeafTriangles && leafCost <= splitCost)
+            {
+                MakeLeaf(node);
+                return false;
+            }
+            if (bestAxis < 0)
+            {
+                SplitMedian(node);
+                return true;
+            }
+
+            // Partition, the children's bounds are the union of their bins and
+            // their centroid bounds are collected on the way.
+            float scale = BinScale(node, bestAxis, binCount);
+            Bounds centroidBounds[2] = { Bounds::Empty(), Bounds::Empty() };
+            auto begin = primitives.begin() + node.first;
+            auto middle = std::partition(begin, begin + node.count, [&](const Primitive& primitive) {
+                bool isLeft = BinIndex(node, primitive, bestAxis, scale, binCount) < bestSplit;
+                centroidBounds[isLeft ? 0 : 1].Grow(primitive.centroid);
+                return isLeft;
+            });
+
+            uint32_t first = AllocateChildren(node);
+            BuildNode& left = nodes[first];
+            BuildNode& right = nodes[first + 1];
+            left = MakeNode(node.first, static_cast<uint32_t>(middle - begin));
+            right = MakeNode(node.first + left.count, node.count - left.count);
+            for (uint32_t b = 0; b < binCount; ++b)
+            {
+                BuildNode& child = b < bestSplit ? left : right;
+                child.bounds.Grow(bins[bestAxis][b].bounds);
+            }
+            left.centroidBounds = centroidBounds[0];
+            right.centroidBounds = centroidBounds[1];
+            return true;
+        }
+    };
+
+    void Flatten(const std::vector<BuildNode>& buildNodes, uint32_t index, uint32_t depth,
+        std::vector<BvhNode>& nodes, BvhStatistics& statistics)
+    {
+        const BuildNode& source = buildNodes[index];
+        uint32_t self = static_cast<uint32_t>(nodes.size());
+        nodes.push_back({ source.bounds.min, source.first, source.bounds.max, source.count });
+        statistics.maxDepth = std::max(statistics.maxDepth, depth);
+        if (source.children[0] == NO_CHILD)
+        {
+            statistics.leafCount++;
+            return;
+        }
+        nodes[self].count = 0;
+        Flatten(buildNodes, source.children[0], depth + 1, nodes, statistics);
+        nodes[self].offset = static_cast<uint32_t>(nodes.size());
+        Flatten(buildNodes, source.children[1], depth + 1, nodes, statistics);
+    }
+
+    inline bool IntersectBox(const BvhNode& node, const XMFLOAT3& origin, const XMFLOAT3& inverse,
+        float tMin, float tMax, float& tEntry)
+    {
+        float t0 = (node.min.x - origin.x) * inverse.x, t1 = (node.max.x - origin.x) * inverse.x;
+        tMin = std::max(tMin, std::min(t0, t1));
+        tMax = std::min(tMax, std::max(t0, t1));
+        t0 = (node.min.y - origin.y) * inverse.y, t1 = (node.max.y - origin.y) * inverse.y;
+        tMin = std::max(tMin, std::min(t0, t1));
+        tMax = std::min(tMax, std::max(t0, t1));
+        t0 = (node.min.z - origin.z) * inverse.z, t1 = (node.max.z - origin.z) * inverse.z;
+        tMin = std::max(tMin, std::min(t0, t1));
+        tMax = std::min(tMax, std::max(t0, t1));
+        tEntry = tMin;
+        return tMin <= tMax;
+    }
+
+    // Moller-Trumbore
+    inline bool IntersectTriangle(const XMFLOAT3* v, const BvhRay& ray, float tMax, float& t, float& u, float& w)
+    {
+        XMFLOAT3 e1(v[1].x - v[0].x, v[1].y - v[0].y, v[1].z - v[0].z);
+        XMFLOAT3 e2(v[2].x - v[0].x, v[2].y - v[0].y, v[2].z - v[0].z);
+        const XMFLOAT3& d = ray.direction;
+        XMFLOAT3 p(d.y * e2.z - d.z * e2.y, d.z * e2.x - d.x * e2.z, d.x * e2.y - d.y * e2.x);
+        float determinant = e1.x * p.x + e1.y * p.y + e1.z * p.z;
+        if (std::abs(determinant) < 1e-20f) return false;
+        float inverse = 1.f / determinant;
+        XMFLOAT3 s(ray.origin.x - v[0].x, ray.origin.y - v[0].y, ray.origin.z - v[0].z);
+        u = (s.x * p.x + s.y * p.y + s.z * p.z) * inverse;
+        if (u < 0.f || u > 1.f) return false;
+        XMFLOAT3 q(s.y * e1.z - s.z * e1.y, s.z * e1.x - s.x * e1.z, s.x * e1.y - s.y * e1.x);
+        w = (d.x * q.x + d.y * q.y + d.z * q.z) * inverse;
+        if (w < 0.f || u + w > 1.f) return false;
+        t = (e2.x * q.x + e2.y * q.y + e2.z * q.z) * inverse;
+        return t >= ray.tMin && t < tMax;
+    }
+}
+
+Bvh Bvh::Build(const std::vector<uint32_t>& indicies, const XMFLOAT3* positions, size_t vertexCount,
+    size_t vertexStride, const BvhConfig& config)
+{
+    auto start = std::chrono::steady_clock::now();
+    Bvh bvh;
+    uint32_t triangleCount = static_cast<uint32_t>(indicies.size() / 3);
+    if (triangleCount == 0) return bvh;
+    auto pool = TaskPool::GetInstance();
+
+    // 1. triangle bounds and centroids, the root's bounds per chunk
+    Builder builder(config);
+    auto& primitives = builder.primitives;
+    primitives.resize(triangleCount);
+    size_t chunkCount = (triangleCount + BIN_GRAIN - 1) / BIN_GRAIN;
+    std::vector<Bounds> chunkBounds(chunkCount, Bounds::Empty());
+    std::vector<Bounds> chunkCentroidBounds(chunkCount, Bounds::Empty());
+    pool->ParallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk)
+        {
+            uint32_t last = static_cast<uint32_t>(std::min<size_t>((chunk + 1) * BIN_GRAIN, triangleCount));
+            for (uint32_t t = static_cast<uint32_t>(chunk * BIN_GRAIN); t < last; ++t)
+            {
+                auto& primitive = primitives[t];
+                if (indicies[t * 3] >= vertexCount || indicies[t * 3 + 1] >= vertexCount
+                    || indicies[t * 3 + 2] >= vertexCount)
+                {
+                    primitive.triangle = INVALID_TRIANGLE;
+                    continue;
+                }
+                Bounds b = Bounds::Empty();
+                for (int k = 0; k < 3; ++k) b.Grow(GetPosition(positions, vertexStride, indicies[t * 3 + k]));
+                primitive.bounds = b;
+                primitive.centroid = XMFLOAT3((b.min.x + b.max.x) * 0.5f, (b.min.y + b.max.y) * 0.5f, (b.min.z + b.max.z) * 0.5f);
+                primitive.triangle = t;
+                chunkBounds[chunk].Grow(b);
+                chunkCentroidBounds[chunk].Grow(primitive.centroid);
+            }
+        }
+    });
+
+    primitives.erase(std::remove_if(primitives.begin(), primitives.end(),
+        [](const Primitive& primitive) { return primitive.triangle == INVALID_TRIANGLE; }), primitives.end());
+    triangleCount = static_cast<uint32_t>(primitives.size());
+    if (triangleCount == 0) return bvh;
+
+    // 2. top down, every split allocates both children at once
+    builder.nodes.resize(std::max(1u, triangleCount * 2 - 1));
+    BuildNode& root = builder.nodes[0];
+    root = MakeNode(0, triangleCount);
+    for (size_t chunk = 0; chunk < chunkCount; ++chunk)
+    {
+        root.bounds.Grow(chunkBounds[chunk]);
+        root.centroidBounds.Grow(chunkCentroidBounds[chunk]);
+    }
+    builder.nodeCount = 1;
+    builder.Split(0, 0);
+
+    // 3. depth first, the leaves' triangles are already consecutive
+    bvh.m_nodes.reserve(builder.nodeCount);
+    Flatten(builder.nodes, 0, 0, bvh.m_nodes, bvh.m_statistics);
+    bvh.m_triangles.resize(triangleCount);
+    bvh.m_vertices.resize(static_cast<size_t>(triangleCount) * 3);
+    pool->ParallelFor(triangleCount, BIN_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint32_t t = primitives[i].triangle;
+            bvh.m_triangles[i] = t;
+            for (int k = 0; k < 3; ++k) bvh.m_vertices[i * 3 + k] = GetPosition(positions, vertexStride, indicies[t * 3 + k]);
+        }
+    });
+
+    auto& statistics = bvh.m_statistics;
+    statistics.nodeCount = static_cast<uint32_t>(bvh.m_nodes.size());
+    statistics.averageLeafTriangles = static_cast<float>(triangleCount) / statistics.leafCount;
+    Bounds rootBounds;
+    rootBounds.min = bvh.m_nodes[0].min;
+    rootBounds.max = bvh.m_nodes[0].max;
+    float rootArea = rootBounds.Area();
+    double cost = 0.;
+    for (auto& node: bvh.m_nodes)
+    {
+        Bounds b;
+        b.min = node.min;
+        b.max = node.max;
+        cost += b.Area() * (node.IsLeaf() ? config.intersectionCost * node.count : config.traversalCost);
+    }
+    statistics.sahCost = rootArea > 0.f ? static_cast<float>(cost / rootArea) : 0.f;
+    statistics.buildMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return bvh;
+}
+
+const std::vector<BvhNode>& Bvh::GetNodes() const
+{
+    return m_nodes;
+}
+
+const std::vector<uint32_t>& Bvh::GetTriangles() const
+{
+    return m_triangles;
+}
+
+const std::vector<XMFLOAT3>& Bvh::GetTriangleVertices() const
+{
+    return m_vertices;
+}
+
+const BvhStatistics& Bvh::GetStatistics() const
+{
+    return m_statistics;
+}
+
+bool Bvh::Intersect(const BvhRay& ray, BvhHit& hit, BvhTraversalStatistics* statistics) const
+{
+    if (m_nodes.empty()) return false;
+    XMFLOAT3 inverse(1.f / ray.direction.x, 1.f / ray.direction.y, 1.f / ray.direction.z);
+    float tMax = std::min(ray.tMax, hit.t);
+    uint64_t nodesVisited = 0;
+    uint64_t trianglesTested = 0;
+    bool found = false;
+
+    // with the entry distance, nodes behind a hit found meanwhile are skipped
+    uint32_t stack[MAX_DEPTH * 2];
+    float entries[MAX_DEPTH * 2];
+    uint32_t stackSize = 0;
+    if (IntersectBox(m_nodes[0], ray.origin, inverse, ray.tMin, tMax, entries[0])) stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        stackSize--;
+        if (entries[stackSize] > tMax) continue;
+        const BvhNode& node = m_nodes[stack[stackSize]];
+        nodesVisited++;
+        if (node.IsLeaf())
+        {
+            for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+            {
+                float t, u, v;
+                trianglesTested++;
+                if (IntersectTriangle(&m_vertices[i * 3], ray, tMax, t, u, v))
+                {
+                    tMax = t;
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    hit.triangle = m_triangles[i];
+                    found = true;
+                }
+            }
+            continue;
+        }
+
+        // the nearer child is popped first
+        uint32_t children[2] = { static_cast<uint32_t>(&node - m_nodes.data()) + 1, node.offset };
+        float entry[2];
+        bool hits[2] = {
+            IntersectBox(m_nodes[children[0]], ray.origin, inverse, ray.tMin, tMax, entry[0]),
+            IntersectBox(m_nodes[children[1]], ray.origin, inverse, ray.tMin, tMax, entry[1]) };
+        if (hits[0] && hits[1])
+        {
+            int nearer = entry[1] < entry[0] ? 1 : 0;
+            stack[stackSize] = children[1 - nearer];
+            entries[stackSize++] = entry[1 - nearer];
+            stack[stackSize] = children[nearer];
+            entries[stackSize++] = entry[nearer];
+        }
+        else if (hits[0] || hits[1])
+        {
+            int c = hits[0] ? 0 : 1;
+            stack[stackSize] = children[c];
+            entries[stackSize++] = entry[c];
+        }
+    }
+
+    if (statistics)
+    {
+        statistics->rays++;
+        statistics->nodesVisited += nodesVisited;
+        statistics->trianglesTested += trianglesTested;
+    }
+    return found;
+}
\ No newline at end of file
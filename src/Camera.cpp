@@ -1,4 +1,44 @@
 #include "Camera.h"
+#include <cmath>
+
+namespace
+{
+    inline bool Equal(const XMFLOAT4& a, const XMFLOAT4& b)
+    {
+        return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w;
+    }
+
+    // Gribb-Hartmann, the planes are sums of the columns of the clip matrix
+    Frustum ExtractFrustum(const XMMATRIX& clipMatrix)
+    {
+        XMFLOAT4X4 m;
+        XMStoreFloat4x4(&m, clipMatrix);
+        auto column = [&m](int c) { return XMFLOAT4(m.m[0][c], m.m[1][c], m.m[2][c], m.m[3][c]); };
+        auto combine = [](const XMFLOAT4& a, const XMFLOAT4& b, float sign) {
+            return XMFLOAT4(a.x + sign * b.x, a.y + sign * b.y, a.z + sign * b.z, a.w + sign * b.w);
+        };
+        XMFLOAT4 x = column(0), y = column(1), z = column(2), w = column(3);
+
+        Frustum frustum;
+        frustum.planes[Frustum::Left] = combine(w, x, 1.f);
+        frustum.planes[Frustum::Right] = combine(w, x, -1.f);
+        frustum.planes[Frustum::Bottom] = combine(w, y, 1.f);
+        frustum.planes[Frustum::Top] = combine(w, y, -1.f);
+        // depth is in [0, w]
+        frustum.planes[Frustum::Near] = z;
+        frustum.planes[Frustum::Far] = combine(w, z, -1.f);
+        return frustum;
+    }
+
+    void NormalizePlanes(Frustum& frustum)
+    {
+        for (auto& plane: frustum.planes)
+        {
+            float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+            if (length > 0.f) plane = XMFLOAT4(plane.x / length, plane.y / length, plane.z / length, plane.w / length);
+        }
+    }
+}
 
 Camera::Camera(
     float windowWidth, float windowHeight,
@@ -12,8 +52,7 @@ Camera::Camera(
     , m_upDirection(upDirection)
 {
     SetAspectRatio(windowWidth, windowHeight);
-    SetViewMatrix();
-    SetProjectionMatrix();
+    UpdateDerivedData();
 }
 
 void Camera::SetAspectRatio(float windowWidth, float windowHeight)
@@ -37,39 +76,147 @@ void Camera::SetProjectionMatrix()
         m_aspectRatio, m_near, m_far);
 }
 
+void Camera::MarkDirty(uint32_t flags)
+{
+    m_dirty |= flags;
+    m_version++;
+}
+
+void Camera::UpdateDerivedData()
+{
+    if (!m_dirty) return;
+    if (m_dirty & VIEW_DIRTY)
+    {
+        SetViewMatrix();
+        m_inverseViewMatrix = XMMatrixInverse(nullptr, m_viewMatrix);
+    }
+    if (m_dirty & PROJECTION_DIRTY)
+    {
+        SetProjectionMatrix();
+        m_inverseProjectionMatrix = XMMatrixInverse(nullptr, m_projectionMatrix);
+    }
+    m_viewProjectionMatrix = m_viewMatrix * m_projectionMatrix;
+    m_inverseViewProjectionMatrix = m_inverseProjectionMatrix * m_inverseViewMatrix;
+    m_frustum = ExtractFrustum(m_viewProjectionMatrix);
+    NormalizePlanes(m_frustum);
+    m_dirty = 0;
+}
+
+// Setting what is already there is no change, so per frame updates from input
+// keep the version.
 void Camera::UpdateAspectRatio(float aspectRatio)
 {
+    if (m_aspectRatio == aspectRatio) return;
     m_aspectRatio = aspectRatio;
+    MarkDirty(PROJECTION_DIRTY);
 }
 void Camera::UpdateAspectRatio(float windowWidth, float windowHeight)
 {
-    SetAspectRatio(windowWidth, windowHeight);
+    UpdateAspectRatio(windowWidth / windowHeight);
 }
 void Camera::UpdateFoV(float FoV)
 {
+    if (m_fov == FoV) return;
     m_fov = FoV;
+    MarkDirty(PROJECTION_DIRTY);
 }
 void Camera::UpdatePosition(XMFLOAT4 position)
 {
+    if (Equal(m_position, position)) return;
     m_position = position;
+    MarkDirty(VIEW_DIRTY);
 }
 void Camera::UpdateFocusPoint(XMFLOAT4 focusPoint)
 {
+    if (Equal(m_focusPoint, focusPoint)) return;
     m_focusPoint = focusPoint;
+    MarkDirty(VIEW_DIRTY);
 }
 void Camera::UpdateUpDirection(XMFLOAT4 upDirection)
 {
+    if (Equal(m_upDirection, upDirection)) return;
     m_upDirection = upDirection;
+    MarkDirty(VIEW_DIRTY);
 }
 
 XMMATRIX Camera::GetViewMatrix()
 {
-    SetViewMatrix();
+    UpdateDerivedData();
     return m_viewMatrix;
 }
 
 XMMATRIX Camera::GetProjectionMatrix()
 {
-    SetProjectionMatrix();
+    UpdateDerivedData();
     return m_projectionMatrix;
+}
+
+XMMATRIX Camera::GetViewProjectionMatrix()
+{
+    UpdateDerivedData();
+    return m_viewProjectionMatrix;
+}
+
+XMMATRIX Camera::GetInverseViewMatrix()
+{
+    UpdateDerivedData();
+    return m_inverseViewMatrix;
+}
+
+XMMATRIX Camera::GetInverseProjectionMatrix()
+{
+    UpdateDerivedData();
+    return m_inverseProjectionMatrix;
+}
+
+XMMATRIX Camera::GetInverseViewProjectionMatrix()
+{
+    UpdateDerivedData();
+    return m_inverseViewProjectionMatrix;
+}
+
+const Frustum& Camera::GetFrustum()
+{
+    UpdateDerivedData();
+    return m_frustum;
+}
+
+Frustum Camera::GetFrustum(const XMMATRIX& modelMatrix)
+{
+    // A point p is inside a world plane if dot(p * modelMatrix, plane) >= 0,
+    // the plane in model space is modelMatrix * plane.
+    const Frustum& world = GetFrustum();
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(&m, modelMatrix);
+    Frustum frustum;
+    for (int i = 0; i < Frustum::PLANE_COUNT; ++i)
+    {
+        const XMFLOAT4& p = world.planes[i];
+        auto row = [&](int r) { return m.m[r][0] * p.x + m.m[r][1] * p.y + m.m[r][2] * p.z + m.m[r][3] * p.w; };
+        frustum.planes[i] = XMFLOAT4(row(0), row(1), row(2), row(3));
+    }
+    NormalizePlanes(frustum);
+    return frustum;
+}
+
+uint64_t Camera::GetVersion() const
+{
+    return m_version;
+}
+
+XMFLOAT4 Camera::GetPosition() const
+{
+    return m_position;
+}
+float Camera::GetFoV() const
+{
+    return m_fov;
+}
+float Camera::GetNear() const
+{
+    return m_near;
+}
+float Camera::GetFar() const
+{
+    return m_far;
 }
\ No newline at end of file
@@ -0,0 +1,255 @@
+#include "Culling.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <xmmintrin.h>
+
+namespace
+{
+    // padding of the SoA arrays, outside of every frustum
+    const float NEVER_VISIBLE = -std::numeric_limits<float>::max();
+
+    uint32_t RoundUp(uint32_t count)
+    {
+        return (count + FrustumCuller::BATCH - 1) / FrustumCuller::BATCH * FrustumCuller::BATCH;
+    }
+
+    // Appends a slot to arrays that are full, the new batch is padding.
+    void Grow(std::vector<float>& array, uint32_t count, float padding)
+    {
+        if (count == array.size()) array.resize(array.size() + FrustumCuller::BATCH, padding);
+    }
+
+    struct PlaneBatch
+    {
+        __m128 a, b, c, d;
+        // |a|, |b|, |c| for the box extents
+        __m128 absA, absB, absC;
+    };
+
+    void LoadPlanes(const Frustum& frustum, PlaneBatch (&planes)[Frustum::PLANE_COUNT])
+    {
+        for (int p = 0; p < Frustum::PLANE_COUNT; ++p)
+        {
+            const XMFLOAT4& plane = frustum.planes[p];
+            planes[p] = { _mm_set1_ps(plane.x), _mm_set1_ps(plane.y), _mm_set1_ps(plane.z), _mm_set1_ps(plane.w),
+                _mm_set1_ps(std::abs(plane.x)), _mm_set1_ps(std::abs(plane.y)), _mm_set1_ps(std::abs(plane.z)) };
+        }
+    }
+
+    // test(first) returns the visibility mask of objects first..first + BATCH - 1.
+    // Every chunk writes its visible objects to its own range of visible, the
+    // ranges are moved together afterwards.
+    template <typename Test>
+    void CullBatches(uint32_t count, const Test& test, std::vector<uint32_t>& visible)
+    {
+        visible.resize(RoundUp(count));
+        if (count == 0) return;
+        uint32_t chunkCount = (count + FrustumCuller::GRAIN - 1) / FrustumCuller::GRAIN;
+        std::vector<uint32_t> chunkVisible(chunkCount);
+        auto cull = [&](uint32_t chunk) {
+            uint32_t first = chunk * FrustumCuller::GRAIN;
+            uint32_t last = std::min(first + FrustumCuller::GRAIN, count);
+            uint32_t out = first;
+            for (uint32_t i = first; i < last; i += FrustumCuller::BATCH)
+            {
+                int mask = test(i);
+                // out never passes i + b, so writing before the check is safe
+                for (uint32_t b = 0; b < FrustumCuller::BATCH; ++b)
+                {
+                    visible[out] = i + b;
+                    out += (mask >> b) & 1;
+                }
+            }
+            chunkVisible[chunk] = out - first;
+        };
+        if (chunkCount == 1)
+        {
+            cull(0);
+        }
+        else
+        {
+            TaskPool::GetInstance()->ParallelFor(chunkCount, 1, [&cull](size_t begin, size_t end) {
+                for (size_t chunk = begin; chunk < end; ++chunk) cull(static_cast<uint32_t>(chunk));
+            });
+        }
+
+        uint32_t total = chunkVisible[0];
+        for (uint32_t chunk = 1; chunk < chunkCount; ++chunk)
+        {
+            std::memmove(&visible[total], &visible[chunk * FrustumCuller::GRAIN], chunkVisible[chunk] * sizeof(uint32_t));
+            total += chunkVisible[chunk];
+        }
+        visible.resize(total);
+    }
+}
+
+uint32_t CullingSpheres::Add(const XMFLOAT3& center, float radius)
+{
+    Grow(m_x, m_count, 0.f);
+    Grow(m_y, m_count, 0.f);
+    Grow(m_z, m_count, 0.f);
+    Grow(m_radius, m_count, NEVER_VISIBLE);
+    Set(m_count, center, radius);
+    return m_count++;
+}
+
+void CullingSpheres::Set(uint32_t index, const XMFLOAT3& center, float radius)
+{
+    m_x[index] = center.x;
+    m_y[index] = center.y;
+    m_z[index] = center.z;
+    m_radius[index] = radius;
+}
+
+void CullingSpheres::Clear()
+{
+    m_x.clear();
+    m_y.clear();
+    m_z.clear();
+    m_radius.clear();
+    m_count = 0;
+}
+
+uint32_t CullingSpheres::GetCount() const
+{
+    return m_count;
+}
+
+const float* CullingSpheres::GetX() const
+{
+    return m_x.data();
+}
+
+const float* CullingSpheres::GetY() const
+{
+    return m_y.data();
+}
+
+const float* CullingSpheres::GetZ() const
+{
+    return m_z.data();
+}
+
+const float* CullingSpheres::GetRadius() const
+{
+    return m_radius.data();
+}
+
+uint32_t CullingBoxes::Add(const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        Grow(m_center[k], m_count, 0.f);
+        Grow(m_extents[k], m_count, NEVER_VISIBLE);
+    }
+    Set(m_count, center, extents);
+    return m_count++;
+}
+
+void CullingBoxes::Set(uint32_t index, const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        m_center[k][index] = (&center.x)[k];
+        m_extents[k][index] = (&extents.x)[k];
+    }
+}
+
+void CullingBoxes::Clear()
+{
+    for (int k = 0; k < 3; ++k)
+    {
+        m_center[k].clear();
+        m_extents[k].clear();
+    }
+    m_count = 0;
+}
+
+uint32_t CullingBoxes::GetCount() const
+{
+    return m_count;
+}
+
+const float* CullingBoxes::GetCenter(int axis) const
+{
+    return m_center[axis].data();
+}
+
+const float* CullingBoxes::GetExtents(int axis) const
+{
+    return m_extents[axis].data();
+}
+
+void FrustumCuller::Cull(const Frustum& frustum, const CullingSpheres& spheres, std::vector<uint32_t>& visible)
+{
+    PlaneBatch planes[Frustum::PLANE_COUNT];
+    LoadPlanes(frustum, planes);
+    const float* x = spheres.GetX();
+    const float* y = spheres.GetY();
+    const float* z = spheres.GetZ();
+    const float* radius = spheres.GetRadius();
+    CullBatches(spheres.GetCount(), [&](uint32_t first) {
+        __m128 cx = _mm_loadu_ps(x + first);
+        __m128 cy = _mm_loadu_ps(y + first);
+        __m128 cz = _mm_loadu_ps(z + first);
+        __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(radius + first));
+        __m128 inside = _mm_cmpge_ps(_mm_loadu_ps(radius + first), _mm_setzero_ps());
+        for (auto& plane: planes)
+        {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, plane.a), _mm_mul_ps(cy, plane.b)),
+                _mm_add_ps(_mm_mul_ps(cz, plane.c), plane.d));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+        }
+        return _mm_movemask_ps(inside);
+    }, visible);
+}
+
+void FrustumCuller::Cull(const Frustum& frustum, const CullingBoxes& boxes, std::vector<uint32_t>& visible)
+{
+    PlaneBatch planes[Frustum::PLANE_COUNT];
+    LoadPlanes(frustum, planes);
+    const float* center[3] = { boxes.GetCenter(0), boxes.GetCenter(1), boxes.GetCenter(2) };
+    const float* extents[3] = { boxes.GetExtents(0), boxes.GetExtents(1), boxes.GetExtents(2) };
+    CullBatches(boxes.GetCount(), [&](uint32_t first) {
+        __m128 cx = _mm_loadu_ps(center[0] + first);
+        __m128 cy = _mm_loadu_ps(center[1] + first);
+        __m128 cz = _mm_loadu_ps(center[2] + first);
+        __m128 ex = _mm_loadu_ps(extents[0] + first);
+        __m128 ey = _mm_loadu_ps(extents[1] + first);
+        __m128 ez = _mm_loadu_ps(extents[2] + first);
+        __m128 inside = _mm_cmpge_ps(ex, _mm_setzero_ps());
+        for (auto& plane: planes)
+        {
+            // the box is outside if even its corner furthest along the plane normal is
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, plane.a), _mm_mul_ps(cy, plane.b)),
+                _mm_add_ps(_mm_mul_ps(cz, plane.c), plane.d));
+            __m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, plane.absA), _mm_mul_ps(ey, plane.absB)),
+                _mm_mul_ps(ez, plane.absC));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+        }
+        return _mm_movemask_ps(inside);
+    }, visible);
+}
+
+bool FrustumCuller::IsVisible(const Frustum& frustum, const XMFLOAT3& center, float radius)
+{
+    for (auto& plane: frustum.planes)
+    {
+        if (plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w < -radius) return false;
+    }
+    return true;
+}
+
+bool FrustumCuller::IsVisible(const Frustum& frustum, const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+    for (auto& plane: frustum.planes)
+    {
+        float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        float reach = std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y + std::abs(plane.z) * extents.z;
+        if (distance + reach < 0.f) return false;
+    }
+    return true;
+}
\ No newline at end of file
@@ -14,6 +14,7 @@ DXWindow::DXWindow(const wchar_t* name, uint32_t w, uint32_t h) noexcept
 {
     m_assetsPath = shader_path;
     m_camera = std::make_shared<Camera>(static_cast<float>(w), static_cast<float>(h));
+    m_modelNode = m_scene.AddNode();
 }
 
 void DXWindow::ParseCommandLineArguments()
@@ -96,6 +97,33 @@ void DXWindow::UpdateBufferResource(
             0, 0, 1, &subresourceData);
     }
 }
+
+void DXWindow::UpdateBufferRange(
+    ComPtr<ID3D12GraphicsCommandList> commandList,
+    ID3D12Resource* pDestinationResource,
+    ID3D12Resource** pIntermediateResource,
+    size_t offset, size_t size, const void* bufferData)
+{
+    ThrowIfFailed(m_device->CreateCommittedResource(
+        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+        D3D12_HEAP_FLAG_NONE,
+        &CD3DX12_RESOURCE_DESC::Buffer(size),
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(pIntermediateResource)));
+
+    void* mapped = nullptr;
+    CD3DX12_RANGE readRange(0, 0);
+    ThrowIfFailed((*pIntermediateResource)->Map(0, &readRange, &mapped));
+    memcpy(mapped, bufferData, size);
+    (*pIntermediateResource)->Unmap(0, nullptr);
+
+    // buffers decay to the common state after every ExecuteCommandLists and
+    // get promoted to copy dest here, the copy leaves the range in use by
+    // earlier draws untouched
+    commandList->CopyBufferRegion(pDestinationResource, offset, *pIntermediateResource, 0, size);
+}
+
 struct MVPData
 {
     XMMATRIX mvp;
@@ -174,12 +202,7 @@ void DXWindow::LoadAssets()
             )
         );
 
-        D3D12_INPUT_ELEMENT_DESC inputElementDescs[] =
-        {
-            { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-            { "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-            // { "COLOR", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-        };
+        auto inputElementDescs = ModelVertexLayout::GetInputElementDescs();
 
         struct PipelineStateStream
         {
@@ -197,7 +220,7 @@ void DXWindow::LoadAssets()
         rtvFormats.RTFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM;
 
         pipelineStateStream.pRootSignature = m_RootSignature.Get();
-        pipelineStateStream.InputLayout = { inputElementDescs, _countof(inputElementDescs) };
+        pipelineStateStream.InputLayout = { inputElementDescs.data(), static_cast<UINT>(inputElementDescs.size()) };
         pipelineStateStream.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
         pipelineStateStream.VS = CD3DX12_SHADER_BYTECODE(vertexShader.Get());
         pipelineStateStream.PS = CD3DX12_SHADER_BYTECODE(pixelShader.Get());
@@ -208,16 +231,143 @@ void DXWindow::LoadAssets()
         pipelineStateStreamDesc.SizeInBytes = sizeof(PipelineStateStream);
         pipelineStateStreamDesc.pPipelineStateSubobjectStream = &pipelineStateStream;
         ThrowIfFailed(m_device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&m_PipelineState)));
+
+        pipelineStateStream.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_POINT;
+        ThrowIfFailed(m_device->CreatePipelineState(&pipelineStateStreamDesc, IID_PPV_ARGS(&m_PointPipelineState)));
+    }
+
+    // 4. the model may still be loading, Update uploads it once it is there
+    m_model = Application::GetInstance()->GetModel();
+    if (m_model)
+    {
+        UploadModel();
+    }
+
+    ResizeDepthBuffer(m_width, m_height);
+}
+
+void DXWindow::UploadModel()
+{
+    UploadMeshBuffers();
+    m_progressiveStored = false;
+    RegisterModel();
+}
+
+void DXWindow::RegisterModel()
+{
+    // Drawing only needs the GPU copy, the residency manager may drop the CPU
+    // copy (and the GPU one while the model is not drawn) under memory pressure.
+    m_residency.Unregister(m_modelResidency);
+    MeshResidencyCallbacks callbacks;
+    callbacks.releaseCPU = [this]() { return m_model->ReleaseCPUData(); };
+    callbacks.restoreCPU = [this]() { return m_model->RestoreCPUData(); };
+    callbacks.releaseGPU = [this]() { ReleaseMeshBuffers(); };
+    callbacks.restoreGPU = [this]() {
+        UploadMeshBuffers();
+        if (m_model->IsLODReady()) UploadLODs();
+        return true;
+    };
+    m_modelResidency = m_residency.Register(m_model->GetCPUBytes(), GetMeshGPUBytes(), true, true, callbacks);
+}
+
+void DXWindow::StreamModel(ProgressiveMeshStream& stream)
+{
+    ProgressiveLevel level;
+    while (stream.Poll(level))
+    {
+        UploadStreamLevel(level, stream.GetHeader());
+
+        m_streamData.vertices.insert(m_streamData.vertices.end(), level.vertices.begin(), level.vertices.end());
+        m_streamData.vertexCounts.push_back(static_cast<uint32_t>(m_streamData.vertices.size()));
+        m_streamData.levels.push_back({ std::move(level.indicies), level.error });
+    }
+    if (!stream.IsDone()) return;
+
+    // the buffers already hold the full mesh, only the LODs are left to upload
+    std::shared_ptr<Model> model;
+    if (!stream.HasFailed() && m_streamData.levels.size() == stream.GetHeader().levelCount)
+    {
+        m_streamData.bounds = stream.GetHeader().bounds;
+        model = std::make_shared<Model>(std::move(m_streamData), stream.GetSourcePath(), stream.GetCacheFlags());
+    }
+    m_streamData = ProgressiveMeshData();
+    // resets stream
+    Application::GetInstance()->EndModelStream(model);
+    if (model)
+    {
+        m_model = model;
+        m_streamIndexCount = 0;
+        m_progressiveStored = true;
+        RegisterModel();
     }
+}
 
+void DXWindow::UploadStreamLevel(const ProgressiveLevel& level, const ProgressiveMesh::Header& header)
+{
     auto commandList = m_commandQueue->GetCommandList(m_PipelineState.Get());
-    
+
+    ComPtr<ID3D12Resource> intermediateVertexBuffer;
+    ComPtr<ID3D12Resource> intermediateIndexBuffer;
+    // frames in flight may still draw the previous level
+    ComPtr<ID3D12Resource> previousIndexBuffer = m_IndexBuffer;
+
+    if (level.level == 0)
+    {
+        // room for all levels up front, each level fills in its own range
+        UpdateBufferResource(commandList, &m_VertexBuffer, &intermediateVertexBuffer,
+            header.vertexCount, sizeof(Vertex), nullptr);
+
+        m_VertexBufferView.BufferLocation = m_VertexBuffer->GetGPUVirtualAddress();
+        m_VertexBufferView.SizeInBytes = header.vertexCount * sizeof(Vertex);
+        m_VertexBufferView.StrideInBytes = sizeof(Vertex);
+        m_LODIndexOffsets.clear();
+        m_LODIndexBuffer.Reset();
+    }
+    if (!level.vertices.empty())
+    {
+        UpdateBufferRange(commandList, m_VertexBuffer.Get(), &intermediateVertexBuffer,
+            static_cast<size_t>(level.firstVertex) * sizeof(Vertex), level.vertices.size() * sizeof(Vertex),
+            level.vertices.data());
+    }
+
+    UpdateBufferResource(commandList, &m_IndexBuffer, &intermediateIndexBuffer,
+        level.indicies.size(), sizeof(uint32_t), level.indicies.data());
+
+    m_IndexBufferView.BufferLocation = m_IndexBuffer->GetGPUVirtualAddress();
+    m_IndexBufferView.Format = DXGI_FORMAT_R32_UINT;
+    m_IndexBufferView.SizeInBytes = static_cast<UINT>(level.indicies.size() * sizeof(uint32_t));
+    m_streamIndexCount = static_cast<uint32_t>(level.indicies.size());
+
+    m_commandQueue->ExecuteCommandList(commandList);
+    // the intermediate buffers have to outlive the copy
+    m_commandQueue->Flush();
+}
+
+void DXWindow::ReleaseMeshBuffers()
+{
+    m_VertexBuffer.Reset();
+    m_IndexBuffer.Reset();
+    m_LODIndexBuffer.Reset();
+    m_LODIndexOffsets.clear();
+}
+
+uint64_t DXWindow::GetMeshGPUBytes() const
+{
+    uint64_t bytes = 0;
+    if (m_VertexBuffer) bytes += m_VertexBufferView.SizeInBytes;
+    if (m_IndexBuffer) bytes += m_IndexBufferView.SizeInBytes;
+    if (m_LODIndexBuffer) bytes += m_LODIndexBufferView.SizeInBytes;
+    return bytes;
+}
+
+void DXWindow::UploadMeshBuffers()
+{
+    auto commandList = m_commandQueue->GetCommandList(m_PipelineState.Get());
+
     ComPtr<ID3D12Resource> intermediateVertexBuffer;
     ComPtr<ID3D12Resource> intermediateIndexBuffer;
 
-    // 4.
     {
-        m_model = Application::GetInstance()->GetModel();
         auto vertices = m_model->GetVertices();
         auto numVertices = m_model->GetVerticesNum();
         auto indicies = m_model->GetIndicies();
@@ -234,21 +384,57 @@ void DXWindow::LoadAssets()
 
         commandList->IASetVertexBuffers(0, 1, &m_VertexBufferView);
 
-        // Upload index buffer data.
-        UpdateBufferResource(commandList, &m_IndexBuffer, &intermediateIndexBuffer,
-            numIndicies, sizeof(uint32_t), indicies.data());
+        // point clouds have no index buffer
+        if (numIndicies > 0)
+        {
+            // Upload index buffer data.
+            UpdateBufferResource(commandList, &m_IndexBuffer, &intermediateIndexBuffer,
+                numIndicies, sizeof(uint32_t), indicies.data());
 
-        // Create index buffer view.
-        m_IndexBufferView.BufferLocation = m_IndexBuffer->GetGPUVirtualAddress();
-        m_IndexBufferView.Format = DXGI_FORMAT_R32_UINT;
-        m_IndexBufferView.SizeInBytes = numIndicies * sizeof(uint32_t);
+            // Create index buffer view.
+            m_IndexBufferView.BufferLocation = m_IndexBuffer->GetGPUVirtualAddress();
+            m_IndexBufferView.Format = DXGI_FORMAT_R32_UINT;
+            m_IndexBufferView.SizeInBytes = numIndicies * sizeof(uint32_t);
 
-        commandList->IASetIndexBuffer(&m_IndexBufferView);
+            commandList->IASetIndexBuffer(&m_IndexBufferView);
+        }
+        else m_IndexBuffer.Reset();
     }
 
     m_commandQueue->ExecuteCommandList(commandList);
+    // the intermediate buffers have to outlive the copy
+    m_commandQueue->Flush();
 
-    ResizeDepthBuffer(m_width, m_height);
+    // LODs of a previous model do not match the new vertex buffer
+    m_LODIndexOffsets.clear();
+    m_LODIndexBuffer.Reset();
+}
+
+void DXWindow::UploadLODs()
+{
+    std::vector<uint32_t> indicies;
+    m_LODIndexOffsets.clear();
+    for (uint32_t level = 1; level < m_model->GetLODCount(); ++level)
+    {
+        auto& lod = m_model->GetLODIndicies(level);
+        m_LODIndexOffsets.push_back(static_cast<uint32_t>(indicies.size()));
+        indicies.insert(indicies.end(), lod.begin(), lod.end());
+    }
+
+    auto commandList = m_commandQueue->GetCommandList(m_PipelineState.Get());
+    ComPtr<ID3D12Resource> intermediateIndexBuffer;
+    UpdateBufferResource(commandList, &m_LODIndexBuffer, &intermediateIndexBuffer,
+        indicies.size(), sizeof(uint32_t), indicies.data());
+
+    m_LODIndexBufferView.BufferLocation = m_LODIndexBuffer->GetGPUVirtualAddress();
+    m_LODIndexBufferView.Format = DXGI_FORMAT_R32_UINT;
+    m_LODIndexBufferView.SizeInBytes = static_cast<UINT>(indicies.size() * sizeof(uint32_t));
+
+    m_commandQueue->ExecuteCommandList(commandList);
+    // the intermediate buffer has to outlive the copy
+    m_commandQueue->Flush();
+
+    m_residency.UpdateSizes(m_modelResidency, m_model->GetCPUBytes(), GetMeshGPUBytes());
 }
 
 void DXWindow::Init(HWND hWnd)
@@ -276,8 +462,10 @@ void DXWindow::Destroy()
 
     m_RootSignature->Release();
     m_PipelineState->Release();
-    m_VertexBuffer->Release();
-    m_IndexBuffer->Release();
+    // the model may never have finished loading
+    m_PointPipelineState->Release();
+    if (m_VertexBuffer) m_VertexBuffer->Release();
+    if (m_IndexBuffer) m_IndexBuffer->Release();
     m_DepthBuffer->Release();
 }
 
@@ -321,6 +509,7 @@ void DXWindow::Update()
     static std::chrono::high_resolution_clock clock;
     static auto t0 = clock.now();
     static double totalTime = 0.;
+    auto app = Application::GetInstance();
 
     frameCounter++;
     auto t1 = clock.now();
@@ -332,7 +521,23 @@ void DXWindow::Update()
     {
         char buffer[500];
         auto fps = frameCounter / elapsedSeconds;
-        sprintf_s(buffer, 500, "FPS: %f\n", fps);
+        if (app->GetModelStream().IsValid())
+        {
+            sprintf_s(buffer, 500, "FPS: %f  Streaming model: level %u/%u\n", fps,
+                app->GetModelStream().GetLevelsPolled(), app->GetModelStream().GetHeader().levelCount);
+        }
+        else if (app->GetModelLoad().IsValid())
+        {
+            sprintf_s(buffer, 500, "FPS: %f  Loading model: %.0f%%\n", fps, app->GetModelLoad().GetProgress() * 100.f);
+        }
+        else if (!app->GetModelError().empty())
+        {
+            sprintf_s(buffer, 500, "FPS: %f  Failed to load model: %s\n", fps, app->GetModelError().c_str());
+        }
+        else
+        {
+            sprintf_s(buffer, 500, "FPS: %f\n", fps);
+        }
         // OutputDebugStringA(buffer);
         // cout << buffer << "\n";
         SetWindowTextA(m_hWnd, buffer);
@@ -340,19 +545,42 @@ void DXWindow::Update()
         elapsedSeconds = 0.0;
     }
 
-    // Update the model matrix.
+    // Update the model matrix, only the rotation changes.
     float angle = static_cast<float>(totalTime * 90.0);
     // float angle = 0.f;
     const XMVECTOR rotationAxis = XMVectorSet(0, 1, 0, 0);
-    // auto scale = XMMatrixScaling(30.f, 30.f, 30.f);
-    auto scale = XMMatrixScaling(1.f, 1.f, 1.f);
-    auto rotation = XMMatrixRotationAxis(rotationAxis, XMConvertToRadians(angle));
-    // auto translation = XMMatrixTranslation(0.f, -3.f, 0.f);
-    auto translation = XMMatrixTranslation(0.f, 0.f, 0.f);
-    
-    // DXMath 里，变换是行向量左乘矩阵
-    // m_ModelMatrix = XMMatrixMultiply(XMMatrixMultiply(scale, rotation), translation); // C-style
-    m_ModelMatrix = scale * rotation * translation;
+    XMFLOAT4 rotation;
+    XMStoreFloat4(&rotation, XMQuaternionRotationAxis(rotationAxis, XMConvertToRadians(angle)));
+    m_scene.SetRotation(m_modelNode, rotation);
+    if (m_scene.Update() > 0)
+    {
+        m_ModelMatrix = XMLoadFloat4x4(&m_scene.GetWorldMatrix(m_modelNode));
+        m_modelMatrixChanged = true;
+    }
+
+    // The model and its LODs are loaded in the background, swap them in once
+    // they are done.
+    if (app->GetModelStream().IsValid())
+    {
+        StreamModel(app->GetModelStream());
+    }
+    if (app->PollModel())
+    {
+        m_model = app->GetModel();
+        UploadModel();
+    }
+    if (m_model && m_LODIndexOffsets.empty() && m_residency.IsGPUResident(m_modelResidency)
+        && m_model->IsLODReady())
+    {
+        UploadLODs();
+        // the next start streams the model coarse to fine
+        if (!m_progressiveStored) m_progressiveStored = m_model->StoreProgressive();
+    }
+    // brings the buffers back if they were evicted
+    if (m_model)
+    {
+        m_residency.Request(m_modelResidency);
+    }
 
     // Update the view matrix.
     // const XMVECTOR eyePosition = XMLoadFloat4(&g_passData.eyePos);
@@ -378,27 +606,85 @@ void DXWindow::Render()
     auto DSVHandle = m_DSVHeap->GetDescriptorHandle();
     m_swapChain->ClearRenderTarget(commandList, RTVHandle, DSVHandle);
     
+    // a model that is still streaming is drawn at its finest level so far
+    bool streaming = !m_model && m_streamIndexCount > 0;
+    if (!streaming && (!m_model || !m_residency.IsGPUResident(m_modelResidency)))
+    {
+        m_swapChain->Present(commandList);
+        m_residency.EndFrame();
+        return;
+    }
+
     // Set obj
     commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
     commandList->IASetVertexBuffers(0, 1, &m_VertexBufferView);
-    commandList->IASetIndexBuffer(&m_IndexBufferView);
 
     // Update the MVP matrix
     // XMMATRIX mvpMatrix = XMMatrixMultiply(m_ModelMatrix, m_ViewMatrix);
     // mvpMatrix = XMMatrixMultiply(mvpMatrix, m_ProjectionMatrix); // C-style
     // DXMath中矩阵是行主序，hlsl中是列主序，在C++层面做一层转置效率更高
-    auto mvp = m_ModelMatrix * m_camera->GetViewMatrix() * m_camera->GetProjectionMatrix();
-    g_MVPCB.mvp = XMMatrixTranspose(mvp);
-    // mvp.r[3] = XMVectorSet(0.f, 0.f, 0.f, 1.f);
-    g_MVPCB.modelMatrixNegaTrans = XMMatrixInverse(nullptr, m_ModelMatrix);
-    g_MVPCB.modelMatrix = XMMatrixTranspose(m_ModelMatrix);
+    if (m_modelMatrixChanged || m_camera->GetVersion() != m_cameraVersion)
+    {
+        auto mvp = m_ModelMatrix * m_camera->GetViewProjectionMatrix();
+        g_MVPCB.mvp = XMMatrixTranspose(mvp);
+        // mvp.r[3] = XMVectorSet(0.f, 0.f, 0.f, 1.f);
+        g_MVPCB.modelMatrixNegaTrans = XMMatrixInverse(nullptr, m_ModelMatrix);
+        g_MVPCB.modelMatrix = XMMatrixTranspose(m_ModelMatrix);
+        // the bounds are in model space, so is the frustum
+        m_modelFrustum = m_camera->GetFrustum(m_ModelMatrix);
+        m_modelMatrixChanged = false;
+        m_cameraVersion = m_camera->GetVersion();
+    }
 
     commandList->SetGraphicsRoot32BitConstants(0, sizeof(MVPData) / 4, &g_MVPCB, 0);
     commandList->SetGraphicsRoot32BitConstants(1, sizeof(PassData) / 4, &g_passData, 0);
 
-    commandList->DrawIndexedInstanced(m_model->GetIndiciesNum(), 1, 0, 0, 0);
+    // outside the frustum nothing is drawn, the frame is only presented
+    bool visible = streaming || FrustumCuller::IsVisible(m_modelFrustum,
+        m_model->GetBounds().center, m_model->GetBounds().extents);
+    if (visible)
+    {
+        uint32_t level = m_LODIndexOffsets.empty() || streaming ? 0 :
+            m_model->SelectLOD(*m_camera, m_ModelMatrix, static_cast<float>(m_height));
+        if (!streaming && m_model->GetPointOctree())
+        {
+            // octree nodes picked for this view, each a range of the vertex buffer
+            auto octree = m_model->GetPointOctree();
+            auto selection = octree->Select(PointCloudView::FromCamera(*m_camera, m_ModelMatrix, static_cast<float>(m_height)),
+                m_pointBudget);
+            commandList->SetPipelineState(m_PointPipelineState.Get());
+            commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_POINTLIST);
+            for (auto index: selection.nodes)
+            {
+                auto& node = octree->GetNodes()[index];
+                commandList->DrawInstanced(node.pointCount, 1, node.firstPoint, 0);
+            }
+        }
+        else if (streaming)
+        {
+            commandList->IASetIndexBuffer(&m_IndexBufferView);
+            commandList->DrawIndexedInstanced(m_streamIndexCount, 1, 0, 0, 0);
+        }
+        else if (level == 0)
+        {
+            commandList->IASetIndexBuffer(&m_IndexBufferView);
+            commandList->DrawIndexedInstanced(m_model->GetIndiciesNum(), 1, 0, 0, 0);
+        }
+        else
+        {
+            commandList->IASetIndexBuffer(&m_LODIndexBufferView);
+            commandList->DrawIndexedInstanced(static_cast<UINT>(m_model->GetLODIndicies(level).size()), 1,
+                m_LODIndexOffsets[level - 1], 0, 0);
+        }
+    }
 
     m_swapChain->Present(commandList);
+    m_residency.EndFrame();
+}
+
+MeshResidencyManager& DXWindow::GetResidency()
+{
+    return m_residency;
 }
 
 void DXWindow::UpdateWindowRect(uint32_t width, uint32_t height)
@@ -474,6 +760,25 @@ void DXWindow::SetFullscreen(bool fullscreen)
     }
 }
 
+uint32_t DXWindow::Pick(int x, int y)
+{
+    if (!m_model || m_model->IsPointCloud()) return ~0u;
+    if (m_pickModel.lock() != m_model)
+    {
+        // the residency manager may have dropped the CPU copy, the Bvh keeps
+        // its own once built
+        if (!m_model->IsCPUResident()) return ~0u;
+        m_pickBvh = std::make_shared<const Bvh>(m_model->BuildBvh());
+        m_pickModel = m_model;
+    }
+
+    BvhRay ray = RayQuery::ScreenRay(*m_camera, m_ModelMatrix, static_cast<float>(x), static_cast<float>(y),
+        static_cast<float>(m_width), static_cast<float>(m_height));
+    BvhHit hit;
+    RayQuery(*m_pickBvh).IntersectClosest(&ray, &hit, 1);
+    return hit.triangle;
+}
+
 void DXWindow::Resize(uint32_t width, uint32_t height)
 {
     if (m_width != width || m_height != height)
@@ -556,6 +861,13 @@ LRESULT DXWindow::OnWndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lPara
         // not handled.
         case WM_SYSCHAR:
         break;
+        case WM_LBUTTONDOWN:
+        {
+            int x = static_cast<int16_t>(LOWORD(lParam));
+            int y = static_cast<int16_t>(HIWORD(lParam));
+            m_pickedTriangle = Pick(x, y);
+        }
+        break;
         case WM_SIZE:
         {
             RECT clientRect = {};
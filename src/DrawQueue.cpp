@@ -0,0 +1,156 @@
+#include "DrawQueue.h"
+#include <algorithm>
+#include <array>
+#include <numeric>
+
+namespace
+{
+    const uint32_t RADIX_BITS = 8;
+    const uint32_t RADIX = 1 << RADIX_BITS;
+    const uint32_t PASSES = 64 / RADIX_BITS;
+
+    inline uint64_t Field(uint64_t value, uint32_t bits, uint32_t shift)
+    {
+        return (value & ((1ull << bits) - 1)) << shift;
+    }
+}
+
+uint64_t DrawQueue::MakeKey(uint32_t pipeline, uint32_t mesh, uint32_t material, float depth)
+{
+    const uint32_t maxDepth = (1u << DEPTH_BITS) - 1;
+    uint32_t depthBucket = static_cast<uint32_t>(std::min(std::max(depth, 0.f), 1.f) * maxDepth);
+    return Field(pipeline, PIPELINE_BITS, MESH_BITS + MATERIAL_BITS + DEPTH_BITS)
+        | Field(mesh, MESH_BITS, MATERIAL_BITS + DEPTH_BITS)
+        | Field(material, MATERIAL_BITS, DEPTH_BITS)
+        | Field(depthBucket, DEPTH_BITS, 0);
+}
+
+uint32_t DrawQueue::GetPipeline(uint64_t key)
+{
+    return static_cast<uint32_t>(key >> (MESH_BITS + MATERIAL_BITS + DEPTH_BITS));
+}
+
+uint32_t DrawQueue::GetMesh(uint64_t key)
+{
+    return static_cast<uint32_t>(key >> (MATERIAL_BITS + DEPTH_BITS)) & ((1u << MESH_BITS) - 1);
+}
+
+uint32_t DrawQueue::GetMaterial(uint64_t key)
+{
+    return static_cast<uint32_t>(key >> DEPTH_BITS) & ((1u << MATERIAL_BITS) - 1);
+}
+
+void DrawQueue::Clear()
+{
+    m_keys.clear();
+    m_transforms.clear();
+    m_order.clear();
+    m_batches.clear();
+    m_instanceTransforms.clear();
+    m_instanceMaterials.clear();
+}
+
+uint32_t DrawQueue::Submit(uint32_t pipeline, uint32_t mesh, uint32_t material, float depth, const XMFLOAT4X4& transform)
+{
+    m_keys.push_back(MakeKey(pipeline, mesh, material, depth));
+    m_transforms.push_back(transform);
+    return static_cast<uint32_t>(m_keys.size() - 1);
+}
+
+// Least significant digit first, stable, so equal keys keep their submission
+// order. All histograms come from one pass, and digits every key shares are
+// skipped, which is most of them when few pipelines and meshes are in use.
+void DrawQueue::Sort()
+{
+    size_t count = m_keys.size();
+    m_order.resize(count);
+    std::iota(m_order.begin(), m_order.end(), 0u);
+    if (count < 2) return;
+
+    std::vector<std::array<uint32_t, RADIX>> histograms(PASSES);
+    for (auto& histogram: histograms) histogram.fill(0);
+    for (uint64_t key: m_keys)
+    {
+        for (uint32_t pass = 0; pass < PASSES; ++pass) histograms[pass][(key >> (pass * RADIX_BITS)) & (RADIX - 1)]++;
+    }
+
+    std::vector<uint64_t> keys = m_keys;
+    m_sortKeys.resize(count);
+    m_sortOrder.resize(count);
+    for (uint32_t pass = 0; pass < PASSES; ++pass)
+    {
+        auto& histogram = histograms[pass];
+        uint32_t shift = pass * RADIX_BITS;
+        if (histogram[(keys[0] >> shift) & (RADIX - 1)] == count) continue;
+
+        uint32_t offset = 0;
+        for (auto& bucket: histogram)
+        {
+            uint32_t size = bucket;
+            bucket = offset;
+            offset += size;
+        }
+        for (size_t i = 0; i < count; ++i)
+        {
+            uint32_t destination = histogram[(keys[i] >> shift) & (RADIX - 1)]++;
+            m_sortKeys[destination] = keys[i];
+            m_sortOrder[destination] = m_order[i];
+        }
+        keys.swap(m_sortKeys);
+        m_order.swap(m_sortOrder);
+    }
+}
+
+void DrawQueue::Build()
+{
+    Sort();
+
+    // a new draw wherever pipeline or mesh change, materials and depth only
+    // order the instances
+    const uint32_t batchShift = MATERIAL_BITS + DEPTH_BITS;
+    m_batches.clear();
+    m_instanceTransforms.resize(m_order.size());
+    m_instanceMaterials.resize(m_order.size());
+    for (uint32_t i = 0; i < m_order.size(); ++i)
+    {
+        uint32_t item = m_order[i];
+        uint64_t key = m_keys[item];
+        if (m_batches.empty() || (m_keys[m_order[i - 1]] >> batchShift) != (key >> batchShift))
+        {
+            m_batches.push_back({ GetPipeline(key), GetMesh(key), i, 0 });
+        }
+        m_batches.back().instanceCount++;
+        m_instanceTransforms[i] = m_transforms[item];
+        m_instanceMaterials[i] = GetMaterial(key);
+    }
+}
+
+uint32_t DrawQueue::GetItemCount() const
+{
+    return static_cast<uint32_t>(m_keys.size());
+}
+
+const std::vector<uint64_t>& DrawQueue::GetKeys() const
+{
+    return m_keys;
+}
+
+const std::vector<uint32_t>& DrawQueue::GetOrder() const
+{
+    return m_order;
+}
+
+const std::vector<DrawBatch>& DrawQueue::GetBatches() const
+{
+    return m_batches;
+}
+
+const std::vector<XMFLOAT4X4>& DrawQueue::GetInstanceTransforms() const
+{
+    return m_instanceTransforms;
+}
+
+const std::vector<uint32_t>& DrawQueue::GetInstanceMaterials() const
+{
+    return m_instanceMaterials;
+}
\ No newline at end of file
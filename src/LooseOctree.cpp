@@ -0,0 +1,292 @@
+#include "LooseOctree.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    enum class Overlap
+    {
+        Outside,
+        Intersects,
+        Inside
+    };
+
+    Overlap ClassifyBox(const Frustum& frustum, const XMFLOAT3& center, const XMFLOAT3& extents)
+    {
+        Overlap overlap = Overlap::Inside;
+        for (auto& plane: frustum.planes)
+        {
+            float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+            float reach = std::abs(plane.x) * extents.x + std::abs(plane.y) * extents.y + std::abs(plane.z) * extents.z;
+            if (distance + reach < 0.f) return Overlap::Outside;
+            if (distance - reach < 0.f) overlap = Overlap::Intersects;
+        }
+        return overlap;
+    }
+
+    bool SphereIntersectsBox(const XMFLOAT3& sphere, float radius, const XMFLOAT3& center, const XMFLOAT3& extents)
+    {
+        float distance = 0.f;
+        for (int k = 0; k < 3; ++k)
+        {
+            float d = std::max(std::abs((&sphere.x)[k] - (&center.x)[k]) - (&extents.x)[k], 0.f);
+            distance += d * d;
+        }
+        return distance <= radius * radius;
+    }
+
+    bool RayIntersectsBox(const XMFLOAT3& origin, const XMFLOAT3& inverse, float tMax, const XMFLOAT3& center,
+        const XMFLOAT3& extents)
+    {
+        float tNear = 0.f;
+        float tFar = tMax;
+        for (int k = 0; k < 3; ++k)
+        {
+            float o = (&origin.x)[k], c = (&center.x)[k], e = (&extents.x)[k], i = (&inverse.x)[k];
+            float t0 = (c - e - o) * i, t1 = (c + e - o) * i;
+            tNear = std::max(tNear, std::min(t0, t1));
+            tFar = std::min(tFar, std::max(t0, t1));
+        }
+        return tNear <= tFar;
+    }
+
+    inline XMFLOAT3 LooseExtents(const LooseOctreeNode& node)
+    {
+        float size = node.halfSize * 2.f;
+        return XMFLOAT3(size, size, size);
+    }
+
+    // Depth first over non-empty nodes. nodeTest returns the overlap of a
+    // node's loose bounds, objectTest whether an object is in, it is skipped
+    // below nodes that are inside. The root is always entered, it also holds
+    // the objects outside of its cell.
+    template <typename NodeTest, typename ObjectTest>
+    void Traverse(const std::vector<LooseOctreeNode>& nodes, const std::vector<uint32_t>& next,
+        const NodeTest& nodeTest, const ObjectTest& objectTest, std::vector<uint32_t>& result)
+    {
+        std::vector<std::pair<uint32_t, bool>> stack;
+        stack.push_back({ 0, false });
+        while (!stack.empty())
+        {
+            auto [index, inside] = stack.back();
+            stack.pop_back();
+            const LooseOctreeNode& node = nodes[index];
+            if (!inside && index != 0)
+            {
+                Overlap overlap = nodeTest(node);
+                if (overlap == Overlap::Outside) continue;
+                inside = overlap == Overlap::Inside;
+            }
+            for (uint32_t object = node.firstObject; object != LooseOctree::INVALID_INDEX; object = next[object])
+            {
+                if (inside || objectTest(object)) result.push_back(object);
+            }
+            if (node.firstChild == LooseOctree::INVALID_INDEX) continue;
+            for (uint32_t c = 0; c < 8; ++c)
+            {
+                if (nodes[node.firstChild + c].subtreeCount > 0) stack.push_back({ node.firstChild + c, inside });
+            }
+        }
+    }
+}
+
+LooseOctree::LooseOctree(const XMFLOAT3& center, float halfSize, uint32_t maxDepth)
+    : m_maxDepth(std::min(maxDepth, MAX_DEPTH))
+{
+    m_nodes.push_back({ center, halfSize, INVALID_INDEX, INVALID_INDEX, INVALID_INDEX, 0, 0 });
+}
+
+uint32_t LooseOctree::AllocateChildren(uint32_t parent)
+{
+    uint32_t first;
+    if (!m_freeBlocks.empty())
+    {
+        first = m_freeBlocks.back();
+        m_freeBlocks.pop_back();
+    }
+    else
+    {
+        first = static_cast<uint32_t>(m_nodes.size());
+        m_nodes.resize(m_nodes.size() + 8);
+    }
+
+    const LooseOctreeNode& node = m_nodes[parent];
+    float half = node.halfSize * 0.5f;
+    for (uint32_t octant = 0; octant < 8; ++octant)
+    {
+        XMFLOAT3 center(
+            node.center.x + (octant & 1 ? half : -half),
+            node.center.y + (octant & 2 ? half : -half),
+            node.center.z + (octant & 4 ? half : -half));
+        m_nodes[first + octant] = { center, half, parent, INVALID_INDEX, INVALID_INDEX, 0, 0 };
+    }
+    m_nodes[parent].firstChild = first;
+    return first;
+}
+
+void LooseOctree::FreeChildren(uint32_t node)
+{
+    uint32_t first = m_nodes[node].firstChild;
+    for (uint32_t c = 0; c < 8; ++c)
+    {
+        if (m_nodes[first + c].firstChild != INVALID_INDEX) FreeChildren(first + c);
+    }
+    m_freeBlocks.push_back(first);
+    m_nodes[node].firstChild = INVALID_INDEX;
+}
+
+// The deepest node whose loose bounds hold the box, INVALID_INDEX if it does
+// not exist yet and create is false.
+uint32_t LooseOctree::FindNode(const XMFLOAT3& center, const XMFLOAT3& extents, bool create)
+{
+    const LooseOctreeNode& root = m_nodes[0];
+    if (std::abs(center.x - root.center.x) > root.halfSize || std::abs(center.y - root.center.y) > root.halfSize
+        || std::abs(center.z - root.center.z) > root.halfSize)
+    {
+        return 0;
+    }
+
+    // a child's loose bounds hold the box if it is no larger than the child's cell
+    float size = std::max(extents.x, std::max(extents.y, extents.z));
+    uint32_t depth = 0;
+    for (float half = root.halfSize * 0.5f; depth < m_maxDepth && size <= half; half *= 0.5f) depth++;
+
+    uint32_t node = 0;
+    for (uint32_t level = 0; level < depth; ++level)
+    {
+        if (m_nodes[node].firstChild == INVALID_INDEX)
+        {
+            if (!create) return INVALID_INDEX;
+            AllocateChildren(node);
+        }
+        const LooseOctreeNode& n = m_nodes[node];
+        uint32_t octant = (center.x >= n.center.x ? 1 : 0) | (center.y >= n.center.y ? 2 : 0) | (center.z >= n.center.z ? 4 : 0);
+        node = n.firstChild + octant;
+    }
+    return node;
+}
+
+void LooseOctree::Link(uint32_t object, uint32_t node)
+{
+    LooseOctreeNode& n = m_nodes[node];
+    m_objectNodes[object] = node;
+    m_previous[object] = INVALID_INDEX;
+    m_next[object] = n.firstObject;
+    if (n.firstObject != INVALID_INDEX) m_previous[n.firstObject] = object;
+    n.firstObject = object;
+    n.objectCount++;
+    for (uint32_t i = node; i != INVALID_INDEX; i = m_nodes[i].parent) m_nodes[i].subtreeCount++;
+}
+
+void LooseOctree::Unlink(uint32_t object)
+{
+    uint32_t node = m_objectNodes[object];
+    LooseOctreeNode& n = m_nodes[node];
+    if (m_previous[object] != INVALID_INDEX) m_next[m_previous[object]] = m_next[object];
+    else n.firstObject = m_next[object];
+    if (m_next[object] != INVALID_INDEX) m_previous[m_next[object]] = m_previous[object];
+    n.objectCount--;
+
+    // empty subtrees go back to the pool
+    for (uint32_t i = node; i != INVALID_INDEX; i = m_nodes[i].parent)
+    {
+        if (--m_nodes[i].subtreeCount == 0 && m_nodes[i].firstChild != INVALID_INDEX) FreeChildren(i);
+    }
+    m_objectNodes[object] = INVALID_INDEX;
+}
+
+uint32_t LooseOctree::Insert(const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+    uint32_t object;
+    if (!m_freeObjects.empty())
+    {
+        object = m_freeObjects.back();
+        m_freeObjects.pop_back();
+    }
+    else
+    {
+        object = static_cast<uint32_t>(m_centers.size());
+        m_centers.emplace_back();
+        m_extents.emplace_back();
+        m_objectNodes.push_back(INVALID_INDEX);
+        m_next.push_back(INVALID_INDEX);
+        m_previous.push_back(INVALID_INDEX);
+    }
+    m_centers[object] = center;
+    m_extents[object] = extents;
+    Link(object, FindNode(center, extents, true));
+    m_objectCount++;
+    return object;
+}
+
+void LooseOctree::Move(uint32_t object, const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+    m_centers[object] = center;
+    m_extents[object] = extents;
+    // most moves stay in their node
+    if (FindNode(center, extents, false) == m_objectNodes[object]) return;
+    // unlinked first, it may free the nodes the object moves to
+    Unlink(object);
+    Link(object, FindNode(center, extents, true));
+}
+
+void LooseOctree::Remove(uint32_t object)
+{
+    Unlink(object);
+    m_freeObjects.push_back(object);
+    m_objectCount--;
+}
+
+void LooseOctree::QueryFrustum(const Frustum& frustum, std::vector<uint32_t>& result) const
+{
+    Traverse(m_nodes, m_next,
+        [&frustum](const LooseOctreeNode& node) { return ClassifyBox(frustum, node.center, LooseExtents(node)); },
+        [&](uint32_t object) { return ClassifyBox(frustum, m_centers[object], m_extents[object]) != Overlap::Outside; },
+        result);
+}
+
+void LooseOctree::QuerySphere(const XMFLOAT3& center, float radius, std::vector<uint32_t>& result) const
+{
+    Traverse(m_nodes, m_next,
+        [&](const LooseOctreeNode& node) {
+            return SphereIntersectsBox(center, radius, node.center, LooseExtents(node)) ? Overlap::Intersects : Overlap::Outside;
+        },
+        [&](uint32_t object) { return SphereIntersectsBox(center, radius, m_centers[object], m_extents[object]); },
+        result);
+}
+
+void LooseOctree::QueryRay(const XMFLOAT3& origin, const XMFLOAT3& direction, float tMax, std::vector<uint32_t>& result) const
+{
+    XMFLOAT3 inverse(1.f / direction.x, 1.f / direction.y, 1.f / direction.z);
+    Traverse(m_nodes, m_next,
+        [&](const LooseOctreeNode& node) {
+            return RayIntersectsBox(origin, inverse, tMax, node.center, LooseExtents(node)) ? Overlap::Intersects : Overlap::Outside;
+        },
+        [&](uint32_t object) { return RayIntersectsBox(origin, inverse, tMax, m_centers[object], m_extents[object]); },
+        result);
+}
+
+uint32_t LooseOctree::GetObjectCount() const
+{
+    return m_objectCount;
+}
+
+const XMFLOAT3& LooseOctree::GetCenter(uint32_t object) const
+{
+    return m_centers[object];
+}
+
+const XMFLOAT3& LooseOctree::GetExtents(uint32_t object) const
+{
+    return m_extents[object];
+}
+
+uint32_t LooseOctree::GetNode(uint32_t object) const
+{
+    return m_objectNodes[object];
+}
+
+const std::vector<LooseOctreeNode>& LooseOctree::GetNodes() const
+{
+    return m_nodes;
+}
\ No newline at end of file
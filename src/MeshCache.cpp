@@ -0,0 +1,195 @@
+#include "MeshCache.h"
+#include "MeshCodec.h"
+#include "path.h"
+#include "common/Hash.h"
+#include "common/MappedFile.h"
+#include <cstring>
+#include <cwchar>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    bool IsBlobValid(const MeshCache::Blob& blob, uint64_t expectedSize, bool encoded, size_t fileSize)
+    {
+        return (encoded || blob.size == expectedSize)
+            && blob.offset % MeshCache::BLOB_ALIGNMENT == 0
+            && blob.offset <= fileSize && blob.size <= fileSize - blob.offset;
+    }
+
+    MeshCache::Blob Append(std::vector<uint8_t>& buffer, const void* data, size_t size)
+    {
+        size_t offset = (buffer.size() + MeshCache::BLOB_ALIGNMENT - 1) / MeshCache::BLOB_ALIGNMENT * MeshCache::BLOB_ALIGNMENT;
+        buffer.resize(offset + size, 0);
+        if (size) std::memcpy(buffer.data() + offset, data, size);
+        return { offset, size };
+    }
+}
+
+bool MeshCache::GetSourceState(const std::wstring& sourcePath, SourceState& state)
+{
+    std::error_code error;
+    state.size = fs::file_size(sourcePath, error);
+    if (error) return false;
+    auto time = fs::last_write_time(sourcePath, error);
+    if (error) return false;
+    state.time = static_cast<int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+bool MeshCache::HashSource(const std::wstring& sourcePath, uint64_t& hash)
+{
+    MappedFile source;
+    if (!source.Open(sourcePath)) return false;
+    hash = Hash::Hash64(source.GetData(), source.GetSize());
+    return true;
+}
+
+bool MeshCache::IsSourceUnchanged(const std::wstring& sourcePath, uint64_t size, int64_t time, uint64_t hash)
+{
+    SourceState state;
+    if (!GetSourceState(sourcePath, state) || state.size != size) return false;
+    if (state.time == time) return true;
+    // touched, but maybe not changed
+    uint64_t current;
+    return HashSource(sourcePath, current) && current == hash;
+}
+
+std::wstring MeshCache::GetCachePath(const std::wstring& sourcePath, uint32_t flags)
+{
+    wchar_t key[32];
+    swprintf(key, 32, L"_%016llx_%x.dxmesh", static_cast<unsigned long long>(Hash::Hash64(sourcePath)), flags);
+    return std::wstring(cache_path) + fs::path(sourcePath).stem().wstring() + key;
+}
+
+bool MeshCache::Load(const std::wstring& sourcePath, uint32_t flags, MeshCacheData& data)
+{
+    MappedFile file;
+    if (!file.Open(GetCachePath(sourcePath, flags))) return false;
+    if (file.GetSize() < sizeof(Header)) return false;
+
+    Header header;
+    std::memcpy(&header, file.GetData(), sizeof(Header));
+    if (header.magic != MAGIC || header.version != VERSION || header.flags != flags
+        || header.vertexStride != sizeof(Vertex))
+    {
+        return false;
+    }
+
+    std::string path = fs::path(sourcePath).u8string();
+    bool encodedVertices = (header.encoding & ENCODED_VERTICES) != 0;
+    bool encodedIndicies = (header.encoding & ENCODED_INDICIES) != 0;
+    if (!IsBlobValid(header.path, path.size(), false, file.GetSize())
+        || !IsBlobValid(header.vertices, static_cast<uint64_t>(header.vertexCount) * sizeof(Vertex), encodedVertices, file.GetSize())
+        || !IsBlobValid(header.indicies, static_cast<uint64_t>(header.indexCount) * sizeof(uint32_t), encodedIndicies, file.GetSize())
+        || !IsBlobValid(header.submeshes, static_cast<uint64_t>(header.submeshCount) * sizeof(MeshSubmesh), false, file.GetSize()))
+    {
+        return false;
+    }
+    if (std::memcmp(file.GetData() + header.path.offset, path.data(), path.size()) != 0) return false;
+
+    if (!IsSourceUnchanged(sourcePath, header.sourceSize, header.sourceTime, header.sourceHash)) return false;
+
+    data.vertices.resize(header.vertexCount);
+    data.indicies.resize(header.indexCount);
+    data.submeshes.resize(header.submeshCount);
+    const uint8_t* vertices = file.GetData() + header.vertices.offset;
+    const uint8_t* indicies = file.GetData() + header.indicies.offset;
+    if (encodedVertices)
+    {
+        if (!MeshCodec::DecodeVertexBuffer(data.vertices.data(), header.vertexCount, sizeof(Vertex),
+            vertices, header.vertices.size))
+        {
+            return false;
+        }
+    }
+    else if (header.vertexCount) std::memcpy(data.vertices.data(), vertices, header.vertices.size);
+    if (encodedIndicies)
+    {
+        if (!MeshCodec::DecodeIndexBuffer(data.indicies.data(), header.indexCount, indicies, header.indicies.size))
+        {
+            return false;
+        }
+    }
+    else if (header.indexCount) std::memcpy(data.indicies.data(), indicies, header.indicies.size);
+    if (header.submeshCount) std::memcpy(data.submeshes.data(), file.GetData() + header.submeshes.offset, header.submeshes.size);
+    data.bounds = header.bounds;
+
+    for (auto index: data.indicies)
+    {
+        if (index >= header.vertexCount) return false;
+    }
+    return true;
+}
+
+bool MeshCache::Store(const std::wstring& sourcePath, uint32_t flags,
+    const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indicies,
+    const std::vector<MeshSubmesh>& submeshes, const ModelBounds& bounds, uint32_t encoding)
+{
+    SourceState state;
+    Header header = {};
+    if (!GetSourceState(sourcePath, state) || !HashSource(sourcePath, header.sourceHash)) return false;
+
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.flags = flags;
+    header.vertexStride = sizeof(Vertex);
+    header.sourceSize = state.size;
+    header.sourceTime = state.time;
+    header.vertexCount = static_cast<uint32_t>(vertices.size());
+    header.indexCount = static_cast<uint32_t>(indicies.size());
+    header.submeshCount = static_cast<uint32_t>(submeshes.size());
+    header.bounds = bounds;
+
+    std::vector<uint8_t> buffer(sizeof(Header));
+    std::string path = fs::path(sourcePath).u8string();
+    header.path = Append(buffer, path.data(), path.size());
+    std::vector<uint8_t> encodedVertices;
+    std::vector<uint8_t> encodedIndicies;
+    if (encoding & ENCODED_VERTICES)
+    {
+        encodedVertices = MeshCodec::EncodeVertexBuffer(vertices.data(), vertices.size(), sizeof(Vertex));
+        if (encodedVertices.size() >= vertices.size() * sizeof(Vertex)) encoding &= ~ENCODED_VERTICES;
+    }
+    if ((encoding & ENCODED_INDICIES) && indicies.size() % 3 == 0)
+    {
+        encodedIndicies = MeshCodec::EncodeIndexBuffer(indicies.data(), indicies.size());
+        if (encodedIndicies.size() >= indicies.size() * sizeof(uint32_t)) encoding &= ~ENCODED_INDICIES;
+    }
+    else encoding &= ~ENCODED_INDICIES;
+    header.encoding = encoding;
+
+    if (encoding & ENCODED_VERTICES) header.vertices = Append(buffer, encodedVertices.data(), encodedVertices.size());
+    else header.vertices = Append(buffer, vertices.data(), vertices.size() * sizeof(Vertex));
+    if (encoding & ENCODED_INDICIES) header.indicies = Append(buffer, encodedIndicies.data(), encodedIndicies.size());
+    else header.indicies = Append(buffer, indicies.data(), indicies.size() * sizeof(uint32_t));
+    header.submeshes = Append(buffer, submeshes.data(), submeshes.size() * sizeof(MeshSubmesh));
+    std::memcpy(buffer.data(), &header, sizeof(Header));
+
+    // write next to the entry and rename, so readers never see half a file
+    std::error_code error;
+    fs::create_directories(cache_path, error);
+    std::wstring cachePath = GetCachePath(sourcePath, flags);
+    std::wstring tempPath = cachePath + L"." + std::to_wstring(std::hash<std::thread::id>()(std::this_thread::get_id())) + L".tmp";
+    {
+        std::ofstream out(fs::path(tempPath), std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+        if (!out)
+        {
+            out.close();
+            fs::remove(tempPath, error);
+            return false;
+        }
+    }
+    fs::rename(tempPath, cachePath, error);
+    if (error)
+    {
+        fs::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
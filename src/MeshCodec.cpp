@@ -0,0 +1,488 @@
+#include "MeshCodec.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MESHCODEC_SSE2
+#endif
+
+namespace
+{
+    const size_t EDGE_FIFO_SIZE = 16;
+    const size_t VERTEX_FIFO_SIZE = 16;
+    // codes of a vertex: 0 next unused, 1..14 vertex fifo, 15 explicit
+    const uint32_t VERTEX_NEXT = 0;
+    const uint32_t VERTEX_EXPLICIT = 15;
+    const uint32_t VERTEX_FIFO_CODES = 14;
+    // edge fifo slot 15 means the triangle shares no recent edge
+    const uint32_t EDGE_NONE = 15;
+
+    const size_t GROUP_SIZE = 16;
+
+    inline uint32_t ZigZag(int32_t v)
+    {
+        return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31);
+    }
+    inline int32_t UnZigZag(uint32_t v)
+    {
+        return static_cast<int32_t>((v >> 1) ^ (0u - (v & 1)));
+    }
+
+    void WriteVarint(std::vector<uint8_t>& out, uint32_t v)
+    {
+        while (v >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+    inline bool ReadVarint(const uint8_t*& p, const uint8_t* end, uint32_t& v)
+    {
+        v = 0;
+        for (int shift = 0; shift < 35; shift += 7)
+        {
+            if (p == end) return false;
+            uint8_t byte = *p++;
+            v |= static_cast<uint32_t>(byte & 0x7f) << shift;
+            if (byte < 0x80) return true;
+        }
+        return false;
+    }
+
+    // State shared by the index encoder and decoder, both have to update it
+    // in exactly the same order.
+    struct IndexCoderState
+    {
+        uint32_t edges[EDGE_FIFO_SIZE][2] = {};
+        uint32_t vertices[VERTEX_FIFO_SIZE] = {};
+        size_t edgeCount = 0;
+        size_t vertexCount = 0;
+        uint32_t next = 0;
+        uint32_t last = 0;
+
+        // slot 0 is the most recent entry
+        const uint32_t* Edge(size_t slot) const { return edges[(edgeCount - 1 - slot) % EDGE_FIFO_SIZE]; }
+        uint32_t Vertex(size_t slot) const { return vertices[(vertexCount - 1 - slot) % VERTEX_FIFO_SIZE]; }
+        size_t EdgeSlots() const { return std::min(edgeCount, static_cast<size_t>(EDGE_NONE)); }
+        size_t VertexSlots() const { return std::min(vertexCount, static_cast<size_t>(VERTEX_FIFO_CODES)); }
+
+        void PushEdge(uint32_t a, uint32_t b)
+        {
+            edges[edgeCount % EDGE_FIFO_SIZE][0] = a;
+            edges[edgeCount % EDGE_FIFO_SIZE][1] = b;
+            edgeCount++;
+        }
+        void PushVertex(uint32_t v)
+        {
+            vertices[vertexCount % VERTEX_FIFO_SIZE] = v;
+            vertexCount++;
+        }
+        void Emitted(uint32_t v)
+        {
+            if (v >= next) next = v + 1;
+            last = v;
+        }
+        // the reversed edges are the ones a neighbour with the same winding has
+        void PushTriangleEdges(uint32_t a, uint32_t b, uint32_t c, bool sharedFirst)
+        {
+            if (!sharedFirst) PushEdge(b, a);
+            PushEdge(c, b);
+            PushEdge(a, c);
+        }
+    };
+
+    uint32_t EncodeVertex(IndexCoderState& state, uint32_t v, std::vector<uint8_t>& data)
+    {
+        uint32_t code;
+        if (v == state.next)
+        {
+            code = VERTEX_NEXT;
+            state.PushVertex(v);
+        }
+        else
+        {
+            code = VERTEX_EXPLICIT;
+            for (size_t slot = 0; slot < state.VertexSlots(); ++slot)
+            {
+                if (state.Vertex(slot) == v)
+                {
+                    code = static_cast<uint32_t>(slot) + 1;
+                    break;
+                }
+            }
+            if (code == VERTEX_EXPLICIT)
+            {
+                WriteVarint(data, ZigZag(static_cast<int32_t>(v - state.last)));
+                state.PushVertex(v);
+            }
+        }
+        state.Emitted(v);
+        return code;
+    }
+
+    inline bool DecodeVertex(IndexCoderState& state, uint32_t code, const uint8_t*& data, const uint8_t* end, uint32_t& v)
+    {
+        if (code == VERTEX_NEXT)
+        {
+            v = state.next;
+            state.PushVertex(v);
+        }
+        else if (code == VERTEX_EXPLICIT)
+        {
+            uint32_t delta;
+            if (!ReadVarint(data, end, delta)) return false;
+            v = state.last + static_cast<uint32_t>(UnZigZag(delta));
+            state.PushVertex(v);
+        }
+        else
+        {
+            if (code > state.VertexSlots()) return false;
+            v = state.Vertex(code - 1);
+        }
+        state.Emitted(v);
+        return true;
+    }
+
+    inline uint32_t BitsForCode(uint32_t code)
+    {
+        static const uint32_t BITS[4] = { 0, 2, 4, 8 };
+        return BITS[code];
+    }
+
+    void EncodePlane(const uint8_t* plane, size_t count, std::vector<uint8_t>& out)
+    {
+        size_t groups = (count + GROUP_SIZE - 1) / GROUP_SIZE;
+        size_t headerOffset = out.size();
+        out.resize(out.size() + (groups + 3) / 4, 0);
+        for (size_t g = 0; g < groups; ++g)
+        {
+            uint8_t values[GROUP_SIZE] = {};
+            size_t n = std::min(GROUP_SIZE, count - g * GROUP_SIZE);
+            std::memcpy(values, plane + g * GROUP_SIZE, n);
+
+            uint8_t maxValue = *std::max_element(values, values + GROUP_SIZE);
+            uint32_t code = maxValue == 0 ? 0 : maxValue < 4 ? 1 : maxValue < 16 ? 2 : 3;
+            out[headerOffset + g / 4] |= static_cast<uint8_t>(code << ((g % 4) * 2));
+
+            uint32_t bits = BitsForCode(code);
+            if (bits == 8)
+            {
+                out.insert(out.end(), values, values + GROUP_SIZE);
+            }
+            else if (bits > 0)
+            {
+                // value i goes to byte i % bytes, so that the decoder can
+                // unpack all bytes at once with shifts and masks
+                size_t bytes = bits * GROUP_SIZE / 8;
+                size_t offset = out.size();
+                out.resize(offset + bytes, 0);
+                for (size_t i = 0; i < GROUP_SIZE; ++i)
+                {
+                    out[offset + i % bytes] |= static_cast<uint8_t>(values[i] << ((i / bytes) * bits));
+                }
+            }
+        }
+    }
+
+#ifdef MESHCODEC_SSE2
+    inline void StoreLanes(__m128i x, uint8_t* out, size_t stride)
+    {
+        for (int k = 0; k < 4; ++k)
+        {
+            int32_t value = _mm_cvtsi128_si32(x);
+            std::memcpy(out + k * stride, &value, 4);
+            x = _mm_srli_si128(x, 4);
+        }
+    }
+
+    // Four vertices per step: zigzag decode and a running sum in registers.
+    inline __m128i AccumulateDeltas(__m128i delta, __m128i& last)
+    {
+        __m128i sign = _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(delta, _mm_set1_epi32(1)));
+        __m128i x = _mm_xor_si128(_mm_srli_epi32(delta, 1), sign);
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi32(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi32(x, last);
+        last = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+        return x;
+    }
+
+    // Transposes the byte planes of 16 vertices at a time, returns how many
+    // vertices were written, the rest is left to the scalar loop.
+    size_t DecodeDeltas(const uint8_t (*planes)[MeshCodec::VERTEX_BLOCK_SIZE], size_t count,
+        uint8_t* out, size_t stride, uint32_t& last)
+    {
+        __m128i running = _mm_set1_epi32(static_cast<int32_t>(last));
+        size_t v = 0;
+        for (; v + 16 <= count; v += 16)
+        {
+            __m128i p0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[0] + v));
+            __m128i p1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[1] + v));
+            __m128i p2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[2] + v));
+            __m128i p3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[3] + v));
+            __m128i low01 = _mm_unpacklo_epi8(p0, p1);
+            __m128i high01 = _mm_unpackhi_epi8(p0, p1);
+            __m128i low23 = _mm_unpacklo_epi8(p2, p3);
+            __m128i high23 = _mm_unpackhi_epi8(p2, p3);
+
+            StoreLanes(AccumulateDeltas(_mm_unpacklo_epi16(low01, low23), running), out + v * stride, stride);
+            StoreLanes(AccumulateDeltas(_mm_unpackhi_epi16(low01, low23), running), out + (v + 4) * stride, stride);
+            StoreLanes(AccumulateDeltas(_mm_unpacklo_epi16(high01, high23), running), out + (v + 8) * stride, stride);
+            StoreLanes(AccumulateDeltas(_mm_unpackhi_epi16(high01, high23), running), out + (v + 12) * stride, stride);
+        }
+        last = static_cast<uint32_t>(_mm_cvtsi128_si32(running));
+        return v;
+    }
+#endif
+
+    inline bool DecodePlane(uint8_t* plane, size_t count, const uint8_t*& p, const uint8_t* end)
+    {
+        size_t groups = (count + GROUP_SIZE - 1) / GROUP_SIZE;
+        size_t headerSize = (groups + 3) / 4;
+        if (static_cast<size_t>(end - p) < headerSize) return false;
+        const uint8_t* header = p;
+        p += headerSize;
+
+        // plane holds groups * GROUP_SIZE bytes, the padding is ignored
+        for (size_t g = 0; g < groups; ++g)
+        {
+            uint8_t* values = plane + g * GROUP_SIZE;
+            uint32_t bits = BitsForCode((header[g / 4] >> ((g % 4) * 2)) & 3);
+            size_t size = bits * GROUP_SIZE / 8;
+            if (static_cast<size_t>(end - p) < size) return false;
+            switch (bits)
+            {
+            case 0:
+                std::memset(values, 0, GROUP_SIZE);
+                break;
+            case 2:
+            {
+                uint32_t packed;
+                std::memcpy(&packed, p, 4);
+                for (int k = 0; k < 4; ++k)
+                {
+                    uint32_t unpacked = (packed >> (k * 2)) & 0x03030303u;
+                    std::memcpy(values + k * 4, &unpacked, 4);
+                }
+                break;
+            }
+            case 4:
+            {
+                uint64_t packed;
+                std::memcpy(&packed, p, 8);
+                uint64_t low = packed & 0x0f0f0f0f0f0f0f0full;
+                uint64_t high = (packed >> 4) & 0x0f0f0f0f0f0f0f0full;
+                std::memcpy(values, &low, 8);
+                std::memcpy(values + 8, &high, 8);
+                break;
+            }
+            default:
+                std::memcpy(values, p, GROUP_SIZE);
+                break;
+            }
+            p += size;
+        }
+        return true;
+    }
+}
+
+std::vector<uint8_t> MeshCodec::EncodeIndexBuffer(const uint32_t* indicies, size_t indexCount)
+{
+    assert(indexCount % 3 == 0);
+    std::vector<uint8_t> codes;
+    std::vector<uint8_t> data;
+    codes.reserve(indexCount / 3);
+
+    IndexCoderState state;
+    for (size_t i = 0; i + 2 < indexCount; i += 3)
+    {
+        uint32_t t[3] = { indicies[i], indicies[i + 1], indicies[i + 2] };
+
+        uint32_t edgeSlot = EDGE_NONE;
+        uint32_t rotation = 0;
+        for (size_t slot = 0; slot < state.EdgeSlots() && edgeSlot == EDGE_NONE; ++slot)
+        {
+            const uint32_t* edge = state.Edge(slot);
+            for (uint32_t r = 0; r < 3; ++r)
+            {
+                if (edge[0] == t[r] && edge[1] == t[(r + 1) % 3])
+                {
+                    edgeSlot = static_cast<uint32_t>(slot);
+                    rotation = r;
+                    break;
+                }
+            }
+        }
+
+        if (edgeSlot != EDGE_NONE)
+        {
+            uint32_t a = t[rotation], b = t[(rotation + 1) % 3], c = t[(rotation + 2) % 3];
+            // a and b come from the edge, they count as emitted for "last"
+            state.last = b;
+            uint32_t code = EncodeVertex(state, c, data);
+            codes.push_back(static_cast<uint8_t>((edgeSlot << 4) | code));
+            state.PushTriangleEdges(a, b, c, true);
+        }
+        else
+        {
+            uint32_t codeA = EncodeVertex(state, t[0], data);
+            uint32_t codeB = EncodeVertex(state, t[1], data);
+            uint32_t codeC = EncodeVertex(state, t[2], data);
+            codes.push_back(static_cast<uint8_t>((EDGE_NONE << 4) | codeA));
+            codes.push_back(static_cast<uint8_t>((codeB << 4) | codeC));
+            state.PushTriangleEdges(t[0], t[1], t[2], false);
+        }
+    }
+
+    std::vector<uint8_t> result;
+    result.reserve(1 + 5 + codes.size() + data.size());
+    result.push_back(INDEX_CODEC_VERSION);
+    WriteVarint(result, static_cast<uint32_t>(codes.size()));
+    result.insert(result.end(), codes.begin(), codes.end());
+    result.insert(result.end(), data.begin(), data.end());
+    return result;
+}
+
+bool MeshCodec::DecodeIndexBuffer(uint32_t* indicies, size_t indexCount, const uint8_t* data, size_t size)
+{
+    if (indexCount % 3 != 0 || size < 1 || data[0] != INDEX_CODEC_VERSION) return false;
+    const uint8_t* p = data + 1;
+    const uint8_t* end = data + size;
+    uint32_t codeSize;
+    if (!ReadVarint(p, end, codeSize) || static_cast<size_t>(end - p) < codeSize) return false;
+    const uint8_t* codes = p;
+    const uint8_t* codesEnd = p + codeSize;
+    const uint8_t* explicitData = codesEnd;
+
+    IndexCoderState state;
+    for (size_t i = 0; i < indexCount; i += 3)
+    {
+        if (codes == codesEnd) return false;
+        uint8_t code = *codes++;
+        uint32_t edgeSlot = code >> 4;
+        uint32_t vertexCode = code & 15;
+        if (edgeSlot != EDGE_NONE && vertexCode != VERTEX_EXPLICIT)
+        {
+            // Common case, written out without branches on the vertex code.
+            // Slot checks against the counts are enough since codes never
+            // exceed the fifo sizes.
+            if (edgeSlot >= state.edgeCount || vertexCode > state.vertexCount) return false;
+            const uint32_t* edge = state.Edge(edgeSlot);
+            uint32_t a = edge[0], b = edge[1];
+            uint32_t isNext = vertexCode == VERTEX_NEXT;
+            uint32_t fifo = state.vertices[(state.vertexCount - vertexCode) % VERTEX_FIFO_SIZE];
+            uint32_t c = isNext ? state.next : fifo;
+            state.vertices[state.vertexCount % VERTEX_FIFO_SIZE] = c;
+            state.vertexCount += isNext;
+            state.next += isNext;
+            state.last = c;
+
+            indicies[i] = a;
+            indicies[i + 1] = b;
+            indicies[i + 2] = c;
+            state.PushTriangleEdges(a, b, c, true);
+        }
+        else if (edgeSlot != EDGE_NONE)
+        {
+            if (edgeSlot >= state.EdgeSlots()) return false;
+            const uint32_t* edge = state.Edge(edgeSlot);
+            uint32_t a = edge[0], b = edge[1], c;
+            state.last = b;
+            if (!DecodeVertex(state, vertexCode, explicitData, end, c)) return false;
+            indicies[i] = a;
+            indicies[i + 1] = b;
+            indicies[i + 2] = c;
+            state.PushTriangleEdges(a, b, c, true);
+        }
+        else
+        {
+            if (codes == codesEnd) return false;
+            uint8_t codeBC = *codes++;
+            uint32_t a, b, c;
+            if (!DecodeVertex(state, vertexCode, explicitData, end, a)
+                || !DecodeVertex(state, codeBC >> 4, explicitData, end, b)
+                || !DecodeVertex(state, codeBC & 15, explicitData, end, c))
+            {
+                return false;
+            }
+            indicies[i] = a;
+            indicies[i + 1] = b;
+            indicies[i + 2] = c;
+            state.PushTriangleEdges(a, b, c, false);
+        }
+    }
+    return codes == codesEnd && explicitData == end;
+}
+
+std::vector<uint8_t> MeshCodec::EncodeVertexBuffer(const void* vertices, size_t vertexCount, size_t vertexStride)
+{
+    assert(vertexStride % 4 == 0 && vertexStride > 0);
+    size_t channels = vertexStride / 4;
+    const uint8_t* source = static_cast<const uint8_t*>(vertices);
+
+    std::vector<uint8_t> result;
+    result.reserve(vertexCount * vertexStride / 2 + 16);
+    result.push_back(VERTEX_CODEC_VERSION);
+
+    std::vector<uint32_t> previous(channels, 0);
+    uint8_t planes[4][VERTEX_BLOCK_SIZE];
+    for (size_t begin = 0; begin < vertexCount; begin += VERTEX_BLOCK_SIZE)
+    {
+        size_t count = std::min(VERTEX_BLOCK_SIZE, vertexCount - begin);
+        for (size_t c = 0; c < channels; ++c)
+        {
+            uint32_t last = previous[c];
+            for (size_t v = 0; v < count; ++v)
+            {
+                uint32_t value;
+                std::memcpy(&value, source + (begin + v) * vertexStride + c * 4, 4);
+                uint32_t delta = ZigZag(static_cast<int32_t>(value - last));
+                last = value;
+                for (int b = 0; b < 4; ++b) planes[b][v] = static_cast<uint8_t>(delta >> (b * 8));
+            }
+            previous[c] = last;
+            for (int b = 0; b < 4; ++b) EncodePlane(planes[b], count, result);
+        }
+    }
+    return result;
+}
+
+bool MeshCodec::DecodeVertexBuffer(void* vertices, size_t vertexCount, size_t vertexStride, const uint8_t* data, size_t size)
+{
+    if (vertexStride % 4 != 0 || vertexStride == 0 || size < 1 || data[0] != VERTEX_CODEC_VERSION) return false;
+    size_t channels = vertexStride / 4;
+    uint8_t* target = static_cast<uint8_t*>(vertices);
+    const uint8_t* p = data + 1;
+    const uint8_t* end = data + size;
+
+    std::vector<uint32_t> previous(channels, 0);
+    uint8_t planes[4][VERTEX_BLOCK_SIZE];
+    for (size_t begin = 0; begin < vertexCount; begin += VERTEX_BLOCK_SIZE)
+    {
+        size_t count = std::min(VERTEX_BLOCK_SIZE, vertexCount - begin);
+        for (size_t c = 0; c < channels; ++c)
+        {
+            for (int b = 0; b < 4; ++b)
+            {
+                if (!DecodePlane(planes[b], count, p, end)) return false;
+            }
+            uint32_t last = previous[c];
+            uint8_t* out = target + begin * vertexStride + c * 4;
+            size_t v = 0;
+#ifdef MESHCODEC_SSE2
+            v = DecodeDeltas(planes, count, out, vertexStride, last);
+#endif
+            for (; v < count; ++v)
+            {
+                uint32_t delta = planes[0][v] | (planes[1][v] << 8) | (planes[2][v] << 16) | (static_cast<uint32_t>(planes[3][v]) << 24);
+                last += static_cast<uint32_t>(UnZigZag(delta));
+                std::memcpy(out + v * vertexStride, &last, 4);
+            }
+            previous[c] = last;
+        }
+    }
+    return p == end;
+}
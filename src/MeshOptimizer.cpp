@@ -0,0 +1,842 @@
+#include "MeshOptimizer.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <cassert>
+#include <numeric>
+#include <limits>
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+    inline const XMFLOAT3& GetPosition(const XMFLOAT3* positions, size_t stride, uint32_t index)
+    {
+        return *reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(positions) + stride * index);
+    }
+
+    inline XMFLOAT3 Sub(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+    }
+    inline XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    }
+    inline float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+    inline XMFLOAT3 Normalize(const XMFLOAT3& a)
+    {
+        float length = std::sqrt(Dot(a, a));
+        if (length == 0.f) return a;
+        return XMFLOAT3(a.x / length, a.y / length, a.z / length);
+    }
+
+    // FIFO cache simulated with timestamps: a vertex is in the cache while fewer
+    // than cacheSize misses happened since it was loaded.
+    // Bumping the timestamp by cacheSize + 1 flushes the cache.
+    inline uint32_t UpdateCache(const uint32_t* triangle, uint32_t cacheSize,
+        std::vector<uint32_t>& timestamps, uint32_t& timestamp)
+    {
+        uint32_t misses = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            if (timestamp - timestamps[triangle[k]] > cacheSize)
+            {
+                timestamps[triangle[k]] = timestamp++;
+                misses++;
+            }
+        }
+        return misses;
+    }
+
+    const size_t CLEAN_GRAIN = 1 << 14;
+    const uint32_t CLEAN_PARTITION_BITS = 8;
+    // sin^2 of the smallest angle a triangle may have, below it has no area
+    const double MIN_TRIANGLE_SIN2 = 1e-12;
+
+    inline bool IsDegenerate(const uint32_t* t, const XMFLOAT3* positions, size_t vertexCount, size_t stride)
+    {
+        if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2]) return true;
+        if (t[0] >= vertexCount || t[1] >= vertexCount || t[2] >= vertexCount) return true;
+        auto& a = GetPosition(positions, stride, t[0]);
+        auto& b = GetPosition(positions, stride, t[1]);
+        auto& c = GetPosition(positions, stride, t[2]);
+        double ab[3] = { double(b.x) - a.x, double(b.y) - a.y, double(b.z) - a.z };
+        double ac[3] = { double(c.x) - a.x, double(c.y) - a.y, double(c.z) - a.z };
+        double cross[3] = { ab[1] * ac[2] - ab[2] * ac[1], ab[2] * ac[0] - ab[0] * ac[2], ab[0] * ac[1] - ab[1] * ac[0] };
+        double area2 = cross[0] * cross[0] + cross[1] * cross[1] + cross[2] * cross[2];
+        double lengths2 = (ab[0] * ab[0] + ab[1] * ab[1] + ab[2] * ab[2]) * (ac[0] * ac[0] + ac[1] * ac[1] + ac[2] * ac[2]);
+        return area2 <= lengths2 * MIN_TRIANGLE_SIN2;
+    }
+
+    const size_t WELD_GRAIN = 1 << 16;
+    const uint32_t WELD_PARTITION_BITS = 8;
+    const size_t WELD_PARTITIONS = size_t(1) << WELD_PARTITION_BITS;
+    // in epsilons, at least 2 so that only one neighbour per axis can be
+    // within epsilon, larger ones make neighbour lookups rarer
+    const double WELD_CELL_SIZE = 4.0;
+    // Past this many cells from the origin the spacing of floats is a cell or
+    // more, so only equal coordinates are within epsilon. They are hashed by
+    // their bits, which also keeps the cell index far from overflowing.
+    const double WELD_MAX_CELL = 16777216.0;
+
+    inline uint64_t HashCell(int64_t x, int64_t y, int64_t z)
+    {
+        uint64_t h = static_cast<uint64_t>(x) * 0x9e3779b97f4a7c15ull ^ static_cast<uint64_t>(y) * 0xc2b2ae3d27d4eb4full
+            ^ static_cast<uint64_t>(z) * 0x165667b19e3779f9ull;
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        return h;
+    }
+
+    // smallest index first, winding kept
+    inline void CanonicalTriangle(const uint32_t* t, uint32_t* out)
+    {
+        int first = t[0] < t[1] ? (t[0] < t[2] ? 0 : 2) : (t[1] < t[2] ? 1 : 2);
+        out[0] = t[first];
+        out[1] = t[(first + 1) % 3];
+        out[2] = t[(first + 2) % 3];
+    }
+
+    inline uint64_t HashTriangle(const uint32_t* t)
+    {
+        uint64_t h = (uint64_t(t[0]) << 32 | t[1]) * 0x9e3779b97f4a7c15ull;
+        h ^= h >> 29;
+        h = (h ^ t[2]) * 0xbf58476d1ce4e5b9ull;
+        return h ^ h >> 32;
+    }
+}
+
+float MeshOptimizer::CalculateACMR(const std::vector<uint32_t>& indicies, size_t vertexCount, uint32_t cacheSize)
+{
+    size_t faceCount = indicies.size() / 3;
+    if (faceCount == 0) return 0.f;
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t timestamp = cacheSize + 1;
+    uint64_t misses = 0;
+    for (size_t i = 0; i < faceCount; ++i)
+    {
+        misses += UpdateCache(&indicies[i * 3], cacheSize, timestamps, timestamp);
+    }
+    return static_cast<float>(misses) / faceCount;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<uint32_t>& indicies, size_t vertexCount, uint32_t cacheSize)
+{
+    size_t faceCount = indicies.size() / 3;
+    if (faceCount == 0 || vertexCount == 0) return;
+
+    // vertex -> triangles adjacency
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < faceCount * 3; ++i) adjacencyOffsets[indicies[i] + 1]++;
+    for (size_t i = 0; i < vertexCount; ++i) adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    std::vector<uint32_t> adjacency(adjacencyOffsets.back());
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < faceCount * 3; ++i)
+        {
+            adjacency[fill[indicies[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) liveTriangles[i] = adjacencyOffsets[i + 1] - adjacencyOffsets[i];
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t timestamp = cacheSize + 1;
+    std::vector<bool> emitted(faceCount, false);
+    std::vector<uint32_t> deadEnds;
+    std::vector<uint32_t> candidates;
+    std::vector<uint32_t> result;
+    result.reserve(faceCount * 3);
+
+    size_t cursor = 0;
+    auto nextVertex = [&]() -> int64_t {
+        while (!deadEnds.empty())
+        {
+            uint32_t v = deadEnds.back();
+            deadEnds.pop_back();
+            if (liveTriangles[v] > 0) return v;
+        }
+        for (; cursor < vertexCount; ++cursor)
+        {
+            if (liveTriangles[cursor] > 0) return static_cast<int64_t>(cursor);
+        }
+        return -1;
+    };
+
+    int64_t fan = nextVertex();
+    while (fan >= 0)
+    {
+        candidates.clear();
+        for (uint32_t a = adjacencyOffsets[fan]; a < adjacencyOffsets[fan + 1]; ++a)
+        {
+            uint32_t t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = true;
+            for (int k = 0; k < 3; ++k)
+            {
+                uint32_t v = indicies[t * 3 + k];
+                result.push_back(v);
+                deadEnds.push_back(v);
+                candidates.push_back(v);
+                liveTriangles[v]--;
+            }
+            UpdateCache(&indicies[t * 3], cacheSize, timestamps, timestamp);
+        }
+
+        // the candidate that stays in the cache the longest while its
+        // remaining triangles are emitted
+        int64_t best = -1;
+        int64_t bestPriority = -1;
+        for (auto v: candidates)
+        {
+            if (liveTriangles[v] == 0) continue;
+            int64_t age = timestamp - timestamps[v];
+            int64_t priority = age + 2 * liveTriangles[v] <= cacheSize ? age : 0;
+            if (priority > bestPriority)
+            {
+                best = v;
+                bestPriority = priority;
+            }
+        }
+        fan = best >= 0 ? best : nextVertex();
+    }
+    indicies.swap(result);
+}
+
+uint32_t MeshOptimizer::OptimizeOverdraw(std::vector<uint32_t>& indicies,
+    const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride,
+    float threshold, uint32_t cacheSize)
+{
+    size_t faceCount = indicies.size() / 3;
+    if (faceCount == 0) return 0;
+
+    std::vector<uint32_t> timestamps(vertexCount, 0);
+    uint32_t timestamp = cacheSize + 1;
+
+    // Hard boundaries: a triangle with three misses almost always starts a new
+    // patch of the mesh, so the order inside those patches is what the cache
+    // optimizer produced and the patches themselves can be moved freely.
+    std::vector<uint32_t> hardBoundaries;
+    uint64_t inputMisses = 0;
+    for (size_t i = 0; i < faceCount; ++i)
+    {
+        uint32_t misses = UpdateCache(&indicies[i * 3], cacheSize, timestamps, timestamp);
+        inputMisses += misses;
+        if (i == 0 || misses == 3) hardBoundaries.push_back(static_cast<uint32_t>(i));
+    }
+    hardBoundaries.push_back(static_cast<uint32_t>(faceCount));
+
+    // Soft boundaries: cut every patch into smaller clusters as soon as the
+    // running ACMR of the cluster drops to threshold times the patch ACMR,
+    // counted from a cold cache as after the reorder. The rest of a patch may
+    // never get there, it is merged into the cluster before it.
+    std::vector<uint32_t> clusters;
+    for (size_t h = 0; h + 1 < hardBoundaries.size(); ++h)
+    {
+        uint32_t start = hardBoundaries[h];
+        uint32_t end = hardBoundaries[h + 1];
+
+        timestamp += cacheSize + 1;
+        uint32_t patchMisses = 0;
+        for (uint32_t i = start; i < end; ++i)
+        {
+            patchMisses += UpdateCache(&indicies[i * 3], cacheSize, timestamps, timestamp);
+        }
+        float clusterThreshold = threshold * static_cast<float>(patchMisses) / (end - start);
+
+        clusters.push_back(start);
+        timestamp += cacheSize + 1;
+        uint32_t runningMisses = 0;
+        uint32_t runningFaces = 0;
+        for (uint32_t i = start; i < end; ++i)
+        {
+            runningMisses += UpdateCache(&indicies[i * 3], cacheSize, timestamps, timestamp);
+            runningFaces++;
+            if (i + 1 < end && static_cast<float>(runningMisses) / runningFaces <= clusterThreshold)
+            {
+                clusters.push_back(i + 1);
+                timestamp += cacheSize + 1;
+                runningMisses = 0;
+                runningFaces = 0;
+            }
+        }
+        if (runningFaces > 0 && clusters.back() != start
+            && static_cast<float>(runningMisses) / runningFaces > clusterThreshold)
+        {
+            clusters.pop_back();
+        }
+    }
+    uint32_t clusterCount = static_cast<uint32_t>(clusters.size());
+    clusters.push_back(static_cast<uint32_t>(faceCount));
+
+    // Occlusion potential of a cluster: how far its area weighted centroid lies
+    // from the mesh centre along the average cluster normal.
+    XMFLOAT3 meshCentroid(0.f, 0.f, 0.f);
+    for (auto index: indicies)
+    {
+        const XMFLOAT3& p = GetPosition(positions, vertexStride, index);
+        meshCentroid.x += p.x;
+        meshCentroid.y += p.y;
+        meshCentroid.z += p.z;
+    }
+    meshCentroid.x /= indicies.size();
+    meshCentroid.y /= indicies.size();
+    meshCentroid.z /= indicies.size();
+
+    std::vector<float> sortKeys(clusterCount);
+    for (uint32_t c = 0; c < clusterCount; ++c)
+    {
+        XMFLOAT3 centroid(0.f, 0.f, 0.f);
+        XMFLOAT3 normal(0.f, 0.f, 0.f);
+        float clusterArea = 0.f;
+        for (uint32_t i = clusters[c]; i < clusters[c + 1]; ++i)
+        {
+            const XMFLOAT3& p0 = GetPosition(positions, vertexStride, indicies[i * 3    ]);
+            const XMFLOAT3& p1 = GetPosition(positions, vertexStride, indicies[i * 3 + 1]);
+            const XMFLOAT3& p2 = GetPosition(positions, vertexStride, indicies[i * 3 + 2]);
+            XMFLOAT3 n = Cross(Sub(p1, p0), Sub(p2, p0));
+            float area = std::sqrt(Dot(n, n));
+
+            centroid.x += (p0.x + p1.x + p2.x) / 3.f * area;
+            centroid.y += (p0.y + p1.y + p2.y) / 3.f * area;
+            centroid.z += (p0.z + p1.z + p2.z) / 3.f * area;
+            normal.x += n.x;
+            normal.y += n.y;
+            normal.z += n.z;
+            clusterArea += area;
+        }
+
+        float invArea = clusterArea == 0.f ? 0.f : 1.f / clusterArea;
+        centroid = XMFLOAT3(centroid.x * invArea, centroid.y * invArea, centroid.z * invArea);
+        sortKeys[c] = Dot(Sub(centroid, meshCentroid), Normalize(normal));
+    }
+
+    std::vector<uint32_t> order(clusterCount);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](uint32_t a, uint32_t b) {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<uint32_t> result;
+    result.reserve(faceCount * 3);
+    for (auto c: order)
+    {
+        result.insert(result.end(), indicies.begin() + clusters[c] * 3, indicies.begin() + clusters[c + 1] * 3);
+    }
+
+    // merged clusters only bound the regression on average, the input order
+    // stays if the whole buffer got worse than threshold
+    float acmrBefore = static_cast<float>(inputMisses) / faceCount;
+    if (CalculateACMR(result, vertexCount, cacheSize) > threshold * acmrBefore) return 0;
+    indicies.swap(result);
+
+    return clusterCount;
+}
+
+MeshOptimizer::OverdrawStatistics MeshOptimizer::AnalyzeOverdraw(const std::vector<uint32_t>& indicies,
+    const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride,
+    const XMFLOAT3& viewDirection, uint32_t resolution)
+{
+    OverdrawStatistics statistics;
+    if (indicies.size() < 3 || vertexCount == 0 || resolution == 0) return statistics;
+
+    XMFLOAT3 minP = GetPosition(positions, vertexStride, 0);
+    XMFLOAT3 maxP = minP;
+    for (uint32_t i = 1; i < vertexCount; ++i)
+    {
+        const XMFLOAT3& p = GetPosition(positions, vertexStride, i);
+        minP = XMFLOAT3(std::min(minP.x, p.x), std::min(minP.y, p.y), std::min(minP.z, p.z));
+        maxP = XMFLOAT3(std::max(maxP.x, p.x), std::max(maxP.y, p.y), std::max(maxP.z, p.z));
+    }
+    XMFLOAT3 center((minP.x + maxP.x) * 0.5f, (minP.y + maxP.y) * 0.5f, (minP.z + maxP.z) * 0.5f);
+    XMFLOAT3 extent = Sub(maxP, center);
+    float radius = std::sqrt(Dot(extent, extent));
+    if (radius == 0.f) return statistics;
+
+    // Same basis as XMMatrixLookAtLH.
+    XMFLOAT3 forward = Normalize(viewDirection);
+    XMFLOAT3 up0 = std::abs(forward.y) > 0.99f ? XMFLOAT3(0.f, 0.f, 1.f) : XMFLOAT3(0.f, 1.f, 0.f);
+    XMFLOAT3 right = Normalize(Cross(up0, forward));
+    XMFLOAT3 up = Cross(forward, right);
+
+    float scale = 0.5f * resolution / radius;
+    float offset = 0.5f * resolution;
+    std::vector<XMFLOAT3> projected(vertexCount);
+    for (uint32_t i = 0; i < vertexCount; ++i)
+    {
+        XMFLOAT3 p = Sub(GetPosition(positions, vertexStride, i), center);
+        projected[i] = XMFLOAT3(Dot(p, right) * scale + offset, Dot(p, up) * scale + offset, Dot(p, forward));
+    }
+
+    auto edge = [](const XMFLOAT3& a, const XMFLOAT3& b, float px, float py) {
+        return (b.x - a.x) * (py - a.y) - (b.y - a.y) * (px - a.x);
+    };
+
+    std::vector<float> depth(static_cast<size_t>(resolution) * resolution, std::numeric_limits<float>::infinity());
+    for (size_t i = 0; i + 2 < indicies.size(); i += 3)
+    {
+        const XMFLOAT3& v0 = projected[indicies[i]];
+        XMFLOAT3 v1 = projected[indicies[i + 1]];
+        XMFLOAT3 v2 = projected[indicies[i + 2]];
+
+        // Front faces are clockwise with y up (FrontCounterClockwise = FALSE).
+        float area = edge(v0, v1, v2.x, v2.y);
+        if (area >= 0.f) continue;
+        std::swap(v1, v2);
+        area = -area;
+
+        int minX = std::max(0, static_cast<int>(std::floor(std::min({v0.x, v1.x, v2.x}))));
+        int minY = std::max(0, static_cast<int>(std::floor(std::min({v0.y, v1.y, v2.y}))));
+        int maxX = std::min(static_cast<int>(resolution) - 1, static_cast<int>(std::ceil(std::max({v0.x, v1.x, v2.x}))));
+        int maxY = std::min(static_cast<int>(resolution) - 1, static_cast<int>(std::ceil(std::max({v0.y, v1.y, v2.y}))));
+
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = y + 0.5f;
+            for (int x = minX; x <= maxX; ++x)
+            {
+                float px = x + 0.5f;
+                float w0 = edge(v1, v2, px, py);
+                float w1 = edge(v2, v0, px, py);
+                float w2 = edge(v0, v1, px, py);
+                if (w0 < 0.f || w1 < 0.f || w2 < 0.f) continue;
+
+                float z = (w0 * v0.z + w1 * v1.z + w2 * v2.z) / area;
+                float& stored = depth[static_cast<size_t>(y) * resolution + x];
+                if (z < stored)
+                {
+                    if (stored == std::numeric_limits<float>::infinity()) statistics.pixelsCovered++;
+                    stored = z;
+                    statistics.pixelsShaded++;
+                }
+            }
+        }
+    }
+
+    statistics.overdraw = statistics.pixelsCovered == 0 ? 0.f :
+        static_cast<float>(statistics.pixelsShaded) / statistics.pixelsCovered;
+    return statistics;
+}
+
+std::vector<MeshOptimizer::OverdrawGain> MeshOptimizer::EstimateOverdrawGain(
+    const std::vector<uint32_t>& before, const std::vector<uint32_t>& after,
+    const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride,
+    const std::vector<XMFLOAT3>& viewDirections, uint32_t resolution)
+{
+    std::vector<OverdrawGain> gains;
+    for (auto& direction: viewDirections)
+    {
+        OverdrawGain gain;
+        gain.viewDirection = direction;
+        gain.before = AnalyzeOverdraw(before, positions, vertexCount, vertexStride, direction, resolution);
+        gain.after = AnalyzeOverdraw(after, positions, vertexCount, vertexStride, direction, resolution);
+        if (gain.before.pixelsShaded > 0)
+        {
+            gain.gain = 1.f - static_cast<float>(gain.after.pixelsShaded) / gain.before.pixelsShaded;
+        }
+        gains.emplace_back(gain);
+    }
+    return gains;
+}
+
+std::vector<uint32_t> MeshOptimizer::GenerateVertexFetchRemap(const std::vector<uint32_t>& indicies, size_t vertexCount)
+{
+    const uint32_t unused = ~0u;
+    std::vector<uint32_t> remap(vertexCount, unused);
+
+    uint32_t next = 0;
+    for (auto index: indicies)
+    {
+        if (remap[index] == unused) remap[index] = next++;
+    }
+    for (auto& r: remap)
+    {
+        if (r == unused) r = next++;
+    }
+    return remap;
+}
+
+void MeshOptimizer::RemapIndexBuffer(std::vector<uint32_t>& indicies, const std::vector<uint32_t>& remap)
+{
+    for (auto& index: indicies)
+    {
+        index = remap[index];
+    }
+}
+
+void MeshOptimizer::RemapVertexBuffer(void* destination, const void* vertices, size_t vertexCount, size_t vertexSize,
+    const std::vector<uint32_t>& remap)
+{
+    auto dst = static_cast<uint8_t*>(destination);
+    auto src = static_cast<const uint8_t*>(vertices);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        std::memcpy(dst + remap[i] * vertexSize, src + i * vertexSize, vertexSize);
+    }
+}
+
+MeshOptimizer::VertexFetchStatistics MeshOptimizer::AnalyzeVertexFetch(const std::vector<uint32_t>& indicies,
+    size_t vertexCount, size_t vertexSize)
+{
+    VertexFetchStatistics statistics;
+    if (indicies.empty() || vertexSize == 0) return statistics;
+
+    std::vector<uint8_t> referenced(vertexCount, 0);
+    std::vector<uint64_t> cacheTags(FETCH_CACHE_LINES, ~0ull);
+    uint64_t strideSum = 0;
+    uint64_t misses = 0;
+    for (size_t i = 0; i < indicies.size(); ++i)
+    {
+        uint32_t index = indicies[i];
+        referenced[index] = 1;
+        if (i > 0)
+        {
+            uint32_t last = indicies[i - 1];
+            strideSum += (index > last ? index - last : last - index) * vertexSize;
+        }
+
+        // a vertex may straddle two lines
+        uint64_t firstLine = index * vertexSize / FETCH_CACHE_LINE_SIZE;
+        uint64_t lastLine = ((index + 1) * vertexSize - 1) / FETCH_CACHE_LINE_SIZE;
+        for (uint64_t line = firstLine; line <= lastLine; ++line)
+        {
+            auto& tag = cacheTags[line % FETCH_CACHE_LINES];
+            if (tag != line)
+            {
+                tag = line;
+                misses++;
+            }
+        }
+    }
+
+    uint64_t referencedCount = 0;
+    for (auto r: referenced) referencedCount += r;
+
+    statistics.averageFetchStride = indicies.size() > 1 ?
+        static_cast<float>(strideSum) / (indicies.size() - 1) : 0.f;
+    statistics.bytesFetched = misses * FETCH_CACHE_LINE_SIZE;
+    statistics.overfetch = static_cast<float>(statistics.bytesFetched) / (referencedCount * vertexSize);
+    return statistics;
+}
+
+MeshOptimizer::CleanReport MeshOptimizer::CleanIndexBuffer(std::vector<uint32_t>& indicies,
+    const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride)
+{
+    CleanReport report;
+    size_t faceCount = indicies.size() / 3;
+    if (faceCount == 0) return report;
+    auto pool = TaskPool::GetInstance();
+
+    // 1. degenerate triangles and keys of the others
+    enum : uint8_t { KEEP, DEGENERATE, DUPLICATE };
+    std::vector<uint8_t> state(faceCount);
+    std::vector<uint64_t> keys(faceCount);
+    pool->ParallelFor(faceCount, CLEAN_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            const uint32_t* t = &indicies[i * 3];
+            state[i] = IsDegenerate(t, positions, vertexCount, vertexStride) ? DEGENERATE : KEEP;
+            uint32_t canonical[3];
+            CanonicalTriangle(t, canonical);
+            keys[i] = HashTriangle(canonical);
+        }
+    });
+
+    // 2. triangles partitioned by key in input order, so equal triangles meet
+    // in one partition and the first of them is the one kept
+    const size_t partitionCount = size_t(1) << CLEAN_PARTITION_BITS;
+    const uint32_t partitionShift = 64 - CLEAN_PARTITION_BITS;
+    std::vector<uint32_t> partitionOffsets(partitionCount + 1, 0);
+    for (size_t i = 0; i < faceCount; ++i)
+    {
+        if (state[i] == KEEP) partitionOffsets[(keys[i] >> partitionShift) + 1]++;
+    }
+    for (size_t p = 0; p < partitionCount; ++p) partitionOffsets[p + 1] += partitionOffsets[p];
+    std::vector<uint32_t> partitioned(partitionOffsets.back());
+    {
+        std::vector<uint32_t> cursor(partitionOffsets.begin(), partitionOffsets.end() - 1);
+        for (size_t i = 0; i < faceCount; ++i)
+        {
+            if (state[i] == KEEP) partitioned[cursor[keys[i] >> partitionShift]++] = static_cast<uint32_t>(i);
+        }
+    }
+
+    // 3. duplicates per partition, open addressing on the key
+    pool->ParallelFor(partitionCount, 1, [&](size_t begin, size_t end) {
+        std::vector<uint32_t> table;
+        for (size_t p = begin; p < end; ++p)
+        {
+            uint32_t first = partitionOffsets[p];
+            uint32_t count = partitionOffsets[p + 1] - first;
+            if (count < 2) continue;
+            size_t capacity = 1;
+            while (capacity < count * 2) capacity <<= 1;
+            table.assign(capacity, ~0u);
+            for (uint32_t j = 0; j < count; ++j)
+            {
+                uint32_t face = partitioned[first + j];
+                uint32_t canonical[3];
+                CanonicalTriangle(&indicies[face * 3], canonical);
+                for (size_t slot = keys[face] & (capacity - 1);; slot = (slot + 1) & (capacity - 1))
+                {
+                    uint32_t other = table[slot];
+                    if (other == ~0u)
+                    {
+                        table[slot] = face;
+                        break;
+                    }
+                    if (keys[other] != keys[face]) continue;
+                    uint32_t otherCanonical[3];
+                    CanonicalTriangle(&indicies[other * 3], otherCanonical);
+                    if (std::equal(canonical, canonical + 3, otherCanonical))
+                    {
+                        state[face] = DUPLICATE;
+                        break;
+                    }
+                }
+            }
+        }
+    });
+
+    size_t out = 0;
+    for (size_t i = 0; i < faceCount; ++i)
+    {
+        if (state[i] == DEGENERATE) report.degenerateTriangles++;
+        else if (state[i] == DUPLICATE) report.duplicateTriangles++;
+        else
+        {
+            if (out != i * 3) std::copy_n(&indicies[i * 3], 3, &indicies[out]);
+            out += 3;
+        }
+    }
+    indicies.resize(out);
+    return report;
+}
+
+size_t MeshOptimizer::GenerateCompactRemap(const std::vector<uint32_t>& indicies, size_t vertexCount,
+    std::vector<uint32_t>& remap)
+{
+    remap.assign(vertexCount, REMOVED_VERTEX);
+    for (auto index: indicies)
+    {
+        remap[index] = 0;
+    }
+    uint32_t next = 0;
+    for (auto& entry: remap)
+    {
+        if (entry != REMOVED_VERTEX) entry = next++;
+    }
+    return next;
+}
+
+void MeshOptimizer::CompactVertexBuffer(void* destination, const void* vertices, size_t vertexCount, size_t vertexSize,
+    const std::vector<uint32_t>& remap)
+{
+    auto dst = static_cast<uint8_t*>(destination);
+    auto src = static_cast<const uint8_t*>(vertices);
+    uint32_t next = 0;
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        if (remap[i] != next) continue;
+        std::memcpy(dst + static_cast<size_t>(next) * vertexSize, src + i * vertexSize, vertexSize);
+        next++;
+    }
+}
+
+size_t MeshOptimizer::GenerateWeldRemap(const XMFLOAT3* positions, const XMFLOAT3* normals, size_t vertexCount,
+    size_t vertexStride, const WeldConfig& config, std::vector<uint32_t>& remap)
+{
+    assert(config.epsilon >= 0.f && config.epsilon <= std::numeric_limits<float>::max());
+    remap.resize(vertexCount);
+    if (vertexCount == 0) return 0;
+    auto pool = TaskPool::GetInstance();
+    const uint32_t UNASSIGNED = ~0u;
+    const double cellSize = std::max(WELD_CELL_SIZE * config.epsilon, static_cast<double>(std::numeric_limits<float>::min()));
+    const double epsilon2 = static_cast<double>(config.epsilon) * config.epsilon;
+    size_t chunkCount = (vertexCount + WELD_GRAIN - 1) / WELD_GRAIN;
+
+    auto cellOf = [&](uint32_t v, int64_t* cell, int* side) {
+        auto& p = GetPosition(positions, vertexStride, v);
+        const float c[3] = { p.x, p.y, p.z };
+        for (int k = 0; k < 3; ++k)
+        {
+            double scaled = c[k] / cellSize;
+            if (std::abs(scaled) >= WELD_MAX_CELL)
+            {
+                uint32_t bits;
+                std::memcpy(&bits, &c[k], sizeof(bits));
+                cell[k] = static_cast<int64_t>(bits) + (int64_t(1) << 32);
+                side[k] = 0;
+                continue;
+            }
+            double floor = std::floor(scaled);
+            cell[k] = static_cast<int64_t>(floor);
+            // the neighbour cell behind a face closer than epsilon, if any
+            double offset = (scaled - floor) * cellSize;
+            side[k] = offset < config.epsilon ? -1 : (cellSize - offset <= config.epsilon ? 1 : 0);
+        }
+    };
+    auto canMerge = [&](uint32_t a, uint32_t b) {
+        auto& pa = GetPosition(positions, vertexStride, a);
+        auto& pb = GetPosition(positions, vertexStride, b);
+        double dx = double(pa.x) - pb.x, dy = double(pa.y) - pb.y, dz = double(pa.z) - pb.z;
+        if (dx * dx + dy * dy + dz * dz > epsilon2) return false;
+        return !normals || Dot(GetPosition(normals, vertexStride, a), GetPosition(normals, vertexStride, b)) >= config.minNormalDot;
+    };
+
+    // 1. cell hashes, and how many vertices of every chunk go to which partition
+    std::vector<uint64_t> cellHashes(vertexCount);
+    std::vector<uint32_t> histograms(chunkCount * WELD_PARTITIONS, 0);
+    pool->ParallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk)
+        {
+            uint32_t* histogram = &histograms[chunk * WELD_PARTITIONS];
+            for (size_t v = chunk * WELD_GRAIN; v < std::min(vertexCount, (chunk + 1) * WELD_GRAIN); ++v)
+            {
+                int64_t cell[3];
+                int side[3];
+                cellOf(static_cast<uint32_t>(v), cell, side);
+                cellHashes[v] = HashCell(cell[0], cell[1], cell[2]);
+                histogram[cellHashes[v] >> (64 - WELD_PARTITION_BITS)]++;
+            }
+        }
+    });
+
+    // 2. CSR hash table: vertices bucketed by the top tableBits of their cell
+    // hash, in index order. The top bits pick the partition, so a stable
+    // scatter into partitions and a counting sort per partition build it.
+    uint32_t tableBits = WELD_PARTITION_BITS;
+    while ((size_t(1) << tableBits) < vertexCount) tableBits++;
+    const uint32_t bucketShift = 64 - tableBits;
+    const size_t partitionBuckets = size_t(1) << (tableBits - WELD_PARTITION_BITS);
+    std::vector<uint32_t> partitionStart(WELD_PARTITIONS + 1, 0);
+    {
+        uint32_t offset = 0;
+        for (size_t p = 0; p < WELD_PARTITIONS; ++p)
+        {
+            partitionStart[p] = offset;
+            for (size_t c = 0; c < chunkCount; ++c)
+            {
+                uint32_t count = histograms[c * WELD_PARTITIONS + p];
+                histograms[c * WELD_PARTITIONS + p] = offset;
+                offset += count;
+            }
+        }
+        partitionStart[WELD_PARTITIONS] = offset;
+    }
+    std::vector<uint32_t> partitioned(vertexCount);
+    pool->ParallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+        for (size_t chunk = begin; chunk < end; ++chunk)
+        {
+            uint32_t* offsets = &histograms[chunk * WELD_PARTITIONS];
+            for (size_t v = chunk * WELD_GRAIN; v < std::min(vertexCount, (chunk + 1) * WELD_GRAIN); ++v)
+            {
+                partitioned[offsets[cellHashes[v] >> (64 - WELD_PARTITION_BITS)]++] = static_cast<uint32_t>(v);
+            }
+        }
+    });
+    std::vector<uint32_t> bucketStart((size_t(1) << tableBits) + 1, 0);
+    std::vector<uint32_t> buckets(vertexCount);
+    pool->ParallelFor(WELD_PARTITIONS, 1, [&](size_t begin, size_t end) {
+        for (size_t p = begin; p < end; ++p)
+        {
+            uint32_t* start = &bucketStart[p * partitionBuckets];
+            for (uint32_t i = partitionStart[p]; i < partitionStart[p + 1]; ++i)
+            {
+                start[(cellHashes[partitioned[i]] >> bucketShift) - p * partitionBuckets]++;
+            }
+            uint32_t offset = partitionStart[p];
+            for (size_t b = 0; b < partitionBuckets; ++b)
+            {
+                uint32_t count = start[b];
+                start[b] = offset;
+                offset += count;
+            }
+            std::vector<uint32_t> cursor(start, start + partitionBuckets);
+            for (uint32_t i = partitionStart[p]; i < partitionStart[p + 1]; ++i)
+            {
+                uint32_t v = partitioned[i];
+                buckets[cursor[(cellHashes[v] >> bucketShift) - p * partitionBuckets]++] = v;
+            }
+        }
+    });
+    bucketStart.back() = static_cast<uint32_t>(vertexCount);
+    partitioned = std::vector<uint32_t>();
+
+    // Smallest vertex v may merge with among those accepted by filter. Buckets
+    // list their vertices by index, so each stops at its first match.
+    auto findFirst = [&](uint32_t v, const auto& filter) {
+        int64_t cell[3];
+        int side[3];
+        cellOf(v, cell, side);
+        uint32_t best = UNASSIGNED;
+        for (int n = 0; n < 8; ++n)
+        {
+            if ((n & 1 && !side[0]) || (n & 2 && !side[1]) || (n & 4 && !side[2])) continue;
+            uint64_t hash = HashCell(cell[0] + (n & 1 ? side[0] : 0), cell[1] + (n & 2 ? side[1] : 0),
+                cell[2] + (n & 4 ? side[2] : 0));
+            size_t bucket = hash >> bucketShift;
+            for (uint32_t i = bucketStart[bucket]; i < bucketStart[bucket + 1]; ++i)
+            {
+                uint32_t other = buckets[i];
+                if (other >= best) break;
+                if (cellHashes[other] == hash && filter(other) && canMerge(v, other))
+                {
+                    best = other;
+                    break;
+                }
+            }
+        }
+        return best;
+    };
+
+    // 3. vertices without a smaller neighbour keep themselves, no two of
+    // them are within epsilon
+    std::vector<uint32_t> group(vertexCount);
+    pool->ParallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+        for (size_t v = begin * WELD_GRAIN; v < std::min(vertexCount, end * WELD_GRAIN); ++v)
+        {
+            uint32_t smaller = findFirst(static_cast<uint32_t>(v), [v](uint32_t other) { return other < v; });
+            group[v] = smaller == UNASSIGNED ? static_cast<uint32_t>(v) : UNASSIGNED;
+        }
+    });
+    // 4. the others join the smallest kept vertex before them
+    std::vector<uint8_t> kept(vertexCount);
+    for (size_t v = 0; v < vertexCount; ++v) kept[v] = group[v] == v;
+    auto keptBefore = [&kept](size_t v) {
+        return [&kept, v](uint32_t other) { return other < v && kept[other] != 0; };
+    };
+    pool->ParallelFor(chunkCount, 1, [&](size_t begin, size_t end) {
+        for (size_t v = begin * WELD_GRAIN; v < std::min(vertexCount, end * WELD_GRAIN); ++v)
+        {
+            if (!kept[v]) group[v] = findFirst(static_cast<uint32_t>(v), keptBefore(v));
+        }
+    });
+    // 5. the few whose smaller neighbours all joined others, in order, so
+    // they can join each other. No later kept vertex is within epsilon of
+    // them, it would have had a smaller neighbour.
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        if (group[v] != UNASSIGNED) continue;
+        uint32_t target = findFirst(static_cast<uint32_t>(v), keptBefore(v));
+        if (target == UNASSIGNED)
+        {
+            target = static_cast<uint32_t>(v);
+            kept[v] = 1;
+        }
+        group[v] = target;
+    }
+
+    // every group keeps its smallest vertex
+    uint32_t next = 0;
+    for (size_t v = 0; v < vertexCount; ++v)
+    {
+        remap[v] = kept[v] ? next++ : remap[group[v]];
+    }
+    return next;
+}
\ No newline at end of file
@@ -0,0 +1,175 @@
+#include "MeshResidency.h"
+#include <algorithm>
+#include <tuple>
+#include <vector>
+
+MeshResidencyManager::MeshResidencyManager(MeshResidencyBudget budget, uint32_t framesInFlight)
+    : m_framesInFlight(framesInFlight)
+    , m_budget(budget)
+{
+}
+
+MeshResidencyManager::MeshId MeshResidencyManager::Register(uint64_t cpuBytes, uint64_t gpuBytes,
+    bool cpuResident, bool gpuResident, MeshResidencyCallbacks callbacks)
+{
+    MeshId id = m_nextId++;
+    Entry entry = { cpuBytes, gpuBytes, cpuResident, gpuResident, m_frame, m_frame, std::move(callbacks) };
+    if (cpuResident) m_statistics.cpuBytes += cpuBytes;
+    if (gpuResident) m_statistics.gpuBytes += gpuBytes;
+    m_entries.emplace(id, std::move(entry));
+    return id;
+}
+
+void MeshResidencyManager::Unregister(MeshId id)
+{
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) return;
+    if (it->second.cpuResident) m_statistics.cpuBytes -= it->second.cpuBytes;
+    if (it->second.gpuResident) m_statistics.gpuBytes -= it->second.gpuBytes;
+    m_entries.erase(it);
+}
+
+void MeshResidencyManager::UpdateSizes(MeshId id, uint64_t cpuBytes, uint64_t gpuBytes)
+{
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) return;
+    Entry& entry = it->second;
+    if (entry.cpuResident) m_statistics.cpuBytes = m_statistics.cpuBytes - entry.cpuBytes + cpuBytes;
+    if (entry.gpuResident) m_statistics.gpuBytes = m_statistics.gpuBytes - entry.gpuBytes + gpuBytes;
+    entry.cpuBytes = cpuBytes;
+    entry.gpuBytes = gpuBytes;
+}
+
+bool MeshResidencyManager::RestoreCPU(Entry& entry)
+{
+    if (entry.cpuResident) return true;
+    if (!entry.callbacks.restoreCPU || !entry.callbacks.restoreCPU())
+    {
+        m_statistics.failedRestores++;
+        return false;
+    }
+    entry.cpuResident = true;
+    m_statistics.cpuBytes += entry.cpuBytes;
+    m_statistics.cpuRestores++;
+    return true;
+}
+
+void MeshResidencyManager::ReleaseCPU(Entry& entry)
+{
+    if (!entry.callbacks.releaseCPU || !entry.callbacks.releaseCPU()) return;
+    entry.cpuResident = false;
+    m_statistics.cpuBytes -= entry.cpuBytes;
+    m_statistics.cpuEvictions++;
+}
+
+bool MeshResidencyManager::Request(MeshId id, bool gpu, bool cpu)
+{
+    auto it = m_entries.find(id);
+    if (it == m_entries.end()) return false;
+    Entry& entry = it->second;
+
+    if (cpu || (gpu && !entry.gpuResident))
+    {
+        if (!RestoreCPU(entry)) return false;
+        entry.lastCPUUse = m_frame;
+    }
+    if (gpu)
+    {
+        if (!entry.gpuResident)
+        {
+            if (!entry.callbacks.restoreGPU || !entry.callbacks.restoreGPU())
+            {
+                m_statistics.failedRestores++;
+                return false;
+            }
+            entry.gpuResident = true;
+            m_statistics.gpuBytes += entry.gpuBytes;
+            m_statistics.gpuRestores++;
+        }
+        entry.lastGPUUse = m_frame;
+    }
+    return true;
+}
+
+void MeshResidencyManager::EvictGPU()
+{
+    if (m_statistics.gpuBytes <= m_budget.gpuBytes) return;
+
+    std::vector<std::pair<uint64_t, Entry*>> candidates;
+    for (auto& it: m_entries)
+    {
+        Entry& entry = it.second;
+        if (entry.gpuResident && entry.lastGPUUse + m_framesInFlight <= m_frame)
+        {
+            candidates.emplace_back(entry.lastGPUUse, &entry);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (auto& candidate: candidates)
+    {
+        if (m_statistics.gpuBytes <= m_budget.gpuBytes) break;
+        Entry& entry = *candidate.second;
+        if (entry.callbacks.releaseGPU) entry.callbacks.releaseGPU();
+        entry.gpuResident = false;
+        m_statistics.gpuBytes -= entry.gpuBytes;
+        m_statistics.gpuEvictions++;
+    }
+}
+
+void MeshResidencyManager::EvictCPU()
+{
+    if (m_statistics.cpuBytes <= m_budget.cpuBytes) return;
+
+    // copies of meshes that can still be drawn go first, then whole meshes
+    std::vector<std::tuple<bool, uint64_t, Entry*>> candidates;
+    for (auto& it: m_entries)
+    {
+        Entry& entry = it.second;
+        if (entry.cpuResident && entry.lastCPUUse < m_frame)
+        {
+            candidates.emplace_back(!entry.gpuResident, entry.lastCPUUse, &entry);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (auto& candidate: candidates)
+    {
+        if (m_statistics.cpuBytes <= m_budget.cpuBytes) break;
+        ReleaseCPU(*std::get<2>(candidate));
+    }
+}
+
+void MeshResidencyManager::EndFrame()
+{
+    EvictGPU();
+    EvictCPU();
+    m_frame++;
+}
+
+void MeshResidencyManager::SetBudget(const MeshResidencyBudget& budget)
+{
+    m_budget = budget;
+}
+
+const MeshResidencyBudget& MeshResidencyManager::GetBudget() const
+{
+    return m_budget;
+}
+
+bool MeshResidencyManager::IsCPUResident(MeshId id) const
+{
+    auto it = m_entries.find(id);
+    return it != m_entries.end() && it->second.cpuResident;
+}
+
+bool MeshResidencyManager::IsGPUResident(MeshId id) const
+{
+    auto it = m_entries.find(id);
+    return it != m_entries.end() && it->second.gpuResident;
+}
+
+const MeshResidencyStatistics& MeshResidencyManager::GetStatistics() const
+{
+    return m_statistics;
+}
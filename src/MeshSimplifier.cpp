@@ -0,0 +1,326 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <queue>
+#include <unordered_map>
+
+namespace
+{
+    inline const XMFLOAT3& GetPosition(const XMFLOAT3* positions, size_t stride, uint32_t index)
+    {
+        return *reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(positions) + stride * index);
+    }
+
+    struct Vector3
+    {
+        double x, y, z;
+    };
+    inline Vector3 Sub(const Vector3& a, const Vector3& b)
+    {
+        return { a.x - b.x, a.y - b.y, a.z - b.z };
+    }
+    inline Vector3 Cross(const Vector3& a, const Vector3& b)
+    {
+        return { a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x };
+    }
+    inline double Dot(const Vector3& a, const Vector3& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    // Symmetric 4x4 matrix of the plane equations plus the accumulated weight,
+    // Evaluate returns the weighted mean squared distance to the planes.
+    struct Quadric
+    {
+        double a2 = 0., ab = 0., ac = 0., ad = 0.;
+        double b2 = 0., bc = 0., bd = 0.;
+        double c2 = 0., cd = 0.;
+        double d2 = 0.;
+        double w = 0.;
+
+        void AddPlane(const Vector3& n, double d, double weight)
+        {
+            a2 += weight * n.x * n.x; ab += weight * n.x * n.y; ac += weight * n.x * n.z; ad += weight * n.x * d;
+            b2 += weight * n.y * n.y; bc += weight * n.y * n.z; bd += weight * n.y * d;
+            c2 += weight * n.z * n.z; cd += weight * n.z * d;
+            d2 += weight * d * d;
+            w += weight;
+        }
+        Quadric& operator+=(const Quadric& q)
+        {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+            b2 += q.b2; bc += q.bc; bd += q.bd;
+            c2 += q.c2; cd += q.cd;
+            d2 += q.d2;
+            w += q.w;
+            return *this;
+        }
+        double Evaluate(const Vector3& p) const
+        {
+            double r = a2 * p.x * p.x + b2 * p.y * p.y + c2 * p.z * p.z
+                + 2. * (ab * p.x * p.y + ac * p.x * p.z + bc * p.y * p.z)
+                + 2. * (ad * p.x + bd * p.y + cd * p.z) + d2;
+            return w > 0. ? std::abs(r) / w : 0.;
+        }
+    };
+
+    struct Collapse
+    {
+        double cost;
+        uint32_t from;
+        uint32_t to;
+        uint32_t fromVersion;
+        uint32_t toVersion;
+
+        bool operator>(const Collapse& c) const { return cost > c.cost; }
+    };
+
+    // Border edges are kept in place by a plane perpendicular to the triangle
+    // through the edge, weighted well above the surface planes.
+    const double BORDER_WEIGHT = 10.;
+
+    struct PositionHash
+    {
+        size_t operator()(const std::array<uint32_t, 3>& p) const
+        {
+            uint64_t h = p[0];
+            h = h * 0x9e3779b97f4a7c15ull ^ p[1];
+            h = h * 0x9e3779b97f4a7c15ull ^ p[2];
+            return static_cast<size_t>(h ^ (h >> 29));
+        }
+    };
+
+    inline uint64_t EdgeKey(uint32_t a, uint32_t b)
+    {
+        return a < b ? (static_cast<uint64_t>(a) << 32) | b : (static_cast<uint64_t>(b) << 32) | a;
+    }
+}
+
+std::vector<uint32_t> MeshSimplifier::Simplify(const std::vector<uint32_t>& indicies,
+    const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride,
+    size_t targetIndexCount, float targetError, float* resultError)
+{
+    if (resultError) *resultError = 0.f;
+    size_t faceCount = indicies.size() / 3;
+    if (targetIndexCount >= faceCount * 3 || faceCount == 0)
+    {
+        return std::vector<uint32_t>(indicies.begin(), indicies.begin() + faceCount * 3);
+    }
+
+    // Vertices sharing a position are one point for the topology, the
+    // triangles keep their own vertex in every corner.
+    std::vector<uint32_t> canonical(vertexCount);
+    std::vector<Vector3> points;
+    {
+        std::unordered_map<std::array<uint32_t, 3>, uint32_t, PositionHash> positionMap;
+        positionMap.reserve(vertexCount);
+        for (uint32_t i = 0; i < vertexCount; ++i)
+        {
+            const XMFLOAT3& p = GetPosition(positions, vertexStride, i);
+            std::array<uint32_t, 3> key;
+            std::memcpy(key.data(), &p, sizeof(key));
+            auto it = positionMap.emplace(key, static_cast<uint32_t>(points.size()));
+            if (it.second) points.push_back({ p.x, p.y, p.z });
+            canonical[i] = it.first->second;
+        }
+    }
+    size_t pointCount = points.size();
+
+    std::vector<std::array<uint32_t, 3>> triangles(faceCount);
+    std::vector<std::array<uint32_t, 3>> corners(faceCount);
+    std::vector<bool> triangleAlive(faceCount, true);
+    std::vector<std::vector<uint32_t>> pointTriangles(pointCount);
+    // Points whose triangles use more than one vertex lie on an attribute
+    // seam (or on duplicates Weld would merge). They stay where they are, a
+    // collapse cannot tell which of their vertices the moved corners need.
+    std::vector<bool> seam(pointCount, false);
+    std::vector<uint32_t> pointVertex(pointCount, ~0u);
+    size_t aliveTriangles = 0;
+    for (size_t t = 0; t < faceCount; ++t)
+    {
+        auto& tri = triangles[t];
+        corners[t] = { indicies[t * 3], indicies[t * 3 + 1], indicies[t * 3 + 2] };
+        tri = { canonical[corners[t][0]], canonical[corners[t][1]], canonical[corners[t][2]] };
+        if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2])
+        {
+            triangleAlive[t] = false;
+            continue;
+        }
+        for (int k = 0; k < 3; ++k)
+        {
+            if (pointVertex[tri[k]] == ~0u) pointVertex[tri[k]] = corners[t][k];
+            else if (pointVertex[tri[k]] != corners[t][k]) seam[tri[k]] = true;
+            pointTriangles[tri[k]].push_back(static_cast<uint32_t>(t));
+        }
+        aliveTriangles++;
+    }
+
+    std::vector<Quadric> quadrics(pointCount);
+    std::unordered_map<uint64_t, uint32_t> edgeUse;
+    edgeUse.reserve(faceCount * 3);
+    for (size_t t = 0; t < faceCount; ++t)
+    {
+        if (!triangleAlive[t]) continue;
+        auto& tri = triangles[t];
+        Vector3 n = Cross(Sub(points[tri[1]], points[tri[0]]), Sub(points[tri[2]], points[tri[0]]));
+        double area = std::sqrt(Dot(n, n));
+        if (area > 0.)
+        {
+            n = { n.x / area, n.y / area, n.z / area };
+            double d = -Dot(n, points[tri[0]]);
+            for (auto p: tri) quadrics[p].AddPlane(n, d, area);
+        }
+        for (int k = 0; k < 3; ++k) edgeUse[EdgeKey(tri[k], tri[(k + 1) % 3])]++;
+    }
+    for (size_t t = 0; t < faceCount; ++t)
+    {
+        if (!triangleAlive[t]) continue;
+        auto& tri = triangles[t];
+        Vector3 n = Cross(Sub(points[tri[1]], points[tri[0]]), Sub(points[tri[2]], points[tri[0]]));
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t a = tri[k];
+            uint32_t b = tri[(k + 1) % 3];
+            if (edgeUse[EdgeKey(a, b)] != 1) continue;
+
+            Vector3 edge = Sub(points[b], points[a]);
+            double length2 = Dot(edge, edge);
+            Vector3 border = Cross(edge, n);
+            double borderLength = std::sqrt(Dot(border, border));
+            if (borderLength == 0.) continue;
+            border = { border.x / borderLength, border.y / borderLength, border.z / borderLength };
+            double d = -Dot(border, points[a]);
+            quadrics[a].AddPlane(border, d, length2 * BORDER_WEIGHT);
+            quadrics[b].AddPlane(border, d, length2 * BORDER_WEIGHT);
+        }
+    }
+
+    std::vector<uint32_t> version(pointCount, 0);
+    std::vector<bool> pointAlive(pointCount, true);
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+
+    // seam points are only ever collapsed onto
+    auto pushEdge = [&](uint32_t a, uint32_t b) {
+        if (seam[a] && seam[b]) return;
+        Quadric q = quadrics[a];
+        q += quadrics[b];
+        double costAB = q.Evaluate(points[b]);
+        double costBA = q.Evaluate(points[a]);
+        if (!seam[a] && (seam[b] || costAB <= costBA)) heap.push({ costAB, a, b, version[a], version[b] });
+        else heap.push({ costBA, b, a, version[b], version[a] });
+    };
+    for (auto& edge: edgeUse)
+    {
+        pushEdge(static_cast<uint32_t>(edge.first >> 32), static_cast<uint32_t>(edge.first & 0xffffffffu));
+    }
+    edgeUse.clear();
+
+    // moving "from" onto "to" must not flip any remaining triangle
+    auto canCollapse = [&](uint32_t from, uint32_t to) {
+        for (auto t: pointTriangles[from])
+        {
+            if (!triangleAlive[t]) continue;
+            auto& tri = triangles[t];
+            if (tri[0] == to || tri[1] == to || tri[2] == to) continue;
+
+            Vector3 p[3] = { points[tri[0]], points[tri[1]], points[tri[2]] };
+            Vector3 before = Cross(Sub(p[1], p[0]), Sub(p[2], p[0]));
+            for (int k = 0; k < 3; ++k)
+            {
+                if (tri[k] == from) p[k] = points[to];
+            }
+            Vector3 after = Cross(Sub(p[1], p[0]), Sub(p[2], p[0]));
+            if (Dot(before, after) <= 0.) return false;
+        }
+        return true;
+    };
+
+    double maxCost = static_cast<double>(targetError) * targetError;
+    double reachedCost = 0.;
+    size_t targetTriangles = targetIndexCount / 3;
+    std::vector<uint32_t> neighbours;
+    while (aliveTriangles > targetTriangles && !heap.empty())
+    {
+        Collapse c = heap.top();
+        heap.pop();
+        if (!pointAlive[c.from] || !pointAlive[c.to]) continue;
+        if (version[c.from] != c.fromVersion || version[c.to] != c.toVersion) continue;
+        if (c.cost > maxCost) break;
+        if (!canCollapse(c.from, c.to)) continue;
+
+        // "from" is inside one chart, the triangles on the collapsed edge
+        // tell which vertex of "to" belongs to it
+        uint32_t toVertex = ~0u;
+        for (auto t: pointTriangles[c.from])
+        {
+            if (!triangleAlive[t]) continue;
+            for (int k = 0; k < 3; ++k)
+            {
+                if (triangles[t][k] == c.to) toVertex = corners[t][k];
+            }
+            if (toVertex != ~0u) break;
+        }
+        if (toVertex == ~0u) continue;
+
+        std::vector<uint32_t> toTriangles;
+        toTriangles.reserve(pointTriangles[c.to].size() + pointTriangles[c.from].size());
+        for (auto t: pointTriangles[c.to])
+        {
+            if (triangleAlive[t]) toTriangles.push_back(t);
+        }
+        for (auto t: pointTriangles[c.from])
+        {
+            if (!triangleAlive[t]) continue;
+            auto& tri = triangles[t];
+            if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+            {
+                triangleAlive[t] = false;
+                aliveTriangles--;
+                continue;
+            }
+            for (int k = 0; k < 3; ++k)
+            {
+                if (tri[k] != c.from) continue;
+                tri[k] = c.to;
+                corners[t][k] = toVertex;
+            }
+            toTriangles.push_back(t);
+        }
+        // drop the triangles that just died
+        toTriangles.erase(std::remove_if(toTriangles.begin(), toTriangles.end(),
+            [&triangleAlive](uint32_t t) { return !triangleAlive[t]; }), toTriangles.end());
+        pointTriangles[c.to].swap(toTriangles);
+        pointTriangles[c.from].clear();
+        pointTriangles[c.from].shrink_to_fit();
+
+        quadrics[c.to] += quadrics[c.from];
+        pointAlive[c.from] = false;
+        version[c.to]++;
+        reachedCost = std::max(reachedCost, c.cost);
+
+        neighbours.clear();
+        for (auto t: pointTriangles[c.to])
+        {
+            for (auto p: triangles[t])
+            {
+                if (p != c.to) neighbours.push_back(p);
+            }
+        }
+        std::sort(neighbours.begin(), neighbours.end());
+        neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+        for (auto n: neighbours) pushEdge(c.to, n);
+    }
+
+    if (resultError) *resultError = static_cast<float>(std::sqrt(reachedCost));
+
+    std::vector<uint32_t> result;
+    result.reserve(aliveTriangles * 3);
+    for (size_t t = 0; t < faceCount; ++t)
+    {
+        if (!triangleAlive[t]) continue;
+        for (auto v: corners[t]) result.push_back(v);
+    }
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,269 @@
+#include "Meshlet.h"
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+namespace
+{
+    inline const XMFLOAT3& GetPosition(const XMFLOAT3* positions, size_t stride, uint32_t index)
+    {
+        return *reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(positions) + stride * index);
+    }
+
+    inline XMFLOAT3 Sub(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z);
+    }
+    inline XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    }
+    inline float Dot(const XMFLOAT3& a, const XMFLOAT3& b)
+    {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+    inline float Length(const XMFLOAT3& a)
+    {
+        return std::sqrt(Dot(a, a));
+    }
+
+    const uint8_t NOT_IN_MESHLET = 0xff;
+}
+
+MeshletData MeshletBuilder::Build(const std::vector<uint32_t>& indicies,
+    const XMFLOAT3* positions, size_t vertexCount, size_t vertexStride,
+    uint32_t maxVertices, uint32_t maxTriangles)
+{
+    assert(maxVertices >= 3 && maxVertices <= 256 && maxTriangles >= 1);
+
+    MeshletData data;
+    size_t faceCount = indicies.size() / 3;
+    if (faceCount == 0) return data;
+
+    // vertex -> triangles adjacency
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (auto index: indicies) adjacencyOffsets[index + 1]++;
+    for (size_t i = 0; i < vertexCount; ++i) adjacencyOffsets[i + 1] += adjacencyOffsets[i];
+    std::vector<uint32_t> adjacency(adjacencyOffsets.back());
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < faceCount * 3; ++i)
+        {
+            adjacency[fill[indicies[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+    // unused triangles left around every vertex
+    std::vector<uint32_t> liveTriangles(vertexCount);
+    for (size_t i = 0; i < vertexCount; ++i) liveTriangles[i] = adjacencyOffsets[i + 1] - adjacencyOffsets[i];
+
+    std::vector<bool> emitted(faceCount, false);
+    std::vector<uint8_t> localIndex(vertexCount, NOT_IN_MESHLET);
+
+    Meshlet meshlet = {};
+    auto finishMeshlet = [&]() {
+        if (meshlet.triangleCount == 0) return;
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+        {
+            localIndex[data.vertices[meshlet.vertexOffset + i]] = NOT_IN_MESHLET;
+        }
+        data.meshlets.push_back(meshlet);
+        meshlet.vertexOffset = static_cast<uint32_t>(data.vertices.size());
+        meshlet.triangleOffset = static_cast<uint32_t>(data.triangles.size() / 3);
+        meshlet.vertexCount = 0;
+        meshlet.triangleCount = 0;
+    };
+    auto newVertices = [&](uint32_t triangle) {
+        uint32_t count = 0;
+        for (int k = 0; k < 3; ++k)
+        {
+            if (localIndex[indicies[triangle * 3 + k]] == NOT_IN_MESHLET) count++;
+        }
+        return count;
+    };
+    auto emit = [&](uint32_t triangle) {
+        for (int k = 0; k < 3; ++k)
+        {
+            uint32_t vertex = indicies[triangle * 3 + k];
+            if (localIndex[vertex] == NOT_IN_MESHLET)
+            {
+                localIndex[vertex] = static_cast<uint8_t>(meshlet.vertexCount++);
+                data.vertices.push_back(vertex);
+            }
+            data.triangles.push_back(localIndex[vertex]);
+            liveTriangles[vertex]--;
+        }
+        meshlet.triangleCount++;
+        emitted[triangle] = true;
+    };
+
+    size_t seed = 0;
+    size_t emittedCount = 0;
+    while (emittedCount < faceCount)
+    {
+        uint32_t best = ~0u;
+        uint32_t bestNew = 4;
+        uint32_t bestLive = ~0u;
+
+        for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+        {
+            uint32_t vertex = data.vertices[meshlet.vertexOffset + i];
+            if (liveTriangles[vertex] == 0) continue;
+
+            for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; ++a)
+            {
+                uint32_t triangle = adjacency[a];
+                if (emitted[triangle]) continue;
+
+                uint32_t added = newVertices(triangle);
+                // prefer triangles whose vertices have few triangles left, so
+                // that vertices get finished and do not need to be duplicated
+                uint32_t live = liveTriangles[indicies[triangle * 3]]
+                    + liveTriangles[indicies[triangle * 3 + 1]]
+                    + liveTriangles[indicies[triangle * 3 + 2]];
+                if (added < bestNew || (added == bestNew && live < bestLive))
+                {
+                    best = triangle;
+                    bestNew = added;
+                    bestLive = live;
+                }
+            }
+        }
+
+        if (best == ~0u || meshlet.vertexCount + bestNew > maxVertices || meshlet.triangleCount + 1 > maxTriangles)
+        {
+            finishMeshlet();
+            if (best == ~0u || meshlet.vertexCount + newVertices(best) > maxVertices)
+            {
+                while (emitted[seed]) seed++;
+                best = static_cast<uint32_t>(seed);
+            }
+        }
+
+        emit(best);
+        emittedCount++;
+    }
+    finishMeshlet();
+
+    data.bounds.reserve(data.meshlets.size());
+    for (auto& m: data.meshlets)
+    {
+        data.bounds.push_back(ComputeBounds(data, m, positions, vertexStride));
+    }
+    return data;
+}
+
+MeshletBounds MeshletBuilder::ComputeBounds(const MeshletData& data, const Meshlet& meshlet,
+    const XMFLOAT3* positions, size_t vertexStride)
+{
+    MeshletBounds bounds = {};
+
+    XMFLOAT3 minP = GetPosition(positions, vertexStride, data.vertices[meshlet.vertexOffset]);
+    XMFLOAT3 maxP = minP;
+    for (uint32_t i = 1; i < meshlet.vertexCount; ++i)
+    {
+        const XMFLOAT3& p = GetPosition(positions, vertexStride, data.vertices[meshlet.vertexOffset + i]);
+        minP = XMFLOAT3(std::min(minP.x, p.x), std::min(minP.y, p.y), std::min(minP.z, p.z));
+        maxP = XMFLOAT3(std::max(maxP.x, p.x), std::max(maxP.y, p.y), std::max(maxP.z, p.z));
+    }
+    bounds.center = XMFLOAT3((minP.x + maxP.x) * 0.5f, (minP.y + maxP.y) * 0.5f, (minP.z + maxP.z) * 0.5f);
+    for (uint32_t i = 0; i < meshlet.vertexCount; ++i)
+    {
+        const XMFLOAT3& p = GetPosition(positions, vertexStride, data.vertices[meshlet.vertexOffset + i]);
+        bounds.radius = std::max(bounds.radius, Length(Sub(p, bounds.center)));
+    }
+
+    std::vector<XMFLOAT3> normals;
+    std::vector<XMFLOAT3> corners;
+    normals.reserve(meshlet.triangleCount);
+    corners.reserve(meshlet.triangleCount);
+    XMFLOAT3 axis(0.f, 0.f, 0.f);
+    for (uint32_t t = 0; t < meshlet.triangleCount; ++t)
+    {
+        const uint8_t* triangle = &data.triangles[(meshlet.triangleOffset + t) * 3];
+        const XMFLOAT3& p0 = GetPosition(positions, vertexStride, data.vertices[meshlet.vertexOffset + triangle[0]]);
+        const XMFLOAT3& p1 = GetPosition(positions, vertexStride, data.vertices[meshlet.vertexOffset + triangle[1]]);
+        const XMFLOAT3& p2 = GetPosition(positions, vertexStride, data.vertices[meshlet.vertexOffset + triangle[2]]);
+        XMFLOAT3 n = Cross(Sub(p1, p0), Sub(p2, p0));
+        float area = Length(n);
+        // degenerate triangles are never visible
+        if (area == 0.f) continue;
+
+        n = XMFLOAT3(n.x / area, n.y / area, n.z / area);
+        normals.push_back(n);
+        corners.push_back(p0);
+        axis = XMFLOAT3(axis.x + n.x, axis.y + n.y, axis.z + n.z);
+    }
+
+    float axisLength = Length(axis);
+    bounds.coneApex = bounds.center;
+    bounds.coneCutoff = 1.f;
+    if (normals.empty() || axisLength == 0.f)
+    {
+        bounds.coneAxis = XMFLOAT3(0.f, 0.f, 0.f);
+        return bounds;
+    }
+    axis = XMFLOAT3(axis.x / axisLength, axis.y / axisLength, axis.z / axisLength);
+    bounds.coneAxis = axis;
+
+    float minDot = 1.f;
+    for (auto& n: normals) minDot = std::min(minDot, Dot(n, axis));
+    // the cone is too wide to ever reject anything
+    if (minDot <= 0.1f) return bounds;
+
+    // move the apex back along the axis until it lies behind every triangle plane
+    float maxT = 0.f;
+    for (size_t i = 0; i < normals.size(); ++i)
+    {
+        float t = Dot(Sub(bounds.center, corners[i]), normals[i]) / Dot(normals[i], axis);
+        maxT = std::max(maxT, t);
+    }
+    bounds.coneApex = XMFLOAT3(bounds.center.x - axis.x * maxT,
+        bounds.center.y - axis.y * maxT,
+        bounds.center.z - axis.z * maxT);
+    bounds.coneCutoff = std::sqrt(1.f - minDot * minDot);
+    return bounds;
+}
+
+bool MeshletBuilder::IsBackFacing(const MeshletBounds& bounds, const XMFLOAT3& eye)
+{
+    XMFLOAT3 view = Sub(bounds.coneApex, eye);
+    float length = Length(view);
+    if (length == 0.f) return false;
+    return Dot(view, bounds.coneAxis) >= bounds.coneCutoff * length;
+}
+
+MeshletStatistics MeshletBuilder::Analyze(const MeshletData& data, const std::vector<XMFLOAT3>& viewpoints,
+    uint32_t maxVertices, uint32_t maxTriangles)
+{
+    MeshletStatistics statistics;
+    statistics.meshletCount = static_cast<uint32_t>(data.meshlets.size());
+    if (data.meshlets.empty()) return statistics;
+
+    uint64_t vertices = 0;
+    uint64_t triangles = 0;
+    for (auto& m: data.meshlets)
+    {
+        vertices += m.vertexCount;
+        triangles += m.triangleCount;
+    }
+    statistics.vertexFill = static_cast<float>(vertices) / (static_cast<double>(maxVertices) * data.meshlets.size());
+    statistics.triangleFill = static_cast<float>(triangles) / (static_cast<double>(maxTriangles) * data.meshlets.size());
+
+    if (viewpoints.empty()) return statistics;
+    uint64_t rejectedMeshlets = 0;
+    uint64_t rejectedTriangles = 0;
+    for (auto& eye: viewpoints)
+    {
+        for (size_t i = 0; i < data.meshlets.size(); ++i)
+        {
+            if (IsBackFacing(data.bounds[i], eye))
+            {
+                rejectedMeshlets++;
+                rejectedTriangles += data.meshlets[i].triangleCount;
+            }
+        }
+    }
+    statistics.coneRejection = static_cast<float>(rejectedMeshlets) / (static_cast<double>(data.meshlets.size()) * viewpoints.size());
+    statistics.triangleRejection = static_cast<float>(rejectedTriangles) / (static_cast<double>(triangles) * viewpoints.size());
+    return statistics;
+}
\ No newline at end of file
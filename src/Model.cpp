@@ -1,41 +1,102 @@
 #include "Model.h"
 #include "path.h"
 #include "common/ModelLoader.h"
+#include "MeshSimplifier.h"
+#include "TaskPool.h"
+#include "Camera.h"
+#include "MeshCache.h"
+#include "ModelRegistry.h"
+#include "ProgressiveMesh.h"
+#include <algorithm>
+#include <cmath>
+
+const std::vector<LODConfig> Model::DEFAULT_LOD_CONFIGS = {
+    { 0.5f,    0.0025f },
+    { 0.25f,   0.005f  },
+    { 0.125f,  0.01f   },
+    { 0.0625f, 0.02f   },
+};
 
 std::wstring Model::GetModelFullPath(std::wstring model_name)
 {
     return std::wstring(model_path) + model_name;
 }
 
-Model::Model(std::wstring model_name, ModelType type, bool reconstruct) noexcept
+Model::Model(std::wstring model_name, ModelType type, bool reconstruct, LoadProgress* progress)
 {
+    if (progress) progress->stage = LoadStage::Reading;
+    auto sourcePath = Model::GetModelFullPath(model_name);
+    uint32_t cacheFlags = reconstruct ? MeshCache::FLAG_RECONSTRUCT : 0;
+    m_sourcePath = sourcePath;
+    m_cacheFlags = cacheFlags;
+    {
+        MeshCacheData cached;
+        if (MeshCache::Load(sourcePath, cacheFlags, cached))
+        {
+            m_vertices.swap(cached.vertices);
+            m_indicies.swap(cached.indicies);
+            m_bounds = cached.bounds;
+            if (progress) progress->stage = LoadStage::Processing;
+            if (IsPointCloud()) BuildPointOctree();
+            return;
+        }
+    }
+
     auto loader = ModelLoader::CreateModelLoader(type);
-    loader->LoadFromFile(Model::GetModelFullPath(model_name));
+    loader->SetProgress(progress);
+    loader->LoadFromFile(sourcePath);
+    if (progress)
+    {
+        progress->ThrowIfCancelled();
+        progress->stage = LoadStage::Processing;
+    }
     if (reconstruct)
     {
         loader->Reconstruct();
     }
     
-    auto positions = loader->GetPositions();
-    m_vertices = std::vector<Vertex>(positions.size());
-    for (int i = 0; i < m_vertices.size(); ++i)
-    {
-        m_vertices[i].position = XMFLOAT3(positions[i][0], positions[i][1], positions[i][2]);
-        m_vertices[i].normal   = XMFLOAT3(0.f, 0.f, 0.f);
-    }
+    // straight from the loader's columns, normals are zero if it has none
+    auto columns = loader->GetColumns();
+    m_vertices = std::vector<Vertex>(loader->GetVertexCount());
+    ModelVertexLayout::Pack(columns, m_vertices.size(), m_vertices.data());
 
     auto indicies = loader->GetIndicies();
     m_indicies.swap(indicies);
 
-    auto normals = loader->GetNormals();
-    if (normals.size() == 0) CalculateVertexNormal();
+    // before the normals are calculated, duplicates would weigh twice
+    if (!m_indicies.empty()) Clean();
+    if (!columns.normals) CalculateVertexNormal();
+
+    CalculateBounds();
+
+    // Locality order suits the post-transform cache and makes the cached copy
+    // compress well, so every model starts out in it. Point clouds get the
+    // octree order, which is local as well.
+    if (IsPointCloud())
+    {
+        BuildPointOctree();
+    }
     else
     {
-        for (int i = 0; i < m_vertices.size(); ++i)
-        {
-            auto ret = XMVector3Normalize(XMVectorSet(normals[i][0], normals[i][1], normals[i][2], 0.f));
-            XMStoreFloat3(&m_vertices[i].normal, ret);
-        }
+        OptimizeVertexCache();
+        OptimizeVertexFetch();
+    }
+
+    MeshCache::Store(sourcePath, cacheFlags, m_vertices, m_indicies,
+        { { 0, static_cast<uint32_t>(m_indicies.size()), m_bounds } }, m_bounds);
+}
+
+Model::Model(ProgressiveMeshData&& data, std::wstring sourcePath, uint32_t cacheFlags)
+    : m_vertices(std::move(data.vertices))
+    , m_bounds(data.bounds)
+    , m_sourcePath(sourcePath)
+    , m_cacheFlags(cacheFlags)
+{
+    if (data.levels.empty()) return;
+    m_indicies.swap(data.levels.back().indicies);
+    for (size_t i = data.levels.size() - 1; i-- > 0;)
+    {
+        m_lods.emplace_back(std::move(data.levels[i]));
     }
 }
 
@@ -76,6 +137,112 @@ void Model::CalculateVertexNormal()
     }
 }
 
+ModelLoadHandle Model::LoadAsync(std::wstring model_name, ModelType type, bool reconstruct,
+    std::function<void(Model&)> postProcess)
+{
+    auto progress = std::make_shared<LoadProgress>();
+    auto result = TaskPool::GetInstance()->Submit([model_name, type, reconstruct, postProcess, progress]() {
+        ModelLoadResult result;
+        try
+        {
+            progress->ThrowIfCancelled();
+            auto model = ModelRegistry::GetInstance()->Acquire(model_name, type, reconstruct, postProcess, progress.get());
+            progress->ThrowIfCancelled();
+            result.model = model;
+            progress->stage = LoadStage::Done;
+        }
+        catch (const LoadCancelled& e)
+        {
+            result.error = e.what();
+            progress->stage = LoadStage::Cancelled;
+        }
+        catch (const std::exception& e)
+        {
+            result.error = e.what();
+            progress->stage = LoadStage::Failed;
+        }
+        catch (...)
+        {
+            result.error = "unknown error";
+            progress->stage = LoadStage::Failed;
+        }
+        return result;
+    });
+    return ModelLoadHandle(progress, result.share());
+}
+
+ModelLoadHandle::ModelLoadHandle(std::shared_ptr<LoadProgress> progress, std::shared_future<ModelLoadResult> result)
+    : m_progress(progress)
+    , m_result(result)
+{
+}
+
+bool ModelLoadHandle::IsValid() const
+{
+    return m_result.valid();
+}
+bool ModelLoadHandle::IsReady() const
+{
+    return m_result.valid() && m_result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+LoadStage ModelLoadHandle::GetStage() const
+{
+    return m_progress ? m_progress->stage.load() : LoadStage::Queued;
+}
+uint64_t ModelLoadHandle::GetBytesParsed() const
+{
+    return m_progress ? m_progress->bytesParsed.load() : 0;
+}
+uint64_t ModelLoadHandle::GetTotalBytes() const
+{
+    return m_progress ? m_progress->totalBytes.load() : 0;
+}
+float ModelLoadHandle::GetProgress() const
+{
+    uint64_t total = GetTotalBytes();
+    return total == 0 ? 0.f : std::min(1.f, static_cast<float>(GetBytesParsed()) / total);
+}
+void ModelLoadHandle::Cancel()
+{
+    if (m_progress) m_progress->cancelRequested = true;
+}
+ModelLoadResult ModelLoadHandle::Get() const
+{
+    return m_result.get();
+}
+
+void Model::CalculateBounds()
+{
+    m_bounds = {};
+    if (m_vertices.empty()) return;
+
+    XMFLOAT3 minP = m_vertices[0].position;
+    XMFLOAT3 maxP = minP;
+    for (auto& v: m_vertices)
+    {
+        minP = XMFLOAT3(std::min(minP.x, v.position.x), std::min(minP.y, v.position.y), std::min(minP.z, v.position.z));
+        maxP = XMFLOAT3(std::max(maxP.x, v.position.x), std::max(maxP.y, v.position.y), std::max(maxP.z, v.position.z));
+    }
+    m_bounds.center = XMFLOAT3((minP.x + maxP.x) / 2.f, (minP.y + maxP.y) / 2.f, (minP.z + maxP.z) / 2.f);
+    m_bounds.extents = XMFLOAT3((maxP.x - minP.x) / 2.f, (maxP.y - minP.y) / 2.f, (maxP.z - minP.z) / 2.f);
+
+    float radius2 = 0.f;
+    for (auto& v: m_vertices)
+    {
+        float dx = v.position.x - m_bounds.center.x;
+        float dy = v.position.y - m_bounds.center.y;
+        float dz = v.position.z - m_bounds.center.z;
+        radius2 = std::max(radius2, dx * dx + dy * dy + dz * dz);
+    }
+    m_bounds.radius = std::sqrt(radius2);
+}
+
+void Model::RemapVertices(const std::vector<uint32_t>& remap)
+{
+    MeshOptimizer::RemapVertexBuffer(m_vertices, remap);
+    MeshOptimizer::RemapIndexBuffer(m_indicies, remap);
+}
+
 std::vector<Vertex> Model::GetVertices() const
 {
     return m_vertices;
@@ -86,9 +253,298 @@ std::vector<uint32_t> Model::GetIndicies() const
 }
 uint32_t Model::GetVerticesNum() const
 {
-    return m_vertices.size();
+    return m_cpuResident ? static_cast<uint32_t>(m_vertices.size()) : m_releasedVertexCount;
 }
 uint32_t Model::GetIndiciesNum() const
 {
-    return m_indicies.size();
+    return m_cpuResident ? static_cast<uint32_t>(m_indicies.size()) : m_releasedIndexCount;
+}
+const ModelBounds& Model::GetBounds() const
+{
+    return m_bounds;
+}
+static Hash::Hash128 HashGeometry(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indicies)
+{
+    uint64_t counts[2] = { vertices.size(), indicies.size() };
+    auto hash = Hash::Hash128Of(counts, sizeof(counts));
+    hash = Hash::Hash128Of(vertices.data(), vertices.size() * sizeof(Vertex), hash);
+    return Hash::Hash128Of(indicies.data(), indicies.size() * sizeof(uint32_t), hash);
+}
+
+Hash::Hash128 Model::GetGeometryHash() const
+{
+    return HashGeometry(m_vertices, m_indicies);
+}
+
+bool Model::ReleaseCPUData()
+{
+    if (!m_cpuResident) return true;
+    // finished LODs are checked against the full index buffer
+    if (!m_pendingLODs.empty()) return false;
+
+    uint32_t snapshotFlags = m_cacheFlags | MeshCache::FLAG_SNAPSHOT;
+    if (GetGeometryHash() != m_snapshotHash)
+    {
+        if (!MeshCache::Store(m_sourcePath, snapshotFlags, m_vertices, m_indicies,
+            { { 0, static_cast<uint32_t>(m_indicies.size()), m_bounds } }, m_bounds))
+        {
+            return false;
+        }
+        MeshCacheData stored;
+        if (!MeshCache::Load(m_sourcePath, snapshotFlags, stored)) return false;
+        m_snapshotHash = HashGeometry(stored.vertices, stored.indicies);
+    }
+
+    m_releasedVertexCount = static_cast<uint32_t>(m_vertices.size());
+    m_releasedIndexCount = static_cast<uint32_t>(m_indicies.size());
+    std::vector<Vertex>().swap(m_vertices);
+    std::vector<uint32_t>().swap(m_indicies);
+    m_cpuResident = false;
+    return true;
+}
+
+bool Model::RestoreCPUData()
+{
+    if (m_cpuResident) return true;
+
+    // another model of the same source may have replaced the snapshot
+    MeshCacheData stored;
+    if (!MeshCache::Load(m_sourcePath, m_cacheFlags | MeshCache::FLAG_SNAPSHOT, stored)
+        || HashGeometry(stored.vertices, stored.indicies) != m_snapshotHash)
+    {
+        return false;
+    }
+    m_vertices.swap(stored.vertices);
+    m_indicies.swap(stored.indicies);
+    m_cpuResident = true;
+    return true;
+}
+
+bool Model::IsCPUResident() const
+{
+    return m_cpuResident;
+}
+
+uint64_t Model::GetCPUBytes() const
+{
+    return static_cast<uint64_t>(GetVerticesNum()) * sizeof(Vertex)
+        + static_cast<uint64_t>(GetIndiciesNum()) * sizeof(uint32_t);
+}
+bool Model::IsPointCloud() const
+{
+    return GetIndiciesNum() == 0 && GetVerticesNum() > 0;
+}
+
+void Model::BuildPointOctree(const PointOctreeConfig& config)
+{
+    if (m_vertices.empty()) return;
+    auto octree = std::make_shared<PointOctree>(PointOctree::Build(&m_vertices[0].position, m_vertices.size(), sizeof(Vertex), config));
+
+    auto& order = octree->GetPointOrder();
+    std::vector<uint32_t> remap(order.size());
+    for (uint32_t i = 0; i < order.size(); ++i) remap[order[i]] = i;
+    RemapVertices(remap);
+    m_pointOctree = octree;
+}
+
+const PointOctree* Model::GetPointOctree() const
+{
+    return m_pointOctree.get();
+}
+
+MeshOptimizer::CleanReport Model::Clean()
+{
+    // point clouds have no triangles to keep their vertices
+    if (m_vertices.empty() || IsPointCloud()) return m_cleanReport = MeshOptimizer::CleanReport();
+    auto report = MeshOptimizer::CleanIndexBuffer(m_indicies, &m_vertices[0].position, m_vertices.size(), sizeof(Vertex));
+    std::vector<uint32_t> remap;
+    size_t keptCount = MeshOptimizer::GenerateCompactRemap(m_indicies, m_vertices.size(), remap);
+    report.unreferencedVertices = static_cast<uint32_t>(m_vertices.size() - keptCount);
+    if (report.unreferencedVertices > 0)
+    {
+        MeshOptimizer::CompactVertexBuffer(m_vertices, remap, keptCount);
+        MeshOptimizer::RemapIndexBuffer(m_indicies, remap);
+    }
+    m_cleanReport = report;
+    return report;
+}
+
+const MeshOptimizer::CleanReport& Model::GetCleanReport() const
+{
+    return m_cleanReport;
+}
+
+uint32_t Model::Weld(const MeshOptimizer::WeldConfig& config, bool recalculateNormals)
+{
+    if (m_vertices.empty() || IsPointCloud()) return 0;
+    std::vector<uint32_t> remap;
+    size_t keptCount = MeshOptimizer::GenerateWeldRemap(&m_vertices[0].position,
+        config.minNormalDot > -1.f ? &m_vertices[0].normal : nullptr, m_vertices.size(), sizeof(Vertex), config, remap);
+    uint32_t merged = static_cast<uint32_t>(m_vertices.size() - keptCount);
+    if (merged == 0) return 0;
+
+    MeshOptimizer::CompactVertexBuffer(m_vertices, remap, keptCount);
+    MeshOptimizer::RemapIndexBuffer(m_indicies, remap);
+    Clean();
+    if (recalculateNormals && !m_indicies.empty())
+    {
+        for (auto& vertex: m_vertices) vertex.normal = XMFLOAT3(0.f, 0.f, 0.f);
+        CalculateVertexNormal();
+    }
+    CalculateBounds();
+    return merged;
+}
+
+float Model::GetACMR(uint32_t cacheSize) const
+{
+    return MeshOptimizer::CalculateACMR(m_indicies, m_vertices.size(), cacheSize);
+}
+
+void Model::OptimizeVertexCache(uint32_t cacheSize)
+{
+    MeshOptimizer::OptimizeVertexCache(m_indicies, m_vertices.size(), cacheSize);
+}
+
+MeshOptimizer::OverdrawReport Model::OptimizeOverdraw(float threshold, const std::vector<XMFLOAT3>& viewDirections)
+{
+    MeshOptimizer::OverdrawReport report;
+    if (m_vertices.empty()) return report;
+
+    auto before = m_indicies;
+    report.acmrBefore = GetACMR();
+    report.clusterCount = MeshOptimizer::OptimizeOverdraw(m_indicies,
+        &m_vertices[0].position, m_vertices.size(), sizeof(Vertex), threshold);
+    report.acmrAfter = GetACMR();
+    report.views = MeshOptimizer::EstimateOverdrawGain(before, m_indicies,
+        &m_vertices[0].position, m_vertices.size(), sizeof(Vertex), viewDirections);
+    return report;
+}
+
+MeshOptimizer::VertexFetchReport Model::OptimizeVertexFetch()
+{
+    MeshOptimizer::VertexFetchReport report;
+    report.before = MeshOptimizer::AnalyzeVertexFetch(m_indicies, m_vertices.size(), sizeof(Vertex));
+    RemapVertices(MeshOptimizer::GenerateVertexFetchRemap(m_indicies, m_vertices.size()));
+    report.after = MeshOptimizer::AnalyzeVertexFetch(m_indicies, m_vertices.size(), sizeof(Vertex));
+    return report;
+}
+
+Bvh Model::BuildBvh(const BvhConfig& config) const
+{
+    if (m_vertices.empty()) return Bvh();
+    return Bvh::Build(m_indicies, &m_vertices[0].position, m_vertices.size(), sizeof(Vertex), config);
+}
+
+MeshletData Model::BuildMeshlets(uint32_t maxVertices, uint32_t maxTriangles) const
+{
+    if (m_vertices.empty()) return MeshletData();
+    return MeshletBuilder::Build(m_indicies, &m_vertices[0].position, m_vertices.size(), sizeof(Vertex),
+        maxVertices, maxTriangles);
+}
+
+void Model::GenerateLODs(const std::vector<LODConfig>& configs)
+{
+    if (m_vertices.empty()) return;
+
+    // the tasks work on their own copy so the model stays usable meanwhile
+    auto positions = std::make_shared<std::vector<XMFLOAT3>>(m_vertices.size());
+    for (size_t i = 0; i < m_vertices.size(); ++i) (*positions)[i] = m_vertices[i].position;
+    auto indicies = std::make_shared<std::vector<uint32_t>>(m_indicies);
+    float radius = m_bounds.radius;
+
+    m_lods.clear();
+    m_pendingLODs.clear();
+    for (auto& config: configs)
+    {
+        m_pendingLODs.emplace_back(TaskPool::GetInstance()->Submit([positions, indicies, radius, config]() {
+            size_t target = static_cast<size_t>(indicies->size() * config.ratio) / 3 * 3;
+            ModelLOD lod;
+            lod.indicies = MeshSimplifier::Simplify(*indicies, positions->data(), positions->size(), sizeof(XMFLOAT3),
+                target, config.maxError * radius, &lod.error);
+            return lod;
+        }));
+    }
+}
+
+bool Model::IsLODReady()
+{
+    if (m_pendingLODs.empty()) return !m_lods.empty();
+    for (auto& pending: m_pendingLODs)
+    {
+        if (pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+    }
+
+    // a level that hit its error bound early may be no coarser than the
+    // previous one, drop it
+    size_t lastCount = m_indicies.size();
+    for (auto& pending: m_pendingLODs)
+    {
+        ModelLOD lod = pending.get();
+        if (lod.indicies.empty() || lod.indicies.size() >= lastCount) continue;
+        lastCount = lod.indicies.size();
+        m_lods.emplace_back(std::move(lod));
+    }
+    m_pendingLODs.clear();
+    return !m_lods.empty();
+}
+
+bool Model::HasPendingLODs() const
+{
+    return !m_pendingLODs.empty();
+}
+
+uint32_t Model::GetLODCount() const
+{
+    return static_cast<uint32_t>(m_lods.size()) + 1;
+}
+
+const std::vector<uint32_t>& Model::GetLODIndicies(uint32_t level) const
+{
+    return level == 0 ? m_indicies : m_lods[level - 1].indicies;
+}
+
+float Model::GetLODError(uint32_t level) const
+{
+    return level == 0 ? 0.f : m_lods[level - 1].error;
+}
+
+bool Model::StoreProgressive() const
+{
+    if (!m_cpuResident || !m_pendingLODs.empty() || m_sourcePath.empty()) return false;
+
+    auto data = std::make_shared<ProgressiveMeshData>(ProgressiveMesh::Build(m_vertices, m_indicies, m_lods, m_bounds));
+    auto sourcePath = m_sourcePath;
+    auto flags = m_cacheFlags;
+    TaskPool::GetInstance()->Submit([data, sourcePath, flags]() {
+        return ProgressiveMesh::Write(sourcePath, flags, *data);
+    });
+    return true;
+}
+
+uint32_t Model::SelectLOD(Camera& camera, const XMMATRIX& modelMatrix, float viewportHeight, float pixelBudget) const
+{
+    if (m_lods.empty()) return 0;
+
+    // _22 of the projection is cot(fov / 2), so an error e at distance d
+    // covers e * _22 / d * viewportHeight / 2 pixels
+    XMMATRIX projection = camera.GetProjectionMatrix();
+    float pixelsPerUnit = XMVectorGetY(projection.r[1]) * viewportHeight * 0.5f;
+
+    float scale = 0.f;
+    for (int i = 0; i < 3; ++i)
+    {
+        scale = std::max(scale, XMVectorGetX(XMVector3Length(modelMatrix.r[i])));
+    }
+    XMVECTOR center = XMVector3TransformCoord(XMLoadFloat3(&m_bounds.center), modelMatrix);
+    XMFLOAT4 eye = camera.GetPosition();
+    float distance = XMVectorGetX(XMVector3Length(XMVectorSubtract(center, XMLoadFloat4(&eye))));
+    distance = std::max(distance - m_bounds.radius * scale, camera.GetNear());
+
+    uint32_t level = 0;
+    for (size_t i = 0; i < m_lods.size(); ++i)
+    {
+        if (m_lods[i].error * scale * pixelsPerUnit / distance > pixelBudget) break;
+        level = static_cast<uint32_t>(i) + 1;
+    }
+    return level;
 }
\ No newline at end of file
@@ -0,0 +1,190 @@
+#include "ModelRegistry.h"
+#include "common/MappedFile.h"
+
+ModelRegistry* ModelRegistry::GetInstance()
+{
+    static ModelRegistry registry;
+    return &registry;
+}
+
+std::shared_ptr<Model> ModelRegistry::Acquire(const std::wstring& modelName, ModelType modelType, bool reconstruct,
+    const std::function<void(Model&)>& postProcess, LoadProgress* progress)
+{
+    uint32_t flags = (static_cast<uint32_t>(modelType) << 1) | (reconstruct ? 1u : 0u);
+    NameKey nameKey(Model::GetModelFullPath(modelName), flags);
+    std::promise<std::shared_ptr<Model>> promise;
+    std::shared_future<std::shared_ptr<Model>> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_byName.find(nameKey);
+        if (it != m_byName.end())
+        {
+            if (auto model = it->second.lock())
+            {
+                m_statistics.nameHits++;
+                return model;
+            }
+        }
+        auto loading = m_pending.find(nameKey);
+        if (loading != m_pending.end())
+        {
+            m_statistics.pendingHits++;
+            pending = loading->second;
+        }
+        else
+        {
+            m_pending[nameKey] = promise.get_future().share();
+        }
+    }
+
+    if (pending.valid())
+    {
+        try
+        {
+            return pending.get();
+        }
+        catch (const LoadCancelled&)
+        {
+            // the load that was waited for got cancelled, not this one
+            if (progress) progress->ThrowIfCancelled();
+            return Acquire(modelName, modelType, reconstruct, postProcess, progress);
+        }
+    }
+
+    std::shared_ptr<Model> model;
+    try
+    {
+        model = Load(nameKey, modelName, modelType, reconstruct, postProcess, progress);
+    }
+    catch (...)
+    {
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.erase(nameKey);
+        throw;
+    }
+    promise.set_value(model);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_pending.erase(nameKey);
+    return model;
+}
+
+std::shared_ptr<Model> ModelRegistry::Load(const NameKey& nameKey, const std::wstring& modelName, ModelType modelType,
+    bool reconstruct, const std::function<void(Model&)>& postProcess, LoadProgress* progress)
+{
+    const std::wstring& sourcePath = std::get<0>(nameKey);
+    uint32_t flags = std::get<1>(nameKey);
+
+    // Byte-identical files under other names, hashing is much cheaper than
+    // parsing. A missing file is left to the Model constructor to report.
+    bool hasSourceKey = false;
+    SourceKey sourceKey;
+    {
+        MappedFile source;
+        if (source.Open(sourcePath))
+        {
+            auto hash = Hash::Hash128Of(source.GetData(), source.GetSize());
+            sourceKey = SourceKey(source.GetSize(), hash.low, hash.high, flags);
+            hasSourceKey = true;
+        }
+    }
+    if (hasSourceKey)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_bySource.find(sourceKey);
+        if (it != m_bySource.end())
+        {
+            if (auto model = it->second.lock())
+            {
+                m_statistics.sourceHits++;
+                m_byName[nameKey] = model;
+                return model;
+            }
+        }
+    }
+
+    auto model = std::make_shared<Model>(modelName, modelType, reconstruct, progress);
+    // hashed before post processing, which reorders the buffers
+    auto geometry = model->GetGeometryHash();
+    GeometryKey geometryKey(geometry.low, geometry.high);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_byGeometry.find(geometryKey);
+        if (it != m_byGeometry.end())
+        {
+            if (auto existing = it->second.lock())
+            {
+                m_statistics.geometryHits++;
+                m_byName[nameKey] = existing;
+                if (hasSourceKey) m_bySource[sourceKey] = existing;
+                return existing;
+            }
+        }
+    }
+
+    if (postProcess)
+    {
+        if (progress) progress->ThrowIfCancelled();
+        postProcess(*model);
+    }
+
+    // A load of the same content under another name may have registered
+    // first, this model is then dropped and every caller gets that one.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RemoveExpired();
+    auto& byGeometry = m_byGeometry[geometryKey];
+    if (auto existing = byGeometry.lock())
+    {
+        m_statistics.geometryHits++;
+        m_byName[nameKey] = existing;
+        if (hasSourceKey) m_bySource[sourceKey] = existing;
+        return existing;
+    }
+    m_statistics.loads++;
+    byGeometry = model;
+    m_byName[nameKey] = model;
+    if (hasSourceKey) m_bySource[sourceKey] = model;
+    return model;
+}
+
+void ModelRegistry::RemoveExpired()
+{
+    for (auto it = m_byName.begin(); it != m_byName.end();)
+    {
+        it = it->second.expired() ? m_byName.erase(it) : std::next(it);
+    }
+    for (auto it = m_bySource.begin(); it != m_bySource.end();)
+    {
+        it = it->second.expired() ? m_bySource.erase(it) : std::next(it);
+    }
+    for (auto it = m_byGeometry.begin(); it != m_byGeometry.end();)
+    {
+        it = it->second.expired() ? m_byGeometry.erase(it) : std::next(it);
+    }
+}
+
+size_t ModelRegistry::GetEntryCount()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    RemoveExpired();
+    return m_byGeometry.size();
+}
+
+long ModelRegistry::GetReferenceCount(const std::shared_ptr<Model>& model)
+{
+    return model.use_count();
+}
+
+ModelRegistryStatistics ModelRegistry::GetStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_statistics;
+}
+
+void ModelRegistry::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_byName.clear();
+    m_bySource.clear();
+    m_byGeometry.clear();
+}
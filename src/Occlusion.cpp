@@ -0,0 +1,303 @@
+#include "Occlusion.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <xmmintrin.h>
+
+namespace
+{
+    const size_t TRANSFORM_GRAIN = 1 << 12;
+    // of the screen space area, thinner triangles cover no pixel centers
+    const float MIN_AREA = 1e-8f;
+
+    uint32_t RoundUp(uint32_t value, uint32_t multiple)
+    {
+        return std::max(1u, (value + multiple - 1) / multiple) * multiple;
+    }
+
+    inline XMFLOAT4 Transform(const XMFLOAT3& p, const XMFLOAT4X4& m)
+    {
+        return XMFLOAT4(
+            p.x * m.m[0][0] + p.y * m.m[1][0] + p.z * m.m[2][0] + m.m[3][0],
+            p.x * m.m[0][1] + p.y * m.m[1][1] + p.z * m.m[2][1] + m.m[3][1],
+            p.x * m.m[0][2] + p.y * m.m[1][2] + p.z * m.m[2][2] + m.m[3][2],
+            p.x * m.m[0][3] + p.y * m.m[1][3] + p.z * m.m[2][3] + m.m[3][3]);
+    }
+}
+
+OcclusionBuffer::OcclusionBuffer(uint32_t width, uint32_t height)
+    : m_width(RoundUp(width, TILE_SIZE))
+    , m_height(RoundUp(height, TILE_SIZE))
+{
+    m_tilesX = m_width / TILE_SIZE;
+    m_tilesY = m_height / TILE_SIZE;
+    m_depth.resize(static_cast<size_t>(m_width) * m_height);
+    m_tileDepth.resize(static_cast<size_t>(m_tilesX) * m_tilesY);
+    Clear();
+}
+
+void OcclusionBuffer::Clear()
+{
+    std::fill(m_depth.begin(), m_depth.end(), 1.f);
+    std::fill(m_tileDepth.begin(), m_tileDepth.end(), 1.f);
+    m_triangles.clear();
+}
+
+void OcclusionBuffer::AddOccluder(const XMFLOAT3* positions, size_t vertexStride, size_t vertexCount,
+    const uint32_t* indicies, size_t indexCount, const XMMATRIX& mvp)
+{
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(&m, mvp);
+    std::vector<XMFLOAT4> clip(vertexCount);
+    TaskPool::GetInstance()->ParallelFor(vertexCount, TRANSFORM_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            clip[i] = Transform(*reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(positions) + vertexStride * i), m);
+        }
+    });
+
+    float halfWidth = m_width * 0.5f;
+    float halfHeight = m_height * 0.5f;
+    for (size_t t = 0; t + 2 < indexCount; t += 3)
+    {
+        float x[3], y[3], z[3];
+        bool crossesNear = false;
+        for (int k = 0; k < 3; ++k)
+        {
+            const XMFLOAT4& c = clip[indicies[t + k]];
+            crossesNear |= c.z < 0.f || c.w <= 0.f;
+            if (crossesNear) break;
+            x[k] = (c.x / c.w + 1.f) * halfWidth;
+            y[k] = (1.f - c.y / c.w) * halfHeight;
+            z[k] = c.z / c.w;
+        }
+        if (crossesNear) continue;
+
+        float area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+        if (std::abs(area) < MIN_AREA) continue;
+        // both windings are occluders, make the edge functions positive inside
+        if (area < 0.f)
+        {
+            std::swap(x[1], x[2]);
+            std::swap(y[1], y[2]);
+            std::swap(z[1], z[2]);
+            area = -area;
+        }
+
+        Triangle triangle;
+        triangle.minX = std::max(0, static_cast<int>(std::floor(std::min(x[0], std::min(x[1], x[2])))));
+        triangle.maxX = std::min(static_cast<int>(m_width) - 1, static_cast<int>(std::floor(std::max(x[0], std::max(x[1], x[2])))));
+        triangle.minY = std::max(0, static_cast<int>(std::floor(std::min(y[0], std::min(y[1], y[2])))));
+        triangle.maxY = std::min(static_cast<int>(m_height) - 1, static_cast<int>(std::floor(std::max(y[0], std::max(y[1], y[2])))));
+        if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY) continue;
+
+        // edge k is opposite vertex k, divided by the area it is that
+        // vertex's barycentric
+        for (int k = 0; k < 3; ++k)
+        {
+            int a = (k + 1) % 3, b = (k + 2) % 3;
+            triangle.edges[k][0] = y[a] - y[b];
+            triangle.edges[k][1] = x[b] - x[a];
+            triangle.edges[k][2] = x[a] * y[b] - y[a] * x[b];
+        }
+        for (int c = 0; c < 3; ++c)
+        {
+            triangle.depth[c] = (triangle.edges[0][c] * z[0] + triangle.edges[1][c] * z[1] + triangle.edges[2][c] * z[2]) / area;
+        }
+        m_triangles.push_back(triangle);
+    }
+}
+
+void OcclusionBuffer::Rasterize()
+{
+    uint32_t bandCount = (m_height + BAND_HEIGHT - 1) / BAND_HEIGHT;
+    TaskPool::GetInstance()->ParallelFor(bandCount, 1, [this](size_t begin, size_t end) {
+        for (size_t band = begin; band < end; ++band) RasterizeBand(static_cast<uint32_t>(band));
+    });
+}
+
+void OcclusionBuffer::RasterizeBand(uint32_t band)
+{
+    int bandMinY = static_cast<int>(band * BAND_HEIGHT);
+    int bandMaxY = std::min(bandMinY + static_cast<int>(BAND_HEIGHT), static_cast<int>(m_height)) - 1;
+    const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (auto& triangle: m_triangles)
+    {
+        int minY = std::max(triangle.minY, bandMinY);
+        int maxY = std::min(triangle.maxY, bandMaxY);
+        if (minY > maxY) continue;
+        // rows are padded to TILE_SIZE, so a step of 4 never leaves the row
+        int minX = triangle.minX & ~3;
+
+        __m128 edgeA[3], edgeStep[3];
+        for (int k = 0; k < 3; ++k)
+        {
+            edgeA[k] = _mm_set1_ps(triangle.edges[k][0]);
+            edgeStep[k] = _mm_set1_ps(triangle.edges[k][0] * 4.f);
+        }
+        __m128 depthA = _mm_set1_ps(triangle.depth[0]);
+        __m128 depthStep = _mm_set1_ps(triangle.depth[0] * 4.f);
+        __m128 x0 = _mm_add_ps(_mm_set1_ps(static_cast<float>(minX)), laneOffsets);
+
+        for (int y = minY; y <= maxY; ++y)
+        {
+            float py = y + 0.5f;
+            __m128 edge[3];
+            for (int k = 0; k < 3; ++k)
+            {
+                edge[k] = _mm_add_ps(_mm_mul_ps(edgeA[k], x0), _mm_set1_ps(triangle.edges[k][1] * py + triangle.edges[k][2]));
+            }
+            __m128 depth = _mm_add_ps(_mm_mul_ps(depthA, x0), _mm_set1_ps(triangle.depth[1] * py + triangle.depth[2]));
+            float* row = &m_depth[static_cast<size_t>(y) * m_width];
+            for (int x = minX; x <= triangle.maxX; x += 4)
+            {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge[0], zero), _mm_cmpge_ps(edge[1], zero)),
+                    _mm_cmpge_ps(edge[2], zero));
+                if (_mm_movemask_ps(inside))
+                {
+                    __m128 old = _mm_loadu_ps(row + x);
+                    __m128 nearer = _mm_min_ps(old, depth);
+                    _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+                }
+                for (int k = 0; k < 3; ++k) edge[k] = _mm_add_ps(edge[k], edgeStep[k]);
+                depth = _mm_add_ps(depth, depthStep);
+            }
+        }
+    }
+
+    // the band covers whole tile rows
+    for (uint32_t ty = bandMinY / TILE_SIZE; ty <= static_cast<uint32_t>(bandMaxY) / TILE_SIZE; ++ty)
+    {
+        for (uint32_t tx = 0; tx < m_tilesX; ++tx)
+        {
+            __m128 farthest = _mm_setzero_ps();
+            for (uint32_t y = ty * TILE_SIZE; y < (ty + 1) * TILE_SIZE; ++y)
+            {
+                const float* row = &m_depth[static_cast<size_t>(y) * m_width + tx * TILE_SIZE];
+                for (uint32_t x = 0; x < TILE_SIZE; x += 4) farthest = _mm_max_ps(farthest, _mm_loadu_ps(row + x));
+            }
+            farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+            farthest = _mm_max_ps(farthest, _mm_shuffle_ps(farthest, farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+            m_tileDepth[ty * m_tilesX + tx] = _mm_cvtss_f32(farthest);
+        }
+    }
+}
+
+bool OcclusionBuffer::IsRectVisible(int minX, int maxX, int minY, int maxY, float depth) const
+{
+    for (int ty = minY / static_cast<int>(TILE_SIZE); ty <= maxY / static_cast<int>(TILE_SIZE); ++ty)
+    {
+        for (int tx = minX / static_cast<int>(TILE_SIZE); tx <= maxX / static_cast<int>(TILE_SIZE); ++tx)
+        {
+            // every occluder of the tile is nearer than the box
+            if (m_tileDepth[ty * m_tilesX + tx] < depth) continue;
+
+            int x0 = std::max(minX, tx * static_cast<int>(TILE_SIZE));
+            int x1 = std::min(maxX, (tx + 1) * static_cast<int>(TILE_SIZE) - 1);
+            int y0 = std::max(minY, ty * static_cast<int>(TILE_SIZE));
+            int y1 = std::min(maxY, (ty + 1) * static_cast<int>(TILE_SIZE) - 1);
+            for (int y = y0; y <= y1; ++y)
+            {
+                const float* row = &m_depth[static_cast<size_t>(y) * m_width];
+                for (int x = x0; x <= x1; ++x)
+                {
+                    if (row[x] >= depth) return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+bool OcclusionBuffer::IsVisible(const XMFLOAT3& center, const XMFLOAT3& extents, const XMMATRIX& mvp) const
+{
+    // clip space is linear in the corner, so every corner is the center plus
+    // or minus the three transformed extents
+    XMFLOAT4X4 m;
+    XMStoreFloat4x4(&m, mvp);
+    __m128 rows[4] = { _mm_loadu_ps(m.m[0]), _mm_loadu_ps(m.m[1]), _mm_loadu_ps(m.m[2]), _mm_loadu_ps(m.m[3]) };
+    __m128 clipCenter = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(center.x), rows[0]), _mm_mul_ps(_mm_set1_ps(center.y), rows[1])),
+        _mm_add_ps(_mm_mul_ps(_mm_set1_ps(center.z), rows[2]), rows[3]));
+    __m128 axes[3] = {
+        _mm_mul_ps(_mm_set1_ps(extents.x), rows[0]),
+        _mm_mul_ps(_mm_set1_ps(extents.y), rows[1]),
+        _mm_mul_ps(_mm_set1_ps(extents.z), rows[2]) };
+
+    // x, y and z of the corners after the divide, as min and max
+    __m128 minimum = _mm_set1_ps(std::numeric_limits<float>::max());
+    __m128 maximum = _mm_set1_ps(-std::numeric_limits<float>::max());
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        __m128 c = clipCenter;
+        for (int k = 0; k < 3; ++k) c = corner & (1 << k) ? _mm_add_ps(c, axes[k]) : _mm_sub_ps(c, axes[k]);
+        alignas(16) float clip[4];
+        _mm_store_ps(clip, c);
+        // reaches in front of the near plane, the camera may be inside it
+        if (clip[2] < 0.f || clip[3] <= 0.f) return true;
+        __m128 projected = _mm_div_ps(c, _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 3, 3)));
+        minimum = _mm_min_ps(minimum, projected);
+        maximum = _mm_max_ps(maximum, projected);
+    }
+    alignas(16) float low[4], high[4];
+    _mm_store_ps(low, minimum);
+    _mm_store_ps(high, maximum);
+
+    float minX = (low[0] + 1.f) * m_width * 0.5f;
+    float maxX = (high[0] + 1.f) * m_width * 0.5f;
+    float minY = (1.f - high[1]) * m_height * 0.5f;
+    float maxY = (1.f - low[1]) * m_height * 0.5f;
+    if (maxX < 0.f || maxY < 0.f || minX >= m_width || minY >= m_height) return false;
+
+    return IsRectVisible(
+        std::max(0, static_cast<int>(minX)), std::min(static_cast<int>(m_width) - 1, static_cast<int>(maxX)),
+        std::max(0, static_cast<int>(minY)), std::min(static_cast<int>(m_height) - 1, static_cast<int>(maxY)),
+        low[2]);
+}
+
+void OcclusionBuffer::Test(const CullingBoxes& boxes, const XMMATRIX& mvp, const std::vector<uint32_t>& candidates,
+    std::vector<uint32_t>& visible) const
+{
+    std::vector<uint8_t> passed(candidates.size());
+    TaskPool::GetInstance()->ParallelFor(candidates.size(), TEST_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i)
+        {
+            uint32_t box = candidates[i];
+            XMFLOAT3 center(boxes.GetCenter(0)[box], boxes.GetCenter(1)[box], boxes.GetCenter(2)[box]);
+            XMFLOAT3 extents(boxes.GetExtents(0)[box], boxes.GetExtents(1)[box], boxes.GetExtents(2)[box]);
+            passed[i] = IsVisible(center, extents, mvp) ? 1 : 0;
+        }
+    });
+    visible.clear();
+    for (size_t i = 0; i < candidates.size(); ++i)
+    {
+        if (passed[i]) visible.push_back(candidates[i]);
+    }
+}
+
+uint32_t OcclusionBuffer::GetWidth() const
+{
+    return m_width;
+}
+
+uint32_t OcclusionBuffer::GetHeight() const
+{
+    return m_height;
+}
+
+const std::vector<float>& OcclusionBuffer::GetDepth() const
+{
+    return m_depth;
+}
+
+const std::vector<float>& OcclusionBuffer::GetTileDepth() const
+{
+    return m_tileDepth;
+}
+
+uint32_t OcclusionBuffer::GetTriangleCount() const
+{
+    return static_cast<uint32_t>(m_triangles.size());
+}
\ No newline at end of file
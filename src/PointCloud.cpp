@@ -0,0 +1,284 @@
+#include "PointCloud.h"
+#include "Camera.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <numeric>
+#include <queue>
+
+namespace
+{
+    const uint32_t MORTON_BITS = 21;
+    const uint32_t UNASSIGNED = ~0u;
+    const size_t SORT_GRAIN = 1 << 16;
+    const size_t SCAN_GRAIN = 1 << 14;
+
+    inline const XMFLOAT3& GetPosition(const XMFLOAT3* positions, size_t stride, size_t index)
+    {
+        return *reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const uint8_t*>(positions) + stride * index);
+    }
+
+    inline uint64_t SpreadBits(uint64_t v)
+    {
+        v &= 0x1fffff;
+        v = (v | v << 32) & 0x1f00000000ffffull;
+        v = (v | v << 16) & 0x1f0000ff0000ffull;
+        v = (v | v << 8) & 0x100f00f00f00f00full;
+        v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+        v = (v | v << 2) & 0x1249249249249249ull;
+        return v;
+    }
+
+    // Sorted runs of SORT_GRAIN merged pairwise, every round in parallel.
+    void ParallelSort(std::vector<std::pair<uint64_t, uint32_t>>& items)
+    {
+        auto pool = TaskPool::GetInstance();
+        size_t count = items.size();
+        pool->ParallelFor(count, SORT_GRAIN, [&items](size_t begin, size_t end) {
+            std::sort(items.begin() + begin, items.begin() + end);
+        });
+        for (size_t run = SORT_GRAIN; run < count; run *= 2)
+        {
+            size_t pairs = (count + run * 2 - 1) / (run * 2);
+            pool->ParallelFor(pairs, 1, [&items, run, count](size_t begin, size_t end) {
+                for (size_t p = begin; p < end; ++p)
+                {
+                    size_t first = p * run * 2;
+                    size_t middle = std::min(first + run, count);
+                    size_t last = std::min(first + run * 2, count);
+                    std::inplace_merge(items.begin() + first, items.begin() + middle, items.begin() + last);
+                }
+            });
+        }
+    }
+
+    struct BuildNode
+    {
+        uint32_t begin = 0;
+        uint32_t end = 0;
+        // unassigned points per child octant, filled while sampling
+        std::array<uint32_t, 8> childBegin = {};
+        std::array<uint32_t, 8> childEnd = {};
+        std::array<uint32_t, 8> childRemaining = {};
+        bool leaf = false;
+    };
+}
+
+PointOctree PointOctree::Build(const XMFLOAT3* positions, size_t pointCount, size_t stride, const PointOctreeConfig& config)
+{
+    PointOctree octree;
+    if (pointCount == 0) return octree;
+
+    uint32_t gridBits = 0;
+    while ((1u << (gridBits + 1)) <= config.gridSize) gridBits++;
+    uint32_t maxDepth = std::min(config.maxDepth, MORTON_BITS - gridBits);
+    auto pool = TaskPool::GetInstance();
+
+    XMFLOAT3 minP = GetPosition(positions, stride, 0);
+    XMFLOAT3 maxP = minP;
+    for (size_t i = 1; i < pointCount; ++i)
+    {
+        const XMFLOAT3& p = GetPosition(positions, stride, i);
+        minP = XMFLOAT3(std::min(minP.x, p.x), std::min(minP.y, p.y), std::min(minP.z, p.z));
+        maxP = XMFLOAT3(std::max(maxP.x, p.x), std::max(maxP.y, p.y), std::max(maxP.z, p.z));
+    }
+    float size = std::max(maxP.x - minP.x, std::max(maxP.y - minP.y, maxP.z - minP.z));
+    size = size > 0.f ? size * 1.0001f : 1.f;
+    float scale = static_cast<float>(1u << MORTON_BITS) / size;
+
+    // 1. points in Morton order, every node is a range of it
+    std::vector<std::pair<uint64_t, uint32_t>> sorted(pointCount);
+    pool->ParallelFor(pointCount, SORT_GRAIN, [&](size_t begin, size_t end) {
+        const uint64_t maxCell = (1u << MORTON_BITS) - 1;
+        for (size_t i = begin; i < end; ++i)
+        {
+            const XMFLOAT3& p = GetPosition(positions, stride, i);
+            uint64_t x = std::min(static_cast<uint64_t>(std::max(0.f, (p.x - minP.x) * scale)), maxCell);
+            uint64_t y = std::min(static_cast<uint64_t>(std::max(0.f, (p.y - minP.y) * scale)), maxCell);
+            uint64_t z = std::min(static_cast<uint64_t>(std::max(0.f, (p.z - minP.z) * scale)), maxCell);
+            sorted[i] = { SpreadBits(x) | SpreadBits(y) << 1 | SpreadBits(z) << 2, static_cast<uint32_t>(i) };
+        }
+    });
+    ParallelSort(sorted);
+
+    // 2. top down, a level at a time, nodes of one level in parallel
+    std::vector<uint32_t> owner(pointCount, UNASSIGNED);
+    std::vector<BuildNode> build;
+    auto& nodes = octree.m_nodes;
+    build.push_back({ 0, static_cast<uint32_t>(pointCount) });
+    PointOctreeNode root = {};
+    root.halfSize = size * 0.5f;
+    root.center = XMFLOAT3(minP.x + root.halfSize, minP.y + root.halfSize, minP.z + root.halfSize);
+    nodes.push_back(root);
+
+    size_t levelBegin = 0;
+    for (uint32_t level = 0; levelBegin < nodes.size(); ++level)
+    {
+        size_t levelEnd = nodes.size();
+        uint32_t cellShift = 3 * (MORTON_BITS - std::min(level + gridBits, MORTON_BITS));
+        uint32_t childShift = 3 * (MORTON_BITS - level - 1);
+
+        pool->ParallelFor(levelEnd - levelBegin, 1, [&](size_t begin, size_t end) {
+            for (size_t n = levelBegin + begin; n < levelBegin + end; ++n)
+            {
+                auto& b = build[n];
+                uint32_t remaining = 0;
+                for (uint32_t i = b.begin; i < b.end; ++i)
+                {
+                    if (owner[i] == UNASSIGNED) remaining++;
+                }
+                b.leaf = level >= maxDepth || remaining <= config.leafCapacity;
+
+                // first unassigned point of every grid cell, all of them for leaves
+                uint32_t picked = 0;
+                uint64_t lastCell = ~0ull;
+                bool cellTaken = false;
+                for (uint32_t i = b.begin; i < b.end; ++i)
+                {
+                    if (owner[i] != UNASSIGNED) continue;
+                    uint64_t cell = sorted[i].first >> cellShift;
+                    if (cell != lastCell)
+                    {
+                        lastCell = cell;
+                        cellTaken = false;
+                    }
+                    if (b.leaf || !cellTaken)
+                    {
+                        owner[i] = static_cast<uint32_t>(n);
+                        cellTaken = true;
+                        picked++;
+                    }
+                }
+                nodes[n].pointCount = picked;
+                nodes[n].level = level;
+                nodes[n].spacing = nodes[n].halfSize * 2.f / (1u << gridBits);
+                if (b.leaf) continue;
+
+                b.childRemaining.fill(0);
+                for (uint32_t octant = 0, i = b.begin; octant < 8; ++octant)
+                {
+                    b.childBegin[octant] = i;
+                    while (i < b.end && ((sorted[i].first >> childShift) & 7) == octant)
+                    {
+                        if (owner[i] == UNASSIGNED) b.childRemaining[octant]++;
+                        i++;
+                    }
+                    b.childEnd[octant] = i;
+                }
+            }
+        });
+
+        for (size_t n = levelBegin; n < levelEnd; ++n)
+        {
+            auto b = build[n];
+            nodes[n].firstChild = static_cast<uint32_t>(nodes.size());
+            nodes[n].childCount = 0;
+            if (b.leaf) continue;
+            for (uint32_t octant = 0; octant < 8; ++octant)
+            {
+                if (b.childRemaining[octant] == 0) continue;
+                PointOctreeNode child = {};
+                child.halfSize = nodes[n].halfSize * 0.5f;
+                child.center = XMFLOAT3(
+                    nodes[n].center.x + (octant & 1 ? child.halfSize : -child.halfSize),
+                    nodes[n].center.y + (octant & 2 ? child.halfSize : -child.halfSize),
+                    nodes[n].center.z + (octant & 4 ? child.halfSize : -child.halfSize));
+                nodes.push_back(child);
+                BuildNode childBuild = {};
+                childBuild.begin = b.childBegin[octant];
+                childBuild.end = b.childEnd[octant];
+                build.push_back(childBuild);
+                nodes[n].childCount++;
+            }
+        }
+        levelBegin = levelEnd;
+    }
+
+    // 3. points grouped by node
+    uint32_t offset = 0;
+    for (auto& node: nodes)
+    {
+        node.firstPoint = offset;
+        offset += node.pointCount;
+    }
+    octree.m_order.resize(pointCount);
+    pool->ParallelFor(nodes.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t n = begin; n < end; ++n)
+        {
+            uint32_t out = nodes[n].firstPoint;
+            for (uint32_t i = build[n].begin; i < build[n].end; ++i)
+            {
+                if (owner[i] == n) octree.m_order[out++] = sorted[i].second;
+            }
+        }
+    });
+    return octree;
+}
+
+const std::vector<PointOctreeNode>& PointOctree::GetNodes() const
+{
+    return m_nodes;
+}
+
+const std::vector<uint32_t>& PointOctree::GetPointOrder() const
+{
+    return m_order;
+}
+
+PointCloudSelection PointOctree::Select(const PointCloudView& view, uint32_t pointBudget, float minSpacing) const
+{
+    PointCloudSelection selection;
+    if (m_nodes.empty()) return selection;
+
+    auto distance = [&view](const PointOctreeNode& node) {
+        float dx = node.center.x - view.eye.x;
+        float dy = node.center.y - view.eye.y;
+        float dz = node.center.z - view.eye.z;
+        float radius = node.halfSize * 1.7320508f;
+        return std::max(std::sqrt(dx * dx + dy * dy + dz * dz) - radius, view.nearPlane);
+    };
+    auto projectedSize = [&](const PointOctreeNode& node) {
+        return node.halfSize * 1.7320508f * view.pixelsPerUnit / distance(node);
+    };
+
+    std::priority_queue<std::pair<float, uint32_t>> queue;
+    queue.push({ projectedSize(m_nodes[0]), 0 });
+    while (!queue.empty())
+    {
+        uint32_t index = queue.top().second;
+        queue.pop();
+        auto& node = m_nodes[index];
+        // without the root there is nothing to draw at all
+        if (index != 0 && selection.pointCount + node.pointCount > pointBudget) continue;
+
+        selection.nodes.push_back(index);
+        selection.pointCount += node.pointCount;
+        // the node's points are already dense enough on screen
+        if (node.spacing * view.pixelsPerUnit / distance(node) < minSpacing) continue;
+        for (uint32_t c = 0; c < node.childCount; ++c)
+        {
+            queue.push({ projectedSize(m_nodes[node.firstChild + c]), node.firstChild + c });
+        }
+    }
+    return selection;
+}
+
+PointCloudView PointCloudView::FromCamera(Camera& camera, const XMMATRIX& modelMatrix, float viewportHeight)
+{
+    PointCloudView view;
+    float scale = 0.f;
+    for (int i = 0; i < 3; ++i)
+    {
+        scale = std::max(scale, XMVectorGetX(XMVector3Length(modelMatrix.r[i])));
+    }
+    XMFLOAT4 eye = camera.GetPosition();
+    XMVECTOR modelEye = XMVector3TransformCoord(XMLoadFloat4(&eye), XMMatrixInverse(nullptr, modelMatrix));
+    XMStoreFloat3(&view.eye, modelEye);
+
+    // _22 of the projection is cot(fov / 2), see Model::SelectLOD
+    XMMATRIX projection = camera.GetProjectionMatrix();
+    view.pixelsPerUnit = XMVectorGetY(projection.r[1]) * viewportHeight * 0.5f;
+    view.nearPlane = scale > 0.f ? camera.GetNear() / scale : camera.GetNear();
+    return view;
+}
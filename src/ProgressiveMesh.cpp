@@ -0,0 +1,282 @@
+#include "ProgressiveMesh.h"
+#include "MeshCache.h"
+#include "TaskPool.h"
+#include "path.h"
+#include <atomic>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+ProgressiveMeshData ProgressiveMesh::Build(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indicies,
+    const std::vector<ModelLOD>& lods, const ModelBounds& bounds)
+{
+    ProgressiveMeshData data;
+    data.bounds = bounds;
+    for (auto it = lods.rbegin(); it != lods.rend(); ++it) data.levels.push_back(*it);
+    data.levels.push_back({ indicies, 0.f });
+
+    const uint32_t UNUSED = ~0u;
+    std::vector<uint32_t> remap(vertices.size(), UNUSED);
+    uint32_t next = 0;
+    for (auto& level: data.levels)
+    {
+        for (auto& index: level.indicies)
+        {
+            if (remap[index] == UNUSED) remap[index] = next++;
+            index = remap[index];
+        }
+        data.vertexCounts.push_back(next);
+    }
+
+    data.vertices.resize(next);
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        if (remap[i] != UNUSED) data.vertices[remap[i]] = vertices[i];
+    }
+    return data;
+}
+
+std::wstring ProgressiveMesh::GetPath(const std::wstring& sourcePath, uint32_t flags)
+{
+    return fs::path(MeshCache::GetCachePath(sourcePath, flags)).replace_extension(L".dxpm").wstring();
+}
+
+bool ProgressiveMesh::Write(const std::wstring& sourcePath, uint32_t flags, const ProgressiveMeshData& data)
+{
+    MeshCache::SourceState state;
+    Header header = {};
+    if (!MeshCache::GetSourceState(sourcePath, state) || !MeshCache::HashSource(sourcePath, header.sourceHash)) return false;
+
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.vertexStride = sizeof(Vertex);
+    header.levelCount = static_cast<uint32_t>(data.levels.size());
+    header.sourceSize = state.size;
+    header.sourceTime = state.time;
+    header.vertexCount = static_cast<uint32_t>(data.vertices.size());
+    header.indexCount = data.levels.empty() ? 0 : static_cast<uint32_t>(data.levels.back().indicies.size());
+    header.bounds = data.bounds;
+
+    std::vector<LevelEntry> entries(data.levels.size());
+    uint64_t offset = sizeof(Header) + entries.size() * sizeof(LevelEntry);
+    uint32_t firstVertex = 0;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        entries[i].firstVertex = firstVertex;
+        entries[i].vertexCount = data.vertexCounts[i] - firstVertex;
+        entries[i].indexCount = static_cast<uint32_t>(data.levels[i].indicies.size());
+        entries[i].error = data.levels[i].error;
+        entries[i].offset = offset;
+        offset += static_cast<uint64_t>(entries[i].vertexCount) * sizeof(Vertex)
+            + static_cast<uint64_t>(entries[i].indexCount) * sizeof(uint32_t);
+        firstVertex = data.vertexCounts[i];
+    }
+
+    // write next to the file and rename, so readers never see half a file
+    std::error_code error;
+    fs::create_directories(cache_path, error);
+    std::wstring path = GetPath(sourcePath, flags);
+    std::wstring tempPath = path + L"." + std::to_wstring(std::hash<std::thread::id>()(std::this_thread::get_id())) + L".tmp";
+    {
+        std::ofstream out(fs::path(tempPath), std::ios::binary | std::ios::trunc);
+        if (!out) return false;
+        out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+        out.write(reinterpret_cast<const char*>(entries.data()), entries.size() * sizeof(LevelEntry));
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            out.write(reinterpret_cast<const char*>(data.vertices.data() + entries[i].firstVertex),
+                static_cast<std::streamsize>(entries[i].vertexCount) * sizeof(Vertex));
+            out.write(reinterpret_cast<const char*>(data.levels[i].indicies.data()),
+                static_cast<std::streamsize>(entries[i].indexCount) * sizeof(uint32_t));
+        }
+        if (!out)
+        {
+            out.close();
+            fs::remove(tempPath, error);
+            return false;
+        }
+    }
+    fs::rename(tempPath, path, error);
+    if (error)
+    {
+        fs::remove(tempPath, error);
+        return false;
+    }
+    return true;
+}
+
+bool ProgressiveMeshReader::Open(const std::wstring& sourcePath, uint32_t flags)
+{
+    using namespace ProgressiveMesh;
+
+    m_file.close();
+    m_levels.clear();
+    m_nextLevel = 0;
+
+    std::wstring path = GetPath(sourcePath, flags);
+    std::error_code error;
+    uint64_t fileSize = fs::file_size(path, error);
+    if (error || fileSize < sizeof(Header)) return false;
+
+    m_file.open(fs::path(path), std::ios::binary);
+    if (!m_file.read(reinterpret_cast<char*>(&m_header), sizeof(Header))) return false;
+    if (m_header.magic != MAGIC || m_header.version != VERSION || m_header.vertexStride != sizeof(Vertex)
+        || m_header.levelCount == 0 || m_header.levelCount > (fileSize - sizeof(Header)) / sizeof(LevelEntry))
+    {
+        return false;
+    }
+
+    m_levels.resize(m_header.levelCount);
+    if (!m_file.read(reinterpret_cast<char*>(m_levels.data()), m_levels.size() * sizeof(LevelEntry))) return false;
+
+    // levels must append to each other and tile the rest of the file
+    uint64_t offset = sizeof(Header) + m_levels.size() * sizeof(LevelEntry);
+    uint64_t vertexCount = 0;
+    for (auto& level: m_levels)
+    {
+        if (level.firstVertex != vertexCount || level.offset != offset) return false;
+        vertexCount += level.vertexCount;
+        offset += static_cast<uint64_t>(level.vertexCount) * sizeof(Vertex)
+            + static_cast<uint64_t>(level.indexCount) * sizeof(uint32_t);
+    }
+    if (vertexCount != m_header.vertexCount || offset != fileSize
+        || m_levels.back().indexCount != m_header.indexCount)
+    {
+        return false;
+    }
+
+    return MeshCache::IsSourceUnchanged(sourcePath, m_header.sourceSize, m_header.sourceTime, m_header.sourceHash);
+}
+
+const ProgressiveMesh::Header& ProgressiveMeshReader::GetHeader() const
+{
+    return m_header;
+}
+
+bool ProgressiveMeshReader::IsComplete() const
+{
+    return m_nextLevel >= m_levels.size();
+}
+
+bool ProgressiveMeshReader::ReadNextLevel(ProgressiveLevel& level)
+{
+    if (IsComplete() || !m_file) return false;
+    auto& entry = m_levels[m_nextLevel];
+
+    level.level = m_nextLevel;
+    level.firstVertex = entry.firstVertex;
+    level.error = entry.error;
+    level.vertices.resize(entry.vertexCount);
+    level.indicies.resize(entry.indexCount);
+    m_file.seekg(static_cast<std::streamoff>(entry.offset));
+    m_file.read(reinterpret_cast<char*>(level.vertices.data()), static_cast<std::streamsize>(entry.vertexCount) * sizeof(Vertex));
+    m_file.read(reinterpret_cast<char*>(level.indicies.data()), static_cast<std::streamsize>(entry.indexCount) * sizeof(uint32_t));
+    if (!m_file) return false;
+
+    uint32_t vertexCount = entry.firstVertex + entry.vertexCount;
+    for (auto index: level.indicies)
+    {
+        if (index >= vertexCount) return false;
+    }
+    m_nextLevel++;
+    return true;
+}
+
+struct ProgressiveMeshStream::State
+{
+    std::wstring sourcePath;
+    uint32_t flags = 0;
+    ProgressiveMeshReader reader;
+
+    std::mutex mutex;
+    std::deque<ProgressiveLevel> levels;
+    std::atomic<bool> reading{ true };
+    std::atomic<bool> failed{ false };
+    std::atomic<bool> cancelRequested{ false };
+    uint32_t polled = 0;
+};
+
+ProgressiveMeshStream ProgressiveMeshStream::Open(const std::wstring& sourcePath, uint32_t flags)
+{
+    auto state = std::make_shared<State>();
+    state->sourcePath = sourcePath;
+    state->flags = flags;
+    if (!state->reader.Open(sourcePath, flags)) return ProgressiveMeshStream();
+
+    TaskPool::GetInstance()->Submit([state]() {
+        while (!state->reader.IsComplete() && !state->cancelRequested)
+        {
+            ProgressiveLevel level;
+            if (!state->reader.ReadNextLevel(level))
+            {
+                state->failed = true;
+                break;
+            }
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->levels.emplace_back(std::move(level));
+        }
+        state->reading = false;
+    });
+
+    ProgressiveMeshStream stream;
+    stream.m_state = state;
+    return stream;
+}
+
+bool ProgressiveMeshStream::IsValid() const
+{
+    return m_state != nullptr;
+}
+
+const std::wstring& ProgressiveMeshStream::GetSourcePath() const
+{
+    return m_state->sourcePath;
+}
+
+uint32_t ProgressiveMeshStream::GetCacheFlags() const
+{
+    return m_state->flags;
+}
+
+const ProgressiveMesh::Header& ProgressiveMeshStream::GetHeader() const
+{
+    return m_state->reader.GetHeader();
+}
+
+uint32_t ProgressiveMeshStream::GetLevelsPolled() const
+{
+    return m_state ? m_state->polled : 0;
+}
+
+bool ProgressiveMeshStream::Poll(ProgressiveLevel& level)
+{
+    if (!m_state) return false;
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    if (m_state->levels.empty()) return false;
+    level = std::move(m_state->levels.front());
+    m_state->levels.pop_front();
+    m_state->polled++;
+    return true;
+}
+
+bool ProgressiveMeshStream::IsDone() const
+{
+    if (!m_state) return true;
+    if (m_state->reading) return false;
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->levels.empty();
+}
+
+bool ProgressiveMeshStream::HasFailed() const
+{
+    return m_state && (m_state->failed || m_state->cancelRequested);
+}
+
+void ProgressiveMeshStream::Cancel()
+{
+    if (m_state) m_state->cancelRequested = true;
+}
@@ -0,0 +1,303 @@
+#include "RayQuery.h"
+#include "Camera.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <mutex>
+#include <emmintrin.h>
+
+namespace
+{
+    // rays in structure of arrays, lane i is ray i of the packet
+    struct RayPacket
+    {
+        __m128 origin[3];
+        __m128 direction[3];
+        __m128 inverse[3];
+        __m128 tMin;
+        __m128 tMax;
+        // lanes without a ray or done with an any hit query
+        __m128 active;
+    };
+
+    RayPacket LoadPacket(const BvhRay* rays, size_t count)
+    {
+        alignas(16) float values[11][RayQuery::PACKET_SIZE] = {};
+        alignas(16) uint32_t active[RayQuery::PACKET_SIZE] = {};
+        for (size_t lane = 0; lane < count; ++lane)
+        {
+            const BvhRay& ray = rays[lane];
+            const float* o = &ray.origin.x;
+            const float* d = &ray.direction.x;
+            for (int k = 0; k < 3; ++k)
+            {
+                values[k][lane] = o[k];
+                values[3 + k][lane] = d[k];
+                values[6 + k][lane] = 1.f / d[k];
+            }
+            values[9][lane] = ray.tMin;
+            values[10][lane] = ray.tMax;
+            active[lane] = ~0u;
+        }
+        // missing lanes get an empty interval, no box or triangle passes it
+        for (size_t lane = count; lane < RayQuery::PACKET_SIZE; ++lane)
+        {
+            values[9][lane] = 1.f;
+            values[10][lane] = -1.f;
+        }
+
+        RayPacket packet;
+        for (int k = 0; k < 3; ++k)
+        {
+            packet.origin[k] = _mm_load_ps(values[k]);
+            packet.direction[k] = _mm_load_ps(values[3 + k]);
+            packet.inverse[k] = _mm_load_ps(values[6 + k]);
+        }
+        packet.tMin = _mm_load_ps(values[9]);
+        packet.tMax = _mm_load_ps(values[10]);
+        packet.active = _mm_load_ps(reinterpret_cast<const float*>(active));
+        return packet;
+    }
+
+    inline __m128 Select(__m128 mask, __m128 a, __m128 b)
+    {
+        return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+    }
+
+    inline float HorizontalMin(__m128 v)
+    {
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_min_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    // Lanes whose interval overlaps the box, and the nearest entry of them.
+    inline int IntersectBox(const BvhNode& node, const RayPacket& packet, float& entry)
+    {
+        const float* minP = &node.min.x;
+        const float* maxP = &node.max.x;
+        __m128 tNear = packet.tMin;
+        __m128 tFar = packet.tMax;
+        for (int k = 0; k < 3; ++k)
+        {
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(minP[k]), packet.origin[k]), packet.inverse[k]);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(maxP[k]), packet.origin[k]), packet.inverse[k]);
+            tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+            tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+        }
+        __m128 hit = _mm_and_ps(_mm_cmple_ps(tNear, tFar), packet.active);
+        int mask = _mm_movemask_ps(hit);
+        if (mask) entry = HorizontalMin(Select(hit, tNear, _mm_set1_ps(std::numeric_limits<float>::max())));
+        return mask;
+    }
+
+    // Moller-Trumbore for all lanes, both faces count.
+    inline __m128 IntersectTriangle(const XMFLOAT3* v, const RayPacket& packet, __m128& t, __m128& u, __m128& w)
+    {
+        __m128 e1[3], e2[3], p[3], s[3], q[3];
+        const float* v0 = &v[0].x;
+        const float* v1 = &v[1].x;
+        const float* v2 = &v[2].x;
+        for (int k = 0; k < 3; ++k)
+        {
+            e1[k] = _mm_set1_ps(v1[k] - v0[k]);
+            e2[k] = _mm_set1_ps(v2[k] - v0[k]);
+            s[k] = _mm_sub_ps(packet.origin[k], _mm_set1_ps(v0[k]));
+        }
+        const __m128* d = packet.direction;
+        p[0] = _mm_sub_ps(_mm_mul_ps(d[1], e2[2]), _mm_mul_ps(d[2], e2[1]));
+        p[1] = _mm_sub_ps(_mm_mul_ps(d[2], e2[0]), _mm_mul_ps(d[0], e2[2]));
+        p[2] = _mm_sub_ps(_mm_mul_ps(d[0], e2[1]), _mm_mul_ps(d[1], e2[0]));
+        q[0] = _mm_sub_ps(_mm_mul_ps(s[1], e1[2]), _mm_mul_ps(s[2], e1[1]));
+        q[1] = _mm_sub_ps(_mm_mul_ps(s[2], e1[0]), _mm_mul_ps(s[0], e1[2]));
+        q[2] = _mm_sub_ps(_mm_mul_ps(s[0], e1[1]), _mm_mul_ps(s[1], e1[0]));
+        auto dot = [](const __m128* a, const __m128* b) {
+            return _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[0], b[0]), _mm_mul_ps(a[1], b[1])), _mm_mul_ps(a[2], b[2]));
+        };
+
+        __m128 determinant = dot(e1, p);
+        __m128 inverse = _mm_div_ps(_mm_set1_ps(1.f), determinant);
+        u = _mm_mul_ps(dot(s, p), inverse);
+        w = _mm_mul_ps(dot(d, q), inverse);
+        t = _mm_mul_ps(dot(e2, q), inverse);
+
+        __m128 absDeterminant = _mm_andnot_ps(_mm_set1_ps(-0.f), determinant);
+        __m128 zero = _mm_setzero_ps();
+        __m128 mask = _mm_cmpge_ps(absDeterminant, _mm_set1_ps(1e-20f));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(u, zero));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(w, zero));
+        mask = _mm_and_ps(mask, _mm_cmple_ps(_mm_add_ps(u, w), _mm_set1_ps(1.f)));
+        mask = _mm_and_ps(mask, _mm_cmpge_ps(t, packet.tMin));
+        mask = _mm_and_ps(mask, _mm_cmplt_ps(t, packet.tMax));
+        return _mm_and_ps(mask, packet.active);
+    }
+
+    // Ordered packet traversal. With anyHit, lanes are retired at their first
+    // hit and the packet stops once all of them are.
+    template <bool anyHit>
+    void TraversePacket(const Bvh& bvh, RayPacket& packet, __m128& t, __m128& u, __m128& w, __m128i& triangle,
+        BvhTraversalStatistics& statistics)
+    {
+        auto& nodes = bvh.GetNodes();
+        auto& vertices = bvh.GetTriangleVertices();
+        auto& triangles = bvh.GetTriangles();
+        uint32_t stack[Bvh::MAX_DEPTH * 2];
+        float entries[Bvh::MAX_DEPTH * 2];
+        uint32_t stackSize = 0;
+        if (IntersectBox(nodes[0], packet, entries[0])) stack[stackSize++] = 0;
+
+        while (stackSize > 0)
+        {
+            stackSize--;
+            // behind the hits of every lane
+            if (_mm_movemask_ps(_mm_and_ps(_mm_cmple_ps(_mm_set1_ps(entries[stackSize]), packet.tMax), packet.active)) == 0)
+            {
+                continue;
+            }
+            const BvhNode& node = nodes[stack[stackSize]];
+            statistics.nodesVisited++;
+            if (node.IsLeaf())
+            {
+                for (uint32_t i = node.offset; i < node.offset + node.count; ++i)
+                {
+                    __m128 hitT, hitU, hitW;
+                    statistics.trianglesTested++;
+                    __m128 mask = IntersectTriangle(&vertices[i * 3], packet, hitT, hitU, hitW);
+                    if (_mm_movemask_ps(mask) == 0) continue;
+                    packet.tMax = Select(mask, hitT, packet.tMax);
+                    t = Select(mask, hitT, t);
+                    u = Select(mask, hitU, u);
+                    w = Select(mask, hitW, w);
+                    triangle = _mm_castps_si128(Select(mask, _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(triangles[i]))),
+                        _mm_castsi128_ps(triangle)));
+                    if (anyHit)
+                    {
+                        packet.active = _mm_andnot_ps(mask, packet.active);
+                        if (_mm_movemask_ps(packet.active) == 0) return;
+                    }
+                }
+                continue;
+            }
+
+            // the child nearer to the packet is popped first
+            uint32_t children[2] = { static_cast<uint32_t>(&node - nodes.data()) + 1, node.offset };
+            float entry[2];
+            bool hits[2] = {
+                IntersectBox(nodes[children[0]], packet, entry[0]) != 0,
+                IntersectBox(nodes[children[1]], packet, entry[1]) != 0 };
+            if (hits[0] && hits[1])
+            {
+                int nearer = entry[1] < entry[0] ? 1 : 0;
+                stack[stackSize] = children[1 - nearer];
+                entries[stackSize++] = entry[1 - nearer];
+                stack[stackSize] = children[nearer];
+                entries[stackSize++] = entry[nearer];
+            }
+            else if (hits[0] || hits[1])
+            {
+                int c = hits[0] ? 0 : 1;
+                stack[stackSize] = children[c];
+                entries[stackSize++] = entry[c];
+            }
+        }
+    }
+
+    // Packets of [begin, end) on the task pool, store(first ray, ray count,
+    // results) writes a packet's results.
+    template <bool anyHit, typename Store>
+    void TraverseBatch(const Bvh& bvh, const BvhRay* rays, size_t count, BvhTraversalStatistics* statistics,
+        const Store& store)
+    {
+        if (count == 0) return;
+        if (bvh.GetNodes().empty())
+        {
+            for (size_t first = 0; first < count; first += RayQuery::PACKET_SIZE)
+            {
+                size_t lanes = std::min<size_t>(RayQuery::PACKET_SIZE, count - first);
+                __m128 t = _mm_set1_ps(std::numeric_limits<float>::max());
+                __m128i triangle = _mm_set1_epi32(-1);
+                store(first, lanes, t, _mm_setzero_ps(), _mm_setzero_ps(), triangle);
+            }
+            return;
+        }
+
+        std::mutex statisticsMutex;
+        size_t packetCount = (count + RayQuery::PACKET_SIZE - 1) / RayQuery::PACKET_SIZE;
+        TaskPool::GetInstance()->ParallelFor(packetCount, RayQuery::BATCH_GRAIN, [&](size_t begin, size_t end) {
+            BvhTraversalStatistics local;
+            for (size_t p = begin; p < end; ++p)
+            {
+                size_t first = p * RayQuery::PACKET_SIZE;
+                size_t lanes = std::min<size_t>(RayQuery::PACKET_SIZE, count - first);
+                RayPacket packet = LoadPacket(rays + first, lanes);
+                __m128 t = _mm_set1_ps(std::numeric_limits<float>::max());
+                __m128 u = _mm_setzero_ps();
+                __m128 w = _mm_setzero_ps();
+                __m128i triangle = _mm_set1_epi32(-1);
+                TraversePacket<anyHit>(bvh, packet, t, u, w, triangle, local);
+                store(first, lanes, t, u, w, triangle);
+            }
+            if (statistics)
+            {
+                std::lock_guard<std::mutex> lock(statisticsMutex);
+                statistics->nodesVisited += local.nodesVisited;
+                statistics->trianglesTested += local.trianglesTested;
+            }
+        });
+        if (statistics) statistics->rays += count;
+    }
+}
+
+RayQuery::RayQuery(const Bvh& bvh)
+    : m_bvh(bvh)
+{
+}
+
+void RayQuery::IntersectClosest(const BvhRay* rays, BvhHit* hits, size_t count, BvhTraversalStatistics* statistics) const
+{
+    TraverseBatch<false>(m_bvh, rays, count, statistics,
+        [hits](size_t first, size_t lanes, __m128 t, __m128 u, __m128 w, __m128i triangle) {
+            alignas(16) float ts[PACKET_SIZE], us[PACKET_SIZE], ws[PACKET_SIZE];
+            alignas(16) uint32_t triangles[PACKET_SIZE];
+            _mm_store_ps(ts, t);
+            _mm_store_ps(us, u);
+            _mm_store_ps(ws, w);
+            _mm_store_si128(reinterpret_cast<__m128i*>(triangles), triangle);
+            for (size_t lane = 0; lane < lanes; ++lane)
+            {
+                BvhHit& hit = hits[first + lane];
+                hit = BvhHit();
+                if (triangles[lane] == ~0u) continue;
+                hit.t = ts[lane];
+                hit.triangle = triangles[lane];
+                hit.u = us[lane];
+                hit.v = ws[lane];
+            }
+        });
+}
+
+void RayQuery::IntersectAny(const BvhRay* rays, uint8_t* occluded, size_t count, BvhTraversalStatistics* statistics) const
+{
+    TraverseBatch<true>(m_bvh, rays, count, statistics,
+        [occluded](size_t first, size_t lanes, __m128, __m128, __m128, __m128i triangle) {
+            alignas(16) uint32_t triangles[PACKET_SIZE];
+            _mm_store_si128(reinterpret_cast<__m128i*>(triangles), triangle);
+            for (size_t lane = 0; lane < lanes; ++lane) occluded[first + lane] = triangles[lane] != ~0u ? 1 : 0;
+        });
+}
+
+BvhRay RayQuery::ScreenRay(Camera& camera, const XMMATRIX& modelMatrix, float x, float y,
+    float viewportWidth, float viewportHeight)
+{
+    float ndcX = (x + 0.5f) / viewportWidth * 2.f - 1.f;
+    float ndcY = 1.f - (y + 0.5f) / viewportHeight * 2.f;
+    XMMATRIX inverse = XMMatrixInverse(nullptr, modelMatrix * camera.GetViewProjectionMatrix());
+    XMVECTOR nearPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 0.f, 1.f), inverse);
+    XMVECTOR farPoint = XMVector3TransformCoord(XMVectorSet(ndcX, ndcY, 1.f, 1.f), inverse);
+
+    BvhRay ray;
+    XMStoreFloat3(&ray.origin, nearPoint);
+    XMStoreFloat3(&ray.direction, XMVectorSubtract(farPoint, nearPoint));
+    ray.tMin = 0.f;
+    ray.tMax = 1.f;
+    return ray;
+}
\ No newline at end of file
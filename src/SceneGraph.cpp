@@ -0,0 +1,182 @@
+#include "SceneGraph.h"
+#include "TaskPool.h"
+#include <algorithm>
+#include <atomic>
+#include <xmmintrin.h>
+
+namespace
+{
+    // world = scale * rotation * translation * parent, rows as in DirectXMath
+    inline void ComputeWorldMatrix(const XMFLOAT3& t, const XMFLOAT4& q, const XMFLOAT3& s,
+        const XMFLOAT4X4* parent, XMFLOAT4X4& world)
+    {
+        float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+        float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+        float xw = q.x * q.w, yw = q.y * q.w, zw = q.z * q.w;
+        __m128 local[4] = {
+            _mm_setr_ps(s.x * (1.f - 2.f * (yy + zz)), s.x * 2.f * (xy + zw), s.x * 2.f * (xz - yw), 0.f),
+            _mm_setr_ps(s.y * 2.f * (xy - zw), s.y * (1.f - 2.f * (xx + zz)), s.y * 2.f * (yz + xw), 0.f),
+            _mm_setr_ps(s.z * 2.f * (xz + yw), s.z * 2.f * (yz - xw), s.z * (1.f - 2.f * (xx + yy)), 0.f),
+            _mm_setr_ps(t.x, t.y, t.z, 1.f) };
+        if (!parent)
+        {
+            for (int r = 0; r < 4; ++r) _mm_storeu_ps(world.m[r], local[r]);
+            return;
+        }
+
+        __m128 p[4] = { _mm_loadu_ps(parent->m[0]), _mm_loadu_ps(parent->m[1]), _mm_loadu_ps(parent->m[2]), _mm_loadu_ps(parent->m[3]) };
+        for (int r = 0; r < 4; ++r)
+        {
+            __m128 row = local[r];
+            __m128 result = _mm_add_ps(
+                _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(0, 0, 0, 0)), p[0]),
+                    _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(1, 1, 1, 1)), p[1])),
+                _mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(2, 2, 2, 2)), p[2]),
+                    _mm_mul_ps(_mm_shuffle_ps(row, row, _MM_SHUFFLE(3, 3, 3, 3)), p[3])));
+            _mm_storeu_ps(world.m[r], result);
+        }
+    }
+}
+
+uint32_t SceneGraph::AddNode(uint32_t parent, const XMFLOAT3& translation, const XMFLOAT4& rotation, const XMFLOAT3& scale)
+{
+    if (parent != INVALID_NODE && parent >= m_parents.size()) return INVALID_NODE;
+    uint32_t node = static_cast<uint32_t>(m_parents.size());
+    m_parents.push_back(parent);
+    m_depths.push_back(parent == INVALID_NODE ? 0 : m_depths[parent] + 1);
+    m_translations.push_back(translation);
+    m_rotations.push_back(rotation);
+    m_scales.push_back(scale);
+    m_worldMatrices.emplace_back();
+    m_dirty.push_back(0);
+    m_updateStamps.push_back(0);
+    m_levelsValid = false;
+    MarkDirty(node);
+    return node;
+}
+
+void SceneGraph::Clear()
+{
+    *this = SceneGraph();
+}
+
+void SceneGraph::MarkDirty(uint32_t node)
+{
+    if (m_dirty[node]) return;
+    m_dirty[node] = 1;
+    m_dirtyNodes.push_back(node);
+}
+
+void SceneGraph::SetTranslation(uint32_t node, const XMFLOAT3& translation)
+{
+    m_translations[node] = translation;
+    MarkDirty(node);
+}
+
+void SceneGraph::SetRotation(uint32_t node, const XMFLOAT4& rotation)
+{
+    m_rotations[node] = rotation;
+    MarkDirty(node);
+}
+
+void SceneGraph::SetScale(uint32_t node, const XMFLOAT3& scale)
+{
+    m_scales[node] = scale;
+    MarkDirty(node);
+}
+
+void SceneGraph::SetLocalTransform(uint32_t node, const XMFLOAT3& translation, const XMFLOAT4& rotation, const XMFLOAT3& scale)
+{
+    m_translations[node] = translation;
+    m_rotations[node] = rotation;
+    m_scales[node] = scale;
+    MarkDirty(node);
+}
+
+void SceneGraph::BuildLevels()
+{
+    m_levels.clear();
+    for (uint32_t node = 0; node < m_parents.size(); ++node)
+    {
+        if (m_depths[node] >= m_levels.size()) m_levels.resize(m_depths[node] + 1);
+        m_levels[m_depths[node]].push_back(node);
+    }
+    m_levelsValid = true;
+}
+
+uint32_t SceneGraph::Update()
+{
+    if (m_dirtyNodes.empty() && !m_allDirty) return 0;
+    if (!m_levelsValid) BuildLevels();
+
+    // levels above the shallowest marked node keep their matrices
+    uint32_t firstLevel = 0;
+    if (!m_allDirty)
+    {
+        firstLevel = m_depths[m_dirtyNodes[0]];
+        for (auto node: m_dirtyNodes) firstLevel = std::min(firstLevel, m_depths[node]);
+    }
+
+    // a level only reads the stamps and matrices of the one before
+    uint32_t stamp = ++m_updateStamp;
+    std::atomic<uint32_t> updated{ 0 };
+    for (size_t depth = firstLevel; depth < m_levels.size(); ++depth)
+    {
+        auto& level = m_levels[depth];
+        TaskPool::GetInstance()->ParallelFor(level.size(), UPDATE_GRAIN, [&](size_t begin, size_t end) {
+            uint32_t count = 0;
+            for (size_t i = begin; i < end; ++i)
+            {
+                uint32_t node = level[i];
+                uint32_t parent = m_parents[node];
+                if (!m_allDirty && !m_dirty[node] && (parent == INVALID_NODE || m_updateStamps[parent] != stamp)) continue;
+                m_updateStamps[node] = stamp;
+                ComputeWorldMatrix(m_translations[node], m_rotations[node], m_scales[node],
+                    parent == INVALID_NODE ? nullptr : &m_worldMatrices[parent], m_worldMatrices[node]);
+                count++;
+            }
+            updated += count;
+        });
+    }
+
+    for (auto node: m_dirtyNodes) m_dirty[node] = 0;
+    m_dirtyNodes.clear();
+    m_allDirty = false;
+    return updated;
+}
+
+uint32_t SceneGraph::UpdateAll()
+{
+    m_allDirty = !m_parents.empty();
+    return Update();
+}
+
+uint32_t SceneGraph::GetNodeCount() const
+{
+    return static_cast<uint32_t>(m_parents.size());
+}
+
+uint32_t SceneGraph::GetParent(uint32_t node) const
+{
+    return m_parents[node];
+}
+
+const XMFLOAT3& SceneGraph::GetTranslation(uint32_t node) const
+{
+    return m_translations[node];
+}
+
+const XMFLOAT4& SceneGraph::GetRotation(uint32_t node) const
+{
+    return m_rotations[node];
+}
+
+const XMFLOAT3& SceneGraph::GetScale(uint32_t node) const
+{
+    return m_scales[node];
+}
+
+const XMFLOAT4X4& SceneGraph::GetWorldMatrix(uint32_t node) const
+{
+    return m_worldMatrices[node];
+}
\ No newline at end of file
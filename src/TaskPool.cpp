@@ -0,0 +1,126 @@
+#include "TaskPool.h"
+#include <atomic>
+#include <algorithm>
+
+TaskPool::TaskPool(uint32_t threadCount)
+{
+    if (threadCount == 0)
+    {
+        threadCount = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    }
+    for (uint32_t i = 0; i < threadCount; ++i)
+    {
+        m_workers.emplace_back(&TaskPool::WorkerLoop, this);
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_condition.notify_all();
+    for (auto& worker: m_workers)
+    {
+        worker.join();
+    }
+}
+
+TaskPool* TaskPool::GetInstance()
+{
+    static TaskPool pool;
+    return &pool;
+}
+
+uint32_t TaskPool::GetThreadCount() const
+{
+    return static_cast<uint32_t>(m_workers.size());
+}
+
+void TaskPool::Enqueue(std::function<void()> task)
+{
+    if (m_workers.empty())
+    {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.emplace(std::move(task));
+    }
+    m_condition.notify_one();
+}
+
+void TaskPool::WorkerLoop()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_condition.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+            if (m_stop && m_tasks.empty()) return;
+            task = std::move(m_tasks.front());
+            m_tasks.pop();
+        }
+        task();
+    }
+}
+
+void TaskPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+{
+    if (count == 0) return;
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (count + grain - 1) / grain;
+    if (chunks == 1 || m_workers.empty())
+    {
+        fn(0, count);
+        return;
+    }
+
+    struct Job
+    {
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> done{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+        std::exception_ptr error;
+    };
+    auto job = std::make_shared<Job>();
+
+    // Helpers that start after every chunk was claimed return without
+    // touching fn, so it is fine that they outlive this call.
+    auto work = [job, chunks, count, grain, pfn = &fn]() {
+        size_t chunk;
+        while ((chunk = job->next.fetch_add(1)) < chunks)
+        {
+            size_t begin = chunk * grain;
+            try
+            {
+                (*pfn)(begin, std::min(count, begin + grain));
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                if (!job->error) job->error = std::current_exception();
+            }
+            if (job->done.fetch_add(1) + 1 == chunks)
+            {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->finished.notify_all();
+            }
+        }
+    };
+
+    size_t helpers = std::min(chunks - 1, m_workers.size());
+    for (size_t i = 0; i < helpers; ++i)
+    {
+        Enqueue(work);
+    }
+    work();
+
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&job, chunks]() { return job->done.load() == chunks; });
+    if (job->error) std::rethrow_exception(job->error);
+}
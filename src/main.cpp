@@ -1,6 +1,7 @@
 #include "stdafx.h"
 #include "DXWindow.h"
 #include "Application.h"
+#include "MeshCache.h"
 
 #include <iostream>
 using namespace std;
@@ -12,9 +13,24 @@ int CALLBACK wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, PWSTR lpCmdL
 
     auto app = Application::GetInstance();
 
-    auto model = make_shared<Model>(L"bun_zipper.ply", ModelType::PLY, true);
-    // auto model = make_shared<Model>(L"african_head.obj", ModelType::OBJ);
-    app->SetModel(model);
+    // A model seen before streams coarse to fine from the progressive copy
+    // written on its first run, otherwise it is parsed on the task pool while
+    // the window comes up.
+    auto stream = ProgressiveMeshStream::Open(Model::GetModelFullPath(L"bun_zipper.ply"), MeshCache::FLAG_RECONSTRUCT);
+    if (stream.IsValid())
+    {
+        app->SetModel(stream);
+    }
+    else
+    {
+        auto model = Model::LoadAsync(L"bun_zipper.ply", ModelType::PLY, true, [](Model& model) {
+            model.OptimizeOverdraw();
+            model.OptimizeVertexFetch();
+            model.GenerateLODs();
+        });
+        // auto model = Model::LoadAsync(L"african_head.obj", ModelType::OBJ);
+        app->SetModel(model);
+    }
 
     auto window = make_shared<DXWindow>(L"Learn DX12");
     auto hWnd = app->CreateWindow(hInstance, window.get());